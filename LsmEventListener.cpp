@@ -0,0 +1,125 @@
+/**
+ C++11 - GCC Compiler
+ LsmEventListener.cpp
+ 
+ Defines the flush and compaction events raised by the Lsm Tree during a rolling merge and the listener
+ interface used to receive them. An LsmEventRingBuffer listener is provided which keeps the most recent
+ events in memory so they can be dumped by tracing tools without doing console I/O on the write path.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmEventListener.h"
+
+/**
+ get a readable name for an event type
+ 
+ @param type the event type
+ @return the name of the event type --> for example FLUSH BEGIN
+ 
+ */
+const char* LsmEventListener::eventTypeName(lsm_event_type type)
+{
+    switch (type)
+    {
+        case Event_FlushBegin:
+            return "FLUSH BEGIN";
+        case Event_FlushEnd:
+            return "FLUSH END";
+        case Event_CompactionBegin:
+            return "COMPACTION BEGIN";
+        case Event_CompactionEnd:
+            return "COMPACTION END";
+    }
+    return "UNKNOWN";
+}
+
+/**
+ Constructor to initialize the ring buffer
+ 
+ @param capacity the number of events kept, once full the oldest event is overwritten
+ 
+ */
+LsmEventRingBuffer::LsmEventRingBuffer(size_t capacity)
+: events(capacity > 0 ? capacity : 1), totalEventsCount(0)
+{
+
+}
+
+/**
+ store the event in the ring buffer
+ 
+ @param event the event that was raised
+ 
+ */
+void LsmEventRingBuffer::onEvent(const LsmEvent &event)
+{
+    std::lock_guard<std::mutex> guard(eventsMutex);
+    
+    // overwrite the oldest slot once the buffer has wrapped around
+    events[totalEventsCount % events.size()] = event;
+    totalEventsCount++;
+}
+
+/**
+ get a copy of the events currently held in the ring buffer
+ 
+ @return the events, oldest first
+ 
+ */
+std::vector<LsmEvent> LsmEventRingBuffer::getEvents()
+{
+    std::lock_guard<std::mutex> guard(eventsMutex);
+    
+    long capacity = events.size();
+    
+    // the oldest event is at the start until the buffer wraps, then it is the next slot to be written
+    long count = totalEventsCount < capacity ? totalEventsCount : capacity;
+    long first = totalEventsCount - count;
+    
+    std::vector<LsmEvent> result;
+    result.reserve(count);
+    for (long i = first; i < totalEventsCount; i++)
+    {
+        result.push_back(events[i % capacity]);
+    }
+    return result;
+}
+
+/**
+ get the number of events raised since the ring buffer was created, including those overwritten
+ 
+ @return the total events count
+ 
+ */
+long LsmEventRingBuffer::getTotalEventsCount()
+{
+    std::lock_guard<std::mutex> guard(eventsMutex);
+    return totalEventsCount;
+}
+
+/**
+ write the events currently held in the ring buffer to a stream, one line per event
+ 
+ example output -
+ 
+ 123456 COMPACTION END c1 -> c2 values 640 bytes 302080 micros 5120
+ 
+ @param out the stream to write to
+ 
+ */
+void LsmEventRingBuffer::dump(std::ostream &out)
+{
+    // copy the events first so the stream is not written to while holding the lock
+    std::vector<LsmEvent> snapshot = getEvents();
+    
+    for (size_t i = 0; i < snapshot.size(); i++)
+    {
+        const LsmEvent &event = snapshot[i];
+        out << event.timestampMicros << " " << eventTypeName(event.type)
+            << " c" << event.sourceLevel << " -> c" << event.targetLevel
+            << " values " << event.inputValues
+            << " bytes " << event.outputBytes
+            << " micros " << event.durationMicros << "\n";
+    }
+}
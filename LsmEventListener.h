@@ -0,0 +1,121 @@
+/**
+ C++11 - GCC Compiler
+ LsmEventListener.h
+ 
+ Defines the flush and compaction events raised by the Lsm Tree during a rolling merge and the listener
+ interface used to receive them. An LsmEventRingBuffer listener is provided which keeps the most recent
+ events in memory so they can be dumped by tracing tools without doing console I/O on the write path.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMEVENTLISTENER_H
+#define LSMEVENTLISTENER_H
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// an enum to describe the type of an event raised by the rolling merge process
+// a flush moves values from c0 to c1, a compaction moves values from one disk level to the next
+enum lsm_event_type {Event_FlushBegin, Event_FlushEnd, Event_CompactionBegin,
+    Event_CompactionEnd};
+
+// struct to define the characteristics of an event
+struct LsmEvent {
+    lsm_event_type type;   // the type of the event
+    int sourceLevel;       // the level values are moved from --> for example c0 has a value of 0
+    int targetLevel;       // the level values are moved to --> for example c1 has a value of 1
+    long inputValues;      // the number of values passed from the source level to the target level
+    long outputBytes;      // the bytes written to the target level, only set on end events
+    long durationMicros;   // the time taken by the flush or compaction, only set on end events
+    long timestampMicros;  // the steady clock time, in microseconds, the event was raised at
+};
+
+// struct used by the Lsm Tree to time a flush or compaction between its begin and end events
+struct LsmEventTimer {
+    std::chrono::steady_clock::time_point start;  // when the begin event was raised
+    long bytesWrittenBefore;                       // the bytes written to the target level before the work started
+};
+
+class LsmEventListener {
+public:
+    virtual ~LsmEventListener() {}
+    
+    /**
+     called by the Lsm Tree for each flush and compaction event
+     
+     this is called on the thread doing the rolling merge so it should return quickly
+     
+     @param event the event that was raised
+     
+     */
+    virtual void onEvent(const LsmEvent &event) = 0;
+    
+    /**
+     get a readable name for an event type
+     
+     @param type the event type
+     @return the name of the event type --> for example FLUSH BEGIN
+     
+     */
+    static const char* eventTypeName(lsm_event_type type);
+};
+
+class LsmEventRingBuffer : public LsmEventListener {
+public:
+    
+    /**
+     Constructor to initialize the ring buffer
+     
+     @param capacity the number of events kept, once full the oldest event is overwritten
+     
+     */
+    LsmEventRingBuffer(size_t capacity = 1024);
+    
+    /**
+     store the event in the ring buffer
+     
+     @param event the event that was raised
+     
+     */
+    void onEvent(const LsmEvent &event);
+    
+    /**
+     get a copy of the events currently held in the ring buffer
+     
+     @return the events, oldest first
+     
+     */
+    std::vector<LsmEvent> getEvents();
+    
+    /**
+     get the number of events raised since the ring buffer was created, including those overwritten
+     
+     @return the total events count
+     
+     */
+    long getTotalEventsCount();
+    
+    /**
+     write the events currently held in the ring buffer to a stream, one line per event
+     
+     @param out the stream to write to
+     
+     */
+    void dump(std::ostream &out);
+
+private:
+    
+    // the fixed size storage for the events
+    std::vector<LsmEvent> events;
+    
+    // the total number of events stored, the next event is written at totalEventsCount % capacity
+    long totalEventsCount;
+    
+    // a mutex used to keep writers and readers of the ring buffer from interleaving
+    std::mutex eventsMutex;
+};
+
+#endif // LSMEVENTLISTENER_H
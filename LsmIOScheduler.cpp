@@ -0,0 +1,168 @@
+/**
+ C++11 - GCC Compiler
+ LsmIOScheduler.cpp
+ 
+ Schedules the disk I/O of the Lsm Tree by priority, so the reads made on behalf of lookups are not slowed
+ down by the flushes and compactions of the rolling merges. Each thread declares the class of the I/O it is
+ about to do with an LsmIOScope, and the levels charge the bytes they read and write to the scheduler of the
+ thread. Foreground reads are never held back, flushes and compactions share a budget of bytes per second
+ and the share of compactions shrinks while lookups are in flight, so a large merge does not take the disk
+ from the lookups.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmIOScheduler.h"
+
+#include <thread>
+
+// the scheduler and class of the I/O of each thread, no scheduler until the thread enters a scope
+thread_local LsmIOScheduler *LsmIOScope::currentScheduler = NULL;
+thread_local lsm_io_priority LsmIOScope::currentPriority = IO_Foreground;
+
+/**
+ Constructor to initialize the scheduler
+ 
+ @param backgroundBytesPerSecond the bytes per second flushes and compactions may read and write, 0 for
+        no limit
+ 
+ */
+LsmIOScheduler::LsmIOScheduler(long backgroundBytesPerSecond)
+: backgroundBudget(backgroundBytesPerSecond), foregroundDepth(0)
+{
+    availableBytes = 0;
+    refillTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < IO_PRIORITY_COUNT; i++) stats[i] = LsmIOClassStats();
+}
+
+/**
+ change the bytes per second flushes and compactions may read and write
+ 
+ @param backgroundBytesPerSecond the budget, 0 for no limit
+ 
+ */
+void LsmIOScheduler::setBackgroundBudget(long backgroundBytesPerSecond)
+{
+    backgroundBudget = backgroundBytesPerSecond;
+}
+
+/**
+ charge a read or write to the scheduler of the calling thread, nothing is done when the thread has no
+ scheduler
+ 
+ @param bytes the bytes read or written
+ 
+ */
+void LsmIOScheduler::charge(long bytes)
+{
+    if (LsmIOScope::currentScheduler == NULL) return;
+    (*LsmIOScope::currentScheduler).request(LsmIOScope::currentPriority, bytes);
+}
+
+/**
+ charge a read or write of a priority class to the scheduler, waiting until the budget allows it when the
+ class is a background class
+ 
+ @param priority the class of the I/O
+ @param bytes the bytes read or written
+ 
+ */
+void LsmIOScheduler::request(lsm_io_priority priority, long bytes)
+{
+    std::unique_lock<std::mutex> lock(schedulerMutex);
+    stats[priority].bytes += bytes;
+    stats[priority].requests++;
+    
+    long budget = backgroundBudget;
+    if (priority == IO_Foreground || budget <= 0) return;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        // flushes get the whole budget, since writes wait for them once c0 is full. Compactions get a share
+        // that shrinks as the foreground queue deepens
+        double rate = (double) budget;
+        if (priority == IO_Compaction)
+        {
+            double share = 1.0 / (1 + foregroundDepth);
+            rate *= share > IO_MIN_COMPACTION_SHARE ? share : IO_MIN_COMPACTION_SHARE;
+        }
+        
+        // top up the budget saved up since the last request, no more than IO_BURST_SECONDS of it
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        availableBytes += rate * std::chrono::duration<double>(now - refillTime).count();
+        refillTime = now;
+        if (availableBytes > rate * IO_BURST_SECONDS) availableBytes = rate * IO_BURST_SECONDS;
+        
+        // a request larger than the burst goes through once the budget is full, running the budget into debt
+        if (availableBytes >= bytes || availableBytes >= rate * IO_BURST_SECONDS)
+        {
+            availableBytes -= bytes;
+            break;
+        }
+        
+        // wait for the missing bytes to be saved up, the rate is checked again after the wait since the
+        // foreground queue depth may have changed
+        std::chrono::duration<double> wait((bytes - availableBytes) / rate);
+        lock.unlock();
+        std::this_thread::sleep_for(wait);
+        lock.lock();
+    }
+    
+    stats[priority].waitMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ function used to get a copy of the I/O counted for a priority class
+ 
+ @param priority the class
+ @return the I/O counted for the class
+ 
+ */
+LsmIOClassStats LsmIOScheduler::getStats(lsm_io_priority priority)
+{
+    std::lock_guard<std::mutex> guard(schedulerMutex);
+    return stats[priority];
+}
+
+/**
+ Constructor to enter the scope
+ 
+ @param scheduler the scheduler to charge the I/O of the thread to, NULL to charge nothing
+ @param priority the class of the I/O of the thread
+ 
+ */
+LsmIOScope::LsmIOScope(LsmIOScheduler *scheduler, lsm_io_priority priority)
+{
+    previousScheduler = currentScheduler;
+    previousPriority = currentPriority;
+    
+    currentScheduler = scheduler;
+    currentPriority = priority;
+    
+    // a foreground scope counts toward the foreground queue depth of its scheduler
+    if (scheduler != NULL && priority == IO_Foreground) (*scheduler).foregroundDepth++;
+}
+
+/**
+ Constructor to enter the scope, the I/O is charged to the scheduler of the thread before the scope
+ 
+ @param priority the class of the I/O of the thread
+ 
+ */
+LsmIOScope::LsmIOScope(lsm_io_priority priority)
+{
+    previousScheduler = currentScheduler;
+    previousPriority = currentPriority;
+    
+    currentPriority = priority;
+    if (currentScheduler != NULL && priority == IO_Foreground) (*currentScheduler).foregroundDepth++;
+}
+
+LsmIOScope::~LsmIOScope()
+{
+    if (currentScheduler != NULL && currentPriority == IO_Foreground) (*currentScheduler).foregroundDepth--;
+    
+    currentScheduler = previousScheduler;
+    currentPriority = previousPriority;
+}
@@ -0,0 +1,154 @@
+/**
+ C++11 - GCC Compiler
+ LsmIOScheduler.h
+ 
+ Schedules the disk I/O of the Lsm Tree by priority, so the reads made on behalf of lookups are not slowed
+ down by the flushes and compactions of the rolling merges. Each thread declares the class of the I/O it is
+ about to do with an LsmIOScope, and the levels charge the bytes they read and write to the scheduler of the
+ thread. Foreground reads are never held back, flushes and compactions share a budget of bytes per second
+ and the share of compactions shrinks while lookups are in flight, so a large merge does not take the disk
+ from the lookups.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMIOSCHEDULER_H
+#define LSMIOSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+// an enum to describe the class of the I/O a thread is doing, in order of priority
+// a foreground read is made on behalf of a lookup, a flush moves c0 to c1, a compaction moves values from
+// one disk level to the next
+enum lsm_io_priority {IO_Foreground, IO_Flush, IO_Compaction};
+
+// the number of I/O priority classes
+#define IO_PRIORITY_COUNT 3
+
+// the time, in seconds, of budget the background I/O can save up while idle and then spend at once
+#define IO_BURST_SECONDS 0.05
+
+// the smallest share of the budget compactions are given, however many lookups are in flight
+#define IO_MIN_COMPACTION_SHARE 0.1
+
+// struct to contain the I/O counted by the scheduler for a priority class
+struct LsmIOClassStats {
+    long bytes;         // the bytes read and written
+    long requests;      // the number of reads and writes
+    long waitMicros;    // the time, in microseconds, the reads and writes were held back
+};
+
+class LsmIOScheduler {
+public:
+    
+    /**
+     Constructor to initialize the scheduler
+     
+     @param backgroundBytesPerSecond the bytes per second flushes and compactions may read and write, 0 for
+            no limit
+     
+     */
+    LsmIOScheduler(long backgroundBytesPerSecond);
+    
+    /**
+     change the bytes per second flushes and compactions may read and write
+     
+     @param backgroundBytesPerSecond the budget, 0 for no limit
+     
+     */
+    void setBackgroundBudget(long backgroundBytesPerSecond);
+    
+    /**
+     charge a read or write to the scheduler of the calling thread, nothing is done when the thread has no
+     scheduler. Background I/O waits until the budget allows it
+     
+     @param bytes the bytes read or written
+     
+     */
+    static void charge(long bytes);
+    
+    /**
+     charge a read or write of a priority class to the scheduler, waiting until the budget allows it when
+     the class is a background class
+     
+     @param priority the class of the I/O
+     @param bytes the bytes read or written
+     
+     */
+    void request(lsm_io_priority priority, long bytes);
+    
+    /**
+     function used to get a copy of the I/O counted for a priority class
+     
+     @param priority the class
+     @return the I/O counted for the class
+     
+     */
+    LsmIOClassStats getStats(lsm_io_priority priority);
+    
+    // the number of threads doing foreground I/O right now, the foreground queue depth
+    long getForegroundDepth()const {return foregroundDepth;}
+
+private:
+    
+    friend class LsmIOScope;
+    
+    // the bytes per second flushes and compactions may read and write, 0 for no limit
+    std::atomic<long> backgroundBudget;
+    
+    // the threads inside a foreground LsmIOScope of this scheduler
+    std::atomic<long> foregroundDepth;
+    
+    // the budget saved up, in bytes, and when it was last topped up
+    double availableBytes;
+    std::chrono::steady_clock::time_point refillTime;
+    
+    // the I/O counted for each priority class
+    LsmIOClassStats stats[IO_PRIORITY_COUNT];
+    
+    // a mutex used to protect the budget and the counters
+    std::mutex schedulerMutex;
+};
+
+// declares the class of the I/O the calling thread does while it is in scope, and the scheduler it is charged
+// to. Scopes nest, the previous class and scheduler of the thread are restored when a scope ends
+class LsmIOScope {
+public:
+    
+    /**
+     Constructor to enter the scope
+     
+     @param scheduler the scheduler to charge the I/O of the thread to, NULL to charge nothing
+     @param priority the class of the I/O of the thread
+     
+     */
+    LsmIOScope(LsmIOScheduler *scheduler, lsm_io_priority priority);
+    
+    /**
+     Constructor to enter the scope, the I/O is charged to the scheduler of the thread before the scope
+     
+     @param priority the class of the I/O of the thread
+     
+     */
+    explicit LsmIOScope(lsm_io_priority priority);
+    ~LsmIOScope();
+    
+    LsmIOScope(const LsmIOScope &) = delete;
+    LsmIOScope &operator=(const LsmIOScope &) = delete;
+
+private:
+    
+    friend class LsmIOScheduler;
+    
+    // the scheduler and class of the calling thread
+    static thread_local LsmIOScheduler *currentScheduler;
+    static thread_local lsm_io_priority currentPriority;
+    
+    // the scheduler and class of the thread before the scope
+    LsmIOScheduler *previousScheduler;
+    lsm_io_priority previousPriority;
+};
+
+#endif // LSMIOSCHEDULER_H
@@ -9,16 +9,51 @@
  @version 1.0 4/01/16
  */
 #include "LsmLevelDisk.h"
+#include "LsmIOScheduler.h"
+#include "LsmMergeOperands.h"
+#include "LsmPointTombstones.h"
+#include "LsmRangeTombstones.h"
+#include "LsmPointFilter.h"
+#include "LsmRangeFilter.h"
 
-// use a mutex to protect the read and write funnctionality for each disk level being simultaneously accessed by multiple threads
-// the mutex allows a thread to get a lock on the node objects and the root of each btree
-std::mutex Node_mutex;
+#include <algorithm>
+
+// used to truncate the file of a level when it is compacted
+#include <unistd.h>
+
+// the signature written to the header of each BTree level file, used to verify the file format. The last
+// byte is the version of the format, files written in another format are rejected rather than misread.
+// Version 2 keeps the node slots count in the header and the free slots bitmap after the last node slot
+#define DISK_SIGNATURE 0x4C534D42545232L
 
 using namespace std;
 
 LsmLevelDisk::LsmLevelDisk()
 {
-    
+    // start the I/O counters at 0, no range tombstones are given to the level
+    ioStats = LsmLevelIOStats();
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    valuesCount = 0;
+    
+    // the file has no node slots
+    slotsCount = 0;
+    freeSlotsCount = 0;
+    freeSlotsHint = 0;
+    
+    // the fence pointers, the filters and the zone map are out of date until they are built, and the level
+    // has no point filter until it is given filter bits
+    mutationsCount = 0;
+    fencesMutationsCount = -1;
+    rangeFilter = new LsmRangeFilter();
+    rangeFilterCapacity = 0;
+    rangeFilterAdded = 0;
+    pointFilter = new LsmPointFilter();
+    pointFilterCapacity = 0;
+    pointFilterAdded = 0;
+    filterBitsPerKey = 0;
+    isZoneKnown = false;
 }
 
 /**
@@ -29,6 +64,28 @@ LsmLevelDisk::LsmLevelDisk()
  */
 LsmLevelDisk::LsmLevelDisk(const char *TreeFileName)
 {
+    // start the I/O counters at 0, no range tombstones are given to the level
+    ioStats = LsmLevelIOStats();
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    
+    // the fence pointers, the filters and the zone map are out of date until they are built, and the level
+    // has no point filter until it is given filter bits
+    mutationsCount = 0;
+    fencesMutationsCount = -1;
+    rangeFilter = new LsmRangeFilter();
+    rangeFilterCapacity = 0;
+    rangeFilterAdded = 0;
+    pointFilter = new LsmPointFilter();
+    pointFilterCapacity = 0;
+    pointFilterAdded = 0;
+    filterBitsPerKey = 0;
+    isZoneKnown = false;
+    
+    fileName = TreeFileName;
+    freeSlotsHint = 0;
+    
     // use the file name to confirm the stream is successfully associated with it
     std::ifstream test(TreeFileName, std::ios::in);
     
@@ -50,21 +107,22 @@ LsmLevelDisk::LsmLevelDisk(const char *TreeFileName)
         // std::ios::binary required with MSDOS, but possibly
         // not accepted with other environments.
         
-        // create the starting point of the new BTree by setting the root to NIL
-        // FreeList is set to NIL to declare the list is empty
-        // FreeList is used as a pointer to the first element of the list for the lifetime of the
-        // application.
-        root = FreeList = NIL;
-        long start[2] = {NIL, NIL};
+        // create the starting point of the new BTree by setting the root to NIL, the file has no node slots
+        root = NIL;
+        slotsCount = 0;
+        freeSlotsCount = 0;
+        valuesCount = 0;
+        disk_header header = {DISK_SIGNATURE, NIL, 0, 0};
         
         // write to the file, from start to end, using one extra byte at the end to represent
         // the signature. This is used as verification in future reads of the file, if the signature
         // doesn't match, the file is rejected.
-        file.write((char*)start, 2 * sizeof(long));
+        file.write((char*)&header, sizeof(disk_header));
     }  else
     {
         // this isn't a new file, we open the file on disk and attempt to write new information
-        long start[2];
+        // only the header and the root node are read, the rest of the BTree is read as it is used
+        disk_header header;
         file.open(TreeFileName, std::ios::out | std::ios::in |
                   std::ios::binary); // See above note.
         
@@ -75,18 +133,23 @@ LsmLevelDisk::LsmLevelDisk(const char *TreeFileName)
         // read the signature
         file.read(&ch, 1);
         file.seekg(0L, std::ios::beg);
-        file.read((char *)start, 2 * sizeof(long));
+        file.read((char *)&header, sizeof(disk_header));
         
-        // verify the file format by checking the signature
-        if (ch != sizeof(int))
+        // verify the file format by checking the signature, in the header and at the end of the file, so a
+        // file written in an older format is rejected before its header is used
+        if (!file || header.signature != DISK_SIGNATURE || ch != sizeof(int))
         {
             // alert the file does not contain the signature
             std::cout << "Wrong file format.\n"; exit(1);
         }
         
-        // set the root and FreeList variables to the starting position
-        root = start[0];
-        FreeList = start[1];
+        // set the root and the slots count to the starting position
+        root = header.root;
+        slotsCount = header.slotsCount;
+        valuesCount = header.valuesCount;
+        
+        // read the free slots bitmap written after the last node slot
+        ReadFreeSlots();
         
         // make a call to function ReadNode
         // set the number of values in the node to start at 0
@@ -94,35 +157,35 @@ LsmLevelDisk::LsmLevelDisk(const char *TreeFileName)
         
         // call to read the node
         ReadNode(root, RootNode);
-        print();
     }
 }
 
 LsmLevelDisk::~LsmLevelDisk()
 {
-    // create the long array to contain the root value and the FreeList pointer
-    long start[2];
+    delete rangeFilter;
+    delete pointFilter;
+    
+    // a level created without a file has nothing to write
+    if (!file.is_open()) return;
+    
+    // create the header to contain the signature, the root value, the slots count and the values count
+    disk_header header = {DISK_SIGNATURE, root, slotsCount, valuesCount};
     
     // use seekp to find the beginning of the file for the BTree
     file.seekp(0L, std::ios::beg);
+    file.write((char*)&header, sizeof(disk_header));
     
-    start[0] = root;
-    start[1] = FreeList;
+    // write the free slots bitmap after the last node slot, followed by the signature
+    file.seekp(SlotPosition(slotsCount), std::ios::beg);
+    if (!freeSlots.empty()) file.write((char*)&freeSlots[0], freeSlots.size() * sizeof(unsigned long));
     
-    // If the current file length is an even number, a
-    // signature is added; otherwise it is already there.
-    file.write((char*)start, 2 * sizeof(long));
-    
-    // set the signature
     char ch = sizeof(int);
-    file.seekg(0L, std::ios::end);
-    if ((file.tellg() & 1) == 0)
-    {
-        file.write(&ch, 1);
-    }
+    file.write(&ch, 1);
+    long fileLength = file.tellp();
     
-    // close the file
+    // close the file, cutting off what was written after the signature before the file was compacted
     file.close();
+    if (truncate(fileName.c_str(), fileLength) != 0) std::cout << "Could not truncate " << fileName << ".\n";
 }
 
 /**
@@ -133,6 +196,8 @@ LsmLevelDisk::~LsmLevelDisk()
  */
 void LsmLevelDisk::insert(dtype x)
 {
+    BeginMutation();
+    bool wasEmpty = valuesCount == 0;
     
     // create new instances for the pointer and the value to be inserted
     long pNew;
@@ -140,6 +205,7 @@ void LsmLevelDisk::insert(dtype x)
     
     // do the insert, return the status of the execution
     status_disk code = ins(root, x, xNew, pNew);
+    if (code != Disk_DuplicateKey) valuesCount++;
     
     // the BTree currently does not support duplicates, this is a debug statement to acknowledge
     // and attempt to insert a value already present in the tree
@@ -170,6 +236,33 @@ void LsmLevelDisk::insert(dtype x)
         // write the node to the BTree
         WriteNode(root, RootNode);
     }
+    
+    // add the value to the range and point filters while they are up to date, one value too many puts a
+    // filter out of date, and widen the zone map to the value
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        if (rangeFilterAdded < rangeFilterCapacity)
+        {
+            (*rangeFilter).add(x.value);
+            rangeFilterAdded++;
+        } else {
+            rangeFilterCapacity = 0;
+        }
+        if (pointFilterAdded < pointFilterCapacity)
+        {
+            (*pointFilter).add(x.value);
+            pointFilterAdded++;
+        } else {
+            pointFilterCapacity = 0;
+        }
+        
+        if (wasEmpty) zoneMinValue = zoneMaxValue = x.value;
+        if (x.value < zoneMinValue) zoneMinValue = x.value;
+        if (zoneMaxValue < x.value) zoneMaxValue = x.value;
+        if (wasEmpty) isZoneKnown = true;
+    }
+    
+    EndMutation();
 }
 
 /**
@@ -218,7 +311,19 @@ status_disk LsmLevelDisk::ins(long r, dtype x, dtype &y, long &q)
     i = NodeSearch(x, Node.k, n);
     
     // if the new value to be inserted is already present in the node, return message for duplicate key
-    if (i < n && x.value == Node.k[i].value) return Disk_DuplicateKey;
+    if (i < n && x.value == Node.k[i].value)
+    {
+#ifdef LSM_SLICE_VALUES
+        // slices are equal when their keys are, the newer record replaces the value held, the node is only
+        // written when the value changed
+        if (x.value.valueLength != Node.k[i].value.valueLength || memcmp(x.value.data, Node.k[i].value.data, sizeof(x.value.data)) != 0)
+        {
+            Node.k[i] = x;
+            WriteNode(r, Node);
+        }
+#endif
+        return Disk_DuplicateKey;
+    }
     
     // get the message for an attempt to insert the new value
     code = ins(Node.p[i], x, xNew, pNew);
@@ -247,7 +352,7 @@ status_disk LsmLevelDisk::ins(long r, dtype x, dtype &y, long &q)
     {
         kFinal = xNew;
         pFinal = pNew;
-        
+    
     } else {
         
         kFinal = Node.k[M-2];
@@ -295,20 +400,19 @@ status_disk LsmLevelDisk::ins(long r, dtype x, dtype &y, long &q)
 }
 
 
-// a counter to keep track of how many values are passed to the next level
-long getNValuesDiskCounter = 0;
+// the values of the level copied from in sorted order, collected by getNValues and moved to the next level
+// once the BTree has been walked. One for each thread so Lsm Trees merging in different threads do not
+// share it
+thread_local std::vector<lsm_value_t> getNValuesDiskArray;
 
 /**
- function used to copy values from one disk level to the subsequent level
+ function used to collect the values of a subtree of the BTree in sorted order, for diskLevelCopy to pick
+ the values to copy from
  
- @param previous_level_pointer pointer to the level to be copied from
- @param current_level_pointer pointer to the level to copy to
- @param r the root of the BTree
- @param total_disk_values_count how many values are in the previous level to be copied from
- @param total_to_pass_next_level the total amount to pass between levels
+ @param r the root of the subtree
  
  */
-void LsmLevelDisk::getNValues(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer, long r, long total_disk_values_count, long total_to_pass_next_level)
+void LsmLevelDisk::getNValues(long r)
 {
     // if the root is not empty
     if (r != NIL)
@@ -317,67 +421,134 @@ void LsmLevelDisk::getNValues(LsmLevelDisk* previous_level_pointer, LsmLevelDisk
         int i;
         node_disk Node; ReadNode(r, Node);
         
-        int j;
-        
-        // for each value in the node
+        // walk the subtree in order, each value after the child holding the smaller values
         for (i=0; i < Node.n; i++)
         {
-            // if the counter has not exceeded its limit
-            if (getNValuesDiskCounter <= total_to_pass_next_level) {
-                
-                // increment the counter by 1
-                getNValuesDiskCounter += 1;
-                
-                // create a new dtype to represent the new key value pair
-                dtype x;
-                x.key = getNValuesDiskCounter;
-                x.value = Node.k[i].value;
-                
-                // insert the new value to the current level
-                (*current_level_pointer).insert(x);
-                
-                // delete the value from the previous level
-                (*previous_level_pointer).DelNode(x);
-                
-            } else {
-                // return since the counter has expired
-                return;
-            }
-        }
-        // this function is called recursively in order to get all values from each subsequent node
-        // in the BTree until the counter has exceeded its limit
-        for (j=0; j <= Node.n; j++)
-        {
-            LsmLevelDisk::getNValues(previous_level_pointer, current_level_pointer, Node.p[j], total_disk_values_count, total_to_pass_next_level);
+            LsmLevelDisk::getNValues(Node.p[i]);
+            getNValuesDiskArray.push_back(Node.k[i].value);
         }
+        LsmLevelDisk::getNValues(Node.p[Node.n]);
     }
 }
 
 /**
- function used to copy values from one disk level to the subsequent level
+ function used to copy values from one disk level to the subsequent level, the values copied are the
+ contiguous range of keys picked by chooseMergeRange of the subsequent level
  
  @param previous_level_pointer pointer to the level to be copied from
  @param current_level_pointer pointer to the level to copy to
  @param r the root of the BTree
  @param total_to_pass_next_level the total amount to pass between levels
+ @param levelNumber the level number of the level to be copied from --> for example c1 has a value of 1
  
  */
-void LsmLevelDisk::diskLevelCopy(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer, long r, long total_to_pass_next_level )
+void LsmLevelDisk::diskLevelCopy(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer, long r, long total_to_pass_next_level, int levelNumber)
 {
-    // get the values count for the BTree to copy from
-    long total_disk_values_count = getValuesCount(r);
+    // collect the values of the previous level in order, they are moved once the BTree has been walked since
+    // deleting them from the previous level now could free the nodes being walked
+    LsmLevelDisk::getNValues(r);
+    if (total_to_pass_next_level > (long) getNValuesDiskArray.size()) total_to_pass_next_level = getNValuesDiskArray.size();
+    
+    // the range of keys the copy rewrites the fewest nodes of the current level for
+    long first = (*current_level_pointer).chooseMergeRange(getNValuesDiskArray, total_to_pass_next_level);
+    
+    // the values of the range, in order
+    std::vector<dtype> moved;
+    for (long i = first; i < first + total_to_pass_next_level; i++)
+    {
+        dtype x;
+        x.key = i - first + 1;
+        x.value = getNValuesDiskArray[i];
+        moved.push_back(x);
+    }
+    getNValuesDiskArray.clear();
+    
+    // drop the values deleted by a point tombstone, and delete the older copies of the values deleted within
+    // the range from the current level, so neither level holds a copy of them once the copy is done
+    std::vector<dtype> kept(moved);
+    std::vector<lsm_value_t> deleted;
+    if (pointTombstones != NULL && !moved.empty())
+    {
+        (*pointTombstones).filter(kept, &moved.front().value, &moved.back().value, levelNumber, levelNumber + 1, &deleted);
+    }
+    for (size_t i = 0; i < deleted.size(); i++)
+    {
+        dtype x;
+        x.key = 0;
+        x.value = deleted[i];
+        (*current_level_pointer).DelNode(x);
+    }
     
-    // make a call to getNValues in order to execute the copy from previous level to current level
-    LsmLevelDisk::getNValues(previous_level_pointer, current_level_pointer, r, total_disk_values_count, total_to_pass_next_level);
+    // fold the merge operands into their records, the previous level holds the newest copies of the records
+    // it moves, and the current level those of the other records with operands within the range
+    std::vector<LsmMergeStack> folded;
+    std::vector<lsm_value_t> missing;
+    if (mergeOperands != NULL && !moved.empty())
+    {
+        (*mergeOperands).foldValues(kept, &moved.front().value, &moved.back().value, levelNumber, levelNumber + 1, folded, &missing);
+    }
+    
+    // insert the values kept to the current level, unless they are deleted by a range tombstone
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        if (rangeTombstones == NULL || !(*rangeTombstones).drop(kept[i].value))
+        {
+            (*current_level_pointer).insert(kept[i]);
+        }
+    }
+    
+    // delete each value of the range from the previous level, once the current level holds it. The records
+    // folded are deleted last, the lookups overlapping their deletes are made again as the folded records
+    // replace the copies they read
+    std::vector<dtype> foldedValues;
+    for (size_t i = 0, j = 0; i < moved.size(); i++)
+    {
+        while (j < folded.size() && folded[j].operands.back() < moved[i].value) j++;
+        if (j < folded.size() && folded[j].operands.back() == moved[i].value) foldedValues.push_back(moved[i]);
+        else (*previous_level_pointer).DelNode(moved[i]);
+        
+        // record the value moving between the levels
+        (*current_level_pointer).countMergedKeys(1, 0);
+        (*previous_level_pointer).countMergedKeys(0, 1);
+    }
+    if (!folded.empty())
+    {
+        (*mergeOperands).beginApply();
+        for (size_t i = 0; i < foldedValues.size(); i++) (*previous_level_pointer).DelNode(foldedValues[i]);
+        (*mergeOperands).retireFolded(folded);
+        (*mergeOperands).endApply();
+    }
     
-    // set the counter back to 0 after the call to getNValues for the next time diskLevelCopy is called
-    getNValuesDiskCounter = 0;
+    // fold the merge operands into the copies of the other records in the current level, replacing them
+    std::vector<dtype> older;
+    for (size_t i = 0; i < missing.size(); i++) (*current_level_pointer).getRangeValues(missing[i], missing[i], older);
+    std::vector<LsmMergeStack> foldedOlder;
+    if (!missing.empty())
+    {
+        (*mergeOperands).foldValues(older, &moved.front().value, &moved.back().value, levelNumber + 1, levelNumber + 1, foldedOlder, NULL);
+    }
+    if (!foldedOlder.empty())
+    {
+        (*mergeOperands).beginApply();
+        for (size_t i = 0; i < older.size(); i++) (*current_level_pointer).insert(older[i]);
+        (*mergeOperands).retireFolded(foldedOlder);
+        (*mergeOperands).endApply();
+    }
     
+    // the values moved out may have been the smallest or largest of the previous level
+    (*previous_level_pointer).updateZone();
+    
+    // give the space of the values moved out back to the file system once most of the file is free
+    long freeCount = (*previous_level_pointer).getFreeSlotsCount();
+    if (freeCount >= DISK_COMPACT_MIN_SLOTS && freeCount > (*previous_level_pointer).getSlotsCount() * DISK_COMPACT_FREE_RATIO)
+    {
+        (*previous_level_pointer).compactFile();
+    }
 }
 
 
 // a counter to get the total values count required for the function
-long LsmLevelDisk::disk_total_values_count = 0;
+thread_local long LsmLevelDisk::disk_total_values_count = 0;
 
 /**
  function used to get the values count for the BTree of a disk level
@@ -406,7 +577,7 @@ long LsmLevelDisk::disk_calculateValuesCount(long r)
     
     // return the total once complete
     return disk_total_values_count;
-    
+
 }
 
 /**
@@ -418,6 +589,9 @@ long LsmLevelDisk::disk_calculateValuesCount(long r)
  */
 long LsmLevelDisk::getValuesCount(long r)
 {
+    // the count of the whole BTree is kept in memory, a subtree is counted by reading its nodes
+    if (r == LsmLevelDisk::root) return valuesCount;
+    
     long root = r;
     
     // set the counter to start at 0
@@ -488,10 +662,20 @@ long LsmLevelDisk::NodeSearch(dtype x, const dtype *a, long n)const
  */
 void LsmLevelDisk::DelNode(dtype x)
 {
+    // a value that is not in the level leaves the BTree, and its fence pointers, unchanged
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        if (FenceSearch(x, false) == 0) return;
+    }
+    
+    BeginMutation();
+    
     long root0;
+    status_disk code = del(root, x);
+    if (code != Disk_NotFound) valuesCount--;
     
     // switch statement to handle various cases associated with an attempt to delete
-    switch (del(root, x))
+    switch (code)
     {
             // if the disk for the level cannot be found, break out
         case Disk_NotFound:
@@ -503,6 +687,8 @@ void LsmLevelDisk::DelNode(dtype x)
             if (root != NIL) ReadNode(root, RootNode);
             break;
     }
+    
+    EndMutation();
 }
 
 /**
@@ -704,17 +890,25 @@ status_disk LsmLevelDisk::del(long r, dtype x)
  @param Node the node to find on disk
  
  */
-void LsmLevelDisk::ReadNode(long r, node_disk &Node)
+void LsmLevelDisk::ReadNode(long r, node_disk &Node, bool isLookup)
 {
+    // charge the read to the I/O scheduler before the lock is taken, so a throttled merge does not keep the
+    // lookups of this level waiting
+    if (r != NIL && r != root) LsmIOScheduler::charge(sizeof(node_disk));
+    
     // place a lock on this point in the function
     // only allow one thread at a time to access the read node functionality
     // so that threads don't share access to the root r value and Node value
-    std::lock_guard<std::mutex> guard(Node_mutex);
+    std::lock_guard<std::mutex> guard(nodeMutex);
     
     if (r == NIL) return;
     
     // if the root is valid and not empty, the node is equal to the root node
-    if (r == root && RootNode.n > 0) Node = RootNode; else
+    if (r == root && RootNode.n > 0)
+    {
+        Node = RootNode;
+        ioStats.cacheHits++;
+    } else
     {
         // start at the root node in the file
         file.seekg(r, std::ios::beg);
@@ -722,6 +916,11 @@ void LsmLevelDisk::ReadNode(long r, node_disk &Node)
         // find the node in the file
         // pass the size of a node_disk struct in order to navigate the file
         file.read((char*)&Node, sizeof(node_disk));
+        
+        // count the read against this level
+        ioStats.nodeReads++;
+        ioStats.bytesRead += sizeof(node_disk);
+        if (isLookup) ioStats.lookupReads++;
     }
 }
 
@@ -734,62 +933,268 @@ void LsmLevelDisk::ReadNode(long r, node_disk &Node)
  */
 void LsmLevelDisk::WriteNode(long r, const node_disk &Node)
 {
+    LsmIOScheduler::charge(sizeof(node_disk));
+    
     // place a lock on this point in the function
     // only allow one thread at a time to access the write node functionality
     // so that threads don't share access to the root r value and Node value
-    std::lock_guard<std::mutex> guard(Node_mutex);
+    std::lock_guard<std::mutex> guard(nodeMutex);
     
     // write the node to disk by finding the next position in the file
     // first see if the r value is the root
     if (r == root) RootNode = Node;
     file.seekp(r, std::ios::beg);
     file.write((char*)&Node, sizeof(node_disk));
+    
+    // count the write against this level
+    ioStats.nodeWrites++;
+    ioStats.bytesWritten += sizeof(node_disk);
+}
+
+/**
+ function used to get a copy of the I/O and merge counters for this level
+ 
+ @return the counters for this level
+ 
+ */
+LsmLevelIOStats LsmLevelDisk::getIOStats()
+{
+    std::lock_guard<std::mutex> guard(nodeMutex);
+    return ioStats;
+}
+
+/**
+ function used to record values moved into or out of this level by a rolling merge
+ 
+ @param keysIn the number of values merged into this level
+ @param keysOut the number of values merged out of this level
+ 
+ */
+void LsmLevelDisk::countMergedKeys(long keysIn, long keysOut)
+{
+    std::lock_guard<std::mutex> guard(nodeMutex);
+    ioStats.keysMergedIn += keysIn;
+    ioStats.keysMergedOut += keysOut;
+}
+
+/**
+ function used to give the level the range tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param rangeTombstones the range tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelDisk::setRangeTombstones(LsmRangeTombstones *rangeTombstones)
+{
+    LsmLevelDisk::rangeTombstones = rangeTombstones;
+}
+
+/**
+ function used to give the level the point tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param pointTombstones the point tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelDisk::setPointTombstones(LsmPointTombstones *pointTombstones)
+{
+    LsmLevelDisk::pointTombstones = pointTombstones;
+}
+
+/**
+ function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+ records as the level is rewritten
+ 
+ @param mergeOperands the merge operands, or NULL to keep every value as it is
+ 
+ */
+void LsmLevelDisk::setMergeOperands(LsmMergeOperands *mergeOperands)
+{
+    LsmLevelDisk::mergeOperands = mergeOperands;
 }
 
 /**
  function used to read from the beginning of the BTree, the root
  */
 void LsmLevelDisk::ReadStart()
-{  long start[2];
+{  disk_header header;
     file.seekg(0L, std::ios::beg);
-    file.read((char *)start, 2 * sizeof(long));
-    root = start[0];
-    FreeList = start[1];
+    file.read((char *)&header, sizeof(disk_header));
+    root = header.root;
+    slotsCount = header.slotsCount;
+    valuesCount = header.valuesCount;
+    ReadFreeSlots();
     ReadNode(root, RootNode);
 }
 
+/**
+ function used to read the free slots bitmap written after the last node slot
+ 
+ */
+void LsmLevelDisk::ReadFreeSlots()
+{
+    freeSlots.assign((slotsCount + DISK_BITMAP_WORD_SLOTS - 1) / DISK_BITMAP_WORD_SLOTS, 0);
+    if (!freeSlots.empty())
+    {
+        file.seekg(SlotPosition(slotsCount), std::ios::beg);
+        file.read((char*)&freeSlots[0], freeSlots.size() * sizeof(unsigned long));
+    }
+    
+    freeSlotsCount = 0;
+    for (size_t i = 0; i < freeSlots.size(); i++) freeSlotsCount += __builtin_popcountl(freeSlots[i]);
+    freeSlotsHint = 0;
+}
+
+/**
+ function used to mark a node slot free or in use in the free slots bitmap
+ 
+ @param slot the number of the slot
+ @param isFree true to mark the slot free
+ 
+ */
+void LsmLevelDisk::MarkSlot(long slot, bool isFree)
+{
+    size_t word = slot / DISK_BITMAP_WORD_SLOTS;
+    unsigned long bit = 1UL << (slot % DISK_BITMAP_WORD_SLOTS);
+    
+    if (isFree)
+    {
+        freeSlots[word] |= bit;
+        freeSlotsCount++;
+        if (word < freeSlotsHint) freeSlotsHint = word;
+    } else {
+        freeSlots[word] &= ~bit;
+        freeSlotsCount--;
+    }
+}
+
 long LsmLevelDisk::GetNode()  // Modified (see also the destructor ~LsmLevelDisk)
-{  long r;
-    node_disk Node;
-    if (FreeList == NIL)
-    {  file.seekp(0L, std::ios::end); // Allocate space on disk; if
-        r = file.tellp() & ~1;    // file length is an odd number,
-        WriteNode(r, Node);       // the new node will overwrite
-    }  else                      // signature byte at end of file
-    {  r = FreeList;
-        ReadNode(r, Node);        // To update FreeList:
-        FreeList = Node.p[0];     // Reduce the free list by 1
+{
+    // no slot is free, add DISK_ALLOCATION_SLOTS slots to the end of the file. The slots are given to the
+    // file as their nodes are written, the first is returned and the others are marked free
+    if (freeSlotsCount == 0)
+    {
+        long slot = slotsCount;
+        slotsCount += DISK_ALLOCATION_SLOTS;
+        freeSlots.resize((slotsCount + DISK_BITMAP_WORD_SLOTS - 1) / DISK_BITMAP_WORD_SLOTS, 0);
+        for (long s = slot + 1; s < slotsCount; s++) MarkSlot(s, true);
+        
+        return SlotPosition(slot);
     }
-    return r;
+    
+    // take the lowest free slot
+    while (freeSlots[freeSlotsHint] == 0) freeSlotsHint++;
+    long slot = freeSlotsHint * DISK_BITMAP_WORD_SLOTS + __builtin_ctzl(freeSlots[freeSlotsHint]);
+    MarkSlot(slot, false);
+    
+    return SlotPosition(slot);
 }
 
 
 /**
- function used to pointer for root node
+ function used to free the slot of a node, no I/O is done
  
- @param r the root node
+ @param r the position of the node
  
  */
 void LsmLevelDisk::FreeNode(long r)
+{
+    MarkSlot(PositionSlot(r), true);
+}
+
+/**
+ function used to move a node to the lowest free slot, the slot it was in is freed
+ 
+ @param r the position of the node
+ @return the new position of the node
+ 
+ */
+long LsmLevelDisk::MoveNode(long r)
 {
     node_disk Node;
-    // find the root node
     ReadNode(r, Node);
     
-    // set the root node pointer
-    Node.p[0] = FreeList;
-    FreeList = r;
-    WriteNode(r, Node);
+    long moved = GetNode();
+    WriteNode(moved, Node);
+    FreeNode(r);
+    
+    return moved;
+}
+
+/**
+ function used to compact the file of the level online, the nodes in the slots after the last slot needed
+ to hold every node are moved to the free slots before it and the file is truncated
+ 
+ @return the number of nodes moved
+ 
+ */
+long LsmLevelDisk::compactFile()
+{
+    if (freeSlotsCount == 0) return 0;
+    
+    BeginMutation();
+    
+    // every node is to be in a slot before liveSlots, each node after it is moved to a free slot before it
+    long liveSlots = slotsCount - freeSlotsCount;
+    long movedCount = 0;
+    
+    if (root != NIL && PositionSlot(root) >= liveSlots)
+    {
+        root = MoveNode(root);
+        movedCount++;
+    }
+    
+    if (root != NIL)
+    {
+        // every leaf is at the same depth, find it by following the first pointer of each node
+        int leafDepth = 0;
+        node_disk Node;
+        for (long r = root; ; leafDepth++)
+        {
+            ReadNode(r, Node);
+            if (Node.p[0] == NIL) break;
+            r = Node.p[0];
+        }
+        
+        // visit the interior nodes, moving the children held after liveSlots and rewriting their parent
+        std::vector<std::pair<long, int> > interiorNodes(1, std::make_pair(root, 0));
+        while (!interiorNodes.empty())
+        {
+            long r = interiorNodes.back().first;
+            int depth = interiorNodes.back().second;
+            interiorNodes.pop_back();
+            
+            ReadNode(r, Node);
+            bool isChanged = false;
+            for (long i = 0; i <= Node.n; i++)
+            {
+                if (PositionSlot(Node.p[i]) >= liveSlots)
+                {
+                    Node.p[i] = MoveNode(Node.p[i]);
+                    movedCount++;
+                    isChanged = true;
+                }
+                if (depth + 1 < leafDepth) interiorNodes.push_back(std::make_pair(Node.p[i], depth + 1));
+            }
+            if (isChanged) WriteNode(r, Node);
+        }
+    }
+    
+    // the slots after liveSlots are all free, drop them and give their space back to the file system
+    slotsCount = liveSlots;
+    freeSlots.assign((slotsCount + DISK_BITMAP_WORD_SLOTS - 1) / DISK_BITMAP_WORD_SLOTS, 0);
+    freeSlotsCount = 0;
+    freeSlotsHint = 0;
+    
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        file.flush();
+        if (truncate(fileName.c_str(), SlotPosition(slotsCount)) != 0) std::cout << "Could not truncate " << fileName << ".\n";
+    }
+    
+    EndMutation();
+    
+    return movedCount;
 }
 
 /**
@@ -800,6 +1205,38 @@ void LsmLevelDisk::FreeNode(long r)
  */
 bool LsmLevelDisk::search_value(dtype x)
 {
+    // the fence pointers of a level opened from an existing file are built by its first search, so opening
+    // the level reads only the header and the root node
+    bool isFirstSearch;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        isFirstSearch = fencesMutationsCount == -1;
+    }
+    if (isFirstSearch) buildFences();
+    
+    // the value is outside the zone map of the level, no node is read
+    if (!mayContainRange(x.value, x.value))
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        ioStats.zoneSkips++;
+        return false;
+    }
+    
+    // the point filter does not hold the value, no node is read
+    if (!MayContainValue(x.value))
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        ioStats.filterSkips++;
+        return false;
+    }
+    
+    // use the fence pointers when they are up to date, a single leaf node is read
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        int fence_search_result = FenceSearch(x, true);
+        if (fence_search_result >= 0) return fence_search_result == 1;
+    }
+    
     //std::cout << "Search path:\n";
     long i, j, n;
     long r = root;
@@ -808,7 +1245,7 @@ bool LsmLevelDisk::search_value(dtype x)
     while (r != NIL)
     {
         // find the root node
-        ReadNode(r, Node);
+        ReadNode(r, Node, true);
         
         // get the size of the node
         n = Node.n;
@@ -837,6 +1274,488 @@ bool LsmLevelDisk::search_value(dtype x)
     return false;
 }
 
+/**
+ function used to get the values of the BTree within a range
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmLevelDisk::getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    bool isOutOfDate;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        isOutOfDate = rangeFilterCapacity == 0;
+    }
+    if (isOutOfDate) buildFilters();
+    
+    // the range is outside the zone map of the level, the level has no value in it
+    if (!mayContainRange(low, high))
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        ioStats.zoneSkips++;
+        return;
+    }
+    
+    // the range filter holds no prefix of the range, the level has no value in it
+    bool mayContain;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        mayContain = rangeFilterCapacity == 0 || (*rangeFilter).mayContainRange(low, high);
+    }
+    if (!mayContain)
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        ioStats.rangeSkips++;
+        return;
+    }
+    
+    AddRangeValues(root, low, high, values);
+}
+
+/**
+ function used to add the values of a subtree within a range in order, subtrees outside the range are
+ not read
+ 
+ @param r the root of the subtree
+ @param low the smallest value to add
+ @param high the largest value to add
+ @param values the vector the values are appended to
+ 
+ */
+void LsmLevelDisk::AddRangeValues(long r, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    if (r == NIL) return;
+    
+    node_disk Node;
+    ReadNode(r, Node);
+    
+    for (int i = 0; i < Node.n; i++)
+    {
+        // the child before a value only holds smaller values
+        if (low < Node.k[i].value) AddRangeValues(Node.p[i], low, high, values);
+        if (high < Node.k[i].value) return;
+        if (!(Node.k[i].value < low)) values.push_back(Node.k[i]);
+    }
+    AddRangeValues(Node.p[Node.n], low, high, values);
+}
+
+/**
+ function used to search for a batch of values in the BTree, with the fence pointers up to date a leaf
+ node holding several of the values is read once for all of them
+ 
+ @param values the data values to search for, sorted by value
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ 
+ */
+void LsmLevelDisk::search_values(const std::vector<dtype> &values, std::vector<char> &states)
+{
+    // out of date fence pointers are rebuilt, reading the interior nodes once costs less than walking the
+    // BTree for every value of the batch, and so is an out of date point filter
+    bool isOutOfDate, isFilterOutOfDate;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        isOutOfDate = fencesMutationsCount != mutationsCount;
+        isFilterOutOfDate = filterBitsPerKey > 0 && pointFilterCapacity == 0;
+    }
+    if (isOutOfDate) buildFences();
+    if (isFilterOutOfDate) buildFilters();
+    
+    // the batch is outside the zone map of the level, no node is read
+    if (values.empty() || !mayContainRange(values.front().value, values.back().value))
+    {
+        std::lock_guard<std::mutex> guard(nodeMutex);
+        ioStats.zoneSkips++;
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        if (fencesMutationsCount == mutationsCount)
+        {
+            if (fenceLeaves.empty()) return;
+            
+            // the values are sorted, so the leaves they need are in order and each is read at most once
+            long currentLeaf = NIL;
+            long filterSkips = 0;
+            node_disk Node;
+            for (size_t x = 0; x < values.size(); x++)
+            {
+                if (states[x] != LookupPending || !IsInZone(values[x].value, values[x].value)) continue;
+                
+                // the point filter does not hold the value, no node is read
+                if (pointFilterCapacity != 0 && !(*pointFilter).mayContain(values[x].value))
+                {
+                    filterSkips++;
+                    continue;
+                }
+                
+                long i = std::lower_bound(fenceKeys.begin(), fenceKeys.end(), values[x].value) - fenceKeys.begin();
+                if (i < (long) fenceKeys.size() && fenceKeys[i] == values[x].value)
+                {
+                    states[x] = LookupFound;
+                    continue;
+                }
+                
+                if (fenceLeaves[i] != currentLeaf)
+                {
+                    ReadNode(fenceLeaves[i], Node, true);
+                    currentLeaf = fenceLeaves[i];
+                }
+                
+                long j = NodeSearch(values[x], Node.k, Node.n);
+                if (j < Node.n && values[x].value == Node.k[j].value) states[x] = LookupFound;
+            }
+            
+            std::lock_guard<std::mutex> nodeGuard(nodeMutex);
+            ioStats.filterSkips += filterSkips;
+            return;
+        }
+    }
+    
+    // the BTree is being changed by another thread, each value is searched for on its own
+    for (size_t x = 0; x < values.size(); x++)
+    {
+        if (states[x] == LookupPending && search_value(values[x])) states[x] = LookupFound;
+    }
+}
+
+/**
+ function used to search for a value using the fence pointers, the caller holds the fence mutex
+ 
+ @param x the value to search for
+ @param isLookup true when the read is made on behalf of search_value
+ @return 1 if the value is in the level, 0 if it is not, -1 if the fence pointers are out of date
+ 
+ */
+int LsmLevelDisk::FenceSearch(dtype x, bool isLookup)
+{
+    if (fencesMutationsCount != mutationsCount) return -1;
+    
+    // the BTree is empty
+    if (fenceLeaves.empty()) return 0;
+    
+    // find the first fence key not less than the value, the value is either that key or in the leaf before it
+    long i = std::lower_bound(fenceKeys.begin(), fenceKeys.end(), x.value) - fenceKeys.begin();
+    if (i < (long) fenceKeys.size() && fenceKeys[i] == x.value) return 1;
+    
+    node_disk Node;
+    ReadNode(fenceLeaves[i], Node, isLookup);
+    
+    long n = Node.n;
+    long j = NodeSearch(x, Node.k, n);
+    return j < n && x.value == Node.k[j].value ? 1 : 0;
+}
+
+/**
+ function used to build the fence pointers of the level, the keys of the interior nodes in order and the
+ position of the leaf node between each pair of them, so a search reads a single leaf node
+ 
+ */
+void LsmLevelDisk::buildFences()
+{
+    // lookups wait for the build on the fence mutex, so its reads are foreground reads whoever runs it
+    LsmIOScope ioScope(IO_Foreground);
+    
+    // changes to the BTree wait for the build to complete, as they need the fence mutex to start
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    
+    // the fence pointers are up to date, or a change is in progress and the BTree can not be read
+    if (fencesMutationsCount == mutationsCount || (mutationsCount & 1) == 1) return;
+    
+    std::vector<lsm_value_t> keys;
+    std::vector<long> leaves;
+    if (root != NIL)
+    {
+        // every leaf is at the same depth, find it by following the first pointer of each node
+        int leafDepth = 0;
+        node_disk Node;
+        for (long r = root; ; leafDepth++)
+        {
+            ReadNode(r, Node);
+            if (Node.p[0] == NIL) break;
+            r = Node.p[0];
+        }
+        AddFences(root, 0, leafDepth, keys, leaves);
+    }
+    
+    fenceKeys.swap(keys);
+    fenceLeaves.swap(leaves);
+    fencesMutationsCount = mutationsCount;
+}
+
+/**
+ function used to add the fence pointers of a subtree in order
+ 
+ @param r the root of the subtree
+ @param depth the depth of r in the BTree
+ @param leafDepth the depth of the leaf nodes
+ @param keys the fence keys
+ @param leaves the leaf node positions
+ 
+ */
+void LsmLevelDisk::AddFences(long r, int depth, int leafDepth, std::vector<lsm_value_t> &keys, std::vector<long> &leaves)
+{
+    // the leaf nodes are not read, only their position is needed
+    if (depth == leafDepth)
+    {
+        leaves.push_back(r);
+        return;
+    }
+    
+    node_disk Node;
+    ReadNode(r, Node);
+    
+    // the keys of an interior node separate its children
+    for (int i = 0; i < Node.n; i++)
+    {
+        AddFences(Node.p[i], depth + 1, leafDepth, keys, leaves);
+        keys.push_back(Node.k[i].value);
+    }
+    AddFences(Node.p[Node.n], depth + 1, leafDepth, keys, leaves);
+}
+
+/**
+ function used to build the filters of the level that are out of date, the range filter of the prefixes of
+ every value of the BTree, so a scan of a range the level holds no value near reads no node, and the point
+ filter of every value, so a lookup of a value the level does not hold reads no node
+ 
+ */
+void LsmLevelDisk::buildFilters()
+{
+    // scans and lookups wait for the build, so its reads are foreground reads whoever runs it
+    LsmIOScope ioScope(IO_Foreground);
+    
+    // changes to the BTree wait for the build to complete, as they need the fence mutex to start
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    
+    // the filters are up to date, or a change is in progress and the BTree can not be read
+    bool isRangeOutOfDate = rangeFilterCapacity == 0;
+    bool isPointOutOfDate = filterBitsPerKey > 0 && pointFilterCapacity == 0;
+    if ((!isRangeOutOfDate && !isPointOutOfDate) || (mutationsCount & 1) == 1) return;
+    
+    // a filter up to date is added to again, adding the values it holds leaves it as it is
+    long rangeCapacity = valuesCount * DISK_RANGE_FILTER_GROWTH;
+    if (rangeCapacity < DISK_RANGE_FILTER_MIN_PREFIXES) rangeCapacity = DISK_RANGE_FILTER_MIN_PREFIXES;
+    if (isRangeOutOfDate) (*rangeFilter).reset(rangeCapacity);
+    
+    long pointCapacity = valuesCount * DISK_POINT_FILTER_GROWTH;
+    if (pointCapacity < DISK_POINT_FILTER_MIN_VALUES) pointCapacity = DISK_POINT_FILTER_MIN_VALUES;
+    if (isPointOutOfDate) (*pointFilter).reset(pointCapacity, filterBitsPerKey);
+    
+    AddFilters(root);
+    
+    if (isRangeOutOfDate)
+    {
+        rangeFilterCapacity = rangeCapacity;
+        rangeFilterAdded = valuesCount;
+    }
+    if (isPointOutOfDate)
+    {
+        pointFilterCapacity = pointCapacity;
+        pointFilterAdded = valuesCount;
+    }
+}
+
+/**
+ function used to add every value of a subtree to the range and point filters, the caller holds the fence
+ mutex
+ 
+ @param r the root of the subtree
+ 
+ */
+void LsmLevelDisk::AddFilters(long r)
+{
+    if (r == NIL) return;
+    
+    node_disk Node;
+    ReadNode(r, Node);
+    
+    for (int i = 0; i < Node.n; i++)
+    {
+        AddFilters(Node.p[i]);
+        (*rangeFilter).add(Node.k[i].value);
+        (*pointFilter).add(Node.k[i].value);
+    }
+    AddFilters(Node.p[Node.n]);
+}
+
+/**
+ function used to check the point filter of the level for a value, a point filter out of date is built first
+ 
+ @param value the value to check
+ @return false if the level does not hold the value, true if it may or the level has no point filter
+ 
+ */
+bool LsmLevelDisk::MayContainValue(const lsm_value_t &value)
+{
+    bool isOutOfDate;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        if (filterBitsPerKey <= 0) return true;
+        isOutOfDate = pointFilterCapacity == 0;
+    }
+    if (isOutOfDate) buildFilters();
+    
+    // the build is skipped while another thread changes the BTree, the filter is then still out of date
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    return pointFilterCapacity == 0 || (*pointFilter).mayContain(value);
+}
+
+/**
+ function used to change the point filter bits for each value of the level, the point filter takes the new
+ size the next time it is built. A level given no bits has no point filter
+ 
+ @param filterBitsPerKey the filter bits for each value
+ 
+ */
+void LsmLevelDisk::setFilterBitsPerKey(double filterBitsPerKey)
+{
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    LsmLevelDisk::filterBitsPerKey = filterBitsPerKey;
+    
+    // a level given no bits drops its point filter
+    if (filterBitsPerKey <= 0)
+    {
+        (*pointFilter).reset(0, 0);
+        pointFilterCapacity = 0;
+    }
+}
+
+/**
+ function used to check the zone map of the level, the smallest and largest value of the BTree, for values
+ within a range
+ 
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if the level holds no value within the range, true if it may
+ 
+ */
+bool LsmLevelDisk::mayContainRange(const lsm_value_t &low, const lsm_value_t &high)
+{
+    bool isOutOfDate;
+    {
+        std::lock_guard<std::mutex> guard(fenceMutex);
+        isOutOfDate = !isZoneKnown;
+    }
+    if (isOutOfDate) updateZone();
+    
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    return IsInZone(low, high);
+}
+
+/**
+ function used to check the zone map for values within a range, the caller holds the fence mutex
+ 
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if the level holds no value within the range, true if it may or the zone map is out of date
+ 
+ */
+bool LsmLevelDisk::IsInZone(const lsm_value_t &low, const lsm_value_t &high)const
+{
+    if (!isZoneKnown) return true;
+    return valuesCount > 0 && !(high < zoneMinValue) && !(zoneMaxValue < low);
+}
+
+/**
+ function used to narrow the zone map of the level to the smallest and largest value of the BTree, only the
+ nodes on the first and last path from the root are read
+ 
+ */
+void LsmLevelDisk::updateZone()
+{
+    // changes to the BTree wait for the zone map, as they need the fence mutex to start
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    
+    // a change is in progress and the BTree can not be read, the zone map is left as it is
+    if ((mutationsCount & 1) == 1) return;
+    
+    if (root != NIL)
+    {
+        // the smallest value is the first value of the first leaf, the largest the last value of the last leaf
+        node_disk Node;
+        for (long r = root; r != NIL; r = Node.p[0])
+        {
+            ReadNode(r, Node);
+            zoneMinValue = Node.k[0].value;
+        }
+        for (long r = root; r != NIL; r = Node.p[Node.n])
+        {
+            ReadNode(r, Node);
+            zoneMaxValue = Node.k[Node.n - 1].value;
+        }
+    }
+    isZoneKnown = true;
+}
+
+/**
+ function used to pick the values a partial merge copies into the level, the range of sorted values whose
+ keys span the fewest leaf nodes of the level, so the merge rewrites as few nodes as it can
+ 
+ @param values the values the merge may copy, sorted by value
+ @param count the number of values to copy
+ @return the position in values of the first value to copy
+ 
+ */
+long LsmLevelDisk::chooseMergeRange(const std::vector<lsm_value_t> &values, long count)
+{
+    long lastFirst = (long) values.size() - count;
+    if (count <= 0 || lastFirst <= 0) return 0;
+    
+    buildFences();
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    
+    // the leaf nodes are not known, the smallest values are picked
+    if (fencesMutationsCount != mutationsCount || fenceLeaves.empty()) return 0;
+    
+    // a value belongs in the leaf before the first fence key not less than it, so the leaves a range
+    // rewrites are those between the leaves of its first and last value
+    long best = 0;
+    long bestLeaves = -1;
+    for (long i = 0; i <= lastFirst; i++)
+    {
+        long firstLeaf = std::lower_bound(fenceKeys.begin(), fenceKeys.end(), values[i]) - fenceKeys.begin();
+        long lastLeaf = std::lower_bound(fenceKeys.begin(), fenceKeys.end(), values[i + count - 1]) - fenceKeys.begin();
+        if (bestLeaves < 0 || lastLeaf - firstLeaf < bestLeaves)
+        {
+            best = i;
+            bestLeaves = lastLeaf - firstLeaf;
+        }
+    }
+    return best;
+}
+
+/**
+ function used to get the number of leaf nodes covered by the fence pointers
+ 
+ @return the fence pointers count, 0 when they are out of date
+ 
+ */
+long LsmLevelDisk::getFencesCount()
+{
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    return fencesMutationsCount == mutationsCount ? (long) fenceLeaves.size() : 0;
+}
+
+/**
+ functions used to mark the start and end of a change to the BTree, the fence pointers are out of date
+ from the start of the change
+ */
+void LsmLevelDisk::BeginMutation()
+{
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    mutationsCount++;
+}
+
+void LsmLevelDisk::EndMutation()
+{
+    std::lock_guard<std::mutex> guard(fenceMutex);
+    mutationsCount++;
+}
+
 /**
  function used to find the file size for each BTree on disk
  
@@ -11,6 +11,10 @@
 #ifndef LSMLEVELDISK_H
 #define LSMLEVELDISK_H
 
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include "LsmLevelMemory.h"
 
 // an enum to return the status of a disk operation used in several utility methods of the class
@@ -24,6 +28,67 @@ struct node_disk {
     long p[M];    // an array of 'Pointers' to other nodes (n+1 in use)
 };
 
+// struct to define the header written at the beginning of each BTree file, with the free slots bitmap
+// written after the last node slot it is the only part of the file read when the level is opened
+struct disk_header {
+    long signature;    // used to verify the file is a BTree level of this format
+    long root;         // the position of the root node, NIL for an empty BTree
+    long slotsCount;   // the number of node slots in the file, in use or free
+    long valuesCount;  // the number of values in the BTree
+};
+
+// the number of node slots added to the end of the file at a time when no slot is free
+#define DISK_ALLOCATION_SLOTS 8
+
+// the file of a level is compacted once values have been moved out of it and more than this fraction of
+// its node slots, and at least DISK_COMPACT_MIN_SLOTS of them, are free
+#define DISK_COMPACT_FREE_RATIO 0.5
+#define DISK_COMPACT_MIN_SLOTS 64
+
+// the number of node slots covered by each word of the free slots bitmap
+#define DISK_BITMAP_WORD_SLOTS (long) (sizeof(unsigned long) * 8)
+
+// the range filter of a level is sized for twice the values of the level when it is built, and for no
+// fewer than DISK_RANGE_FILTER_MIN_PREFIXES prefixes. It is built again once more values are inserted
+#define DISK_RANGE_FILTER_GROWTH 2
+#define DISK_RANGE_FILTER_MIN_PREFIXES 1024
+
+// the point filter of a level is sized for twice the values of the level when it is built, and for no
+// fewer than DISK_POINT_FILTER_MIN_VALUES values. It is built again once more values are inserted
+#define DISK_POINT_FILTER_GROWTH 2
+#define DISK_POINT_FILTER_MIN_VALUES 1024
+
+// struct to contain the I/O and merge accounting for a disk level
+struct LsmLevelIOStats {
+    long nodeReads;      // the number of nodes read from the level's file
+    long nodeWrites;     // the number of nodes written to the level's file
+    long bytesRead;      // the bytes read from the level's file
+    long bytesWritten;   // the bytes written to the level's file
+    long cacheHits;      // the number of node reads served from the in memory RootNode instead of the file
+    long lookupReads;    // the number of node reads from the file made on behalf of search_value
+    long keysMergedIn;   // the number of values merged into this level from the level above
+    long keysMergedOut;  // the number of values merged out of this level to the level below
+    long rangeSkips;     // the number of scans the range filters answered without reading the level
+    long zoneSkips;      // the number of lookups and scans the zone maps answered without reading a node
+    long filterSkips;    // the number of lookups the point filters answered without reading a node
+};
+
+// the range tombstones of the Lsm Tree, the levels drop the values they delete when they are rewritten
+class LsmRangeTombstones;
+
+// the point tombstones of the Lsm Tree, the levels drop the values they delete when they are rewritten
+class LsmPointTombstones;
+
+// the merge operands of the Lsm Tree, the levels fold them into their records when they are rewritten
+class LsmMergeOperands;
+struct LsmMergeStack;
+
+// the prefix range filter of a level, checked by scans before the level is read
+class LsmRangeFilter;
+
+// the point filter of a level, checked by lookups before the level is read
+class LsmPointFilter;
+
 class LsmLevelDisk {
 public:
     LsmLevelDisk();
@@ -33,8 +98,8 @@ public:
     
     ~LsmLevelDisk();
     
-    // a counter used when copying the data from level to level
-    static long disk_total_values_count;
+    // a counter used when copying the data from level to level, one for each thread
+    static thread_local long disk_total_values_count;
     
     /**
      insert the value to the BTree on disk
@@ -67,27 +132,26 @@ public:
     static long getFileSize(const std::string &fileName);
     
     /**
-     function used to copy values from one disk level to the subsequent level
+     function used to collect the values of a subtree of the BTree in sorted order, for diskLevelCopy to pick
+     the values to copy from
      
-     @param previous_level_pointer pointer to the level to be copied from
-     @param current_level_pointer pointer to the level to copy to
-     @param r the root of the BTree
-     @param total_disk_values_count how many values are in the previous level to be copied from
-     @param total_to_pass_next_level the total amount to pass between levels
+     @param r the root of the subtree
      
      */
-    void getNValues(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer,long r, long total_disk_nodes_count, long disk_counter_limit);
+    void getNValues(long r);
     
     /**
-     function used to copy values from one disk level to the subsequent level
+     function used to copy values from one disk level to the subsequent level, the values copied are the
+     contiguous range of keys picked by chooseMergeRange of the subsequent level
      
      @param previous_level_pointer pointer to the level to be copied from
      @param current_level_pointer pointer to the level to copy to
      @param r the root of the BTree
      @param total_to_pass_next_level the total amount to pass between levels
+     @param levelNumber the level number of the level to be copied from --> for example c1 has a value of 1
      
      */
-    void diskLevelCopy(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer, long r, long current_level_max_values);
+    void diskLevelCopy(LsmLevelDisk* previous_level_pointer, LsmLevelDisk* current_level_pointer, long r, long current_level_max_values, int levelNumber);
     
     /**
      function used to get the values count for the BTree of a disk level
@@ -99,7 +163,8 @@ public:
     long disk_calculateValuesCount(long r);
     
     /**
-     function used to get the values count of a level
+     function used to get the values count of a level, the count kept in the header is used for the root
+     so no nodes are read
      
      @param r the root of the BTree
      @return the values count
@@ -115,9 +180,159 @@ public:
      */
     bool search_value(dtype x);
     
-    // long values to represent the place of the root value of the BTree
-    long root, FreeList;
+    /**
+     function used to search for a batch of values in the BTree, with the fence pointers up to date a leaf
+     node holding several of the values is read once for all of them
+     
+     @param values the data values to search for, sorted by value
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     
+     */
+    void search_values(const std::vector<dtype> &values, std::vector<char> &states);
+    
+    /**
+     function used to get the values of the BTree within a range
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+    
+    /**
+     function used to build the fence pointers of the level, the keys of the interior nodes in order and the
+     position of the leaf node between each pair of them, so a search reads a single leaf node
+     
+     only the interior nodes are read. Nothing is done when the fence pointers are up to date, or when
+     another thread is changing the BTree, in which case searches walk the BTree until the next build.
+     The fence pointers of a level opened from an existing file are built by its first search
+     
+     */
+    void buildFences();
+    
+    /**
+     function used to get the number of leaf nodes covered by the fence pointers
+     
+     @return the fence pointers count, 0 when they are out of date
+     
+     */
+    long getFencesCount();
+    
+    /**
+     function used to build the filters of the level that are out of date, the range filter of the prefixes
+     of every value of the BTree, so a scan of a range the level holds no value near reads no node, and the
+     point filter of every value, so a lookup of a value the level does not hold reads no node
+     
+     every node is read once for both filters. Nothing is done when the filters are up to date, or when
+     another thread is changing the BTree, in which case scans and lookups walk the BTree until the next
+     build. The filters of a level opened from an existing file are built by its first scan or lookup
+     
+     */
+    void buildFilters();
+    
+    /**
+     function used to change the point filter bits for each value of the level, the point filter takes the
+     new size the next time it is built. A level given no bits has no point filter
+     
+     @param filterBitsPerKey the filter bits for each value
+     
+     */
+    void setFilterBitsPerKey(double filterBitsPerKey);
+    
+    /**
+     function used to check the zone map of the level, the smallest and largest value of the BTree, for
+     values within a range. The zone map of a level opened from an existing file is found by its first check
+     
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if the level holds no value within the range, true if it may
+     
+     */
+    bool mayContainRange(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     function used to narrow the zone map of the level to the smallest and largest value of the BTree, only
+     the nodes on the first and last path from the root are read. Inserts widen the zone map and deletes
+     leave it as it is, so it is narrowed after values are moved out of the level
+     
+     */
+    void updateZone();
+    
+    /**
+     function used to pick the values a partial merge copies into the level, the range of sorted values
+     whose keys span the fewest leaf nodes of the level, so the merge rewrites as few nodes as it can. The
+     smallest values are picked when the fence pointers are out of date
+     
+     @param values the values the merge may copy, sorted by value
+     @param count the number of values to copy
+     @return the position in values of the first value to copy
+     
+     */
+    long chooseMergeRange(const std::vector<lsm_value_t> &values, long count);
+    
+    /**
+     function used to get a copy of the I/O and merge counters for this level
+     
+     @return the counters for this level
+     
+     */
+    LsmLevelIOStats getIOStats();
+    
+    /**
+     function used to record values moved into or out of this level by a rolling merge
+     
+     @param keysIn the number of values merged into this level
+     @param keysOut the number of values merged out of this level
+     
+     */
+    void countMergedKeys(long keysIn, long keysOut);
+    
+    /**
+     function used to compact the file of the level online, the nodes in the slots after the last slot
+     needed to hold every node are moved to the free slots before it and the file is truncated
+     
+     only the interior nodes and the nodes moved are read
+     
+     @return the number of nodes moved
+     
+     */
+    long compactFile();
+    
+    // functions to get the number of node slots in the file of the level and the number of them free
+    long getSlotsCount()const {return slotsCount;}
+    long getFreeSlotsCount()const {return freeSlotsCount;}
+    
+    /**
+     function used to give the level the range tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param rangeTombstones the range tombstones, or NULL to keep every value
+     
+     */
+    void setRangeTombstones(LsmRangeTombstones *rangeTombstones);
+    
+    /**
+     function used to give the level the point tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param pointTombstones the point tombstones, or NULL to keep every value
+     
+     */
+    void setPointTombstones(LsmPointTombstones *pointTombstones);
+    
+    /**
+     function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+     records as the level is rewritten
+     
+     @param mergeOperands the merge operands, or NULL to keep every value as it is
+     
+     */
+    void setMergeOperands(LsmMergeOperands *mergeOperands);
     
+    // long value to represent the place of the root value of the BTree
+    long root;
+
 private:
     
     enum {NIL=-1};
@@ -125,8 +340,68 @@ private:
     // the root node object for the BTree
     node_disk RootNode;
     
-    // represents the file associated with this BTree on disk
+    // the number of values in the BTree, written to the header with the root and the slots count
+    long valuesCount;
+    
+    // represents the file associated with this BTree on disk, and its name
     std::fstream file;
+    std::string fileName;
+    
+    // the free space of the file, a bit for each node slot set while the slot is free, kept in memory and
+    // written after the last node slot when the level is closed. The lowest free slot is taken first, so
+    // the nodes stay toward the front of the file, and the search for it starts at freeSlotsHint
+    std::vector<unsigned long> freeSlots;
+    long slotsCount;
+    long freeSlotsCount;
+    size_t freeSlotsHint;
+    
+    // the I/O and merge counters for this level, protected by the node mutex
+    LsmLevelIOStats ioStats;
+    
+    // the range tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmRangeTombstones *rangeTombstones;
+    
+    // the point tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmPointTombstones *pointTombstones;
+    
+    // the merge operands of the Lsm Tree, NULL when none are given to the level
+    LsmMergeOperands *mergeOperands;
+    
+    // a mutex used to protect the read and write functionality of the level being accessed by multiple threads
+    // the mutex allows a thread to get a lock on the node objects and the root of the BTree
+    std::mutex nodeMutex;
+    
+    // the fence pointers, the values of the interior nodes in order and the position of the leaf node
+    // before, between and after them, so there is one more leaf than there are keys
+    std::vector<lsm_value_t> fenceKeys;
+    std::vector<long> fenceLeaves;
+    
+    // the number of changes started and completed on the BTree, odd while a change is in progress, and the
+    // count the fence pointers were built at. The fence pointers are up to date while the two are equal
+    long mutationsCount;
+    long fencesMutationsCount;
+    
+    // the prefix range filter of the values, added to by each insert once built. It is out of date while
+    // rangeFilterCapacity is 0, until it is built, and once more values than the capacity are added to it
+    LsmRangeFilter *rangeFilter;
+    long rangeFilterCapacity;
+    long rangeFilterAdded;
+    
+    // the point filter of the values, added to by each insert once built, and the filter bits for each
+    // value it is built with. It is out of date while pointFilterCapacity is 0, as the range filter is
+    LsmPointFilter *pointFilter;
+    long pointFilterCapacity;
+    long pointFilterAdded;
+    double filterBitsPerKey;
+    
+    // the zone map of the level, no value of the BTree is outside it. It is out of date until it is found
+    // for a level opened from an existing file
+    lsm_value_t zoneMinValue;
+    lsm_value_t zoneMaxValue;
+    bool isZoneKnown;
+    
+    // a mutex used to protect the fence pointers, the range and point filters, the zone map and the counts
+    std::mutex fenceMutex;
     
     /**
      insert the value to the BTree on disk
@@ -161,6 +436,76 @@ private:
      */
     long NodeSearch(dtype x, const dtype  *a, long n)const;
     
+    /**
+     function used to search for a value using the fence pointers, the caller holds the fence mutex
+     
+     @param x the value to search for
+     @param isLookup true when the read is made on behalf of search_value
+     @return 1 if the value is in the level, 0 if it is not, -1 if the fence pointers are out of date
+     
+     */
+    int FenceSearch(dtype x, bool isLookup);
+    
+    /**
+     function used to add the values of a subtree within a range in order, subtrees outside the range are
+     not read
+     
+     @param r the root of the subtree
+     @param low the smallest value to add
+     @param high the largest value to add
+     @param values the vector the values are appended to
+     
+     */
+    void AddRangeValues(long r, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+    
+    /**
+     function used to add the fence pointers of a subtree in order
+     
+     @param r the root of the subtree
+     @param depth the depth of r in the BTree
+     @param leafDepth the depth of the leaf nodes
+     @param keys the fence keys
+     @param leaves the leaf node positions
+     
+     */
+    void AddFences(long r, int depth, int leafDepth, std::vector<lsm_value_t> &keys, std::vector<long> &leaves);
+    
+    /**
+     function used to add every value of a subtree to the range and point filters, the caller holds the
+     fence mutex
+     
+     @param r the root of the subtree
+     
+     */
+    void AddFilters(long r);
+    
+    /**
+     function used to check the point filter of the level for a value, a point filter out of date is built
+     first
+     
+     @param value the value to check
+     @return false if the level does not hold the value, true if it may or the level has no point filter
+     
+     */
+    bool MayContainValue(const lsm_value_t &value);
+    
+    /**
+     function used to check the zone map for values within a range, the caller holds the fence mutex
+     
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if the level holds no value within the range, true if it may or the zone map is out of date
+     
+     */
+    bool IsInZone(const lsm_value_t &low, const lsm_value_t &high)const;
+    
+    /**
+     functions used to mark the start and end of a change to the BTree, the fence pointers are out of date
+     from the start of the change
+     */
+    void BeginMutation();
+    void EndMutation();
+    
     /**
      function used to delete the node
      
@@ -176,9 +521,10 @@ private:
      
      @param r the root of the BTree
      @param Node the node to find on disk
+     @param isLookup true when the read is made on behalf of search_value
      
      */
-    void ReadNode(long r, node_disk &Node);
+    void ReadNode(long r, node_disk &Node, bool isLookup = false);
     
     /**
      function used to write a node
@@ -195,7 +541,38 @@ private:
     void ReadStart();
     
     /**
-     function used to return the position of a newly created node
+     function used to read the free slots bitmap written after the last node slot
+     
+     */
+    void ReadFreeSlots();
+    
+    /**
+     functions used to convert between the position of a node in the file and the number of its slot
+     */
+    static long SlotPosition(long slot) {return (long) sizeof(disk_header) + slot * (long) sizeof(node_disk);}
+    static long PositionSlot(long r) {return (r - (long) sizeof(disk_header)) / (long) sizeof(node_disk);}
+    
+    /**
+     function used to mark a node slot free or in use in the free slots bitmap
+     
+     @param slot the number of the slot
+     @param isFree true to mark the slot free
+     
+     */
+    void MarkSlot(long slot, bool isFree);
+    
+    /**
+     function used to move a node to the lowest free slot, the slot it was in is freed
+     
+     @param r the position of the node
+     @return the new position of the node
+     
+     */
+    long MoveNode(long r);
+    
+    /**
+     function used to return the position of a newly created node, the lowest free slot, or when no slot is
+     free the first of DISK_ALLOCATION_SLOTS slots added to the end of the file
      
      @return long the node position
      
@@ -203,13 +580,13 @@ private:
     long GetNode();
     
     /**
-     function used to pointer for root node
+     function used to free the slot of a node, no I/O is done
      
-     @param r the root node
+     @param r the position of the node
      
      */
     void FreeNode(long r);
-    
+
 };
 
 #endif
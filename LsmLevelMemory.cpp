@@ -11,6 +11,7 @@
 #include "LsmLevelMemory.h"
 #include "LsmTree.h"
 
+#include <algorithm>
 #include <vector>
 
 /**
@@ -94,7 +95,14 @@ status LsmLevelMemory::ins(node *r, dtype x, dtype &y, node* &q)
     i = NodeSearch(x, r->k, n);
     
     // if the new value to be inserted is already present in the node, return message for duplicate key
-    if (i < n && x.value == r->k[i].value) return DuplicateKey;
+    if (i < n && x.value == r->k[i].value)
+    {
+#ifdef LSM_SLICE_VALUES
+        // slices are equal when their keys are, the newer record replaces the value held
+        r->k[i] = x;
+#endif
+        return DuplicateKey;
+    }
     
     // get the message for an attempt to insert the new value
     code = ins(r->p[i], x, xNew, pNew);
@@ -193,75 +201,37 @@ void LsmLevelMemory::pr(const node *r, int nSpace)const
     }
 }
 
-// a counter to keep track of how many values are passed to the next level
-long getNValuesCounter = 0;
-
-std::vector<long> getNValuesArray;
+// the values of c0 in sorted order, collected by getNValues. One for each thread so Lsm Trees merging in
+// different threads do not share it
+thread_local std::vector<lsm_value_t> getNValuesArray;
 
 /**
- function used to copy values from c0 memory level to the c1 level
+ function used to collect the values of a subtree of the c0 BTree in sorted order, for memoryLevelCopy to
+ pick the values to copy from
  
- @param c pointer to the level to be copied to
- @param c0 pointer to the level to copy from
- @param r the root of the BTree
- @param c0TotalValues the total values in the memory level BTree
- @param copyAllFromC0 boolean to determine if all of c0 should be copied
- @param c0_percentage_to_copy what percentage of c0 should be copied?
+ @param r the root of the subtree
  
  */
-void LsmLevelMemory::getNValues(LsmLevelDisk *c, LsmLevelMemory* c0, const node *r, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const
+void LsmLevelMemory::getNValues(const node *r)const
 {
-    
-    // the limit set to only copy a certain amount from the level
-    long counter_limit;
-    
-    // if all should be copied from c0
-    if (copyAllFromC0)
-    {
-        counter_limit = c0TotalValues;
-        
-    // else only copy a certain percetage, defined as a tunable parameter, from c0
-    } else {
-        counter_limit = (long) c0TotalValues * c0_percentage_to_copy;
-    }
-    
     // if the root is valid
     if (r)
     {
-        // loop through the root node and continue throughout the tree calling this function recursively
+        // walk the subtree in order, each value after the child holding the smaller values
         long i;
         for (i=0; i < r->n; i++)
         {
-            // get more values to copy and delete from the levels until the limit is reached
-            if (getNValuesCounter < counter_limit)
-            {
-                
-                dtype x;
-                x.key = 0;
-                x.value = r->k[i].value;
-                
-                (*c).insert(x);
-
-                (*c0).DelNode(x);
-                
-                // increment the counter before exiting
-                getNValuesCounter += 1;
-                
-            }
-        }
-        // run this function recursively until the total required has been reached
-        for (i=0; i <= r->n; i++)
-        {
-            getNValues(c, c0, r->p[i], c0TotalValues, copyAllFromC0, c0_percentage_to_copy);
+            getNValues(r->p[i]);
+            getNValuesArray.push_back(r->k[i].value);
         }
+        getNValues(r->p[r->n]);
     }
 }
 
-
-long getNValuesCounterVector = 0;
-std::vector<long> getNValuesArrayVector;
 /**
- function used to copy the vector of c0 to c1 on disk
+ function used to copy values from c0 memory level to the c1 level, the values copied are removed from the
+ vector and the values left stay in c0. When only a percentage of c0 is copied the values copied are a
+ contiguous range of keys, the range picked by the level copied to
  
  @param c0VectorPtr pointer to the copy of the memory level vector
  @param c a pointer to the c1 level BTree
@@ -270,7 +240,7 @@ std::vector<long> getNValuesArrayVector;
  @param c0_percentage_to_copy if not all of c0 should be copied, what percentage should be copied?
  
  */
-void LsmLevelMemory::getNValuesVector(std::vector<long>* c0VectorPtr, LsmLevelDisk *c, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const
+void LsmLevelMemory::getNValuesVector(std::vector<lsm_value_t>* c0VectorPtr, LsmLevelDisk *c, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const
 {
     
     // the counter to monitor the amount to copy from c0 vector to c1 BTree
@@ -284,31 +254,37 @@ void LsmLevelMemory::getNValuesVector(std::vector<long>* c0VectorPtr, LsmLevelDi
         counter_limit = (long) c0TotalValues * c0_percentage_to_copy;
     }
     
-    // for each value of the vector at c0
+    // the values are copied in sorted order, so the inserts to c1 walk its leaf nodes once
+    std::sort((*c0VectorPtr).begin(), (*c0VectorPtr).end());
+    long first = (*c).chooseMergeRange(*c0VectorPtr, counter_limit);
+    
+    // for each value of the range picked
     // insert the value to c1
-    // stop when the counter limit has been reached
     long i;
-    for (i=0; i < counter_limit; i++)
+    for (i=first; i < first + counter_limit; i++)
     {
         dtype x;
-        x.key = getNValuesCounterVector;
-        x.value = (*c0VectorPtr).at(i);
+        x.key = i - first;
+        x.value = (*c0VectorPtr)[i];
         
         // insert to c1
         (*c).insert(x);
         
-        getNValuesCounterVector += 1;
-        
-        // c0 vector will be cleared, no need to delete from it here
+        // record the value moving into the disk level
+        (*c).countMergedKeys(1, 0);
     }
+    
+    // the values copied leave c0, the rest are kept
+    (*c0VectorPtr).erase((*c0VectorPtr).begin() + first, (*c0VectorPtr).begin() + first + counter_limit);
 }
 
 
 /**
- function used to copy the BTree of c0 to c1 on disk
+ function used to copy the BTree of c0 to c1 on disk. When only a percentage of c0 is copied the values
+ copied are a contiguous range of keys, the range picked by the level copied to
  
- @param c0VectorPtr pointer to the copy of the memory level vector
  @param c a pointer to the c1 level BTree
+ @param c0 pointer to the level to copy from
  @param copyAllFromC0 should all of c0 be copied?
  @param c0_percentage_to_copy if not all of c0 should be copied, what percentage should be copied?
  
@@ -318,26 +294,57 @@ void LsmLevelMemory::memoryLevelCopy(LsmLevelDisk *c, LsmLevelMemory *c0, bool c
     node *r = root;
     long c0TotalValues = (*c0).getValuesCount();
     
-    // all getNValues to make the copy
-    getNValues(c, c0, r, c0TotalValues, copyAllFromC0, c0_percentage_to_copy);
+    // the limit set to only copy a certain amount from the level
+    long counter_limit;
+    
+    // if all should be copied from c0
+    if (copyAllFromC0)
+    {
+        counter_limit = c0TotalValues;
+        
+    // else only copy a certain percetage, defined as a tunable parameter, from c0
+    } else {
+        counter_limit = (long) c0TotalValues * c0_percentage_to_copy;
+    }
+    
+    // collect the values of c0 in order, they are moved once the BTree has been walked since deleting them
+    // from c0 now could free the nodes being walked
+    getNValues(r);
+    if (counter_limit > (long) getNValuesArray.size()) counter_limit = getNValuesArray.size();
+    
+    // the range of keys the partial copy rewrites the fewest nodes of c1 for
+    long first = (*c).chooseMergeRange(getNValuesArray, counter_limit);
+    
+    // move each value of the range from c0 to the disk level
+    for (long i = first; i < first + counter_limit; i++)
+    {
+        dtype x;
+        x.key = 0;
+        x.value = getNValuesArray[i];
+        
+        (*c).insert(x);
+        
+        (*c0).DelNode(x);
+        
+        // record the value moving into the disk level
+        (*c).countMergedKeys(1, 0);
+    }
     
     // clear the array to make way for the next call to memoryLevelCopy from LsmTree
     getNValuesArray.clear();
-    
-    // reset the counter for getNValues back to 0 for the next call to memoryLevelCOpy from LsmTree
-    getNValuesCounter = 0;
 }
 
 /**
  function used to copy the vector of c0 to c1 on disk
  
- @param c0VectorPtr pointer to the copy of the memory level vector
+ @param c0VectorPtr pointer to the copy of the memory level vector, the values left in it once the copy is
+        done are the values not copied
  @param c a pointer to the c1 level BTree
  @param copyAllFromC0 should all of c0 be copied?
  @param c0_percentage_to_copy if not all of c0 should be copied, what percentage should be copied?
  
  */
-void LsmLevelMemory::memoryLevelCopyVector(std::vector<long>* c0VectorPtr, LsmLevelDisk *c, bool copyAllFromC0, double c0_percentage_to_copy)
+void LsmLevelMemory::memoryLevelCopyVector(std::vector<lsm_value_t>* c0VectorPtr, LsmLevelDisk *c, bool copyAllFromC0, double c0_percentage_to_copy)
 {
     
     // get the total values to be copied to c1 from the memory level vector
@@ -345,13 +352,6 @@ void LsmLevelMemory::memoryLevelCopyVector(std::vector<long>* c0VectorPtr, LsmLe
     
     // call to make the actual copy from c0 to c1
     getNValuesVector(c0VectorPtr, c, c0TotalValues, copyAllFromC0, c0_percentage_to_copy);
-    
-    
-    // clear the array to make way for the next call to memoryLevelCopy from LsmTree
-    getNValuesArray.clear();
-    
-    // reset the counter for getNValues back to 0 for the next call to memoryLevelCOpy from LsmTree
-    getNValuesCounterVector = 0;
 }
 
 
@@ -361,7 +361,7 @@ void LsmLevelMemory::memoryLevelCopyVector(std::vector<long>* c0VectorPtr, LsmLe
  @param r the root node pointer
  
  */
-long LsmLevelMemory::total_values_count = 0;
+thread_local long LsmLevelMemory::total_values_count = 0;
 long LsmLevelMemory::calculateValuesCount(const node *r)const
 {
     if (r)
@@ -392,6 +392,77 @@ long LsmLevelMemory::getValuesCount()
     return calculateValuesCount(r);
 }
 
+/**
+ function used to get the values of the c0 memory level in sorted order
+ 
+ @param values the vector the values are appended to
+ @param limit the maximum number of values to get, starting from the smallest
+ 
+ */
+void LsmLevelMemory::getSortedValues(std::vector<dtype> &values, long limit)const
+{
+    inOrderValues(root, values, values.size() + limit);
+}
+
+/**
+ function used to walk the BTree in order, appending its values
+ 
+ @param r the root of the BTree
+ @param values the vector the values are appended to
+ @param limit the size values should not grow beyond
+ 
+ */
+void LsmLevelMemory::inOrderValues(const node *r, std::vector<dtype> &values, long limit)const
+{
+    if (r == NULL) return;
+    
+    // visit each child before the value that follows it, so the values come out sorted
+    for (int i = 0; i < r->n; i++)
+    {
+        inOrderValues(r->p[i], values, limit);
+        if ((long) values.size() >= limit) return;
+        values.push_back(r->k[i]);
+    }
+    inOrderValues(r->p[r->n], values, limit);
+}
+
+/**
+ function used to get the values of the c0 memory level within a range
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmLevelMemory::getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)const
+{
+    inOrderRangeValues(root, low, high, values);
+}
+
+/**
+ function used to walk the BTree in order, appending its values within a range, subtrees outside the
+ range are skipped
+ 
+ @param r the root of the BTree
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to
+ 
+ */
+void LsmLevelMemory::inOrderRangeValues(const node *r, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)const
+{
+    if (r == NULL) return;
+    
+    for (int i = 0; i < r->n; i++)
+    {
+        // the child before a value only holds smaller values
+        if (low < r->k[i].value) inOrderRangeValues(r->p[i], low, high, values);
+        if (high < r->k[i].value) return;
+        if (!(r->k[i].value < low)) values.push_back(r->k[i]);
+    }
+    inOrderRangeValues(r->p[r->n], low, high, values);
+}
+
 /**
  function used to locate a node, based on binary search
  
@@ -440,8 +511,61 @@ bool LsmLevelMemory::search_value(dtype x)const
 }
 
 /**
- Function to delete a value associated with a node in the BTree
+ function used to search for a batch of values in the BTree, MEMORY_LOOKUP_GROUP lookups are walked down
+ the BTree together, one node each in turn
  
+ @param values the data values to search for
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ 
+ */
+void LsmLevelMemory::search_values(const std::vector<dtype> &values, std::vector<char> &states)const
+{
+    for (size_t first = 0; first < values.size(); first += MEMORY_LOOKUP_GROUP)
+    {
+        size_t last = std::min(first + MEMORY_LOOKUP_GROUP, values.size());
+        
+        // the node each lookup of the group is about to search, NULL once the lookup is complete
+        node *cursors[MEMORY_LOOKUP_GROUP];
+        long active = 0;
+        for (size_t i = first; i < last; i++)
+        {
+            cursors[i - first] = states[i] == LookupPending ? root : NULL;
+            if (cursors[i - first] != NULL) active++;
+        }
+        
+        while (active > 0)
+        {
+            for (size_t i = first; i < last; i++)
+            {
+                node *r = cursors[i - first];
+                if (r == NULL) continue;
+                
+                long n = r->n;
+                long j = NodeSearch(values[i], r->k, n);
+                if (j < n && values[i].value == r->k[j].value)
+                {
+                    states[i] = LookupFound;
+                    r = NULL;
+                } else {
+                    r = r->p[j];
+                }
+                
+                // load the keys of the next node while the other lookups of the group are searched
+                if (r != NULL)
+                {
+                    for (size_t b = 0; b < sizeof(r->k); b += 64) __builtin_prefetch((const char*) r->k + b);
+                } else {
+                    active--;
+                }
+                cursors[i - first] = r;
+            }
+        }
+    }
+}
+
+/**
+ Function to delete a value associated with a node in the BTree
+
  @param x the key value pair to be deleted
  */
 void LsmLevelMemory::DelNode(dtype x)
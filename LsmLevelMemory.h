@@ -16,11 +16,29 @@
 // there are M fields in each node
 #define M 20
 
+// the type of the values held by the lsm tree, the values are ordered and searched for by this type.
+// A long by default, or a slice holding a byte string key and value when built with LSM_SLICE_VALUES. The
+// type is chosen for the whole build, not for each tree, as the nodes and pages of every level are written
+// to disk as records of its fixed size
+#ifdef LSM_SLICE_VALUES
+
+#include "LsmSlice.h"
+
+// the bytes held by each slice, shared by its key and value
+#ifndef LSM_SLICE_CAPACITY
+#define LSM_SLICE_CAPACITY 48
+#endif
+
+typedef LsmSlice<LSM_SLICE_CAPACITY> lsm_value_t;
+#else
+typedef long lsm_value_t;
+#endif
+
 // this struct represents the data of the lsm tree
 // it is currently set as key value pairs
 typedef struct {
     long key;
-    long value;
+    lsm_value_t value;
 } dtype;
 
 #include <fstream>
@@ -37,6 +55,14 @@ typedef struct {
 enum status {InsertNotComplete, Success, DuplicateKey,
     Underflow, NotFound};
 
+// the state of each lookup of a batch searched by the search_values functions of the levels, a level only
+// searches for the lookups still pending and marks those it finds
+enum lookup_state {LookupPending, LookupFound, LookupMissing};
+
+// the number of lookups of a batch walked down the BTree of c0 together, the next node of each is prefetched
+// while the others are searched
+#define MEMORY_LOOKUP_GROUP 16
+
 // struct to define the characteristics of a node
 struct node {
     int n;        // Number of items stored in a node (n < M)
@@ -50,8 +76,8 @@ class LsmLevelDisk;
 class LsmLevelMemory {
 public:
     
-    // a counter used when copying the data from level to level
-    static long total_values_count;
+    // a counter used when copying the data from level to level, one for each thread
+    static thread_local long total_values_count;
     
     LsmLevelMemory(): root(NULL){}
     
@@ -76,6 +102,17 @@ public:
      */
     void DelNode(dtype x);
     
+    /**
+     function used to search for a batch of values in the BTree, MEMORY_LOOKUP_GROUP lookups are walked down
+     the BTree together, one node each in turn, so the next node of a lookup is loaded from memory while the
+     others are searched
+     
+     @param values the data values to search for
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     
+     */
+    void search_values(const std::vector<dtype> &values, std::vector<char> &states)const;
+    
     /**
      function used to search for a value in the BTree
      
@@ -85,20 +122,17 @@ public:
     bool search_value(dtype x)const;
     
     /**
-     function used to copy values from c0 memory level to the c1 level
+     function used to collect the values of a subtree of the c0 BTree in sorted order, for memoryLevelCopy to
+     pick the values to copy from
      
-     @param c pointer to the level to be copied to
-     @param c0 pointer to the level to copy from
-     @param r the root of the BTree
-     @param c0TotalValues the total values in the memory level BTree
-     @param copyAllFromC0 boolean to determine if all of c0 should be copied
-     @param c0_percentage_to_copy what percentage of c0 should be copied?
+     @param r the root of the subtree
      
      */
-    void getNValues(LsmLevelDisk* c, LsmLevelMemory* c0,const node *r, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const;
+    void getNValues(const node *r)const;
     
     /**
-     function used to copy values from c0 memory level to the c1 level
+     function used to copy values from c0 memory level to the c1 level. When only a percentage of c0 is copied
+     the values copied are a contiguous range of keys, the range picked by the level copied to
      
      @param c pointer to the level to be copied to
      @param c0 pointer to the level to copy from
@@ -117,10 +151,12 @@ public:
      @param c0_percentage_to_copy what percentage of c0 should be copied?
      
      */
-    void memoryLevelCopyVector(std::vector<long>* c0VectorPtr, LsmLevelDisk *c, bool copyAllFromC0, double c0_percentage_to_copy);
+    void memoryLevelCopyVector(std::vector<lsm_value_t>* c0VectorPtr, LsmLevelDisk *c, bool copyAllFromC0, double c0_percentage_to_copy);
     
     /**
-     function used to copy values from c0 memory level to the c1 level
+     function used to copy values from c0 memory level to the c1 level, the values copied are removed from the
+     vector and the values left stay in c0. When only a percentage of c0 is copied the values copied are a
+     contiguous range of keys, the range picked by the level copied to
      
      @param c0VectorPtr pointer to the vector to be copied from
      @param c pointer to the level to copy to
@@ -129,7 +165,7 @@ public:
      @param c0_percentage_to_copy what percentage of c0 should be copied?
      
      */
-    void getNValuesVector(std::vector<long>* c0VectorPtr, LsmLevelDisk *c, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const;
+    void getNValuesVector(std::vector<lsm_value_t>* c0VectorPtr, LsmLevelDisk *c, long c0TotalValues, bool copyAllFromC0, double c0_percentage_to_copy)const;
     
     /**
      function used to get the values count of the c0 memory level
@@ -139,6 +175,25 @@ public:
      */
     long getValuesCount();
     
+    /**
+     function used to get the values of the c0 memory level in sorted order
+     
+     @param values the vector the values are appended to
+     @param limit the maximum number of values to get, starting from the smallest
+     
+     */
+    void getSortedValues(std::vector<dtype> &values, long limit)const;
+    
+    /**
+     function used to get the values of the c0 memory level within a range
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)const;
+
 private:
     
     // pointer to the root node
@@ -175,6 +230,28 @@ private:
      */
     long calculateValuesCount(const node *r)const;
     
+    /**
+     function used to walk the BTree in order, appending its values
+     
+     @param r the root of the BTree
+     @param values the vector the values are appended to
+     @param limit the size values should not grow beyond
+     
+     */
+    void inOrderValues(const node *r, std::vector<dtype> &values, long limit)const;
+    
+    /**
+     function used to walk the BTree in order, appending its values within a range, subtrees outside the
+     range are skipped
+     
+     @param r the root of the BTree
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to
+     
+     */
+    void inOrderRangeValues(const node *r, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)const;
+
     /**
      function used to locate a node, based on binary search
      
@@ -0,0 +1,494 @@
+/**
+ C++11 - GCC Compiler
+ LsmLevelPartitioned.cpp
+ 
+ Creates a disk level of the Lsm Tree made of several sorted runs, each covering a key range that does
+ not overlap the key range of any other run in the level. A manifest file for the level records its runs
+ so the level can be opened again.
+ 
+ A rolling merge into the level only rewrites the runs overlapping the values passed to it, and a
+ compaction to the next level moves a single run, so the work done is bounded by the size of a run
+ rather than the size of the level.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmLevelPartitioned.h"
+#include "LsmMergeOperands.h"
+#include "LsmPointTombstones.h"
+#include "LsmRangeTombstones.h"
+
+// the signature written to the header of each manifest file, used to verify the file format
+#define MANIFEST_SIGNATURE 0x4C534D4D414E31L
+
+LsmLevelPartitioned::LsmLevelPartitioned()
+{
+    levelNumber = 0;
+    runMaxValues = 0;
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    filterBitsPerKey = 0;
+}
+
+/**
+ Constructor to initialize the level, the runs listed in the level's manifest are opened if it exists
+ 
+ @param levelNumber the level number --> for example c1 has a value of 1
+ @param runMaxValues the number of values written to a run before a new run is started
+ @param filePrefix the prefix of the names of the level's files, used to keep the files of several Lsm
+        Trees apart
+ 
+ */
+LsmLevelPartitioned::LsmLevelPartitioned(int levelNumber, long runMaxValues, const std::string &filePrefix)
+{
+    LsmLevelPartitioned::levelNumber = levelNumber;
+    LsmLevelPartitioned::filePrefix = filePrefix;
+    LsmLevelPartitioned::runMaxValues = runMaxValues > 0 ? runMaxValues : 1;
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    filterBitsPerKey = 0;
+    
+    // if the manifest exists, open each of the runs it lists
+    manifest = LsmRunManifest(levelNumber, filePrefix, MANIFEST_SIGNATURE);
+    manifest.open(runs);
+}
+
+LsmLevelPartitioned::~LsmLevelPartitioned()
+{
+    // the manifest is written after every change, so only the memory for the runs needs to be released
+    for (size_t i = 0; i < runs.size(); i++) delete runs[i];
+}
+
+/**
+ function used to find the first run whose largest value is not less than a value
+ 
+ @param value the value to search for
+ @return the position of the run, or runs.size() if there is none
+ 
+ */
+size_t LsmLevelPartitioned::RunSearch(lsm_value_t value)const
+{
+    size_t left = 0, right = runs.size();
+    while (left < right)
+    {
+        size_t middle = (left + right) / 2;
+        if ((*runs[middle]).getMaxValue() < value) left = middle + 1; else right = middle;
+    }
+    return left;
+}
+
+/**
+ function used to write sorted values to new runs, splitting them every runMaxValues values
+ 
+ @param values the values to write
+ @param newRuns the vector the new runs are appended to
+ 
+ */
+void LsmLevelPartitioned::WriteRuns(const std::vector<dtype> &values, std::vector<LsmSortedRun*> &newRuns)
+{
+    long total = values.size();
+    
+    // split the values into runs of runMaxValues, spreading the remainder so the last run is not tiny
+    long runsCount = (total + runMaxValues - 1) / runMaxValues;
+    long first = 0;
+    for (long i = 0; i < runsCount; i++)
+    {
+        long last = total * (i + 1) / runsCount;
+        newRuns.push_back(LsmSortedRun::create(manifest.nextRunFileName().c_str(), values, first, last, filterBitsPerKey));
+        
+        first = last;
+    }
+}
+
+/**
+ function used to delete a run's file, keeping its I/O counters for the level
+ 
+ @param run the run to remove, it is deleted
+ 
+ */
+void LsmLevelPartitioned::RetireRun(LsmSortedRun *run)
+{
+    {
+        std::lock_guard<std::mutex> guard(levelMutex);
+        manifest.retire(run);
+    }
+    
+    (*run).removeFile();
+    delete run;
+}
+
+/**
+ function used to merge sorted values into the level
+ 
+ only the runs whose key range overlaps the values are read and rewritten, values passed in replace
+ equal values already in the level
+ 
+ @param values the values to merge, sorted by value with no duplicates
+ @param folded the vector the merge operand stacks folded into the values are appended to, for the caller to
+        retire once the values are removed from the level they came from, or NULL to retire them with the
+        merge
+ @return the number of values in the level after the merge
+ 
+ */
+long LsmLevelPartitioned::merge(const std::vector<dtype> &values, std::vector<LsmMergeStack> *folded)
+{
+    if (values.empty()) return getValuesCount();
+    
+    // find the runs overlapping the key range of the values
+    size_t first = RunSearch(values.front().value);
+    size_t last = first;
+    while (last < runs.size() && (*runs[last]).getMinValue() <= values.back().value) last++;
+    
+    // when the values fall in a gap between runs, fold them into a small neighbouring run
+    // instead of creating another small run
+    if (first == last)
+    {
+        if (first > 0 && (*runs[first - 1]).getValuesCount() + (long) values.size() <= runMaxValues) first--;
+        else if (last < runs.size() && (*runs[last]).getValuesCount() + (long) values.size() <= runMaxValues) last++;
+    }
+    
+    // read the overlapping runs, they are already in key order
+    std::vector<dtype> existing;
+    for (size_t i = first; i < last; i++) (*runs[i]).getValues(existing);
+    
+    // merge the two sorted sequences, an equal value passed in replaces the existing value
+    std::vector<dtype> merged;
+    merged.reserve(existing.size() + values.size());
+    size_t i = 0, j = 0;
+    while (i < existing.size() || j < values.size())
+    {
+        if (j == values.size() || (i < existing.size() && existing[i].value < values[j].value))
+        {
+            merged.push_back(existing[i++]);
+        } else {
+            if (i < existing.size() && existing[i].value == values[j].value) i++;
+            merged.push_back(values[j++]);
+        }
+    }
+    
+    // drop the values deleted by a range tombstone, from the runs rewritten and the values passed in
+    if (rangeTombstones != NULL) (*rangeTombstones).filter(merged);
+    
+    // drop the values deleted by a point tombstone, the previous level and the runs rewritten hold no copy of
+    // the values deleted within the range of the values passed in once the merge is done
+    if (pointTombstones != NULL) (*pointTombstones).filter(merged, &values.front().value, &values.back().value, levelNumber - 1, levelNumber, NULL);
+    
+    // fold the merge operands into their records, the previous level and the runs rewritten hold the newest
+    // copies of the records within the range of the values passed in
+    std::vector<LsmMergeStack> foldedStacks;
+    if (mergeOperands != NULL) (*mergeOperands).foldValues(merged, &values.front().value, &values.back().value, levelNumber - 1, levelNumber, foldedStacks, NULL);
+    
+    std::vector<LsmSortedRun*> newRuns;
+    WriteRuns(merged, newRuns);
+    
+    // swap the new runs in for the old ones, then record them in the manifest before removing the old files.
+    // The lookups overlapping the swap are made again, the folded records replace the copies they read
+    if (!foldedStacks.empty()) (*mergeOperands).beginApply();
+    std::vector<LsmSortedRun*> oldRuns(runs.begin() + first, runs.begin() + last);
+    {
+        std::lock_guard<std::mutex> guard(levelMutex);
+        runs.erase(runs.begin() + first, runs.begin() + last);
+        runs.insert(runs.begin() + first, newRuns.begin(), newRuns.end());
+        manifest.write(runs);
+    }
+    if (!foldedStacks.empty())
+    {
+        // the operands are retired once the values passed in are removed from their level, which still holds
+        // the copies the operands are not folded into
+        if (folded != NULL) (*folded).insert((*folded).end(), foldedStacks.begin(), foldedStacks.end());
+        else (*mergeOperands).retireFolded(foldedStacks);
+        (*mergeOperands).endApply();
+    }
+    for (size_t k = 0; k < oldRuns.size(); k++) RetireRun(oldRuns[k]);
+    
+    return getValuesCount();
+}
+
+/**
+ function used to move one run of this level to the next level
+ 
+ the runs are picked in key order, starting after the last run compacted, so repeated compactions
+ cycle through the key range of the level
+ 
+ @param next a pointer to the next level
+ @return the number of values moved
+ 
+ */
+long LsmLevelPartitioned::compactInto(LsmLevelPartitioned *next)
+{
+    if (runs.empty()) return 0;
+    
+    size_t picked = PickCompactionRun();
+    LsmSortedRun *run = runs[picked];
+    
+    // merge the values of the run into the overlapping runs of the next level
+    std::vector<dtype> values;
+    std::vector<LsmMergeStack> folded;
+    (*run).getValues(values);
+    (*next).merge(values, &folded);
+    
+    long moved = values.size();
+    (*next).countMergedKeys(moved, 0);
+    countMergedKeys(0, moved);
+    
+    // remove the run from this level, and the operands folded into the copies of its records in the next level
+    if (!folded.empty()) (*mergeOperands).beginApply();
+    {
+        std::lock_guard<std::mutex> guard(levelMutex);
+        manifest.setCompactPointer((*run).getMaxValue());
+        runs.erase(runs.begin() + picked);
+        manifest.write(runs);
+    }
+    if (!folded.empty())
+    {
+        (*mergeOperands).retireFolded(folded);
+        (*mergeOperands).endApply();
+    }
+    RetireRun(run);
+    
+    return moved;
+}
+
+/**
+ function used to get the number of values the next call to compactInto will move
+ 
+ @return the values count of the run that will be picked
+ 
+ */
+long LsmLevelPartitioned::getCompactionValuesCount()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    if (runs.empty()) return 0;
+    return (*runs[PickCompactionRun()]).getValuesCount();
+}
+
+/**
+ function used to pick the run moved by the next compaction
+ 
+ @return the position of the run
+ 
+ */
+size_t LsmLevelPartitioned::PickCompactionRun()const
+{
+    // pick the first run after the compact pointer, wrapping around to the start of the level
+    size_t picked = 0;
+    while (picked < runs.size() && (*runs[picked]).getMinValue() <= manifest.getCompactPointer()) picked++;
+    if (picked == runs.size()) picked = 0;
+    return picked;
+}
+
+/**
+ function used to search for a value in the level, at most one run is searched
+ 
+ @param x the data value to search for
+ @return true if the value is in the level
+ 
+ */
+bool LsmLevelPartitioned::search_value(dtype x)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    // only the run whose key range contains the value can hold it
+    size_t i = RunSearch(x.value);
+    if (i == runs.size() || (*runs[i]).getMinValue() > x.value) return false;
+    
+    return (*runs[i]).search_value(x);
+}
+
+/**
+ function used to search for a batch of values in the level, the lookups are split between the runs
+ whose key range holds them and each run is searched once for its share
+ 
+ @param values the data values to search for, sorted by value
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ 
+ */
+void LsmLevelPartitioned::search_values(const std::vector<dtype> &values, std::vector<char> &states)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    size_t first = 0;
+    while (first < values.size())
+    {
+        size_t i = RunSearch(values[first].value);
+        if (i == runs.size()) return;
+        
+        // the lookups up to the maximum value of the run are its share
+        size_t last = first;
+        while (last < values.size() && values[last].value <= (*runs[i]).getMaxValue()) last++;
+        
+        (*runs[i]).search_values(values, states, first, last);
+        first = last;
+    }
+}
+
+/**
+ Function to delete a value from the level
+ 
+ @param x the key value pair to be deleted
+ 
+ */
+void LsmLevelPartitioned::DelNode(dtype x)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    size_t i = RunSearch(x.value);
+    if (i == runs.size() || (*runs[i]).getMinValue() > x.value) return;
+    
+    (*runs[i]).DelNode(x);
+}
+
+/**
+ function used to get the values of the level within a range, only the runs overlapping it are read
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmLevelPartitioned::getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    // the runs are ordered by key range, so the runs overlapping the range follow one another
+    for (size_t i = RunSearch(low); i < runs.size() && !(high < (*runs[i]).getMinValue()); i++)
+    {
+        (*runs[i]).getRangeValues(low, high, values);
+    }
+}
+
+/**
+ function used to check the zone map of the level, from the smallest value of its first run to the
+ largest value of its last run, for values within a range
+ 
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if the level holds no value within the range, true if it may
+ 
+ */
+bool LsmLevelPartitioned::mayContainRange(const lsm_value_t &low, const lsm_value_t &high)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    // the runs are ordered by key range and do not overlap, so the first and last runs bound the level
+    if (runs.empty()) return false;
+    return !(high < (*runs.front()).getMinValue()) && !((*runs.back()).getMaxValue() < low);
+}
+
+/**
+ function used to get the values count of the level, kept in memory so no disk reads are made
+ 
+ @return the values count
+ 
+ */
+long LsmLevelPartitioned::getValuesCount()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    long total = 0;
+    for (size_t i = 0; i < runs.size(); i++) total += (*runs[i]).getValuesCount();
+    return total;
+}
+
+/**
+ function used to get the number of runs in the level
+ 
+ @return the runs count
+ 
+ */
+long LsmLevelPartitioned::getRunsCount()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    return runs.size();
+}
+
+/**
+ function used to get the total size, in bytes, of the run files of the level
+ 
+ @return the size of the level on disk
+ 
+ */
+long LsmLevelPartitioned::getFileSize()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    long total = 0;
+    for (size_t i = 0; i < runs.size(); i++) total += LsmLevelDisk::getFileSize((*runs[i]).getFileName());
+    return total;
+}
+
+/**
+ function used to get the I/O counters of the level, including runs already replaced by a merge
+ 
+ @return the counters for this level
+ 
+ */
+LsmLevelIOStats LsmLevelPartitioned::getIOStats()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    return manifest.getIOStats(runs);
+}
+
+/**
+ function used to record values moved into or out of this level by a rolling merge
+ 
+ @param keysIn the number of values merged into this level
+ @param keysOut the number of values merged out of this level
+ 
+ */
+void LsmLevelPartitioned::countMergedKeys(long keysIn, long keysOut)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    manifest.countMergedKeys(keysIn, keysOut);
+}
+
+/**
+ function used to give the level the range tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param rangeTombstones the range tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelPartitioned::setRangeTombstones(LsmRangeTombstones *rangeTombstones)
+{
+    LsmLevelPartitioned::rangeTombstones = rangeTombstones;
+}
+
+/**
+ function used to give the level the point tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param pointTombstones the point tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelPartitioned::setPointTombstones(LsmPointTombstones *pointTombstones)
+{
+    LsmLevelPartitioned::pointTombstones = pointTombstones;
+}
+
+/**
+ function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+ records as the level is rewritten
+ 
+ @param mergeOperands the merge operands, or NULL to keep every value as it is
+ 
+ */
+void LsmLevelPartitioned::setMergeOperands(LsmMergeOperands *mergeOperands)
+{
+    LsmLevelPartitioned::mergeOperands = mergeOperands;
+}
+
+/**
+ function used to change the point filter bits for each value of the runs written to the level, the runs
+ already written keep their point filters until they are rewritten
+ 
+ @param filterBitsPerKey the filter bits for each value, 0 to write runs without a point filter
+ 
+ */
+void LsmLevelPartitioned::setFilterBitsPerKey(double filterBitsPerKey)
+{
+    LsmLevelPartitioned::filterBitsPerKey = filterBitsPerKey;
+}
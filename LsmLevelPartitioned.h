@@ -0,0 +1,268 @@
+/**
+ C++11 - GCC Compiler
+ LsmLevelPartitioned.h
+ 
+ Creates a disk level of the Lsm Tree made of several sorted runs, each covering a key range that does
+ not overlap the key range of any other run in the level. A manifest file for the level records its runs
+ so the level can be opened again.
+ 
+ A rolling merge into the level only rewrites the runs overlapping the values passed to it, and a
+ compaction to the next level moves a single run, so the work done is bounded by the size of a run
+ rather than the size of the level.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMLEVELPARTITIONED_H
+#define LSMLEVELPARTITIONED_H
+
+#include <mutex>
+#include <vector>
+
+#include "LsmRunManifest.h"
+
+class LsmLevelPartitioned {
+public:
+    LsmLevelPartitioned();
+    
+    /**
+     Constructor to initialize the level, the runs listed in the level's manifest are opened if it exists
+     
+     @param levelNumber the level number --> for example c1 has a value of 1
+     @param runMaxValues the number of values written to a run before a new run is started
+     @param filePrefix the prefix of the names of the level's files, used to keep the files of several Lsm
+            Trees apart
+     
+     */
+    LsmLevelPartitioned(int levelNumber, long runMaxValues, const std::string &filePrefix = "");
+    
+    ~LsmLevelPartitioned();
+    
+    /**
+     function used to merge sorted values into the level
+     
+     only the runs whose key range overlaps the values are read and rewritten, values passed in replace
+     equal values already in the level
+     
+     @param values the values to merge, sorted by value with no duplicates
+     @param folded the vector the merge operand stacks folded into the values are appended to, for the caller
+            to retire once the values are removed from the level they came from, or NULL to retire them with
+            the merge
+     @return the number of values in the level after the merge
+     
+     */
+    long merge(const std::vector<dtype> &values, std::vector<LsmMergeStack> *folded = NULL);
+    
+    /**
+     function used to move one run of this level to the next level
+     
+     the runs are picked in key order, starting after the last run compacted, so repeated compactions
+     cycle through the key range of the level
+     
+     @param next a pointer to the next level
+     @return the number of values moved
+     
+     */
+    long compactInto(LsmLevelPartitioned *next);
+    
+    /**
+     function used to get the number of values the next call to compactInto will move
+     
+     @return the values count of the run that will be picked
+     
+     */
+    long getCompactionValuesCount();
+    
+    /**
+     function used to search for a value in the level, at most one run is searched
+     
+     @param x the data value to search for
+     @return true if the value is in the level
+     
+     */
+    bool search_value(dtype x);
+    
+    /**
+     function used to search for a batch of values in the level, the lookups are split between the runs
+     whose key range holds them and each run is searched once for its share
+     
+     @param values the data values to search for, sorted by value
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     
+     */
+    void search_values(const std::vector<dtype> &values, std::vector<char> &states);
+    
+    /**
+     Function to delete a value from the level
+     
+     @param x the key value pair to be deleted
+     
+     */
+    void DelNode(dtype x);
+    
+    /**
+     function used to get the values of the level within a range, only the runs overlapping it are read
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+    
+    /**
+     function used to check the zone map of the level, from the smallest value of its first run to the
+     largest value of its last run, for values within a range
+     
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if the level holds no value within the range, true if it may
+     
+     */
+    bool mayContainRange(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     function used to get the values count of the level, kept in memory so no disk reads are made
+     
+     @return the values count
+     
+     */
+    long getValuesCount();
+    
+    /**
+     function used to get the number of runs in the level
+     
+     @return the runs count
+     
+     */
+    long getRunsCount();
+    
+    /**
+     function used to get the total size, in bytes, of the run files of the level
+     
+     @return the size of the level on disk
+     
+     */
+    long getFileSize();
+    
+    /**
+     function used to get the I/O counters of the level, including runs already replaced by a merge
+     
+     @return the counters for this level
+     
+     */
+    LsmLevelIOStats getIOStats();
+    
+    /**
+     function used to record values moved into or out of this level by a rolling merge
+     
+     @param keysIn the number of values merged into this level
+     @param keysOut the number of values merged out of this level
+     
+     */
+    void countMergedKeys(long keysIn, long keysOut);
+    
+    /**
+     function used to give the level the range tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param rangeTombstones the range tombstones, or NULL to keep every value
+     
+     */
+    void setRangeTombstones(LsmRangeTombstones *rangeTombstones);
+    
+    /**
+     function used to give the level the point tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param pointTombstones the point tombstones, or NULL to keep every value
+     
+     */
+    void setPointTombstones(LsmPointTombstones *pointTombstones);
+    
+    /**
+     function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+     records as the level is rewritten
+     
+     @param mergeOperands the merge operands, or NULL to keep every value as it is
+     
+     */
+    void setMergeOperands(LsmMergeOperands *mergeOperands);
+    
+    /**
+     function used to change the point filter bits for each value of the runs written to the level, the
+     runs already written keep their point filters until they are rewritten
+     
+     @param filterBitsPerKey the filter bits for each value, 0 to write runs without a point filter
+     
+     */
+    void setFilterBitsPerKey(double filterBitsPerKey);
+
+private:
+    
+    // the level number --> for example c1 has a value of 1
+    int levelNumber;
+    
+    // the prefix of the names of the level's files
+    std::string filePrefix;
+    
+    // the number of values written to a run before a new run is started
+    long runMaxValues;
+    
+    // the runs of the level, ordered by key range
+    std::vector<LsmSortedRun*> runs;
+    
+    // the manifest of the level, with the I/O counters of runs that have been replaced
+    LsmRunManifest manifest;
+    
+    // the range tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmRangeTombstones *rangeTombstones;
+    
+    // the point tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmPointTombstones *pointTombstones;
+    
+    // the merge operands of the Lsm Tree, NULL when none are given to the level
+    LsmMergeOperands *mergeOperands;
+    
+    // the point filter bits for each value of the runs written to the level
+    double filterBitsPerKey;
+    
+    // a mutex used to keep searches from using the runs while a merge replaces them
+    std::mutex levelMutex;
+    
+    /**
+     function used to find the first run whose largest value is not less than a value
+     
+     @param value the value to search for
+     @return the position of the run, or runs.size() if there is none
+     
+     */
+    size_t RunSearch(lsm_value_t value)const;
+    
+    /**
+     function used to pick the run moved by the next compaction
+     
+     @return the position of the run
+     
+     */
+    size_t PickCompactionRun()const;
+    
+    /**
+     function used to write sorted values to new runs, splitting them every runMaxValues values
+     
+     @param values the values to write
+     @param newRuns the vector the new runs are appended to
+     
+     */
+    void WriteRuns(const std::vector<dtype> &values, std::vector<LsmSortedRun*> &newRuns);
+    
+    /**
+     function used to delete a run's file, keeping its I/O counters for the level
+     
+     @param run the run to remove, it is deleted
+     
+     */
+    void RetireRun(LsmSortedRun *run);
+};
+
+#endif // LSMLEVELPARTITIONED_H
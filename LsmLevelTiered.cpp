@@ -0,0 +1,469 @@
+/**
+ C++11 - GCC Compiler
+ LsmLevelTiered.cpp
+ 
+ Creates a disk level of the Lsm Tree for size-tiered merging. The level holds several sorted runs of
+ similar size whose key ranges may overlap. A rolling merge adds a new run without reading the runs
+ already in the level, and once the level holds its maximum number of runs they are merged together
+ into a single run, which is added to the next level.
+ 
+ Each value is rewritten once per level, rather than once per run merged into a level, which lowers the
+ write amplification at the cost of searching several runs on a lookup.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmLevelTiered.h"
+#include "LsmMergeOperands.h"
+#include "LsmPointTombstones.h"
+#include "LsmRangeTombstones.h"
+
+#include <algorithm>
+
+// the signature written to the header of each tiered manifest file, used to verify the file format
+#define TIERED_MANIFEST_SIGNATURE 0x4C534D5449455231L
+
+LsmLevelTiered::LsmLevelTiered()
+{
+    levelNumber = 0;
+    maxRunsCount = 0;
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    filterBitsPerKey = 0;
+}
+
+/**
+ Constructor to initialize the level, the runs listed in the level's manifest are opened if it exists
+ 
+ @param levelNumber the level number --> for example c1 has a value of 1
+ @param maxRunsCount the number of runs the level holds before they are merged together
+ @param filePrefix the prefix of the names of the level's files, used to keep the files of several Lsm
+        Trees apart
+ 
+ */
+LsmLevelTiered::LsmLevelTiered(int levelNumber, long maxRunsCount, const std::string &filePrefix)
+{
+    LsmLevelTiered::levelNumber = levelNumber;
+    LsmLevelTiered::filePrefix = filePrefix;
+    LsmLevelTiered::maxRunsCount = maxRunsCount > 1 ? maxRunsCount : 2;
+    rangeTombstones = NULL;
+    pointTombstones = NULL;
+    mergeOperands = NULL;
+    filterBitsPerKey = 0;
+    
+    // if the manifest exists, open each of the runs it lists
+    manifest = LsmRunManifest(levelNumber, filePrefix, TIERED_MANIFEST_SIGNATURE);
+    manifest.open(runs);
+}
+
+LsmLevelTiered::~LsmLevelTiered()
+{
+    // the manifest is written after every change, so only the memory for the runs needs to be released
+    for (size_t i = 0; i < runs.size(); i++) delete runs[i];
+}
+
+/**
+ function used to create a run file for the level
+ 
+ @param values the values to write
+ @return a pointer to the new run
+ 
+ */
+LsmSortedRun* LsmLevelTiered::CreateRun(const std::vector<dtype> &values)
+{
+    return LsmSortedRun::create(manifest.nextRunFileName().c_str(), values, 0, values.size(), filterBitsPerKey);
+}
+
+/**
+ function used to add sorted values to the level as its newest run
+ 
+ @param values the values to write, sorted by value with no duplicates
+ 
+ */
+void LsmLevelTiered::addRun(const std::vector<dtype> &values)
+{
+    if (values.empty()) return;
+    
+    LsmSortedRun *run = CreateRun(values);
+    
+    std::lock_guard<std::mutex> guard(levelMutex);
+    runs.push_back(run);
+    manifest.write(runs);
+}
+
+/**
+ function used to check whether the level holds its maximum number of runs
+ 
+ @return true if the runs of the level should be merged
+ 
+ */
+bool LsmLevelTiered::isFull()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    return (long) runs.size() >= maxRunsCount;
+}
+
+/**
+ function used to change the number of runs the level holds before they are merged together
+ 
+ @param maxRunsCount the number of runs, at least 2
+ 
+ */
+void LsmLevelTiered::setMaxRunsCount(long maxRunsCount)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    LsmLevelTiered::maxRunsCount = maxRunsCount > 1 ? maxRunsCount : 2;
+}
+
+/**
+ compare two key value pairs by value, used to sort the values of the runs being merged
+ 
+ @param a the first key value pair
+ @param b the second key value pair
+ @return true if a sorts before b
+ 
+ */
+static bool compareValues(const dtype &a, const dtype &b)
+{
+    return a.value < b.value;
+}
+
+// compare a lookup to a value and a value to a lookup, used to find the lookups within the key range of a run
+static bool lookupBefore(const dtype &a, const lsm_value_t &b) {return a.value < b;}
+static bool valueBefore(const lsm_value_t &a, const dtype &b) {return a < b.value;}
+
+/**
+ function used to merge the values of every run, the newest run wins for equal values
+ 
+ @param merged the vector the merged values are written to, sorted by value with no duplicates
+ @param folded the vector the merge operand stacks folded into the merged values are appended to
+ 
+ */
+void LsmLevelTiered::MergeRuns(std::vector<dtype> &merged, std::vector<LsmMergeStack> &folded)
+{
+    // read the runs newest first, so a stable sort keeps the newest of equal values at the front
+    for (size_t i = runs.size(); i > 0; i--) (*runs[i - 1]).getValues(merged);
+    
+    std::stable_sort(merged.begin(), merged.end(), compareValues);
+    
+    // keep only the first, newest, of each value
+    size_t kept = 0;
+    for (size_t i = 0; i < merged.size(); i++)
+    {
+        if (kept > 0 && merged[kept - 1].value == merged[i].value) continue;
+        merged[kept++] = merged[i];
+    }
+    merged.resize(kept);
+    
+    // drop the values deleted by a range tombstone
+    if (rangeTombstones != NULL) (*rangeTombstones).filter(merged);
+    
+    // drop the values deleted by a point tombstone, every run of the level is merged so the level holds no
+    // copy of a value deleted once the merge is done
+    if (pointTombstones != NULL) (*pointTombstones).filter(merged, NULL, NULL, levelNumber, levelNumber, NULL);
+    
+    // fold the merge operands into their records, the level holds the newest copies of the records once the
+    // levels above it hold none
+    if (mergeOperands != NULL) (*mergeOperands).foldValues(merged, NULL, NULL, levelNumber, levelNumber, folded, NULL);
+}
+
+/**
+ function used to remove every run of the level, keeping their I/O counters for the level
+ 
+ @param keep a run to leave in the level, or NULL to remove every run
+ @param folded the merge operand stacks folded into the values of the runs, retired with the runs
+ 
+ */
+void LsmLevelTiered::RetireRuns(LsmSortedRun *keep, const std::vector<LsmMergeStack> &folded)
+{
+    // the lookups overlapping the runs being removed are made again, the folded records replace the copies
+    // they read
+    if (!folded.empty()) (*mergeOperands).beginApply();
+    
+    std::vector<LsmSortedRun*> oldRuns;
+    {
+        std::lock_guard<std::mutex> guard(levelMutex);
+        oldRuns.swap(runs);
+        if (keep != NULL) runs.push_back(keep);
+        manifest.write(runs);
+        
+        for (size_t i = 0; i < oldRuns.size(); i++) manifest.retire(oldRuns[i]);
+    }
+    if (!folded.empty())
+    {
+        (*mergeOperands).retireFolded(folded);
+        (*mergeOperands).endApply();
+    }
+    
+    for (size_t i = 0; i < oldRuns.size(); i++)
+    {
+        (*oldRuns[i]).removeFile();
+        delete oldRuns[i];
+    }
+}
+
+/**
+ function used to merge every run of this level into a single run added to the next level
+ 
+ @param next a pointer to the next level
+ @return the number of values moved
+ 
+ */
+long LsmLevelTiered::compactInto(LsmLevelTiered *next)
+{
+    std::vector<dtype> merged;
+    std::vector<LsmMergeStack> folded;
+    MergeRuns(merged, folded);
+    
+    // the next level's manifest lists the new run before the runs of this level are removed
+    (*next).addRun(merged);
+    RetireRuns(NULL, folded);
+    
+    long moved = merged.size();
+    (*next).countMergedKeys(moved, 0);
+    countMergedKeys(0, moved);
+    
+    return moved;
+}
+
+/**
+ function used to merge every run of this level into a single run kept in this level, used for the
+ last level which has no next level to move values to
+ 
+ @return the number of values in the merged run
+ 
+ */
+long LsmLevelTiered::compactInPlace()
+{
+    std::vector<dtype> merged;
+    std::vector<LsmMergeStack> folded;
+    MergeRuns(merged, folded);
+    
+    LsmSortedRun *run = merged.empty() ? NULL : CreateRun(merged);
+    RetireRuns(run, folded);
+    
+    countMergedKeys(merged.size(), merged.size());
+    
+    return merged.size();
+}
+
+/**
+ function used to search for a value in the level, the runs are searched newest first
+ 
+ @param x the data value to search for
+ @return true if the value is in the level
+ 
+ */
+bool LsmLevelTiered::search_value(dtype x)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    // a run whose key range does not contain the value is skipped without reading from disk
+    for (size_t i = runs.size(); i > 0; i--)
+    {
+        if ((*runs[i - 1]).search_value(x)) return true;
+    }
+    return false;
+}
+
+/**
+ function used to search for a batch of values in the level, the runs are searched newest first, each
+ for the lookups still pending within its key range
+ 
+ @param values the data values to search for, sorted by value
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ 
+ */
+void LsmLevelTiered::search_values(const std::vector<dtype> &values, std::vector<char> &states)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    for (size_t i = runs.size(); i > 0; i--)
+    {
+        const LsmSortedRun &run = *runs[i - 1];
+        size_t first = std::lower_bound(values.begin(), values.end(), run.getMinValue(), lookupBefore) - values.begin();
+        size_t last = std::upper_bound(values.begin(), values.end(), run.getMaxValue(), valueBefore) - values.begin();
+        
+        (*runs[i - 1]).search_values(values, states, first, last);
+    }
+}
+
+/**
+ Function to delete a value from the level, it is removed from every run holding it
+ 
+ @param x the key value pair to be deleted
+ 
+ */
+void LsmLevelTiered::DelNode(dtype x)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    for (size_t i = 0; i < runs.size(); i++) (*runs[i]).DelNode(x);
+}
+
+/**
+ function used to get the values of the level within a range, a value held by more than one run is
+ got once, from the newest run holding it
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmLevelTiered::getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    std::vector<dtype> found;
+    {
+        std::lock_guard<std::mutex> guard(levelMutex);
+        
+        // read the runs newest first, so a stable sort keeps the newest of equal values at the front
+        for (size_t i = runs.size(); i > 0; i--) (*runs[i - 1]).getRangeValues(low, high, found);
+    }
+    
+    std::stable_sort(found.begin(), found.end(), compareValues);
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        if (i > 0 && found[i - 1].value == found[i].value) continue;
+        values.push_back(found[i]);
+    }
+}
+
+/**
+ function used to check the zone map of the level, from the smallest to the largest value of its
+ runs, for values within a range
+ 
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if the level holds no value within the range, true if it may
+ 
+ */
+bool LsmLevelTiered::mayContainRange(const lsm_value_t &low, const lsm_value_t &high)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    // the runs overlap each other, the level may hold a value of the range if any of them may
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        if ((*runs[i]).getValuesCount() == 0) continue;
+        if (!(high < (*runs[i]).getMinValue()) && !((*runs[i]).getMaxValue() < low)) return true;
+    }
+    return false;
+}
+
+/**
+ function used to get the values count of the level, kept in memory so no disk reads are made
+ 
+ a value held by more than one run is counted once for each run
+ 
+ @return the values count
+ 
+ */
+long LsmLevelTiered::getValuesCount()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    long total = 0;
+    for (size_t i = 0; i < runs.size(); i++) total += (*runs[i]).getValuesCount();
+    return total;
+}
+
+/**
+ function used to get the number of runs in the level
+ 
+ @return the runs count
+ 
+ */
+long LsmLevelTiered::getRunsCount()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    return runs.size();
+}
+
+/**
+ function used to get the total size, in bytes, of the run files of the level
+ 
+ @return the size of the level on disk
+ 
+ */
+long LsmLevelTiered::getFileSize()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    
+    long total = 0;
+    for (size_t i = 0; i < runs.size(); i++) total += LsmLevelDisk::getFileSize((*runs[i]).getFileName());
+    return total;
+}
+
+/**
+ function used to get the I/O counters of the level, including runs already replaced by a merge
+ 
+ @return the counters for this level
+ 
+ */
+LsmLevelIOStats LsmLevelTiered::getIOStats()
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    return manifest.getIOStats(runs);
+}
+
+/**
+ function used to record values moved into or out of this level by a rolling merge
+ 
+ @param keysIn the number of values merged into this level
+ @param keysOut the number of values merged out of this level
+ 
+ */
+void LsmLevelTiered::countMergedKeys(long keysIn, long keysOut)
+{
+    std::lock_guard<std::mutex> guard(levelMutex);
+    manifest.countMergedKeys(keysIn, keysOut);
+}
+
+/**
+ function used to give the level the range tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param rangeTombstones the range tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelTiered::setRangeTombstones(LsmRangeTombstones *rangeTombstones)
+{
+    LsmLevelTiered::rangeTombstones = rangeTombstones;
+}
+
+/**
+ function used to give the level the point tombstones of the Lsm Tree, the values they delete are dropped as
+ the level is rewritten
+ 
+ @param pointTombstones the point tombstones, or NULL to keep every value
+ 
+ */
+void LsmLevelTiered::setPointTombstones(LsmPointTombstones *pointTombstones)
+{
+    LsmLevelTiered::pointTombstones = pointTombstones;
+}
+
+/**
+ function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+ records as the level is rewritten
+ 
+ @param mergeOperands the merge operands, or NULL to keep every value as it is
+ 
+ */
+void LsmLevelTiered::setMergeOperands(LsmMergeOperands *mergeOperands)
+{
+    LsmLevelTiered::mergeOperands = mergeOperands;
+}
+
+/**
+ function used to change the point filter bits for each value of the runs written to the level, the runs
+ already written keep their point filters until they are rewritten
+ 
+ @param filterBitsPerKey the filter bits for each value, 0 to write runs without a point filter
+ 
+ */
+void LsmLevelTiered::setFilterBitsPerKey(double filterBitsPerKey)
+{
+    LsmLevelTiered::filterBitsPerKey = filterBitsPerKey;
+}
@@ -0,0 +1,271 @@
+/**
+ C++11 - GCC Compiler
+ LsmLevelTiered.h
+ 
+ Creates a disk level of the Lsm Tree for size-tiered merging. The level holds several sorted runs of
+ similar size whose key ranges may overlap. A rolling merge adds a new run without reading the runs
+ already in the level, and once the level holds its maximum number of runs they are merged together
+ into a single run, which is added to the next level.
+ 
+ Each value is rewritten once per level, rather than once per run merged into a level, which lowers the
+ write amplification at the cost of searching several runs on a lookup.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMLEVELTIERED_H
+#define LSMLEVELTIERED_H
+
+#include <mutex>
+#include <vector>
+
+#include "LsmLevelPartitioned.h"
+
+class LsmLevelTiered {
+public:
+    LsmLevelTiered();
+    
+    /**
+     Constructor to initialize the level, the runs listed in the level's manifest are opened if it exists
+     
+     @param levelNumber the level number --> for example c1 has a value of 1
+     @param maxRunsCount the number of runs the level holds before they are merged together
+     @param filePrefix the prefix of the names of the level's files, used to keep the files of several Lsm
+            Trees apart
+     
+     */
+    LsmLevelTiered(int levelNumber, long maxRunsCount, const std::string &filePrefix = "");
+    
+    ~LsmLevelTiered();
+    
+    /**
+     function used to add sorted values to the level as its newest run
+     
+     @param values the values to write, sorted by value with no duplicates
+     
+     */
+    void addRun(const std::vector<dtype> &values);
+    
+    /**
+     function used to check whether the level holds its maximum number of runs
+     
+     @return true if the runs of the level should be merged
+     
+     */
+    bool isFull();
+    
+    /**
+     function used to change the number of runs the level holds before they are merged together
+     
+     @param maxRunsCount the number of runs, at least 2
+     
+     */
+    void setMaxRunsCount(long maxRunsCount);
+    
+    /**
+     function used to merge every run of this level into a single run added to the next level
+     
+     @param next a pointer to the next level
+     @return the number of values moved
+     
+     */
+    long compactInto(LsmLevelTiered *next);
+    
+    /**
+     function used to merge every run of this level into a single run kept in this level, used for the
+     last level which has no next level to move values to
+     
+     @return the number of values in the merged run
+     
+     */
+    long compactInPlace();
+    
+    /**
+     function used to search for a value in the level, the runs are searched newest first
+     
+     @param x the data value to search for
+     @return true if the value is in the level
+     
+     */
+    bool search_value(dtype x);
+    
+    /**
+     function used to search for a batch of values in the level, the runs are searched newest first, each
+     for the lookups still pending within its key range
+     
+     @param values the data values to search for, sorted by value
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     
+     */
+    void search_values(const std::vector<dtype> &values, std::vector<char> &states);
+    
+    /**
+     Function to delete a value from the level, it is removed from every run holding it
+     
+     @param x the key value pair to be deleted
+     
+     */
+    void DelNode(dtype x);
+    
+    /**
+     function used to get the values of the level within a range, a value held by more than one run is
+     got once, from the newest run holding it
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+    
+    /**
+     function used to check the zone map of the level, from the smallest to the largest value of its
+     runs, for values within a range
+     
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if the level holds no value within the range, true if it may
+     
+     */
+    bool mayContainRange(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     function used to get the values count of the level, kept in memory so no disk reads are made
+     
+     a value held by more than one run is counted once for each run
+     
+     @return the values count
+     
+     */
+    long getValuesCount();
+    
+    /**
+     function used to get the number of runs in the level
+     
+     @return the runs count
+     
+     */
+    long getRunsCount();
+    
+    /**
+     function used to get the total size, in bytes, of the run files of the level
+     
+     @return the size of the level on disk
+     
+     */
+    long getFileSize();
+    
+    /**
+     function used to get the I/O counters of the level, including runs already replaced by a merge
+     
+     @return the counters for this level
+     
+     */
+    LsmLevelIOStats getIOStats();
+    
+    /**
+     function used to record values moved into or out of this level by a rolling merge
+     
+     @param keysIn the number of values merged into this level
+     @param keysOut the number of values merged out of this level
+     
+     */
+    void countMergedKeys(long keysIn, long keysOut);
+    
+    /**
+     function used to give the level the range tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param rangeTombstones the range tombstones, or NULL to keep every value
+     
+     */
+    void setRangeTombstones(LsmRangeTombstones *rangeTombstones);
+    
+    /**
+     function used to give the level the point tombstones of the Lsm Tree, the values they delete are
+     dropped as the level is rewritten
+     
+     @param pointTombstones the point tombstones, or NULL to keep every value
+     
+     */
+    void setPointTombstones(LsmPointTombstones *pointTombstones);
+    
+    /**
+     function used to give the level the merge operands of the Lsm Tree, the operands are folded into their
+     records as the level is rewritten
+     
+     @param mergeOperands the merge operands, or NULL to keep every value as it is
+     
+     */
+    void setMergeOperands(LsmMergeOperands *mergeOperands);
+    
+    /**
+     function used to change the point filter bits for each value of the runs written to the level, the
+     runs already written keep their point filters until they are rewritten
+     
+     @param filterBitsPerKey the filter bits for each value, 0 to write runs without a point filter
+     
+     */
+    void setFilterBitsPerKey(double filterBitsPerKey);
+
+private:
+    
+    // the level number --> for example c1 has a value of 1
+    int levelNumber;
+    
+    // the prefix of the names of the level's files
+    std::string filePrefix;
+    
+    // the number of runs the level holds before they are merged together
+    long maxRunsCount;
+    
+    // the runs of the level, oldest first
+    std::vector<LsmSortedRun*> runs;
+    
+    // the manifest of the level, with the I/O counters of runs that have been replaced
+    LsmRunManifest manifest;
+    
+    // the range tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmRangeTombstones *rangeTombstones;
+    
+    // the point tombstones of the Lsm Tree, NULL when none are given to the level
+    LsmPointTombstones *pointTombstones;
+    
+    // the merge operands of the Lsm Tree, NULL when none are given to the level
+    LsmMergeOperands *mergeOperands;
+    
+    // the point filter bits for each value of the runs written to the level
+    double filterBitsPerKey;
+    
+    // a mutex used to keep searches from using the runs while a merge replaces them
+    std::mutex levelMutex;
+    
+    /**
+     function used to merge the values of every run, the newest run wins for equal values
+     
+     @param merged the vector the merged values are written to, sorted by value with no duplicates
+     @param folded the vector the merge operand stacks folded into the merged values are appended to
+     
+     */
+    void MergeRuns(std::vector<dtype> &merged, std::vector<LsmMergeStack> &folded);
+    
+    /**
+     function used to remove every run of the level, keeping their I/O counters for the level
+     
+     @param keep a run to leave in the level, or NULL to remove every run
+     @param folded the merge operand stacks folded into the values of the runs, retired with the runs
+     
+     */
+    void RetireRuns(LsmSortedRun *keep, const std::vector<LsmMergeStack> &folded);
+    
+    /**
+     function used to create a run file for the level
+     
+     @param values the values to write
+     @return a pointer to the new run
+     
+     */
+    LsmSortedRun* CreateRun(const std::vector<dtype> &values);
+};
+
+#endif // LSMLEVELTIERED_H
@@ -0,0 +1,365 @@
+/**
+ C++11 - GCC Compiler
+ LsmMergeOperands.cpp
+ 
+ Holds the merge operands of the Lsm Tree, the operands written by merge_value and not yet folded into the
+ records they change. Merges are blind writes, lookups fold the operands of a record as they read it, and
+ the rolling merges fold the records held by c0 and the merges between levels fold the records they stream,
+ before retiring their operands.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmMergeOperands.h"
+
+LsmMergeOperands::LsmMergeOperands()
+{
+    mergeOperator = NULL;
+    stacksCount = 0;
+    operandsCount = 0;
+    partialMergeCount = 0;
+    foldedCount = 0;
+    generation = 0;
+}
+
+/**
+ set the merge operator used to combine the operands stacked on a record
+ 
+ @param mergeOperator the merge operator, or NULL to stack every operand as it is
+ 
+ */
+void LsmMergeOperands::setMergeOperator(LsmMergeOperator *mergeOperator)
+{
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    LsmMergeOperands::mergeOperator = mergeOperator;
+}
+
+/**
+ add an operand to the stack of its record, combined with the newest operand of the stack when the merge
+ operator can do so
+ 
+ @param operand the operand
+ @param sequence the sequence number of the merge
+ 
+ */
+void LsmMergeOperands::add(const lsm_value_t &operand, long sequence)
+{
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    // a new stack is not yet checked against c0, which may hold the record
+    std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.find(operand);
+    if (it == stacks.end())
+    {
+        LsmMergeStack stack = LsmMergeStack();
+        stack.depth = -1;
+        it = stacks.insert(std::make_pair(operand, stack)).first;
+    }
+    LsmMergeStack &stack = it->second;
+    stack.sequence = sequence;
+    
+    // a counter incremented many times between two rolling merges holds a single operand, an operand folded
+    // by a merge not yet done is kept apart so it can be retired
+    lsm_value_t combined;
+    if (stack.operands.size() > stack.foldingCount && mergeOperator != NULL && (*mergeOperator).partialMerge(stack.operands.back(), operand, combined))
+    {
+        stack.operands.back() = combined;
+        partialMergeCount++;
+    } else {
+        stack.operands.push_back(operand);
+        operandsCount++;
+    }
+    stacksCount = stacks.size();
+}
+
+/**
+ record a value written or deleted, the stack of its record is removed as the write is newer than the
+ operands
+ 
+ @param value the value written or deleted
+ 
+ */
+void LsmMergeOperands::recordWrite(const lsm_value_t &value)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.find(value);
+    if (it != stacks.end()) Erase(it);
+}
+
+/**
+ record a range deleted, the stacks of the records within it are removed
+ 
+ @param low the smallest value deleted
+ @param high the largest value deleted
+ 
+ */
+void LsmMergeOperands::recordRangeDelete(const lsm_value_t &low, const lsm_value_t &high)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.lower_bound(low);
+    while (it != stacks.end() && !(high < it->first))
+    {
+        Erase(it++);
+    }
+}
+
+/**
+ check whether a record has operands not yet folded
+ 
+ @param value the record to check
+ @return true if the record has operands
+ 
+ */
+bool LsmMergeOperands::contains(const lsm_value_t &value)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    return stacks.find(value) != stacks.end();
+}
+
+/**
+ function used to get the operands stacked on a record
+ 
+ @param value the record
+ @param operands the vector the operands are appended to, oldest first
+ @return true if the record has operands
+ 
+ */
+bool LsmMergeOperands::get(const lsm_value_t &value, std::vector<lsm_value_t> &operands)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    std::map<lsm_value_t, LsmMergeStack>::const_iterator it = stacks.find(value);
+    if (it == stacks.end()) return false;
+    
+    operands.insert(operands.end(), it->second.operands.begin(), it->second.operands.end());
+    return true;
+}
+
+/**
+ function used to get a copy of the stacks of the records within a range
+ 
+ @param low the smallest record to get
+ @param high the largest record to get
+ @param stacks the vector the stacks are appended to, sorted by record
+ 
+ */
+void LsmMergeOperands::getRange(const lsm_value_t &low, const lsm_value_t &high, std::vector<LsmMergeStack> &stacks)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    std::map<lsm_value_t, LsmMergeStack>::const_iterator it;
+    for (it = LsmMergeOperands::stacks.lower_bound(low); it != LsmMergeOperands::stacks.end() && !(high < it->first); ++it)
+    {
+        stacks.push_back(it->second);
+    }
+}
+
+/**
+ function used to get a copy of the stacks for a rolling merge to fold, those not yet checked against c0 and
+ those merged down past the last level holding values. Called while no merge is running
+ 
+ @param pending the vector the stacks are appended to, sorted by record
+ @param lastLevel the level number of the deepest level holding values, 0 if every level is empty
+ 
+ */
+void LsmMergeOperands::getPending(std::vector<LsmMergeStack> &pending, int lastLevel)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    std::map<lsm_value_t, LsmMergeStack>::const_iterator it;
+    for (it = stacks.begin(); it != stacks.end(); ++it)
+    {
+        if (it->second.depth >= 0 && it->second.depth < lastLevel) continue;
+        
+        pending.push_back(it->second);
+    }
+}
+
+/**
+ remove the stacks folded by a rolling merge. A stack merged to or removed by a write since it was folded is
+ left as it is
+ 
+ @param applied the stacks folded, as got from getPending
+ @param foldedCount the number of records the stacks were folded into
+ 
+ */
+void LsmMergeOperands::retire(const std::vector<LsmMergeStack> &applied, long foldedCount)
+{
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    for (size_t i = 0; i < applied.size(); i++)
+    {
+        std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.find(applied[i].operands.back());
+        if (it == stacks.end() || it->second.sequence != applied[i].sequence) continue;
+        
+        Erase(it);
+    }
+    LsmMergeOperands::foldedCount += foldedCount;
+}
+
+/**
+ record the stacks a rolling merge found no copy of the record in c0 for, they are left for the merges
+ between levels to fold. A stack removed by a write since is left as it is
+ 
+ @param deferred the stacks, as got from getPending
+ 
+ */
+void LsmMergeOperands::defer(const std::vector<LsmMergeStack> &deferred)
+{
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    for (size_t i = 0; i < deferred.size(); i++)
+    {
+        std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.find(deferred[i].operands.back());
+        if (it == stacks.end() || it->second.depth >= 0) continue;
+        
+        it->second.depth = 0;
+    }
+}
+
+/**
+ fold the stacks of the records merged between levels into the records, and record the stacks within the
+ range of the merge as merged through the levels the merge clears. A stack is folded only when the levels
+ above those the merge clears hold no copy of its record, the copy merged is then the newest
+ 
+ @param values the values merged, sorted by value, the records folded are replaced
+ @param low the smallest value of the range merged, or NULL when the merge takes the whole of the levels
+ @param high the largest value of the range merged, or NULL when the merge takes the whole of the levels
+ @param fromLevel the shallowest level the merge clears, 0 for c0
+ @param toLevel the deepest level the merge clears
+ @param folded the vector the stacks folded are appended to
+ @param missing the vector the records of the stacks within the range with no value merged are appended to,
+        when the deepest level is written without being merged and may hold a copy for the caller to fold, or
+        NULL
+ @return the number of records folded
+ 
+ */
+long LsmMergeOperands::foldValues(std::vector<dtype> &values, const lsm_value_t *low, const lsm_value_t *high, int fromLevel, int toLevel, std::vector<LsmMergeStack> &folded, std::vector<lsm_value_t> *missing)
+{
+    if (empty()) return 0;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    // walk the values and the stacks within the range together, both are sorted
+    std::map<lsm_value_t, LsmMergeStack>::iterator it = low != NULL ? stacks.lower_bound(*low) : stacks.begin();
+    size_t i = 0;
+    long foldedValues = 0;
+    for (; it != stacks.end() && (high == NULL || !(*high < it->first)); ++it)
+    {
+        LsmMergeStack &stack = it->second;
+        if (stack.foldingCount > 0 || stack.depth < fromLevel - 1 || stack.depth >= toLevel) continue;
+        
+        while (i < values.size() && values[i].value < it->first) i++;
+        
+        // the levels the merge clears hold no copy of the record, or the record is not in the Lsm Tree
+        if (i == values.size() || !(values[i].value == it->first))
+        {
+            if (missing == NULL)
+            {
+                stack.depth = toLevel;
+            } else {
+                (*missing).push_back(it->first);
+                stack.depth = toLevel - 1;
+            }
+            continue;
+        }
+        
+        // the copy merged is the newest, the operands are kept until it is written where the lookups find it
+        lsm_value_t record = values[i].value;
+        fold(&record, stack.operands, values[i].value);
+        stack.foldingCount = stack.operands.size();
+        folded.push_back(stack);
+        
+        // the operands merged after the fold are folded into the new copy, no level above the merge holds one
+        folded.back().depth = fromLevel - 1;
+        foldedValues++;
+    }
+    
+    return foldedValues;
+}
+
+/**
+ remove the operands folded by a merge between levels, once the records folded are the newest copies in the
+ levels. The operands merged since the records were folded are kept, and a stack removed by a write since is
+ left as it is. Called between beginApply and endApply
+ 
+ @param folded the stacks folded, as got from foldValues
+ 
+ */
+void LsmMergeOperands::retireFolded(const std::vector<LsmMergeStack> &folded)
+{
+    if (folded.empty()) return;
+    
+    std::lock_guard<std::mutex> guard(operandsMutex);
+    
+    for (size_t i = 0; i < folded.size(); i++)
+    {
+        std::map<lsm_value_t, LsmMergeStack>::iterator it = stacks.find(folded[i].operands.back());
+        if (it == stacks.end() || it->second.foldingCount == 0) continue;
+        
+        LsmMergeStack &stack = it->second;
+        if (stack.operands.size() == stack.foldingCount)
+        {
+            Erase(it);
+            continue;
+        }
+        
+        stack.operands.erase(stack.operands.begin(), stack.operands.begin() + stack.foldingCount);
+        operandsCount -= stack.foldingCount;
+        stack.foldingCount = 0;
+        if (folded[i].depth < stack.depth) stack.depth = folded[i].depth;
+    }
+    foldedCount += folded.size();
+}
+
+/**
+ fold the operands of a record into its value with the merge operator
+ 
+ @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+ @param operands the operands of the record, oldest first
+ @param result set to the folded record
+ @return false if the record is not in the Lsm Tree once folded
+ 
+ */
+bool LsmMergeOperands::fold(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result)const
+{
+    // the merge operator was removed since the operands were written, the newest is the value
+    if (mergeOperator == NULL)
+    {
+        result = operands.back();
+        return true;
+    }
+    
+    if ((*mergeOperator).fullMerge(existing, operands, result)) return true;
+    
+    // the operands can not be folded, they are dropped and the record keeps its value
+    if (existing == NULL) return false;
+    result = *existing;
+    return true;
+}
+
+/**
+ function used to remove a stack, called while the lock is held
+ 
+ @param it the stack to remove
+ 
+ */
+void LsmMergeOperands::Erase(std::map<lsm_value_t, LsmMergeStack>::iterator it)
+{
+    operandsCount -= it->second.operands.size();
+    stacks.erase(it);
+    stacksCount = stacks.size();
+}
@@ -0,0 +1,233 @@
+/**
+ C++11 - GCC Compiler
+ LsmMergeOperands.h
+ 
+ Holds the merge operands of the Lsm Tree, the operands written by merge_value and not yet folded into the
+ records they change. A merge is a blind write, its operand is stacked on the operands of the same record
+ without reading any level, and when the merge operator can combine it with the newest operand of the
+ stack the two are kept as one. Lookups fold the stack of a record into its newest value.
+ 
+ The records are folded without being looked up. Each rolling merge folds the stacks of the records held by
+ c0 and of the records deleted, and the merges between levels fold a stack into its record as the record
+ streams through them, as they drop the values deleted by the tombstones. Each stack records the deepest
+ level merged since it was checked against c0, like a point tombstone, so a merge only folds a record when
+ the levels above it hold no newer copy, and a stack merged past the last level holding values is folded
+ into nothing and written to c0.
+ 
+ A value written or deleted after a merge is newer than its operands, which are removed.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMMERGEOPERANDS_H
+#define LSMMERGEOPERANDS_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "LsmLevelMemory.h"
+#include "LsmMergeOperator.h"
+
+// struct to define the operands stacked on a record, oldest first, and the sequence number of the newest
+struct LsmMergeStack {
+    std::vector<lsm_value_t> operands;  // the operands not yet folded, oldest first
+    long sequence;                      // the sequence number of the newest merge, a newer merge changes it
+    int depth;                          // the deepest level with no copy of the record, -1 until checked against c0
+    size_t foldingCount;                // the oldest operands folded by a merge not yet done, 0 when none are
+};
+
+class LsmMergeOperands {
+public:
+    LsmMergeOperands();
+    
+    /**
+     set the merge operator used to combine the operands stacked on a record
+     
+     @param mergeOperator the merge operator, or NULL to stack every operand as it is
+     
+     */
+    void setMergeOperator(LsmMergeOperator *mergeOperator);
+    
+    /**
+     add an operand to the stack of its record, combined with the newest operand of the stack when the merge
+     operator can do so
+     
+     @param operand the operand
+     @param sequence the sequence number of the merge
+     
+     */
+    void add(const lsm_value_t &operand, long sequence);
+    
+    /**
+     record a value written or deleted, the stack of its record is removed as the write is newer than the
+     operands
+     
+     @param value the value written or deleted
+     
+     */
+    void recordWrite(const lsm_value_t &value);
+    
+    /**
+     record a range deleted, the stacks of the records within it are removed
+     
+     @param low the smallest value deleted
+     @param high the largest value deleted
+     
+     */
+    void recordRangeDelete(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     check whether a record has operands not yet folded
+     
+     @param value the record to check
+     @return true if the record has operands
+     
+     */
+    bool contains(const lsm_value_t &value);
+    
+    /**
+     function used to get the operands stacked on a record
+     
+     @param value the record
+     @param operands the vector the operands are appended to, oldest first
+     @return true if the record has operands
+     
+     */
+    bool get(const lsm_value_t &value, std::vector<lsm_value_t> &operands);
+    
+    /**
+     function used to get a copy of the stacks of the records within a range
+     
+     @param low the smallest record to get
+     @param high the largest record to get
+     @param stacks the vector the stacks are appended to, sorted by record
+     
+     */
+    void getRange(const lsm_value_t &low, const lsm_value_t &high, std::vector<LsmMergeStack> &stacks);
+    
+    /**
+     function used to get a copy of the stacks for a rolling merge to fold, those not yet checked against c0
+     and those merged down past the last level holding values. Called while no merge is running
+     
+     @param pending the vector the stacks are appended to, sorted by record
+     @param lastLevel the level number of the deepest level holding values, 0 if every level is empty
+     
+     */
+    void getPending(std::vector<LsmMergeStack> &pending, int lastLevel);
+    
+    /**
+     remove the stacks folded by a rolling merge. A stack merged to or removed by a write since it was folded
+     is left as it is
+     
+     @param applied the stacks folded, as got from getPending
+     @param foldedCount the number of records the stacks were folded into
+     
+     */
+    void retire(const std::vector<LsmMergeStack> &applied, long foldedCount);
+    
+    /**
+     record the stacks a rolling merge found no copy of the record in c0 for, they are left for the merges
+     between levels to fold
+     
+     @param deferred the stacks, as got from getPending
+     
+     */
+    void defer(const std::vector<LsmMergeStack> &deferred);
+    
+    /**
+     fold the stacks of the records merged between levels into the records, and record the stacks within the
+     range of the merge as merged through the levels the merge clears. A stack is folded only when the levels
+     above those the merge clears hold no copy of its record
+     
+     the stacks folded keep their operands until retireFolded is called, once the folded records are the
+     newest copies in the levels
+     
+     @param values the values merged, sorted by value, the records folded are replaced
+     @param low the smallest value of the range merged, or NULL when the merge takes the whole of the levels
+     @param high the largest value of the range merged, or NULL when the merge takes the whole of the levels
+     @param fromLevel the shallowest level the merge clears, 0 for c0
+     @param toLevel the deepest level the merge clears
+     @param folded the vector the stacks folded are appended to
+     @param missing the vector the records of the stacks within the range with no value merged are appended
+            to, when the deepest level is written without being merged and may hold a copy for the caller to
+            fold, or NULL
+     @return the number of records folded
+     
+     */
+    long foldValues(std::vector<dtype> &values, const lsm_value_t *low, const lsm_value_t *high, int fromLevel, int toLevel, std::vector<LsmMergeStack> &folded, std::vector<lsm_value_t> *missing);
+    
+    /**
+     remove the operands folded by a merge between levels, once the records folded are the newest copies in
+     the levels. The operands merged since the records were folded are kept. Called between beginApply and
+     endApply
+     
+     @param folded the stacks folded, as got from foldValues
+     
+     */
+    void retireFolded(const std::vector<LsmMergeStack> &folded);
+    
+    /**
+     fold the operands of a record into its value with the merge operator
+     
+     @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+     @param operands the operands of the record, oldest first
+     @param result set to the folded record
+     @return false if the record is not in the Lsm Tree once folded
+     
+     */
+    bool fold(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result)const;
+    
+    /**
+     mark the start and end of a merge making folded records the newest copies, in c0 or a level. A lookup
+     that overlaps one is made again, so it does not fold the operands of a record into a value they were
+     already folded into
+     
+     */
+    void beginApply() {generation++;}
+    void endApply() {generation++;}
+    
+    // function used to get the generation, odd while a merge makes folded records the newest copies
+    long getGeneration()const {return generation;}
+    
+    // true if no operand is held, checked without taking the lock
+    bool empty()const {return stacksCount == 0;}
+    
+    // functions used to get the number of operands held, of those combined as they were written, and of the
+    // records the rolling merges have folded
+    long getCount()const {return operandsCount;}
+    long getPartialMergeCount()const {return partialMergeCount;}
+    long getFoldedCount()const {return foldedCount;}
+
+private:
+    
+    // the stacks of operands, by record
+    std::map<lsm_value_t, LsmMergeStack> stacks;
+    
+    // the merge operator, NULL when none is set
+    LsmMergeOperator *mergeOperator;
+    
+    // the number of stacks and of operands, and of the operands combined and the records folded by the rolling
+    // merges and the merges between levels
+    std::atomic<long> stacksCount;
+    std::atomic<long> operandsCount;
+    std::atomic<long> partialMergeCount;
+    std::atomic<long> foldedCount;
+    
+    // the generation of the folded records, odd while a merge makes them the newest copies
+    std::atomic<long> generation;
+    
+    // a mutex used to keep the rolling merges, the writers and the lookups from interleaving
+    std::mutex operandsMutex;
+    
+    /**
+     function used to remove a stack, called while the lock is held
+     
+     @param it the stack to remove
+     
+     */
+    void Erase(std::map<lsm_value_t, LsmMergeStack>::iterator it);
+};
+
+#endif // LSMMERGEOPERANDS_H
@@ -0,0 +1,141 @@
+/**
+ C++11 - GCC Compiler
+ LsmMergeOperator.cpp
+ 
+ Defines the LsmPutMergeOperator, a merge operator keeping the newest operand as the value of a record, and
+ the LsmCounterMergeOperator, a merge operator adding 64 bit counters held in the value of slices, so a
+ counter is incremented with a blind write to the Lsm Tree.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmMergeOperator.h"
+
+#include <string.h>
+
+/**
+ fold the operands into the record by taking the newest operand as its value, so a merge is an insert that
+ does not read the record
+ 
+ @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+ @param operands the operands written to the record since, oldest first
+ @param result set to the newest operand
+ @return false if there are no operands
+ 
+ */
+bool LsmPutMergeOperator::fullMerge(const lsm_value_t * /*existing*/, const std::vector<lsm_value_t> &operands, lsm_value_t &result)
+{
+    if (operands.empty()) return false;
+    
+    result = operands.back();
+    return true;
+}
+
+/**
+ combine two operands by keeping the newer
+ 
+ @param older the operand written first
+ @param newer the operand written second
+ @param result set to the newer operand
+ @return true, the operands can always be combined
+ 
+ */
+bool LsmPutMergeOperator::partialMerge(const lsm_value_t &/*older*/, const lsm_value_t &newer, lsm_value_t &result)
+{
+    result = newer;
+    return true;
+}
+
+#ifdef LSM_SLICE_VALUES
+
+/**
+ add the amounts of the operands to the counter of the record, a record or operand whose value is not a
+ counter counts as 0
+ 
+ @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+ @param operands the amounts to add, oldest first
+ @param result set to the record holding the sum
+ @return false if the key of the record leaves no room for a counter
+ 
+ */
+bool LsmCounterMergeOperator::fullMerge(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result)
+{
+    if (operands.empty()) return false;
+    
+    long counter = existing != NULL ? getCounter(*existing) : 0;
+    for (size_t i = 0; i < operands.size(); i++)
+    {
+        counter += getCounter(operands[i]);
+    }
+    return SetCounter(operands.back(), counter, result);
+}
+
+/**
+ add the amounts of two operands together
+ 
+ @param older the operand written first
+ @param newer the operand written second
+ @param result set to the operand holding the sum
+ @return false if the key of the operand leaves no room for a counter
+ 
+ */
+bool LsmCounterMergeOperator::partialMerge(const lsm_value_t &older, const lsm_value_t &newer, lsm_value_t &result)
+{
+    return SetCounter(newer, getCounter(older) + getCounter(newer), result);
+}
+
+/**
+ function used to make a slice holding a counter in its value
+ 
+ @param key the key of the record
+ @param counter the counter, or the amount to add when the slice is an operand
+ @return the slice
+ 
+ */
+lsm_value_t LsmCounterMergeOperator::makeCounter(const std::string &key, long counter)
+{
+    lsm_value_t slice(key);
+    SetCounter(slice, counter, slice);
+    return slice;
+}
+
+/**
+ function used to get the counter held in the value of a slice
+ 
+ @param slice the slice
+ @return the counter, 0 if the value of the slice is not a counter
+ 
+ */
+long LsmCounterMergeOperator::getCounter(const lsm_value_t &slice)
+{
+    if (slice.valueLength != sizeof(long)) return 0;
+    
+    long counter;
+    memcpy(&counter, slice.data + slice.keyLength, sizeof(long));
+    return counter;
+}
+
+/**
+ function used to set the value of a slice to a counter, the key is kept
+ 
+ @param slice the slice to take the key from
+ @param counter the counter
+ @param result set to the slice holding the counter
+ @return false if the key leaves no room for a counter
+ 
+ */
+bool LsmCounterMergeOperator::SetCounter(const lsm_value_t &slice, long counter, lsm_value_t &result)
+{
+    if (slice.keyLength + sizeof(long) > sizeof(slice.data)) return false;
+    
+    // the bytes after the value are zero filled, so slices holding the same counter are equal byte for byte
+    lsm_value_t counterSlice;
+    counterSlice.keyLength = slice.keyLength;
+    counterSlice.valueLength = sizeof(long);
+    memcpy(counterSlice.data, slice.data, slice.keyLength);
+    memcpy(counterSlice.data + slice.keyLength, &counter, sizeof(long));
+    result = counterSlice;
+    return true;
+}
+
+#endif // LSM_SLICE_VALUES
@@ -0,0 +1,148 @@
+/**
+ C++11 - GCC Compiler
+ LsmMergeOperator.h
+ 
+ Defines the merge operator interface, used by the Lsm Tree to fold the operands written by merge_value
+ into the value of a record without reading the record on the write path. Built with LSM_SLICE_VALUES the
+ key of an operand picks the record it changes and its value holds the change, for example an amount to
+ add to a counter. Operands are folded lazily, by the reads of the record and by the rolling merges, and
+ operands stacked on the same record are combined as they are written when the operator can do so.
+ 
+ An LsmPutMergeOperator is provided which keeps the newest operand as the value of the record, and built
+ with LSM_SLICE_VALUES an LsmCounterMergeOperator which adds 64 bit counters held in the value of slices.
+ The default build has values that are their own keys, a record folded can only be the record itself, so
+ the put operator is the one that works in both builds.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMMERGEOPERATOR_H
+#define LSMMERGEOPERATOR_H
+
+#include <vector>
+
+#include "LsmLevelMemory.h"
+
+class LsmMergeOperator {
+public:
+    virtual ~LsmMergeOperator() {}
+    
+    /**
+     fold the operands written to a record into its value
+     
+     this is called by the reads of the record and by the rolling merges, possibly from several threads at
+     once, so it should not keep state between calls
+     
+     @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+     @param operands the operands written to the record since, oldest first
+     @param result set to the record holding the folded value
+     @return false if the operands can not be folded, the record then keeps its value and the operands
+             are dropped
+     
+     */
+    virtual bool fullMerge(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result) = 0;
+    
+    /**
+     combine two operands written to the same record into one, so a record written many times between two
+     rolling merges holds a single operand
+     
+     @param older the operand written first
+     @param newer the operand written second
+     @param result set to the operand with the effect of both
+     @return false if the operands can not be combined, both are then kept
+     
+     */
+    virtual bool partialMerge(const lsm_value_t &/*older*/, const lsm_value_t &/*newer*/, lsm_value_t &/*result*/) {return false;}
+};
+
+class LsmPutMergeOperator : public LsmMergeOperator {
+public:
+    
+    /**
+     fold the operands into the record by taking the newest operand as its value, so a merge is an insert
+     that does not read the record
+     
+     @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+     @param operands the operands written to the record since, oldest first
+     @param result set to the newest operand
+     @return false if there are no operands
+     
+     */
+    virtual bool fullMerge(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result);
+    
+    /**
+     combine two operands by keeping the newer
+     
+     @param older the operand written first
+     @param newer the operand written second
+     @param result set to the newer operand
+     @return true, the operands can always be combined
+     
+     */
+    virtual bool partialMerge(const lsm_value_t &older, const lsm_value_t &newer, lsm_value_t &result);
+};
+
+#ifdef LSM_SLICE_VALUES
+
+class LsmCounterMergeOperator : public LsmMergeOperator {
+public:
+    
+    /**
+     add the amounts of the operands to the counter of the record, a record or operand whose value is not
+     a counter counts as 0
+     
+     @param existing the newest value of the record, or NULL if the record is not in the Lsm Tree
+     @param operands the amounts to add, oldest first
+     @param result set to the record holding the sum
+     @return false if the key of the record leaves no room for a counter
+     
+     */
+    virtual bool fullMerge(const lsm_value_t *existing, const std::vector<lsm_value_t> &operands, lsm_value_t &result);
+    
+    /**
+     add the amounts of two operands together
+     
+     @param older the operand written first
+     @param newer the operand written second
+     @param result set to the operand holding the sum
+     @return false if the key of the operand leaves no room for a counter
+     
+     */
+    virtual bool partialMerge(const lsm_value_t &older, const lsm_value_t &newer, lsm_value_t &result);
+    
+    /**
+     function used to make a slice holding a counter in its value
+     
+     @param key the key of the record
+     @param counter the counter, or the amount to add when the slice is an operand
+     @return the slice
+     
+     */
+    static lsm_value_t makeCounter(const std::string &key, long counter);
+    
+    /**
+     function used to get the counter held in the value of a slice
+     
+     @param slice the slice
+     @return the counter, 0 if the value of the slice is not a counter
+     
+     */
+    static long getCounter(const lsm_value_t &slice);
+
+private:
+    
+    /**
+     function used to set the value of a slice to a counter, the key is kept
+     
+     @param slice the slice to take the key from
+     @param counter the counter
+     @param result set to the slice holding the counter
+     @return false if the key leaves no room for a counter
+     
+     */
+    static bool SetCounter(const lsm_value_t &slice, long counter, lsm_value_t &result);
+};
+
+#endif // LSM_SLICE_VALUES
+
+#endif // LSMMERGEOPERATOR_H
@@ -0,0 +1,104 @@
+/**
+ C++11 - GCC Compiler
+ LsmPointFilter.cpp
+ 
+ Defines a point Bloom filter, used by the levels to answer whether they may hold a value without reading
+ the level. The filter holds every value added, and is sized by the filter bits the tuner gives the level.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmPointFilter.h"
+
+#include <math.h>
+
+LsmPointFilter::LsmPointFilter()
+{
+    hashesCount = 0;
+}
+
+/**
+ clear the filter and size it for a number of values, a filter given no bits per value is left empty
+ 
+ @param expectedValues the number of values expected to be added
+ @param bitsPerKey the filter bits for each value
+ 
+ */
+void LsmPointFilter::reset(long expectedValues, double bitsPerKey)
+{
+    words.clear();
+    hashesCount = 0;
+    if (bitsPerKey <= 0) return;
+    
+    long bits = (long) ((expectedValues > 0 ? expectedValues : 1) * bitsPerKey);
+    words.assign((bits + 63) / 64, 0);
+    
+    // the number of bits set for each value with the fewest false positives is bitsPerKey * ln(2)
+    hashesCount = lround(bitsPerKey * log(2.0));
+    if (hashesCount < 1) hashesCount = 1;
+    if (hashesCount > POINT_FILTER_MAX_HASHES) hashesCount = POINT_FILTER_MAX_HASHES;
+}
+
+/**
+ add a value to the filter, the bits are picked by double hashing the two halves of the hash
+ 
+ @param value the value to add
+ 
+ */
+void LsmPointFilter::add(const lsm_value_t &value)
+{
+    if (words.empty()) return;
+    
+    unsigned long hash = ValueHash(value);
+    unsigned long bitsCount = words.size() * 64;
+    unsigned long step = (hash >> 32) | 1;
+    for (long i = 0; i < hashesCount; i++, hash += step)
+    {
+        unsigned long bit = hash % bitsCount;
+        words[bit / 64] |= 1UL << (bit % 64);
+    }
+}
+
+/**
+ check whether a value may have been added to the filter
+ 
+ @param value the value to check
+ @return false if the value was not added, true if it may have been or the filter is empty
+ 
+ */
+bool LsmPointFilter::mayContain(const lsm_value_t &value)const
+{
+    if (words.empty()) return true;
+    
+    unsigned long hash = ValueHash(value);
+    unsigned long bitsCount = words.size() * 64;
+    unsigned long step = (hash >> 32) | 1;
+    for (long i = 0; i < hashesCount; i++, hash += step)
+    {
+        unsigned long bit = hash % bitsCount;
+        if ((words[bit / 64] & (1UL << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
+
+/**
+ function used to hash a value, a slice is hashed by its key as slices are equal when their keys are
+ 
+ @param value the value
+ @return the hash of the value
+ 
+ */
+unsigned long LsmPointFilter::ValueHash(const lsm_value_t &value)
+{
+#ifdef LSM_SLICE_VALUES
+    // FNV-1a over the bytes of the key, then mixed so both halves of the hash are spread
+    unsigned long hash = 0xcbf29ce484222325UL;
+    for (int i = 0; i < value.keyLength; i++)
+    {
+        hash = (hash ^ (unsigned char) value.data[i]) * 0x100000001b3UL;
+    }
+    return LsmMixBits(hash);
+#else
+    return LsmMixBits((unsigned long) value);
+#endif // LSM_SLICE_VALUES
+}
@@ -0,0 +1,84 @@
+/**
+ C++11 - GCC Compiler
+ LsmPointFilter.h
+ 
+ Defines a point Bloom filter, used by the levels to answer whether they may hold a value without reading
+ the level. The filter holds every value added - the whole value, or the key of a slice - so a lookup of a
+ value a sorted run or level does not hold reads no page or node, except for the false positives.
+ 
+ The filter is sized by a number of bits per value, the filter memory the tuner gives each level. A level
+ given more bits per value has fewer false positives, about e^(-bitsPerKey * ln(2)^2) of the lookups for
+ values it does not hold, and a level given no bits has no filter.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMPOINTFILTER_H
+#define LSMPOINTFILTER_H
+
+#include <vector>
+
+#include "LsmRangeFilter.h"
+
+// the largest number of bits set for each value, reached with about 43 bits per value
+#define POINT_FILTER_MAX_HASHES 30
+
+class LsmPointFilter {
+public:
+    LsmPointFilter();
+    
+    /**
+     clear the filter and size it for a number of values, a filter given no bits per value is left empty
+     
+     @param expectedValues the number of values expected to be added
+     @param bitsPerKey the filter bits for each value
+     
+     */
+    void reset(long expectedValues, double bitsPerKey);
+    
+    /**
+     add a value to the filter
+     
+     @param value the value to add
+     
+     */
+    void add(const lsm_value_t &value);
+    
+    /**
+     check whether a value may have been added to the filter
+     
+     @param value the value to check
+     @return false if the value was not added, true if it may have been or the filter is empty
+     
+     */
+    bool mayContain(const lsm_value_t &value)const;
+    
+    // true if the filter was never sized, it may hold any value
+    bool empty()const {return words.empty();}
+    
+    // the bits of the filter, used to write the filter to disk and read it back
+    std::vector<unsigned long> &getWords() {return words;}
+    
+    // the number of bits set for each value, written to disk with the filter
+    long getHashesCount()const {return hashesCount;}
+    void setHashesCount(long hashesCount) {LsmPointFilter::hashesCount = hashesCount;}
+
+private:
+    
+    // the bits of the filter, 64 bits to a word
+    std::vector<unsigned long> words;
+    
+    // the number of bits set for each value
+    long hashesCount;
+    
+    /**
+     function used to hash a value, a slice is hashed by its key as slices are equal when their keys are
+     
+     @param value the value
+     @return the hash of the value
+     
+     */
+    static unsigned long ValueHash(const lsm_value_t &value);
+};
+
+#endif // LSMPOINTFILTER_H
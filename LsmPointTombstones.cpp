@@ -0,0 +1,230 @@
+/**
+ C++11 - GCC Compiler
+ LsmPointTombstones.cpp
+ 
+ Holds the point tombstones of the Lsm Tree, the values deleted or replaced by an update whose older copies
+ may still be in the disk levels. Deletes are blind writes, the rolling merges drop the copies from the
+ values they merge, and a point tombstone is retired once it is merged down to the last level. The point
+ tombstones held when the Lsm Tree is closed are written to a file and read back when it is opened.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmPointTombstones.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+
+// the signature written to the header of the point tombstones file, used to verify the file format
+#define POINT_TOMBSTONES_SIGNATURE 0x4C534D44454C31L
+
+LsmPointTombstones::LsmPointTombstones()
+{
+    tombstonesCount = 0;
+    droppedCount = 0;
+    retiredCount = 0;
+}
+
+/**
+ add a point tombstone, replacing an older one of the same value. The levels cleared of the value since the
+ older delete stay clear
+ 
+ @param value the value deleted
+ @param sequence the sequence number of the delete
+ 
+ */
+void LsmPointTombstones::add(const lsm_value_t &value, long sequence)
+{
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    
+    // a new point tombstone is only known to be clear of c0, where the blind delete removed the value
+    std::map<lsm_value_t, LsmPointTombstone>::iterator it = tombstones.find(value);
+    if (it == tombstones.end())
+    {
+        LsmPointTombstone tombstone;
+        tombstone.depth = 0;
+        it = tombstones.insert(std::make_pair(value, tombstone)).first;
+    }
+    it->second.sequence = sequence;
+    tombstonesCount = tombstones.size();
+}
+
+/**
+ record a value written to the Lsm Tree, the point tombstone of the value is removed as the write is newer
+ than the delete
+ 
+ @param value the value written
+ 
+ */
+void LsmPointTombstones::recordWrite(const lsm_value_t &value)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    tombstones.erase(value);
+    tombstonesCount = tombstones.size();
+}
+
+/**
+ check whether a value is deleted by a point tombstone
+ 
+ @param value the value to check
+ @return true if the value was deleted and not written since
+ 
+ */
+bool LsmPointTombstones::isDeleted(const lsm_value_t &value)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    return tombstones.find(value) != tombstones.end();
+}
+
+/**
+ remove the values deleted by a point tombstone from sorted values merged between levels, and record the
+ point tombstones within the range of the merge as merged through the levels the merge clears. A point
+ tombstone is moved down only when the levels above those the merge clears are already clear of its value
+ 
+ @param values the values merged, sorted by value
+ @param low the smallest value of the range merged, or NULL when the merge takes the whole of the levels
+ @param high the largest value of the range merged, or NULL when the merge takes the whole of the levels
+ @param fromLevel the shallowest level the merge clears, 0 for c0
+ @param toLevel the deepest level the merge clears
+ @param deleted the vector the values of the point tombstones within the range not yet merged through the
+ deepest level are appended to, or NULL
+ @return the number of values removed
+ 
+ */
+long LsmPointTombstones::filter(std::vector<dtype> &values, const lsm_value_t *low, const lsm_value_t *high, int fromLevel, int toLevel, std::vector<lsm_value_t> *deleted)
+{
+    if (empty()) return 0;
+    
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    
+    // walk the values and the point tombstones together, both are sorted
+    std::map<lsm_value_t, LsmPointTombstone>::iterator it = values.empty() ? tombstones.end() : tombstones.lower_bound(values.front().value);
+    size_t kept = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        while (it != tombstones.end() && it->first < values[i].value) ++it;
+        if (it != tombstones.end() && it->first == values[i].value) continue;
+        
+        values[kept++] = values[i];
+    }
+    long removed = values.size() - kept;
+    values.resize(kept);
+    droppedCount += removed;
+    
+    // the values deleted within the range have no copy left in the levels the merge clears
+    it = low != NULL ? tombstones.lower_bound(*low) : tombstones.begin();
+    for (; it != tombstones.end() && (high == NULL || !(*high < it->first)); ++it)
+    {
+        LsmPointTombstone &tombstone = it->second;
+        if (tombstone.depth >= toLevel) continue;
+        
+        if (deleted != NULL) (*deleted).push_back(it->first);
+        if (tombstone.depth >= fromLevel - 1) tombstone.depth = toLevel;
+    }
+    
+    return removed;
+}
+
+/**
+ remove the point tombstones merged down to the last level holding values, no level holds an older copy of
+ their values. Called while no merge is running
+ 
+ @param lastLevel the level number of the deepest level holding values, 0 if every level is empty
+ 
+ */
+void LsmPointTombstones::retire(int lastLevel)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    
+    std::map<lsm_value_t, LsmPointTombstone>::iterator it = tombstones.begin();
+    while (it != tombstones.end())
+    {
+        if (it->second.depth < lastLevel)
+        {
+            ++it;
+            continue;
+        }
+        
+        tombstones.erase(it++);
+        retiredCount++;
+    }
+    tombstonesCount = tombstones.size();
+}
+
+
+/**
+ read the point tombstones written when the Lsm Tree was last closed, if the file exists
+ 
+ @param fileName the name of the point tombstones file
+ 
+ */
+void LsmPointTombstones::open(const std::string &fileName)
+{
+    std::ifstream tombstonesFile(fileName.c_str(), std::ios::in | std::ios::binary);
+    if (!tombstonesFile.is_open()) return;
+    
+    point_tombstones_header header;
+    tombstonesFile.read((char*)&header, sizeof(point_tombstones_header));
+    
+    // verify the file format by checking the signature
+    if (!tombstonesFile || header.signature != POINT_TOMBSTONES_SIGNATURE)
+    {
+        // alert the file does not contain the signature
+        std::cout << "Wrong file format.\n"; exit(1);
+    }
+    
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    for (long i = 0; i < header.tombstonesCount; i++)
+    {
+        lsm_value_t value;
+        LsmPointTombstone tombstone;
+        tombstonesFile.read((char*)&value, sizeof(lsm_value_t));
+        tombstonesFile.read((char*)&tombstone, sizeof(LsmPointTombstone));
+        tombstones[value] = tombstone;
+    }
+    tombstonesCount = tombstones.size();
+}
+
+/**
+ write the point tombstones held to a file, read back by open when the Lsm Tree is opened again. The file
+ is removed when no point tombstone is held. Called while no merge is running
+ 
+ @param fileName the name of the point tombstones file
+ 
+ */
+void LsmPointTombstones::write(const std::string &fileName)
+{
+    std::lock_guard<std::mutex> guard(tombstonesMutex);
+    if (tombstones.empty())
+    {
+        remove(fileName.c_str());
+        return;
+    }
+    
+    point_tombstones_header header;
+    header.signature = POINT_TOMBSTONES_SIGNATURE;
+    header.tombstonesCount = tombstones.size();
+    
+    // write the new file beside the old one and rename it over the old one once it is complete
+    std::string tempFileName = fileName + ".tmp";
+    std::ofstream tombstonesFile(tempFileName.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    tombstonesFile.write((char*)&header, sizeof(point_tombstones_header));
+    
+    std::map<lsm_value_t, LsmPointTombstone>::const_iterator it;
+    for (it = tombstones.begin(); it != tombstones.end(); ++it)
+    {
+        tombstonesFile.write((char*)&it->first, sizeof(lsm_value_t));
+        tombstonesFile.write((char*)&it->second, sizeof(LsmPointTombstone));
+    }
+    tombstonesFile.close();
+    
+    rename(tempFileName.c_str(), fileName.c_str());
+}
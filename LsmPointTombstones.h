@@ -0,0 +1,151 @@
+/**
+ C++11 - GCC Compiler
+ LsmPointTombstones.h
+ 
+ Holds the point tombstones of the Lsm Tree, the values deleted or replaced by an update whose older copies
+ may still be in the disk levels. A delete is a blind write, it removes the value from c0 and records a
+ point tombstone without reading any level. Lookups and scans hide the values a point tombstone covers,
+ the newest write of a value shadowing the copies below it, and the rolling merges drop the copies from
+ the values they merge, as they do for the range tombstones.
+ 
+ Each point tombstone records the deepest level its older copies have been merged out of, with every level
+ above it. A merge moves it down a level or two only when the levels above the ones it merges are already
+ clear of the value, and it is retired once it reaches the last level holding values.
+ 
+ A value written after it was deleted is newer than the point tombstone, which is removed so the value is
+ seen again.
+ 
+ The point tombstones held when the Lsm Tree is closed are written to a file and read back when it is
+ opened again, the older copies they hide are still in the levels.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMPOINTTOMBSTONES_H
+#define LSMPOINTTOMBSTONES_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LsmLevelMemory.h"
+
+// struct to define a point tombstone, the sequence number of the delete and the levels clear of the value
+struct LsmPointTombstone {
+    long sequence;  // the sequence number of the delete, a newer delete of the value replaces it
+    int depth;      // the deepest level merged since the delete, it and every level above it hold no copy
+};
+
+// struct to define the header written at the beginning of the point tombstones file, each value deleted
+// and its point tombstone are written after it
+struct point_tombstones_header {
+    long signature;        // used to verify the file holds point tombstones
+    long tombstonesCount;  // the number of point tombstones in the file
+};
+
+class LsmPointTombstones {
+public:
+    LsmPointTombstones();
+    
+    /**
+     add a point tombstone, replacing an older one of the same value. The levels cleared of the value since
+     the older delete stay clear
+     
+     @param value the value deleted
+     @param sequence the sequence number of the delete
+     
+     */
+    void add(const lsm_value_t &value, long sequence);
+    
+    /**
+     record a value written to the Lsm Tree, the point tombstone of the value is removed as the write is
+     newer than the delete
+     
+     @param value the value written
+     
+     */
+    void recordWrite(const lsm_value_t &value);
+    
+    /**
+     check whether a value is deleted by a point tombstone
+     
+     @param value the value to check
+     @return true if the value was deleted and not written since
+     
+     */
+    bool isDeleted(const lsm_value_t &value);
+    
+    /**
+     remove the values deleted by a point tombstone from sorted values merged between levels, and record the
+     point tombstones within the range of the merge as merged through the levels the merge clears
+     
+     a merge clears a level of a value when every copy of the value in the level is among the values
+     merged, the level then holds no copy once the merge is done
+     
+     @param values the values merged, sorted by value
+     @param low the smallest value of the range merged, or NULL when the merge takes the whole of the levels
+     @param high the largest value of the range merged, or NULL when the merge takes the whole of the levels
+     @param fromLevel the shallowest level the merge clears, 0 for c0
+     @param toLevel the deepest level the merge clears
+     @param deleted the vector the values of the point tombstones within the range not yet merged through
+     the deepest level are appended to, or NULL
+     @return the number of values removed
+     
+     */
+    long filter(std::vector<dtype> &values, const lsm_value_t *low, const lsm_value_t *high, int fromLevel, int toLevel, std::vector<lsm_value_t> *deleted);
+    
+    /**
+     remove the point tombstones merged down to the last level holding values, no level holds an older
+     copy of their values. Called while no merge is running
+     
+     @param lastLevel the level number of the deepest level holding values, 0 if every level is empty
+     
+     */
+    void retire(int lastLevel);
+    
+    /**
+     read the point tombstones written when the Lsm Tree was last closed, if the file exists
+     
+     @param fileName the name of the point tombstones file
+     
+     */
+    void open(const std::string &fileName);
+    
+    /**
+     write the point tombstones held to a file, read back by open when the Lsm Tree is opened again. The
+     file is removed when no point tombstone is held. Called while no merge is running
+     
+     @param fileName the name of the point tombstones file
+     
+     */
+    void write(const std::string &fileName);
+    
+    // true if no point tombstone is held, checked without taking the lock
+    bool empty()const {return tombstonesCount == 0;}
+    
+    // function used to get the number of point tombstones held
+    long getCount()const {return tombstonesCount;}
+    
+    // functions used to get the number of values the rolling merges have dropped, and of the point
+    // tombstones retired
+    long getDroppedCount()const {return droppedCount;}
+    long getRetiredCount()const {return retiredCount;}
+
+private:
+    
+    // the point tombstones, by value deleted
+    std::map<lsm_value_t, LsmPointTombstone> tombstones;
+    
+    // the number of point tombstones, of the values dropped by the rolling merges and of the point
+    // tombstones retired
+    std::atomic<long> tombstonesCount;
+    std::atomic<long> droppedCount;
+    std::atomic<long> retiredCount;
+    
+    // a mutex used to keep the rolling merges, the writers and the lookups from interleaving
+    std::mutex tombstonesMutex;
+};
+
+#endif // LSMPOINTTOMBSTONES_H
@@ -0,0 +1,175 @@
+/**
+ C++11 - GCC Compiler
+ LsmRangeFilter.cpp
+ 
+ Defines a prefix Bloom filter, used by the levels to answer whether a range of values may hold any of
+ their values without reading the level. The filter holds the prefix of every value added, and a short
+ range is checked by probing each prefix it spans.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmRangeFilter.h"
+
+#include <string.h>
+
+#ifdef LSM_SLICE_VALUES
+
+/**
+ check whether two slices have the same prefix, a slice whose key is too short has none
+ 
+ @param a the first slice
+ @param b the second slice
+ @return true if both slices have a prefix and the prefixes are equal
+ 
+ */
+static inline bool SamePrefix(const lsm_value_t &a, const lsm_value_t &b)
+{
+    if (a.keyLength < RANGE_FILTER_PREFIX_BYTES || b.keyLength < RANGE_FILTER_PREFIX_BYTES) return false;
+    return memcmp(a.data, b.data, RANGE_FILTER_PREFIX_BYTES) == 0;
+}
+
+#else
+
+// check whether two values have the same prefix, the values without their low bits
+static inline bool SamePrefix(const lsm_value_t &a, const lsm_value_t &b)
+{
+    return (a >> RANGE_FILTER_PREFIX_BITS) == (b >> RANGE_FILTER_PREFIX_BITS);
+}
+
+#endif // LSM_SLICE_VALUES
+
+LsmRangeFilter::LsmRangeFilter()
+{
+}
+
+/**
+ clear the filter and size it for a number of prefixes
+ 
+ @param expectedPrefixes the number of different prefixes expected to be added
+ 
+ */
+void LsmRangeFilter::reset(long expectedPrefixes)
+{
+    long bits = (expectedPrefixes > 0 ? expectedPrefixes : 1) * RANGE_FILTER_BITS_PER_PREFIX;
+    words.assign((bits + 63) / 64, 0);
+}
+
+/**
+ add the prefix of a value to the filter
+ 
+ @param value the value to add
+ 
+ */
+void LsmRangeFilter::add(const lsm_value_t &value)
+{
+    unsigned long hash;
+    if (!words.empty() && PrefixHash(value, hash)) SetBits(hash);
+}
+
+/**
+ check whether any value added to the filter may be within a range
+ 
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if no value added is within the range, true if one may be or the filter is empty
+ 
+ */
+bool LsmRangeFilter::mayContainRange(const lsm_value_t &low, const lsm_value_t &high)const
+{
+    if (words.empty()) return true;
+    if (high < low) return false;
+
+#ifdef LSM_SLICE_VALUES
+    // every key between two keys sharing a prefix has the prefix, other ranges can not be checked
+    unsigned long hash;
+    if (!SamePrefix(low, high) || !PrefixHash(low, hash)) return true;
+    return TestBits(hash);
+#else
+    // probe each prefix the range spans, the range may hold a value if any of them was added
+    long first = low >> RANGE_FILTER_PREFIX_BITS;
+    long last = high >> RANGE_FILTER_PREFIX_BITS;
+    if ((unsigned long) last - (unsigned long) first >= RANGE_FILTER_MAX_PROBES) return true;
+    
+    for (long prefix = first; ; prefix++)
+    {
+        if (TestBits(LsmMixBits((unsigned long) prefix))) return true;
+        if (prefix == last) return false;
+    }
+#endif // LSM_SLICE_VALUES
+}
+
+/**
+ function used to count the different prefixes of sorted values, to size a filter for them
+ 
+ @param values the values, sorted by value
+ @param first the position in values of the first value to count
+ @param last the position in values after the last value to count
+ @return the number of different prefixes
+ 
+ */
+long LsmRangeFilter::countPrefixes(const std::vector<dtype> &values, long first, long last)
+{
+    // values sharing a prefix are next to each other once sorted
+    long count = 0;
+    for (long i = first; i < last; i++)
+    {
+        if (i == first || !SamePrefix(values[i - 1].value, values[i].value)) count++;
+    }
+    return count;
+}
+
+/**
+ function used to hash the prefix of a value
+ 
+ @param value the value
+ @param hash the hash of the prefix of the value
+ @return false if the value has no prefix, a slice whose key is too short
+ 
+ */
+bool LsmRangeFilter::PrefixHash(const lsm_value_t &value, unsigned long &hash)
+{
+#ifdef LSM_SLICE_VALUES
+    if (value.keyLength < RANGE_FILTER_PREFIX_BYTES) return false;
+    
+    unsigned long prefix = 0;
+    for (int i = 0; i < RANGE_FILTER_PREFIX_BYTES; i++)
+    {
+        prefix = (prefix << 8) | (unsigned char) value.data[i];
+    }
+    hash = LsmMixBits(prefix);
+#else
+    hash = LsmMixBits((unsigned long) (value >> RANGE_FILTER_PREFIX_BITS));
+#endif // LSM_SLICE_VALUES
+    return true;
+}
+
+/**
+ functions used to set and check the bits of a prefix hash, the bits are picked by double hashing the
+ two halves of the hash
+ 
+ @param hash the hash of the prefix
+ 
+ */
+void LsmRangeFilter::SetBits(unsigned long hash)
+{
+    unsigned long bitsCount = words.size() * 64;
+    unsigned long step = (hash >> 32) | 1;
+    for (int i = 0; i < RANGE_FILTER_HASHES; i++, hash += step)
+    {
+        unsigned long bit = hash % bitsCount;
+        words[bit / 64] |= 1UL << (bit % 64);
+    }
+}
+
+bool LsmRangeFilter::TestBits(unsigned long hash)const
+{
+    unsigned long bitsCount = words.size() * 64;
+    unsigned long step = (hash >> 32) | 1;
+    for (int i = 0; i < RANGE_FILTER_HASHES; i++, hash += step)
+    {
+        unsigned long bit = hash % bitsCount;
+        if ((words[bit / 64] & (1UL << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
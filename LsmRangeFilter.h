@@ -0,0 +1,125 @@
+/**
+ C++11 - GCC Compiler
+ LsmRangeFilter.h
+ 
+ Defines a prefix Bloom filter, used by the levels to answer whether a range of values may hold any of
+ their values without reading the level. The filter holds the prefix of every value added - the value
+ without its RANGE_FILTER_PREFIX_BITS lowest bits, or the first RANGE_FILTER_PREFIX_BYTES bytes of the key
+ of a slice. A short range is checked by probing each prefix it spans, so a scan skips the sorted runs and
+ levels holding no value near the range. A range spanning more than RANGE_FILTER_MAX_PROBES prefixes, or
+ slices not sharing a prefix, may always hold values.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMRANGEFILTER_H
+#define LSMRANGEFILTER_H
+
+#include <vector>
+
+#include "LsmLevelMemory.h"
+
+// the number of low bits dropped from a value to get its prefix, values sharing the rest share a prefix
+#define RANGE_FILTER_PREFIX_BITS 8
+
+// the number of bytes of the key of a slice making up its prefix, shorter keys have no prefix
+#define RANGE_FILTER_PREFIX_BYTES 4
+
+// the number of filter bits for each prefix and the number of bits set for each prefix
+#define RANGE_FILTER_BITS_PER_PREFIX 10
+#define RANGE_FILTER_HASHES 6
+
+// the largest number of prefixes a range is checked by, a longer range may always hold values
+#define RANGE_FILTER_MAX_PROBES 16
+
+/**
+ mix the bits of a number so every bit of the result depends on every bit of the number, used to hash the
+ values added to the range and point filters
+ 
+ @param number the number to mix
+ @return the mixed number
+ 
+ */
+inline unsigned long LsmMixBits(unsigned long number)
+{
+    number ^= number >> 33;
+    number *= 0xff51afd7ed558ccdUL;
+    number ^= number >> 33;
+    number *= 0xc4ceb9fe1a85ec53UL;
+    number ^= number >> 33;
+    return number;
+}
+
+class LsmRangeFilter {
+public:
+    LsmRangeFilter();
+    
+    /**
+     clear the filter and size it for a number of prefixes
+     
+     @param expectedPrefixes the number of different prefixes expected to be added
+     
+     */
+    void reset(long expectedPrefixes);
+    
+    /**
+     add the prefix of a value to the filter
+     
+     @param value the value to add
+     
+     */
+    void add(const lsm_value_t &value);
+    
+    /**
+     check whether any value added to the filter may be within a range
+     
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if no value added is within the range, true if one may be or the filter is empty
+     
+     */
+    bool mayContainRange(const lsm_value_t &low, const lsm_value_t &high)const;
+    
+    /**
+     function used to count the different prefixes of sorted values, to size a filter for them
+     
+     @param values the values, sorted by value
+     @param first the position in values of the first value to count
+     @param last the position in values after the last value to count
+     @return the number of different prefixes
+     
+     */
+    static long countPrefixes(const std::vector<dtype> &values, long first, long last);
+    
+    // true if the filter was never sized, it may hold any value
+    bool empty()const {return words.empty();}
+    
+    // the bits of the filter, used to write the filter to disk and read it back
+    std::vector<unsigned long> &getWords() {return words;}
+
+private:
+    
+    // the bits of the filter, 64 bits to a word
+    std::vector<unsigned long> words;
+    
+    /**
+     function used to hash the prefix of a value
+     
+     @param value the value
+     @param hash the hash of the prefix of the value
+     @return false if the value has no prefix, a slice whose key is too short
+     
+     */
+    static bool PrefixHash(const lsm_value_t &value, unsigned long &hash);
+    
+    /**
+     functions used to set and check the bits of a prefix hash
+     
+     @param hash the hash of the prefix
+     
+     */
+    void SetBits(unsigned long hash);
+    bool TestBits(unsigned long hash)const;
+};
+
+#endif // LSMRANGEFILTER_H
@@ -0,0 +1,168 @@
+/**
+ C++11 - GCC Compiler
+ LsmRangeTombstones.cpp
+ 
+ Holds the range tombstones of the Lsm Tree, each marking every value between a low and a high value as
+ deleted with a single entry, so a key range is deleted without searching or rewriting the levels.
+ Lookups and scans hide the values a range tombstone covers, and the rolling merges drop them as they
+ rewrite the levels, so the disk space is given back over the following merges.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmRangeTombstones.h"
+
+#include <algorithm>
+
+LsmRangeTombstones::LsmRangeTombstones()
+{
+    rangesCount = 0;
+    droppedCount = 0;
+}
+
+/**
+ add a range tombstone, overlapping range tombstones are joined into one
+ 
+ @param low the smallest value to delete
+ @param high the largest value to delete
+ 
+ */
+void LsmRangeTombstones::add(const lsm_value_t &low, const lsm_value_t &high)
+{
+    if (high < low) return;
+    
+    std::lock_guard<std::mutex> guard(rangesMutex);
+    
+    LsmRangeTombstone added;
+    added.low = low;
+    added.high = high;
+    
+    // join the range tombstones overlapping the new one, they are contiguous since the ranges are sorted
+    size_t first = 0;
+    while (first < ranges.size() && ranges[first].high < low) first++;
+    size_t last = first;
+    while (last < ranges.size() && !(high < ranges[last].low))
+    {
+        if (ranges[last].low < added.low) added.low = ranges[last].low;
+        if (added.high < ranges[last].high) added.high = ranges[last].high;
+        last++;
+    }
+    ranges.erase(ranges.begin() + first, ranges.begin() + last);
+    ranges.insert(ranges.begin() + first, added);
+    rangesCount = ranges.size();
+    
+    // the values written before now are deleted again
+    rewritten.erase(rewritten.lower_bound(low), rewritten.upper_bound(high));
+}
+
+/**
+ record a value written to the Lsm Tree, a value covered by a range tombstone is recorded as rewritten so
+ the range tombstone no longer hides it
+ 
+ @param value the value written
+ 
+ */
+void LsmRangeTombstones::recordWrite(const lsm_value_t &value)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(rangesMutex);
+    if (RangeSearch(value) < ranges.size()) rewritten.insert(value);
+}
+
+/**
+ check whether a value is deleted by a range tombstone
+ 
+ @param value the value to check
+ @return true if a range tombstone covers the value and it was not written since
+ 
+ */
+bool LsmRangeTombstones::isDeleted(const lsm_value_t &value)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(rangesMutex);
+    return IsDeleted(value);
+}
+
+/**
+ remove the values deleted by a range tombstone from sorted values, used by the rolling merges to drop the
+ deleted values as they rewrite a level
+ 
+ @param values the values, sorted by value
+ @return the number of values removed
+ 
+ */
+long LsmRangeTombstones::filter(std::vector<dtype> &values)
+{
+    if (empty() || values.empty()) return 0;
+    
+    std::lock_guard<std::mutex> guard(rangesMutex);
+    
+    // the values and the ranges are both sorted, so they are walked together
+    size_t range = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        while (range < ranges.size() && ranges[range].high < values[i].value) range++;
+        
+        bool isCovered = range < ranges.size() && !(values[i].value < ranges[range].low);
+        if (isCovered && rewritten.find(values[i].value) == rewritten.end()) continue;
+        
+        values[kept++] = values[i];
+    }
+    
+    long removed = values.size() - kept;
+    values.resize(kept);
+    droppedCount += removed;
+    return removed;
+}
+
+/**
+ check whether a rolling merge moving a value should drop it, used where the values moved are not sorted
+ 
+ @param value the value moved
+ @return true if the value is deleted by a range tombstone and is counted as dropped
+ 
+ */
+bool LsmRangeTombstones::drop(const lsm_value_t &value)
+{
+    if (!isDeleted(value)) return false;
+    
+    droppedCount++;
+    return true;
+}
+
+/**
+ function used to find the range tombstone covering a value, called with the lock held
+ 
+ @param value the value to find
+ @return the position of the range tombstone, or ranges.size() if there is none
+ 
+ */
+size_t LsmRangeTombstones::RangeSearch(const lsm_value_t &value)const
+{
+    // the first range whose high value is not less than the value, the only one that can cover it
+    size_t low = 0, high = ranges.size();
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (ranges[middle].high < value) low = middle + 1;
+        else high = middle;
+    }
+    
+    if (low < ranges.size() && !(value < ranges[low].low)) return low;
+    return ranges.size();
+}
+
+/**
+ function used to check whether a value is deleted, called with the lock held
+ 
+ @param value the value to check
+ @return true if a range tombstone covers the value and it was not written since
+ 
+ */
+bool LsmRangeTombstones::IsDeleted(const lsm_value_t &value)const
+{
+    return RangeSearch(value) < ranges.size() && rewritten.find(value) == rewritten.end();
+}
@@ -0,0 +1,125 @@
+/**
+ C++11 - GCC Compiler
+ LsmRangeTombstones.h
+ 
+ Holds the range tombstones of the Lsm Tree, each marking every value between a low and a high value as
+ deleted with a single entry, so a key range is deleted without searching or rewriting the levels.
+ Lookups and scans hide the values a range tombstone covers, and the rolling merges drop them as they
+ rewrite the levels, so the disk space is given back over the following merges.
+ 
+ A value written after a range tombstone covering it is recorded as rewritten, and is not hidden or
+ dropped until another range tombstone covers it.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMRANGETOMBSTONES_H
+#define LSMRANGETOMBSTONES_H
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "LsmLevelMemory.h"
+
+// struct to define a range tombstone, every value from low to high, inclusive, is deleted
+struct LsmRangeTombstone {
+    lsm_value_t low;   // the smallest value deleted
+    lsm_value_t high;  // the largest value deleted
+};
+
+class LsmRangeTombstones {
+public:
+    LsmRangeTombstones();
+    
+    /**
+     add a range tombstone, overlapping range tombstones are joined into one
+     
+     @param low the smallest value to delete
+     @param high the largest value to delete
+     
+     */
+    void add(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     record a value written to the Lsm Tree, a value covered by a range tombstone is recorded as rewritten
+     so the range tombstone no longer hides it
+     
+     @param value the value written
+     
+     */
+    void recordWrite(const lsm_value_t &value);
+    
+    /**
+     check whether a value is deleted by a range tombstone
+     
+     @param value the value to check
+     @return true if a range tombstone covers the value and it was not written since
+     
+     */
+    bool isDeleted(const lsm_value_t &value);
+    
+    /**
+     remove the values deleted by a range tombstone from sorted values, used by the rolling merges to drop
+     the deleted values as they rewrite a level
+     
+     @param values the values, sorted by value
+     @return the number of values removed
+     
+     */
+    long filter(std::vector<dtype> &values);
+    
+    /**
+     check whether a rolling merge moving a value should drop it, used where the values moved are not sorted
+     
+     @param value the value moved
+     @return true if the value is deleted by a range tombstone and is counted as dropped
+     
+     */
+    bool drop(const lsm_value_t &value);
+    
+    // true if no range tombstone is held, checked without taking the lock
+    bool empty()const {return rangesCount == 0;}
+    
+    // function used to get the number of range tombstones held
+    long getRangesCount()const {return rangesCount;}
+    
+    // function used to get the number of deleted values the rolling merges have dropped
+    long getDroppedCount()const {return droppedCount;}
+
+private:
+    
+    // the range tombstones, sorted by their low value and not overlapping each other
+    std::vector<LsmRangeTombstone> ranges;
+    
+    // the values written since a range tombstone covering them was added
+    std::set<lsm_value_t> rewritten;
+    
+    // the number of range tombstones, and of the values dropped by the rolling merges
+    std::atomic<long> rangesCount;
+    std::atomic<long> droppedCount;
+    
+    // a mutex used to keep the rolling merge threads and the writers from interleaving
+    std::mutex rangesMutex;
+    
+    /**
+     function used to find the range tombstone covering a value, called with the lock held
+     
+     @param value the value to find
+     @return the position of the range tombstone, or ranges.size() if there is none
+     
+     */
+    size_t RangeSearch(const lsm_value_t &value)const;
+    
+    /**
+     function used to check whether a value is deleted, called with the lock held
+     
+     @param value the value to check
+     @return true if a range tombstone covers the value and it was not written since
+     
+     */
+    bool IsDeleted(const lsm_value_t &value)const;
+};
+
+#endif // LSMRANGETOMBSTONES_H
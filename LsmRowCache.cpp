@@ -0,0 +1,240 @@
+/**
+ C++11 - GCC Compiler
+ LsmRowCache.cpp
+ 
+ Caches the results of the lookups of the Lsm Tree, whether each value looked up was found, in front of c0
+ and every disk level, so the hot values of a skewed read workload are answered without searching the
+ levels. Values not found are cached too, so repeated lookups of missing values read no node either.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmRowCache.h"
+
+/**
+ hash a value, the bits are mixed so values close to each other spread over the shards
+ 
+ @param value the value to hash
+ @return the hash of the value
+ 
+ */
+size_t LsmRowCacheHash::operator()(const lsm_value_t &value)const
+{
+#ifdef LSM_SLICE_VALUES
+    // slices are equal when their keys are, so only the key is hashed
+    unsigned long hash = 0xcbf29ce484222325UL;
+    for (int i = 0; i < value.keyLength; i++)
+    {
+        hash ^= (unsigned char) value.data[i];
+        hash *= 0x100000001b3UL;
+    }
+#else
+    unsigned long hash = (unsigned long) value;
+#endif // LSM_SLICE_VALUES
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdUL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ Constructor to initialize the cache
+ 
+ @param capacityBytes the memory budget of the cache, in bytes
+ 
+ */
+LsmRowCache::LsmRowCache(long capacityBytes)
+{
+    for (int i = 0; i < ROW_CACHE_SHARDS; i++)
+    {
+        shards[i].generation = 0;
+        shards[i].stats = LsmRowCacheStats();
+    }
+    setCapacity(capacityBytes);
+}
+
+/**
+ look up the cached result for a value, the result is moved to the front of the least recently used list
+ of its shard
+ 
+ @param value the value to look up
+ @param found set to the cached result when there is one
+ @param generation set to the count of removals from the shard of the value when no result is cached, to
+        be passed to insert once the levels are searched
+ @return true if a result is cached for the value
+ 
+ */
+bool LsmRowCache::lookup(const lsm_value_t &value, bool &found, long &generation)
+{
+    Shard &shard = ShardOf(value);
+    std::lock_guard<std::mutex> guard(shard.shardMutex);
+    
+    row_cache_index::iterator it = shard.index.find(value);
+    if (it == shard.index.end())
+    {
+        shard.stats.misses++;
+        generation = shard.generation;
+        return false;
+    }
+    
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    found = (*it->second).found;
+    
+    shard.stats.hits++;
+    if (!found) shard.stats.negativeHits++;
+    return true;
+}
+
+/**
+ cache the result of a lookup, nothing is cached when a value of the shard was written since the
+ generation was taken, as the result may be stale
+ 
+ @param value the value looked up
+ @param found true if the value was found
+ @param generation the count set by lookup before the levels were searched
+ 
+ */
+void LsmRowCache::insert(const lsm_value_t &value, bool found, long generation)
+{
+    if (shardEntries == 0) return;
+    
+    Shard &shard = ShardOf(value);
+    std::lock_guard<std::mutex> guard(shard.shardMutex);
+    
+    if (shard.generation != generation) return;
+    
+    // another lookup of the value cached it first, the result is the same
+    if (shard.index.find(value) != shard.index.end()) return;
+    
+    LsmRowCacheEntry entry;
+    entry.value = value;
+    entry.found = found;
+    shard.entries.push_front(entry);
+    shard.index[value] = shard.entries.begin();
+    
+    Evict(shard);
+}
+
+/**
+ remove the cached result of a value, called after the value is written
+ 
+ @param value the value written
+ 
+ */
+void LsmRowCache::invalidate(const lsm_value_t &value)
+{
+    Shard &shard = ShardOf(value);
+    std::lock_guard<std::mutex> guard(shard.shardMutex);
+    
+    // the lookups in flight for values of the shard may have read the value before the write
+    shard.generation++;
+    
+    row_cache_index::iterator it = shard.index.find(value);
+    if (it == shard.index.end()) return;
+    
+    shard.entries.erase(it->second);
+    shard.index.erase(it);
+    shard.stats.invalidations++;
+}
+
+/**
+ remove the cached results of every value within a range, called after the range is deleted
+ 
+ @param low the smallest value written
+ @param high the largest value written
+ 
+ */
+void LsmRowCache::invalidateRange(const lsm_value_t &low, const lsm_value_t &high)
+{
+    // the values of a range are spread over every shard, each is walked once
+    for (int i = 0; i < ROW_CACHE_SHARDS; i++)
+    {
+        Shard &shard = shards[i];
+        std::lock_guard<std::mutex> guard(shard.shardMutex);
+        shard.generation++;
+        
+        std::list<LsmRowCacheEntry>::iterator it = shard.entries.begin();
+        while (it != shard.entries.end())
+        {
+            if ((*it).value < low || high < (*it).value)
+            {
+                ++it;
+                continue;
+            }
+            shard.index.erase((*it).value);
+            it = shard.entries.erase(it);
+            shard.stats.invalidations++;
+        }
+    }
+}
+
+/**
+ change the memory budget of the cache, the least recently used results are removed until the cache fits
+ in it
+ 
+ @param capacityBytes the memory budget of the cache, in bytes
+ 
+ */
+void LsmRowCache::setCapacity(long capacityBytes)
+{
+    LsmRowCache::capacityBytes = capacityBytes > 0 ? capacityBytes : 0;
+    shardEntries = LsmRowCache::capacityBytes / ROW_CACHE_SHARDS / (long) (sizeof(LsmRowCacheEntry) + ROW_CACHE_ENTRY_OVERHEAD);
+    
+    for (int i = 0; i < ROW_CACHE_SHARDS; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].shardMutex);
+        Evict(shards[i]);
+    }
+}
+
+/**
+ function used to get a copy of the counters of the cache
+ 
+ @return the counters, summed over the shards
+ 
+ */
+LsmRowCacheStats LsmRowCache::getStats()
+{
+    LsmRowCacheStats total = LsmRowCacheStats();
+    for (int i = 0; i < ROW_CACHE_SHARDS; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].shardMutex);
+        total.hits += shards[i].stats.hits;
+        total.negativeHits += shards[i].stats.negativeHits;
+        total.misses += shards[i].stats.misses;
+        total.evictions += shards[i].stats.evictions;
+        total.invalidations += shards[i].stats.invalidations;
+        total.entries += shards[i].index.size();
+    }
+    return total;
+}
+
+/**
+ function used to find the shard of a value
+ 
+ @param value the value
+ @return the shard holding the result of the value
+ 
+ */
+LsmRowCache::Shard &LsmRowCache::ShardOf(const lsm_value_t &value)
+{
+    // the high bits pick the shard, the hash table of the shard uses the low bits
+    return shards[(LsmRowCacheHash()(value) >> 32) % ROW_CACHE_SHARDS];
+}
+
+/**
+ function used to remove the least recently used results of a shard until it holds no more than the
+ results it may hold, called with the lock of the shard held
+ 
+ @param shard the shard
+ 
+ */
+void LsmRowCache::Evict(Shard &shard)
+{
+    while ((long) shard.index.size() > shardEntries)
+    {
+        shard.index.erase(shard.entries.back().value);
+        shard.entries.pop_back();
+        shard.stats.evictions++;
+    }
+}
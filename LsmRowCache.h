@@ -0,0 +1,166 @@
+/**
+ C++11 - GCC Compiler
+ LsmRowCache.h
+ 
+ Caches the results of the lookups of the Lsm Tree, whether each value looked up was found, in front of c0
+ and every disk level, so the hot values of a skewed read workload are answered without searching the
+ levels. Values not found are cached too, so repeated lookups of missing values read no node either.
+ 
+ The cache is split into ROW_CACHE_SHARDS shards by the hash of the value, each with its own lock and least
+ recently used list, so lookups of different values rarely wait for each other. The memory budget is split
+ evenly between the shards. A write to a value removes it from the cache, and each shard counts its
+ removals so a lookup that raced a write does not put a result the write made stale back in the cache.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMROWCACHE_H
+#define LSMROWCACHE_H
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "LsmLevelMemory.h"
+
+// the number of shards of the cache, each locked on its own
+#define ROW_CACHE_SHARDS 16
+
+// the bytes each cached result is counted as using beyond its value, for its list and hash table nodes
+#define ROW_CACHE_ENTRY_OVERHEAD 64
+
+// struct to define a cached result, the value looked up and whether it was found
+struct LsmRowCacheEntry {
+    lsm_value_t value;  // the value looked up
+    bool found;         // true if the value was in the Lsm Tree
+};
+
+// struct to contain the counters of the cache
+struct LsmRowCacheStats {
+    long hits;           // the lookups answered by the cache, found or not
+    long negativeHits;   // the lookups answered by the cache as not found
+    long misses;         // the lookups the cache held no result for
+    long evictions;      // the results removed to stay within the memory budget
+    long invalidations;  // the results removed because their value was written
+    long entries;        // the number of results held
+};
+
+// the hash of a value, used to pick its shard and its place in the hash table of the shard
+struct LsmRowCacheHash {
+    size_t operator()(const lsm_value_t &value)const;
+};
+
+// a hash table from each value to its cached result in the least recently used list of a shard
+typedef std::unordered_map<lsm_value_t, std::list<LsmRowCacheEntry>::iterator, LsmRowCacheHash> row_cache_index;
+
+class LsmRowCache {
+public:
+    
+    /**
+     Constructor to initialize the cache
+     
+     @param capacityBytes the memory budget of the cache, in bytes
+     
+     */
+    LsmRowCache(long capacityBytes);
+    
+    /**
+     look up the cached result for a value, the result is moved to the front of the least recently used
+     list of its shard
+    
+     @param value the value to look up
+     @param found set to the cached result when there is one
+     @param generation set to the count of removals from the shard of the value when no result is cached,
+            to be passed to insert once the levels are searched
+     @return true if a result is cached for the value
+    
+     */
+    bool lookup(const lsm_value_t &value, bool &found, long &generation);
+    
+    /**
+     cache the result of a lookup, nothing is cached when a value of the shard was written since the
+     generation was taken, as the result may be stale
+     
+     @param value the value looked up
+     @param found true if the value was found
+     @param generation the count set by lookup before the levels were searched
+     
+     */
+    void insert(const lsm_value_t &value, bool found, long generation);
+    
+    /**
+     remove the cached result of a value, called after the value is written
+     
+     @param value the value written
+     
+     */
+    void invalidate(const lsm_value_t &value);
+    
+    /**
+     remove the cached results of every value within a range, called after the range is deleted
+     
+     @param low the smallest value written
+     @param high the largest value written
+     
+     */
+    void invalidateRange(const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     change the memory budget of the cache, the least recently used results are removed until the cache
+     fits in it
+     
+     @param capacityBytes the memory budget of the cache, in bytes
+     
+     */
+    void setCapacity(long capacityBytes);
+    
+    // function used to get the memory budget of the cache, in bytes
+    long getCapacity()const {return capacityBytes;}
+    
+    /**
+     function used to get a copy of the counters of the cache
+     
+     @return the counters, summed over the shards
+     
+     */
+    LsmRowCacheStats getStats();
+
+private:
+    
+    // struct to define a shard, the results most recently used first and a hash table to find them
+    struct Shard {
+        std::list<LsmRowCacheEntry> entries;
+        row_cache_index index;
+        long generation;
+        LsmRowCacheStats stats;
+        std::mutex shardMutex;
+    };
+    
+    // the shards, a value belongs to the shard picked by its hash
+    Shard shards[ROW_CACHE_SHARDS];
+    
+    // the memory budget of the cache, and the number of results each shard may hold within it
+    std::atomic<long> capacityBytes;
+    std::atomic<long> shardEntries;
+    
+    /**
+     function used to find the shard of a value
+     
+     @param value the value
+     @return the shard holding the result of the value
+     
+     */
+    Shard &ShardOf(const lsm_value_t &value);
+    
+    /**
+     function used to remove the least recently used results of a shard until it holds no more than the
+     results it may hold, called with the lock of the shard held
+     
+     @param shard the shard
+     
+     */
+    void Evict(Shard &shard);
+};
+
+#endif // LSMROWCACHE_H
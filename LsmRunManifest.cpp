@@ -0,0 +1,189 @@
+/**
+ C++11 - GCC Compiler
+ LsmRunManifest.cpp
+ 
+ Keeps the manifest of a disk level made of sorted runs, the file listing the runs of the level so the
+ level can be opened again, together with the I/O counters of the runs the level has already removed.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmRunManifest.h"
+
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+// the size of the file name entries in the manifest
+#define MANIFEST_NAME_SIZE 32
+
+LsmRunManifest::LsmRunManifest()
+{
+    levelNumber = 0;
+    header = manifest_header();
+    retiredIOStats = LsmLevelIOStats();
+}
+
+/**
+ Constructor to initialize the manifest of a level, nothing is read until open is called
+ 
+ @param levelNumber the level number --> for example c1 has a value of 1
+ @param filePrefix the prefix of the names of the level's files
+ @param signature the signature written to the header of the manifest, which differs by kind of level
+ 
+ */
+LsmRunManifest::LsmRunManifest(int levelNumber, const std::string &filePrefix, long signature)
+{
+    LsmRunManifest::levelNumber = levelNumber;
+    LsmRunManifest::filePrefix = filePrefix;
+    retiredIOStats = LsmLevelIOStats();
+    
+    header.signature = signature;
+    header.runsCount = 0;
+    header.nextFileNumber = 1;
+    header.compactPointer = lsm_value_t();
+}
+
+/**
+ function used to get the name of the manifest file for the level
+ 
+ @return the file name --> for example c2.manifest
+ 
+ */
+std::string LsmRunManifest::getManifestFileName()const
+{
+    std::stringstream ss;
+    ss << filePrefix << "c" << levelNumber << ".manifest";
+    return ss.str();
+}
+
+/**
+ function used to open each of the runs listed in the manifest, if it exists
+ 
+ @param runs the vector the runs are appended to, in the order they were written
+ 
+ */
+void LsmRunManifest::open(std::vector<LsmSortedRun*> &runs)
+{
+    std::ifstream manifestFile(getManifestFileName().c_str(), std::ios::in | std::ios::binary);
+    if (!manifestFile.is_open()) return;
+    
+    long signature = header.signature;
+    manifestFile.read((char*)&header, sizeof(manifest_header));
+    
+    // verify the file format by checking the signature
+    if (!manifestFile || header.signature != signature)
+    {
+        // alert the file does not contain the signature
+        std::cout << "Wrong file format.\n"; exit(1);
+    }
+    
+    for (long i = 0; i < header.runsCount; i++)
+    {
+        char runFileName[MANIFEST_NAME_SIZE];
+        manifestFile.read(runFileName, MANIFEST_NAME_SIZE);
+        runs.push_back(new LsmSortedRun(runFileName));
+    }
+}
+
+/**
+ function used to write the manifest, listing the file name of each run
+ 
+ @param runs the runs of the level
+ 
+ */
+void LsmRunManifest::write(const std::vector<LsmSortedRun*> &runs)
+{
+    header.runsCount = runs.size();
+    
+    // write the new manifest beside the old one and rename it over the old one once it is complete
+    // so the level is never left without a valid manifest
+    std::string manifestFileName = getManifestFileName();
+    std::string tempFileName = manifestFileName + ".tmp";
+    
+    std::ofstream manifestFile(tempFileName.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    manifestFile.write((char*)&header, sizeof(manifest_header));
+    
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        char runFileName[MANIFEST_NAME_SIZE];
+        memset(runFileName, 0, MANIFEST_NAME_SIZE);
+        strncpy(runFileName, (*runs[i]).getFileName().c_str(), MANIFEST_NAME_SIZE - 1);
+        manifestFile.write(runFileName, MANIFEST_NAME_SIZE);
+    }
+    manifestFile.close();
+    
+    rename(tempFileName.c_str(), manifestFileName.c_str());
+}
+
+/**
+ function used to get the name of the file of a new run of the level
+ 
+ @return the file name --> for example c2-7.run
+ 
+ */
+std::string LsmRunManifest::nextRunFileName()
+{
+    std::stringstream ss;
+    ss << filePrefix << "c" << levelNumber << "-" << header.nextFileNumber++ << ".run";
+    return ss.str();
+}
+
+/**
+ function used to keep the I/O counters of a run removed from the level, called while the level is locked
+ 
+ @param run the run removed
+ 
+ */
+void LsmRunManifest::retire(LsmSortedRun *run)
+{
+    AddIOStats(retiredIOStats, (*run).getIOStats());
+}
+
+/**
+ function used to get the I/O counters of the level, those of the runs already removed added to those of
+ its runs, called while the level is locked
+ 
+ @param runs the runs of the level
+ @return the counters for the level
+ 
+ */
+LsmLevelIOStats LsmRunManifest::getIOStats(const std::vector<LsmSortedRun*> &runs)const
+{
+    LsmLevelIOStats total = retiredIOStats;
+    for (size_t i = 0; i < runs.size(); i++) AddIOStats(total, (*runs[i]).getIOStats());
+    return total;
+}
+
+/**
+ function used to record values moved into or out of the level, called while the level is locked
+ 
+ @param keysIn the number of values merged into the level
+ @param keysOut the number of values merged out of the level
+ 
+ */
+void LsmRunManifest::countMergedKeys(long keysIn, long keysOut)
+{
+    retiredIOStats.keysMergedIn += keysIn;
+    retiredIOStats.keysMergedOut += keysOut;
+}
+
+/**
+ function used to add the I/O counters of a run to a total, the merge counters are left as they are
+ 
+ @param total the counters added to
+ @param runStats the counters of the run
+ 
+ */
+void LsmRunManifest::AddIOStats(LsmLevelIOStats &total, const LsmLevelIOStats &runStats)
+{
+    total.nodeReads += runStats.nodeReads;
+    total.nodeWrites += runStats.nodeWrites;
+    total.bytesRead += runStats.bytesRead;
+    total.bytesWritten += runStats.bytesWritten;
+    total.cacheHits += runStats.cacheHits;
+    total.lookupReads += runStats.lookupReads;
+    total.rangeSkips += runStats.rangeSkips;
+    total.zoneSkips += runStats.zoneSkips;
+    total.filterSkips += runStats.filterSkips;
+}
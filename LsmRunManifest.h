@@ -0,0 +1,134 @@
+/**
+ C++11 - GCC Compiler
+ LsmRunManifest.h
+ 
+ Keeps the manifest of a disk level made of sorted runs, the file listing the runs of the level so the
+ level can be opened again, together with the I/O counters of the runs the level has already removed.
+ Used by the partitioned and the size-tiered levels, which differ in how they merge their runs but not in
+ how they record them.
+ 
+ The manifest is written beside the old one and renamed over it once it is complete, so the level is
+ never left without a valid manifest.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMRUNMANIFEST_H
+#define LSMRUNMANIFEST_H
+
+#include <string>
+#include <vector>
+
+#include "LsmSortedRun.h"
+
+// struct to define the header written at the beginning of each level manifest file
+struct manifest_header {
+    long signature;       // used to verify the file is a manifest
+    long runsCount;       // the number of runs in the level
+    long nextFileNumber;  // the number used to name the next run file created for the level
+    lsm_value_t compactPointer;  // the largest value of the last run compacted to the next level
+};
+
+class LsmRunManifest {
+public:
+    LsmRunManifest();
+    
+    /**
+     Constructor to initialize the manifest of a level, nothing is read until open is called
+     
+     @param levelNumber the level number --> for example c1 has a value of 1
+     @param filePrefix the prefix of the names of the level's files
+     @param signature the signature written to the header of the manifest, which differs by kind of level
+     
+     */
+    LsmRunManifest(int levelNumber, const std::string &filePrefix, long signature);
+    
+    /**
+     function used to open each of the runs listed in the manifest, if it exists
+     
+     @param runs the vector the runs are appended to, in the order they were written
+     
+     */
+    void open(std::vector<LsmSortedRun*> &runs);
+    
+    /**
+     function used to write the manifest, listing the file name of each run
+     
+     @param runs the runs of the level
+     
+     */
+    void write(const std::vector<LsmSortedRun*> &runs);
+    
+    /**
+     function used to get the name of the file of a new run of the level
+     
+     @return the file name --> for example c2-7.run
+     
+     */
+    std::string nextRunFileName();
+    
+    /**
+     function used to keep the I/O counters of a run removed from the level, called while the level
+     is locked
+     
+     @param run the run removed
+     
+     */
+    void retire(LsmSortedRun *run);
+    
+    /**
+     function used to get the I/O counters of the level, those of the runs already removed added to
+     those of its runs, called while the level is locked
+     
+     @param runs the runs of the level
+     @return the counters for the level
+     
+     */
+    LsmLevelIOStats getIOStats(const std::vector<LsmSortedRun*> &runs)const;
+    
+    /**
+     function used to record values moved into or out of the level, called while the level is locked
+     
+     @param keysIn the number of values merged into the level
+     @param keysOut the number of values merged out of the level
+     
+     */
+    void countMergedKeys(long keysIn, long keysOut);
+    
+    // functions used to get and set the largest value of the last run compacted to the next level
+    const lsm_value_t& getCompactPointer()const {return header.compactPointer;}
+    void setCompactPointer(const lsm_value_t &compactPointer) {header.compactPointer = compactPointer;}
+
+private:
+    
+    // the level number --> for example c1 has a value of 1
+    int levelNumber;
+    
+    // the prefix of the names of the level's files
+    std::string filePrefix;
+    
+    // the header written at the beginning of the manifest
+    manifest_header header;
+    
+    // the I/O counters of runs that have been removed, and the merge counters of the level
+    LsmLevelIOStats retiredIOStats;
+    
+    /**
+     function used to add the I/O counters of a run to a total, the merge counters are left as they are
+     
+     @param total the counters added to
+     @param runStats the counters of the run
+     
+     */
+    static void AddIOStats(LsmLevelIOStats &total, const LsmLevelIOStats &runStats);
+    
+    /**
+     function used to get the name of the manifest file for the level
+     
+     @return the file name --> for example c2.manifest
+     
+     */
+    std::string getManifestFileName()const;
+};
+
+#endif // LSMRUNMANIFEST_H
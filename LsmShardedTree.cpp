@@ -0,0 +1,273 @@
+/**
+ C++11 - GCC Compiler
+ LsmShardedTree.cpp
+ 
+ Creates a sharded Lsm Tree, a front end that partitions the values across several independent Lsm Trees
+ by a hash of the value. Each shard has its own c0, its own level files, named with the prefix s<shard>-,
+ and its own rolling merge thread, so writes to different shards do not wait on each other. Range scans
+ are run on every shard in parallel and the values found are merged back into order.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmShardedTree.h"
+
+#include <queue>
+#include <sstream>
+#include <thread>
+
+// an entry of the merge of the shard scans --> the position of the shard and of the value in its scan
+struct shard_cursor {
+    int shard;
+    size_t position;
+};
+
+/**
+ Constructor to initialize the sharded Lsm Tree, every shard is created with the same settings
+ 
+ @param shardsCount the number of independent Lsm Trees the values are partitioned across
+ @param readOptimized true to use the tombstone technique for deletes in each shard
+ @param c0DataStructure the data structure of c0 in each shard --> 1 for a BTree, 2 for a vector
+ @param numberOfLevels the number of disk levels of each shard
+ @param firstLevelFileSize the maximum size, in kb, of c1 in each shard
+ @param sizeBetweenLevels the size increase for each additional level
+ @param copyAllFromC0 should all of c0 be copied to c1 on a rolling merge
+ @param c0_percentage_to_copy the percentage of c0 copied to c1 on a rolling merge
+ @param c0_percentage_of_c1 the percentage of c1 c0 can be before a rolling merge occurs
+ @param mergeStrategy 1 for partitioned sorted runs, 2 for BTree levels, 3 for size-tiered sorted runs
+ @param threadedRollingMerge true to run the rolling merges of each shard in a detached thread
+ 
+ */
+LsmShardedTree::LsmShardedTree(int shardsCount, bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge)
+{
+    if (shardsCount < 1) shardsCount = 1;
+    
+    for (int i = 0; i < shardsCount; i++)
+    {
+        // the level files of each shard are prefixed with the shard number --> for example s0-c1.bin
+        std::ostringstream prefix;
+        prefix << "s" << i << "-";
+        
+        shards.push_back(new LsmTree(readOptimized, c0DataStructure, numberOfLevels, firstLevelFileSize, sizeBetweenLevels, copyAllFromC0, c0_percentage_to_copy, c0_percentage_of_c1, mergeStrategy, threadedRollingMerge, prefix.str()));
+        shardMutexes.push_back(std::unique_ptr<std::mutex>(new std::mutex));
+    }
+}
+
+LsmShardedTree::~LsmShardedTree()
+{
+    // each shard waits for its rolling merge thread before it is deleted
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        delete shards[i];
+    }
+}
+
+/**
+ get the shard a value belongs to
+ 
+ @param value the value
+ @return the position of the shard --> from 0 to shardsCount - 1
+ 
+ */
+int LsmShardedTree::getShard(const lsm_value_t &value)const
+{
+#ifdef LSM_SLICE_VALUES
+    // FNV-1a over the bytes of the key
+    unsigned long hash = 14695981039346656037UL;
+    for (size_t i = 0; i < value.keyLength; i++)
+    {
+        hash ^= (unsigned char) value.data[i];
+        hash *= 1099511628211UL;
+    }
+#else
+    // the splitmix64 finalizer, so values close to each other are spread across the shards
+    unsigned long hash = (unsigned long) value;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9UL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebUL;
+    hash = hash ^ (hash >> 31);
+#endif
+    return (int) (hash % shards.size());
+}
+
+/**
+ adds a key value pair to the shard the value belongs to
+ 
+ @param dtype the data to be inserted
+ 
+ */
+void LsmShardedTree::insert_value(dtype value)
+{
+    int shard = getShard(value.value);
+    std::lock_guard<std::mutex> lock(*shardMutexes[shard]);
+    (*shards[shard]).insert_value(value);
+}
+
+/**
+ deletes a key value pair from the shard the value belongs to
+ 
+ @param dtype the data to be deleted
+ 
+ */
+void LsmShardedTree::delete_value(dtype value)
+{
+    int shard = getShard(value.value);
+    std::lock_guard<std::mutex> lock(*shardMutexes[shard]);
+    (*shards[shard]).delete_value(value);
+}
+
+/**
+ search the shard the value belongs to for the value
+ 
+ @param dtype the data to search for
+ @return true if the value is found
+ 
+ */
+bool LsmShardedTree::read_value(dtype value)
+{
+    int shard = getShard(value.value);
+    std::lock_guard<std::mutex> lock(*shardMutexes[shard]);
+    return (*shards[shard]).read_value(value);
+}
+
+/**
+ update a value, when the old and new values belong to different shards the old value is deleted from
+ its shard and the new value inserted in the other
+ 
+ @param old_value the value to be replaced
+ @param new_value the value to replace it with
+ 
+ */
+void LsmShardedTree::update_value(dtype old_value, dtype new_value)
+{
+    int oldShard = getShard(old_value.value);
+    int newShard = getShard(new_value.value);
+    
+    if (oldShard == newShard)
+    {
+        std::lock_guard<std::mutex> lock(*shardMutexes[oldShard]);
+        (*shards[oldShard]).update_value(old_value, new_value);
+        return;
+    }
+    
+    delete_value(old_value);
+    insert_value(new_value);
+}
+
+/**
+ write an operand to the shard its record belongs to, for the merge operator to fold into the record
+ 
+ @param operand the operand
+ 
+ */
+void LsmShardedTree::merge_value(dtype operand)
+{
+    int shard = getShard(operand.value);
+    std::lock_guard<std::mutex> lock(*shardMutexes[shard]);
+    (*shards[shard]).merge_value(operand);
+}
+
+/**
+ Search for a record by its key in the shard it belongs to and get its newest value, with its operands
+ folded in
+ 
+ @param key the record to get, only its key is compared
+ @param result set to the record found
+ @return true if the record is found
+ 
+ */
+bool LsmShardedTree::read_value(const lsm_value_t &key, lsm_value_t &result)
+{
+    int shard = getShard(key);
+    std::lock_guard<std::mutex> lock(*shardMutexes[shard]);
+    return (*shards[shard]).read_value(key, result);
+}
+
+/**
+ set the merge operator of every shard, owned by the caller
+ 
+ @param mergeOperator the merge operator, or NULL to insert the operands as values
+ 
+ */
+void LsmShardedTree::setMergeOperator(LsmMergeOperator *mergeOperator)
+{
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        std::lock_guard<std::mutex> lock(*shardMutexes[i]);
+        (*shards[i]).setMergeOperator(mergeOperator);
+    }
+}
+
+/**
+ scan a shard within a range, run in a thread for each shard
+ 
+ @param tree the Lsm Tree of the shard
+ @param shardMutex the mutex of the shard
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values of the shard are appended to
+ 
+ */
+static void scanShard(LsmTree *tree, std::mutex *shardMutex, const lsm_value_t *low, const lsm_value_t *high, std::vector<lsm_value_t> *values)
+{
+    std::lock_guard<std::mutex> lock(*shardMutex);
+    (*tree).scan_values(*low, *high, *values);
+}
+
+/**
+ get the values of every shard within a range, the shards are scanned in parallel
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order with no duplicates
+ 
+ */
+void LsmShardedTree::scan_values(const lsm_value_t &low, const lsm_value_t &high, std::vector<lsm_value_t> &values)
+{
+    std::vector<std::vector<lsm_value_t> > shardValues(shards.size());
+    std::vector<std::thread> threads;
+    
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        threads.push_back(std::thread(scanShard, shards[i], shardMutexes[i].get(), &low, &high, &shardValues[i]));
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    
+    // merge the sorted values of the shards, smallest value first
+    auto isAfter = [&shardValues](const shard_cursor &a, const shard_cursor &b)
+    {
+        return shardValues[b.shard][b.position] < shardValues[a.shard][a.position];
+    };
+    std::priority_queue<shard_cursor, std::vector<shard_cursor>, decltype(isAfter)> cursors(isAfter);
+    
+    for (size_t i = 0; i < shardValues.size(); i++)
+    {
+        if (!shardValues[i].empty()) cursors.push(shard_cursor{(int) i, 0});
+    }
+    
+    while (!cursors.empty())
+    {
+        shard_cursor cursor = cursors.top();
+        cursors.pop();
+        
+        values.push_back(shardValues[cursor.shard][cursor.position]);
+        
+        if (++cursor.position < shardValues[cursor.shard].size()) cursors.push(cursor);
+    }
+}
+
+/**
+ print the statistics of every shard
+ 
+ */
+void LsmShardedTree::printStats()
+{
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        std::lock_guard<std::mutex> lock(*shardMutexes[i]);
+        cout << "----------------- SHARD " << i << " -----------------" << endl;
+        (*shards[i]).printStats();
+    }
+}
@@ -0,0 +1,144 @@
+/**
+ C++11 - GCC Compiler
+ LsmShardedTree.h
+ 
+ Creates a sharded Lsm Tree, a front end that partitions the values across several independent Lsm Trees
+ by a hash of the value. Each shard has its own c0, its own level files, named with the prefix s<shard>-,
+ and its own rolling merge thread, so writes to different shards do not wait on each other. Range scans
+ are run on every shard in parallel and the values found are merged back into order.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMSHARDEDTREE_H
+#define LSMSHARDEDTREE_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "LsmTree.h"
+
+class LsmShardedTree {
+public:
+    
+    /**
+     Constructor to initialize the sharded Lsm Tree, every shard is created with the same settings
+     
+     @param shardsCount the number of independent Lsm Trees the values are partitioned across
+     @param readOptimized true to use the tombstone technique for deletes in each shard
+     @param c0DataStructure the data structure of c0 in each shard --> 1 for a BTree, 2 for a vector
+     @param numberOfLevels the number of disk levels of each shard
+     @param firstLevelFileSize the maximum size, in kb, of c1 in each shard
+     @param sizeBetweenLevels the size increase for each additional level
+     @param copyAllFromC0 should all of c0 be copied to c1 on a rolling merge
+     @param c0_percentage_to_copy the percentage of c0 copied to c1 on a rolling merge
+     @param c0_percentage_of_c1 the percentage of c1 c0 can be before a rolling merge occurs
+     @param mergeStrategy 1 for partitioned sorted runs, 2 for BTree levels, 3 for size-tiered sorted runs
+     @param threadedRollingMerge true to run the rolling merges of each shard in a detached thread
+     
+     */
+    LsmShardedTree(int shardsCount, bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge);
+    virtual ~LsmShardedTree();
+    
+    /**
+     adds a key value pair to the shard the value belongs to
+     
+     @param dtype the data to be inserted
+     
+     */
+    void insert_value(dtype value);
+    
+    /**
+     deletes a key value pair from the shard the value belongs to
+     
+     @param dtype the data to be deleted
+     
+     */
+    void delete_value(dtype value);
+    
+    /**
+     search the shard the value belongs to for the value
+     
+     @param dtype the data to search for
+     @return true if the value is found
+     
+     */
+    bool read_value(dtype value);
+    
+    /**
+     update a value, when the old and new values belong to different shards the old value is deleted from
+     its shard and the new value inserted in the other
+     
+     @param old_value the value to be replaced
+     @param new_value the value to replace it with
+     
+     */
+    void update_value(dtype old_value, dtype new_value);
+    
+    /**
+     write an operand to the shard its record belongs to, for the merge operator to fold into the record
+     
+     @param operand the operand
+     
+     */
+    void merge_value(dtype operand);
+    
+    /**
+     Search for a record by its key in the shard it belongs to and get its newest value, with its operands
+     folded in
+     
+     @param key the record to get, only its key is compared
+     @param result set to the record found
+     @return true if the record is found
+     
+     */
+    bool read_value(const lsm_value_t &key, lsm_value_t &result);
+    
+    /**
+     set the merge operator of every shard, owned by the caller
+     
+     @param mergeOperator the merge operator, or NULL to insert the operands as values
+     
+     */
+    void setMergeOperator(LsmMergeOperator *mergeOperator);
+    
+    /**
+     get the values of every shard within a range, the shards are scanned in parallel
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order with no duplicates
+     
+     */
+    void scan_values(const lsm_value_t &low, const lsm_value_t &high, std::vector<lsm_value_t> &values);
+    
+    /**
+     get the shard a value belongs to
+     
+     @param value the value
+     @return the position of the shard --> from 0 to shardsCount - 1
+     
+     */
+    int getShard(const lsm_value_t &value)const;
+    
+    // functions to get the number of shards and the Lsm Tree of a shard
+    int getShardsCount()const {return (int) shards.size();}
+    LsmTree* getShardTree(int shard) {return shards[shard];}
+    
+    /**
+     print the statistics of every shard
+     
+     */
+    void printStats();
+
+private:
+    
+    // the Lsm Tree of each shard
+    std::vector<LsmTree*> shards;
+    
+    // a mutex for each shard, held by the operations made to the shard
+    std::vector<std::unique_ptr<std::mutex> > shardMutexes;
+};
+
+#endif // LSMSHARDEDTREE_H
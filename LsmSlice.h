@@ -0,0 +1,162 @@
+/**
+ C++11 - GCC Compiler
+ LsmSlice.h
+
+ Defines a slice, a record made of a byte string key and a byte string value held inline, so it can be
+ stored by the levels of the Lsm Tree in place of a long. Slices are ordered and compared by their key
+ only, using a comparator class, so the value of a record is replaced when a record with an equal key is
+ inserted.
+
+ A slice has a fixed capacity shared by its key and value, so nodes and pages holding slices keep a fixed
+ size on disk. A key and value longer than the capacity together are not stored, the constructor throws
+ std::length_error in place of cutting them short. Build with LSM_SLICE_VALUES defined to store slices,
+ the default build stores longs.
+
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMSLICE_H
+#define LSMSLICE_H
+
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+// the comparator used by default, orders keys byte by byte with a shorter key before a longer key it starts
+struct LsmBytewiseComparator {
+
+    /**
+     compare two keys
+
+     @param a the first key
+     @param aLength the length of the first key
+     @param b the second key
+     @param bLength the length of the second key
+     @return a negative number, 0 or a positive number when a is before, equal to or after b
+
+     */
+    static int compare(const char *a, size_t aLength, const char *b, size_t bLength)
+    {
+        int result = memcmp(a, b, aLength < bLength ? aLength : bLength);
+        if (result != 0) return result;
+        return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+    }
+};
+
+template <size_t Capacity, class Comparator = LsmBytewiseComparator>
+struct LsmSlice {
+
+    // the lengths are held in unsigned shorts
+    static_assert(Capacity <= 65535, "the capacity of a slice must fit an unsigned short");
+
+    unsigned short keyLength;    // the number of bytes of data holding the key
+    unsigned short valueLength;  // the number of bytes of data holding the value, after the key
+    char data[Capacity];         // the key followed by the value, the rest is zero filled
+
+    // an empty key and value, ordered before every other slice
+    LsmSlice()
+    {
+        keyLength = 0;
+        valueLength = 0;
+        memset(data, 0, Capacity);
+    }
+
+    /**
+     Constructor for a slice whose key is a long and whose value is empty, the key is stored big endian
+     with the sign bit flipped so the bytewise order of the keys is the numeric order
+
+     @param number the key
+
+     */
+    LsmSlice(long number)
+    {
+        keyLength = sizeof(unsigned long);
+        valueLength = 0;
+        memset(data, 0, Capacity);
+
+        unsigned long bits = (unsigned long) number ^ (1UL << (sizeof(unsigned long) * 8 - 1));
+        for (size_t i = 0; i < sizeof(unsigned long); i++)
+        {
+            data[i] = (char) (bits >> ((sizeof(unsigned long) - 1 - i) * 8));
+        }
+    }
+
+    /**
+     Constructor for a slice from a key and a value, throws std::length_error if they do not fit the
+     capacity together, a key cut short would be equal to other keys
+
+     @param key the key
+     @param value the value
+
+     */
+    LsmSlice(const std::string &key, const std::string &value = std::string())
+    {
+        if (!fits(key, value)) throw std::length_error("Slice key and value exceed the slice capacity");
+
+        memset(data, 0, Capacity);
+        keyLength = (unsigned short) key.size();
+        valueLength = (unsigned short) value.size();
+        memcpy(data, key.data(), keyLength);
+        memcpy(data + keyLength, value.data(), valueLength);
+    }
+
+    /**
+     check whether a key and a value fit the capacity of a slice together
+
+     @param key the key
+     @param value the value
+     @return true if a slice can hold them
+
+     */
+    static bool fits(const std::string &key, const std::string &value = std::string())
+    {
+        return key.size() <= Capacity && value.size() <= Capacity - key.size();
+    }
+
+    // functions to get the key and value of the slice
+    std::string getKey()const {return std::string(data, keyLength);}
+    std::string getValue()const {return std::string(data + keyLength, valueLength);}
+
+    /**
+     compare the key of this slice to the key of another slice
+
+     @param other the slice to compare to
+     @return a negative number, 0 or a positive number when this slice is before, equal to or after other
+
+     */
+    int compare(const LsmSlice &other)const
+    {
+        return Comparator::compare(data, keyLength, other.data, other.keyLength);
+    }
+
+    bool operator<(const LsmSlice &other)const {return compare(other) < 0;}
+    bool operator>(const LsmSlice &other)const {return compare(other) > 0;}
+    bool operator<=(const LsmSlice &other)const {return compare(other) <= 0;}
+    bool operator>=(const LsmSlice &other)const {return compare(other) >= 0;}
+    bool operator==(const LsmSlice &other)const {return compare(other) == 0;}
+    bool operator!=(const LsmSlice &other)const {return compare(other) != 0;}
+};
+
+/**
+ write the key of a slice to a stream, bytes that can not be printed are written as hex
+
+ @param out the stream to write to
+ @param slice the slice to write
+ @return the stream
+
+ */
+template <size_t Capacity, class Comparator>
+std::ostream &operator<<(std::ostream &out, const LsmSlice<Capacity, Comparator> &slice)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < slice.keyLength; i++)
+    {
+        unsigned char c = (unsigned char) slice.data[i];
+        if (c >= 0x20 && c < 0x7f) out << (char) c;
+        else out << "\\x" << hex[c >> 4] << hex[c & 0xf];
+    }
+    return out;
+}
+
+#endif // LSMSLICE_H
@@ -0,0 +1,673 @@
+/**
+ C++11 - GCC Compiler
+ LsmSortedRun.cpp
+ 
+ Creates a sorted run on disk, a file holding the values of a key range in sorted order.
+ The values are written once, when the run is created by a rolling merge, into compressed pages.
+ An in memory index holding the first value, last value and file position of every page lets a search
+ read a single page, and no page at all when the value falls between two pages.
+ 
+ Pages are compressed with delta and varint encoding - each value is stored as its difference from the
+ value before it, and numbers are stored in as few bytes as they need, 7 bits per byte. A page is filled
+ until its encoded values reach RUN_PAGE_SIZE bytes and pages are written back to back, so only the
+ encoded bytes are read and written.
+ 
+ A prefix range filter of the values is built with the run and written after the page index, so a scan
+ of a range the run holds no value near reads no page.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmSortedRun.h"
+#include "LsmIOScheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the signature written to the header of each sorted run file, used to verify the file format
+#define RUN_SIGNATURE 0x4C534D52554E34L
+
+// the largest number of bytes of an encoded number, and of an encoded key value pair
+#define MAX_VARINT_SIZE 10
+#define MAX_ENCODED_ENTRY_SIZE (2 * MAX_VARINT_SIZE + sizeof(lsm_value_t))
+
+/**
+ write a number in as few bytes as it needs, 7 bits per byte, the high bit of a byte is set when
+ another byte follows
+ 
+ @param p the position to write to
+ @param number the number to write
+ @return the position after the number
+ 
+ */
+static inline char* PutVarint(char *p, unsigned long number)
+{
+    while (number >= 0x80)
+    {
+        *p++ = (char) (number | 0x80);
+        number >>= 7;
+    }
+    *p++ = (char) number;
+    return p;
+}
+
+/**
+ read a number written by PutVarint
+ 
+ @param p the position to read from
+ @param end the end of the buffer, a number is never read past it
+ @param number the number read
+ @return the position after the number
+ 
+ */
+static inline const char* GetVarint(const char *p, const char *end, unsigned long &number)
+{
+    // the deltas of dense values fit in a single byte, so it is checked for first
+    if (p < end && (*p & 0x80) == 0)
+    {
+        number = (unsigned char) *p;
+        return p + 1;
+    }
+    
+    number = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned long byte = (unsigned char) *p++;
+        number |= (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) break;
+    }
+    return p;
+}
+
+// map signed numbers to unsigned numbers so numbers close to 0 write few bytes --> 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+static inline unsigned long ZigZag(long number) {return ((unsigned long) number << 1) ^ (unsigned long) (number >> 63);}
+static inline long UnZigZag(unsigned long number) {return (long) (number >> 1) ^ -(long) (number & 1);}
+
+#ifdef LSM_SLICE_VALUES
+
+/**
+ write a slice, only the bytes of its key and value are written
+ 
+ @param p the position to write to
+ @param value the slice to write
+ @param previous the slice before it in the page, not used for slices
+ @return the position after the slice
+ 
+ */
+static inline char* PutValue(char *p, const lsm_value_t &value, const lsm_value_t * /*previous*/)
+{
+    p = PutVarint(p, value.keyLength);
+    p = PutVarint(p, value.valueLength);
+    memcpy(p, value.data, value.keyLength + value.valueLength);
+    return p + value.keyLength + value.valueLength;
+}
+
+/**
+ read a slice written by PutValue
+ 
+ @param p the position to read from
+ @param end the end of the buffer
+ @param value the slice read
+ @param previous the slice before it in the page, not used for slices
+ @return the position after the slice
+ 
+ */
+static inline const char* GetValue(const char *p, const char *end, lsm_value_t &value, const lsm_value_t * /*previous*/)
+{
+    unsigned long keyLength, valueLength;
+    p = GetVarint(p, end, keyLength);
+    p = GetVarint(p, end, valueLength);
+    
+    value = lsm_value_t();
+    value.keyLength = (unsigned short) keyLength;
+    value.valueLength = (unsigned short) valueLength;
+    memcpy(value.data, p, keyLength + valueLength);
+    return p + keyLength + valueLength;
+}
+
+#else
+
+/**
+ write a value as its difference from the value before it in the page, the first value of a page is
+ written whole
+ 
+ @param p the position to write to
+ @param value the value to write
+ @param previous the value before it in the page, or NULL for the first value
+ @return the position after the value
+ 
+ */
+static inline char* PutValue(char *p, const lsm_value_t &value, const lsm_value_t *previous)
+{
+    // the values of a page are sorted with no duplicates, so the difference is always positive
+    if (previous == NULL) return PutVarint(p, ZigZag(value));
+    return PutVarint(p, (unsigned long) value - (unsigned long) *previous);
+}
+
+/**
+ read a value written by PutValue
+ 
+ @param p the position to read from
+ @param end the end of the buffer
+ @param value the value read
+ @param previous the value before it in the page, or NULL for the first value
+ @return the position after the value
+ 
+ */
+static inline const char* GetValue(const char *p, const char *end, lsm_value_t &value, const lsm_value_t *previous)
+{
+    unsigned long number;
+    p = GetVarint(p, end, number);
+    value = previous == NULL ? UnZigZag(number) : (long) ((unsigned long) *previous + number);
+    return p;
+}
+
+#endif // LSM_SLICE_VALUES
+
+LsmSortedRun::LsmSortedRun()
+{
+    // start the I/O counters at 0
+    ioStats = LsmLevelIOStats();
+}
+
+/**
+ Constructor to open an existing sorted run file
+ 
+ @param RunFileName the name of the file for the run
+ 
+ */
+LsmSortedRun::LsmSortedRun(const char *RunFileName)
+{
+    // start the I/O counters at 0
+    ioStats = LsmLevelIOStats();
+    
+    fileName = RunFileName;
+    file.open(RunFileName, std::ios::out | std::ios::in | std::ios::binary);
+    
+    // read the header from the beginning of the file
+    file.seekg(0L, std::ios::beg);
+    file.read((char*)&header, sizeof(run_header));
+    
+    // verify the file format by checking the signature
+    if (!file || header.signature != RUN_SIGNATURE)
+    {
+        // alert the file does not contain the signature
+        std::cout << "Wrong file format.\n"; exit(1);
+    }
+    
+    // the page index, the page positions, the last value of each page and the filters are written after
+    // the last page
+    pageIndex.resize(header.pagesCount);
+    pageOffsets.resize(header.pagesCount + 1);
+    pageMaxValues.resize(header.pagesCount);
+    rangeFilter.getWords().resize(header.filterWords);
+    pointFilter.getWords().resize(header.pointFilterWords);
+    pointFilter.setHashesCount(header.pointFilterHashes);
+    file.seekg(sizeof(run_header) + header.pagesBytes, std::ios::beg);
+    file.read((char*)pageIndex.data(), header.pagesCount * sizeof(lsm_value_t));
+    file.read((char*)pageOffsets.data(), (header.pagesCount + 1) * sizeof(long));
+    file.read((char*)pageMaxValues.data(), header.pagesCount * sizeof(lsm_value_t));
+    file.read((char*)rangeFilter.getWords().data(), header.filterWords * sizeof(unsigned long));
+    file.read((char*)pointFilter.getWords().data(), header.pointFilterWords * sizeof(unsigned long));
+}
+
+LsmSortedRun::~LsmSortedRun()
+{
+    if (file.is_open()) file.close();
+}
+
+/**
+ create a new sorted run file from sorted values
+ 
+ @param RunFileName the name of the file to create
+ @param values the values to write, sorted by value with no duplicates
+ @param first the position in values of the first value to write
+ @param last the position in values after the last value to write
+ @param filterBitsPerKey the point filter bits for each value, 0 to write the run without a point filter
+ @return a pointer to the new run, owned by the caller
+ 
+ */
+LsmSortedRun* LsmSortedRun::create(const char *RunFileName, const std::vector<dtype> &values, long first, long last, double filterBitsPerKey)
+{
+    LsmSortedRun *run = new LsmSortedRun();
+    
+    run->fileName = RunFileName;
+    run->file.open(RunFileName, std::ios::out | std::ios::in |
+                   std::ios::trunc | std::ios::binary);
+    
+    run->header.signature = RUN_SIGNATURE;
+    run->header.valuesCount = last - first;
+    run->header.pagesCount = 0;
+    run->header.pagesBytes = 0;
+    run->header.filterWords = 0;
+    run->header.pointFilterWords = 0;
+    run->header.pointFilterHashes = 0;
+    run->header.minValue = last > first ? values[first].value : lsm_value_t();
+    run->header.maxValue = last > first ? values[last - 1].value : lsm_value_t();
+    
+    // fill the pages in order, remembering the first value and the position of each one
+    run->pageOffsets.push_back(0);
+    
+    char buffer[RUN_PAGE_SIZE];
+    long i = first;
+    while (i < last)
+    {
+        long size;
+        long pageEnd = EncodePage(values, i, last, buffer, size);
+        
+        run->pageIndex.push_back(values[i].value);
+        run->pageMaxValues.push_back(values[pageEnd - 1].value);
+        run->pageOffsets.push_back(run->pageOffsets.back() + size);
+        run->WritePage(run->header.pagesCount, buffer, size);
+        run->header.pagesCount++;
+        
+        i = pageEnd;
+    }
+    run->header.pagesBytes = run->pageOffsets.back();
+    
+    // the range filter is sized for the prefixes of the values, which are next to each other once sorted
+    if (last > first)
+    {
+        run->rangeFilter.reset(LsmRangeFilter::countPrefixes(values, first, last));
+        for (long j = first; j < last; j++) run->rangeFilter.add(values[j].value);
+        run->header.filterWords = run->rangeFilter.getWords().size();
+        
+        run->pointFilter.reset(last - first, filterBitsPerKey);
+        for (long j = first; j < last; j++) run->pointFilter.add(values[j].value);
+        run->header.pointFilterWords = run->pointFilter.getWords().size();
+        run->header.pointFilterHashes = run->pointFilter.getHashesCount();
+    }
+    
+    run->WriteHeader();
+    return run;
+}
+
+/**
+ function used to write the header, page index, page zone maps, range filter and point filter to the file
+ */
+void LsmSortedRun::WriteHeader()
+{
+    file.seekp(0L, std::ios::beg);
+    file.write((char*)&header, sizeof(run_header));
+    
+    file.seekp(sizeof(run_header) + header.pagesBytes, std::ios::beg);
+    file.write((char*)pageIndex.data(), header.pagesCount * sizeof(lsm_value_t));
+    file.write((char*)pageOffsets.data(), (header.pagesCount + 1) * sizeof(long));
+    file.write((char*)pageMaxValues.data(), header.pagesCount * sizeof(lsm_value_t));
+    file.write((char*)rangeFilter.getWords().data(), header.filterWords * sizeof(unsigned long));
+    file.write((char*)pointFilter.getWords().data(), header.pointFilterWords * sizeof(unsigned long));
+    file.flush();
+    
+    // count the write against this run
+    ioStats.bytesWritten += sizeof(run_header) + header.pagesCount * sizeof(lsm_value_t)
+        + (header.pagesCount + 1) * sizeof(long) + header.pagesCount * sizeof(lsm_value_t)
+        + (header.filterWords + header.pointFilterWords) * sizeof(unsigned long);
+}
+
+/**
+ function used to encode as many values as fit in a page
+ 
+ @param values the values to encode, sorted by value
+ @param first the position in values of the first value to encode
+ @param last the position in values after the last value that may be encoded
+ @param buffer the buffer of RUN_PAGE_SIZE bytes the page is encoded into
+ @param size the size of the encoded page
+ @return the position in values after the last value encoded
+ 
+ */
+long LsmSortedRun::EncodePage(const std::vector<dtype> &values, long first, long last, char *buffer, long &size)
+{
+    // the page begins with the count of values, followed by the key and value of each one
+    char *p = buffer + sizeof(int);
+    
+    long i = first;
+    for (; i < last; i++)
+    {
+        // encode the pair on its own first, to check it fits in what is left of the page
+        char entry[MAX_ENCODED_ENTRY_SIZE];
+        char *entryEnd = PutVarint(entry, ZigZag(values[i].key));
+        entryEnd = PutValue(entryEnd, values[i].value, i > first ? &values[i - 1].value : NULL);
+        
+        if (p + (entryEnd - entry) > buffer + RUN_PAGE_SIZE) break;
+        
+        memcpy(p, entry, entryEnd - entry);
+        p += entryEnd - entry;
+    }
+    
+    int n = (int) (i - first);
+    memcpy(buffer, &n, sizeof(int));
+    size = p - buffer;
+    
+    return i;
+}
+
+/**
+ function used to decode a page
+ 
+ @param buffer the encoded page
+ @param size the size of the encoded page
+ @param values the values of the page, in sorted order
+ 
+ */
+void LsmSortedRun::DecodePage(const char *buffer, long size, std::vector<dtype> &values)
+{
+    int n;
+    memcpy(&n, buffer, sizeof(int));
+    values.resize(n);
+    
+    const char *p = buffer + sizeof(int);
+    const char *end = buffer + size;
+    for (int i = 0; i < n; i++)
+    {
+        unsigned long key;
+        p = GetVarint(p, end, key);
+        values[i].key = UnZigZag(key);
+        p = GetValue(p, end, values[i].value, i > 0 ? &values[i - 1].value : NULL);
+    }
+}
+
+/**
+ function used to write an encoded page at the page's position in the file
+ 
+ @param page the page number
+ @param buffer the encoded page
+ @param size the size of the encoded page, it must fit in the space of the page
+ 
+ */
+void LsmSortedRun::WritePage(long page, const char *buffer, long size)
+{
+    LsmIOScheduler::charge(size);
+    
+    file.seekp(sizeof(run_header) + pageOffsets[page], std::ios::beg);
+    file.write(buffer, size);
+    
+    // count the write against this run
+    ioStats.nodeWrites++;
+    ioStats.bytesWritten += size;
+}
+
+/**
+ function used to read and decode a page
+ 
+ @param page the page number
+ @param values the values of the page, in sorted order
+ @param isLookup true when the read is made on behalf of search_value
+ 
+ */
+void LsmSortedRun::ReadPage(long page, std::vector<dtype> &values, bool isLookup)
+{
+    char buffer[RUN_PAGE_SIZE];
+    long size = pageOffsets[page + 1] - pageOffsets[page];
+    
+    LsmIOScheduler::charge(size);
+    
+    file.seekg(sizeof(run_header) + pageOffsets[page], std::ios::beg);
+    file.read(buffer, size);
+    
+    // count the read against this run
+    ioStats.nodeReads++;
+    ioStats.bytesRead += size;
+    if (isLookup) ioStats.lookupReads++;
+    
+    DecodePage(buffer, size, values);
+}
+
+/**
+ function used to locate the page that may contain a value, based on binary search of the page index
+ 
+ @param x the value to search for
+ @return the page number, or -1 when the value is below the first page
+ 
+ */
+long LsmSortedRun::PageSearch(dtype x)const
+{
+    // find the last page whose first value is not greater than x
+    long left = 0, right = (long) pageIndex.size() - 1, result = -1;
+    while (left <= right)
+    {
+        long middle = (left + right) / 2;
+        if (pageIndex[middle] <= x.value)
+        {
+            result = middle;
+            left = middle + 1;
+        } else {
+            right = middle - 1;
+        }
+    }
+    return result;
+}
+
+/**
+ function used to search for a value in the run
+ 
+ @param x the data value to search for
+ @return true if the value is in the run
+ 
+ */
+bool LsmSortedRun::search_value(dtype x)
+{
+    // the value is outside the key range of the run, no page needs to be read
+    if (header.valuesCount == 0 || x.value < header.minValue || x.value > header.maxValue) return false;
+    
+    std::lock_guard<std::mutex> guard(runMutex);
+    
+    // the point filter does not hold the value, no page needs to be read
+    if (!pointFilter.mayContain(x.value))
+    {
+        ioStats.filterSkips++;
+        return false;
+    }
+    
+    long page = PageSearch(x);
+    if (page < 0) return false;
+    
+    // the value falls after the last value of its page, in the gap before the next page
+    if (pageMaxValues[page] < x.value)
+    {
+        ioStats.zoneSkips++;
+        return false;
+    }
+    
+    // read the single page that may contain the value and binary search it
+    std::vector<dtype> values;
+    ReadPage(page, values, true);
+    
+    long left = 0, right = (long) values.size() - 1;
+    while (left <= right)
+    {
+        long middle = (left + right) / 2;
+        if (values[middle].value == x.value) return true;
+        if (values[middle].value < x.value) left = middle + 1; else right = middle - 1;
+    }
+    return false;
+}
+
+/**
+ function used to search for a batch of values in the run, a page holding several of the values is read
+ once for all of them
+ 
+ @param values the data values to search for, sorted by value
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ @param first the position in values of the first lookup to search for
+ @param last the position in values after the last lookup to search for
+ 
+ */
+void LsmSortedRun::search_values(const std::vector<dtype> &values, std::vector<char> &states, size_t first, size_t last)
+{
+    if (header.valuesCount == 0) return;
+    
+    std::lock_guard<std::mutex> guard(runMutex);
+    
+    // the values are sorted, so the pages they need are in order and each is read at most once
+    long currentPage = -1;
+    std::vector<dtype> pageValues;
+    for (size_t i = first; i < last; i++)
+    {
+        if (states[i] != LookupPending) continue;
+        if (values[i].value < header.minValue || values[i].value > header.maxValue) continue;
+        
+        if (!pointFilter.mayContain(values[i].value))
+        {
+            ioStats.filterSkips++;
+            continue;
+        }
+        
+        long page = PageSearch(values[i]);
+        if (page < 0) continue;
+        
+        if (pageMaxValues[page] < values[i].value)
+        {
+            ioStats.zoneSkips++;
+            continue;
+        }
+        
+        if (page != currentPage)
+        {
+            ReadPage(page, pageValues, true);
+            currentPage = page;
+        }
+        
+        long left = 0, right = (long) pageValues.size() - 1;
+        while (left <= right)
+        {
+            long middle = (left + right) / 2;
+            if (pageValues[middle].value == values[i].value)
+            {
+                states[i] = LookupFound;
+                break;
+            }
+            if (pageValues[middle].value < values[i].value) left = middle + 1; else right = middle - 1;
+        }
+    }
+}
+
+/**
+ Function to delete a value from the run, the page holding it is rewritten in place
+
+ @param x the key value pair to be deleted
+ 
+ */
+void LsmSortedRun::DelNode(dtype x)
+{
+    if (header.valuesCount == 0 || x.value < header.minValue || x.value > header.maxValue) return;
+    
+    std::lock_guard<std::mutex> guard(runMutex);
+    
+    long page = PageSearch(x);
+    if (page < 0 || pageMaxValues[page] < x.value) return;
+    
+    std::vector<dtype> values;
+    ReadPage(page, values);
+    
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (values[i].value == x.value)
+        {
+            // removing a value always leaves the page small enough to be written back to the same place,
+            // the difference between the values around it never takes more bytes than the two differences
+            values.erase(values.begin() + i);
+            if (!values.empty()) pageMaxValues[page] = values.back().value;
+            
+            char buffer[RUN_PAGE_SIZE];
+            long size;
+            EncodePage(values, 0, values.size(), buffer, size);
+            WritePage(page, buffer, size);
+            
+            header.valuesCount--;
+            WriteHeader();
+            return;
+        }
+    }
+}
+
+/**
+ function used to read every value of the run
+ 
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmSortedRun::getValues(std::vector<dtype> &values)
+{
+    values.reserve(values.size() + header.valuesCount);
+    
+    // the run is locked a page at a time, so lookups are not kept waiting while a merge reading the run is
+    // held back by the I/O scheduler
+    std::vector<dtype> pageValues;
+    for (long page = 0; page < header.pagesCount; page++)
+    {
+        std::lock_guard<std::mutex> guard(runMutex);
+        ReadPage(page, pageValues);
+        values.insert(values.end(), pageValues.begin(), pageValues.end());
+    }
+}
+
+/**
+ function used to read the values of the run within a range, only the pages that may hold them are read
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmSortedRun::getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    // the range is outside the key range of the run, no page needs to be read
+    if (header.valuesCount == 0 || high < header.minValue || header.maxValue < low) return;
+    
+    std::lock_guard<std::mutex> guard(runMutex);
+    
+    // the range filter holds no prefix of the range, the run has no value in it
+    if (!rangeFilter.mayContainRange(low, high))
+    {
+        ioStats.rangeSkips++;
+        return;
+    }
+    
+    // start at the page that may hold the smallest value of the range
+    dtype x;
+    x.key = 0;
+    x.value = low;
+    long page = PageSearch(x);
+    if (page < 0) page = 0;
+    
+    // the range starts after the last value of that page, so its values start on the next page
+    if (page < header.pagesCount && pageMaxValues[page] < low)
+    {
+        ioStats.zoneSkips++;
+        page++;
+    }
+    
+    std::vector<dtype> pageValues;
+    for (; page < header.pagesCount && !(high < pageIndex[page]); page++)
+    {
+        ReadPage(page, pageValues);
+        for (size_t i = 0; i < pageValues.size(); i++)
+        {
+            if (!(pageValues[i].value < low) && !(high < pageValues[i].value)) values.push_back(pageValues[i]);
+        }
+    }
+}
+
+/**
+ function used to close the run and delete its file from disk
+ 
+ */
+void LsmSortedRun::removeFile()
+{
+    std::lock_guard<std::mutex> guard(runMutex);
+    
+    if (file.is_open()) file.close();
+    remove(fileName.c_str());
+}
+
+/**
+ function used to get a copy of the I/O counters for this run
+ 
+ @return the counters for this run
+ 
+ */
+LsmLevelIOStats LsmSortedRun::getIOStats()
+{
+    std::lock_guard<std::mutex> guard(runMutex);
+    return ioStats;
+}
@@ -0,0 +1,240 @@
+/**
+ C++11 - GCC Compiler
+ LsmSortedRun.h
+ 
+ Creates a sorted run on disk, a file holding the values of a key range in sorted order.
+ The values are written once, when the run is created by a rolling merge, into compressed pages.
+ An in memory index holding the first value, last value and file position of every page lets a search
+ read a single page, and no page at all when the value falls between two pages.
+ 
+ Pages are compressed with delta and varint encoding - each value is stored as its difference from the
+ value before it, and numbers are stored in as few bytes as they need, 7 bits per byte. A page is filled
+ until its encoded values reach RUN_PAGE_SIZE bytes and pages are written back to back, so only the
+ encoded bytes are read and written.
+ 
+ A prefix range filter of the values is built with the run and written after the page index, so a scan
+ of a range the run holds no value near reads no page. A point filter of the values, sized by the filter
+ bits per value of the level, is written after it so a lookup of a value the run does not hold reads no
+ page, except for the false positives.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMSORTEDRUN_H
+#define LSMSORTEDRUN_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LsmLevelDisk.h"
+#include "LsmPointFilter.h"
+#include "LsmRangeFilter.h"
+
+// the largest size, in bytes, of each page of a sorted run file
+#define RUN_PAGE_SIZE 4096
+
+// the number of values that fit in a page when they do not compress, after the int holding the count
+// of values in the page
+#define RUN_PAGE_VALUES ((long)((RUN_PAGE_SIZE - sizeof(int)) / sizeof(dtype)))
+
+// struct to define the header written at the beginning of each sorted run file
+struct run_header {
+    long signature;    // used to verify the file is a sorted run
+    long valuesCount;  // the number of values in the run
+    long pagesCount;   // the number of pages in the run
+    long pagesBytes;   // the number of bytes of the pages, written after the header
+    long filterWords;  // the number of words of the range filter, written after the page zone maps
+    long pointFilterWords;   // the number of words of the point filter, written after the range filter
+    long pointFilterHashes;  // the number of bits set for each value in the point filter
+    lsm_value_t minValue;  // the smallest value in the run
+    lsm_value_t maxValue;  // the largest value in the run
+};
+
+class LsmSortedRun {
+public:
+    
+    /**
+     Constructor to open an existing sorted run file
+     
+     @param RunFileName the name of the file for the run
+     
+     */
+    LsmSortedRun(const char *RunFileName);
+    
+    ~LsmSortedRun();
+    
+    /**
+     create a new sorted run file from sorted values
+     
+     @param RunFileName the name of the file to create
+     @param values the values to write, sorted by value with no duplicates
+     @param first the position in values of the first value to write
+     @param last the position in values after the last value to write
+     @param filterBitsPerKey the point filter bits for each value, 0 to write the run without a point filter
+     @return a pointer to the new run, owned by the caller
+     
+     */
+    static LsmSortedRun* create(const char *RunFileName, const std::vector<dtype> &values, long first, long last, double filterBitsPerKey = 0);
+    
+    /**
+     function used to search for a value in the run
+     
+     @param x the data value to search for
+     @return true if the value is in the run
+     
+     */
+    bool search_value(dtype x);
+    
+    /**
+     function used to search for a batch of values in the run, a page holding several of the values is read
+     once for all of them
+     
+     @param values the data values to search for, sorted by value
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     @param first the position in values of the first lookup to search for
+     @param last the position in values after the last lookup to search for
+     
+     */
+    void search_values(const std::vector<dtype> &values, std::vector<char> &states, size_t first, size_t last);
+
+    /**
+     Function to delete a value from the run, the page holding it is rewritten in place
+     
+     @param x the key value pair to be deleted
+     
+     */
+    void DelNode(dtype x);
+    
+    /**
+     function used to read every value of the run
+     
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getValues(std::vector<dtype> &values);
+    
+    /**
+     function used to read the values of the run within a range, only the pages that may hold them are read
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void getRangeValues(const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+
+    /**
+     function used to close the run and delete its file from disk
+     
+     */
+    void removeFile();
+    
+    // functions to get the header information of the run
+    long getValuesCount()const {return header.valuesCount;}
+    lsm_value_t getMinValue()const {return header.minValue;}
+    lsm_value_t getMaxValue()const {return header.maxValue;}
+    const std::string &getFileName()const {return fileName;}
+    
+    /**
+     function used to get a copy of the I/O counters for this run
+     
+     @return the counters for this run
+     
+     */
+    LsmLevelIOStats getIOStats();
+
+private:
+    
+    // private constructor used by create
+    LsmSortedRun();
+    
+    // the name of the file associated with this run
+    std::string fileName;
+    
+    // represents the file associated with this run on disk
+    std::fstream file;
+    
+    // the header of the run, kept in memory
+    run_header header;
+    
+    // the first value of every page, used to find the page that may contain a value
+    std::vector<lsm_value_t> pageIndex;
+    
+    // the last value of every page, with the first value the zone map of the page
+    std::vector<lsm_value_t> pageMaxValues;
+    
+    // the position of every page after the header, and the position after the last page
+    std::vector<long> pageOffsets;
+    
+    // the prefix range filter of the values, built when the run is created and not changed after
+    LsmRangeFilter rangeFilter;
+    
+    // the point filter of the values, built when the run is created and not changed after
+    LsmPointFilter pointFilter;
+
+    // the I/O counters for this run, protected by the run mutex
+    LsmLevelIOStats ioStats;
+    
+    // a mutex used to allow only one thread at a time to use the file
+    std::mutex runMutex;
+    
+    /**
+     function used to locate the page that may contain a value, based on binary search of the page index
+     
+     @param x the value to search for
+     @return the page number, or -1 when the value is below the first page
+     
+     */
+    long PageSearch(dtype x)const;
+    
+    /**
+     function used to read and decode a page
+     
+     @param page the page number
+     @param values the values of the page, in sorted order
+     @param isLookup true when the read is made on behalf of search_value
+     
+     */
+    void ReadPage(long page, std::vector<dtype> &values, bool isLookup = false);
+    
+    /**
+     function used to write an encoded page at the page's position in the file
+     
+     @param page the page number
+     @param buffer the encoded page
+     @param size the size of the encoded page, it must fit in the space of the page
+     
+     */
+    void WritePage(long page, const char *buffer, long size);
+    
+    /**
+     function used to encode as many values as fit in a page
+     
+     @param values the values to encode, sorted by value
+     @param first the position in values of the first value to encode
+     @param last the position in values after the last value that may be encoded
+     @param buffer the buffer of RUN_PAGE_SIZE bytes the page is encoded into
+     @param size the size of the encoded page
+     @return the position in values after the last value encoded
+     
+     */
+    static long EncodePage(const std::vector<dtype> &values, long first, long last, char *buffer, long &size);
+    
+    /**
+     function used to decode a page
+     
+     @param buffer the encoded page
+     @param size the size of the encoded page
+     @param values the values of the page, in sorted order
+     
+     */
+    static void DecodePage(const char *buffer, long size, std::vector<dtype> &values);
+    
+    /**
+     function used to write the header, page index, page zone maps, range filter and point filter to the file
+     */
+    void WriteHeader();
+};
+
+#endif // LSMSORTEDRUN_H
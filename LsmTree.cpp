@@ -9,6 +9,8 @@
 #include "LsmTree.h"
 #include "LsmLevelDisk.h"
 #include "LsmLevelMemory.h"
+#include "LsmEventListener.h"
+#include "LsmIOScheduler.h"
 
 // includes added for detecting virtual and physical memory usage
 #include "sys/types.h"
@@ -23,15 +25,10 @@
 #include <iostream>
 #include <sstream>
 
+#include <algorithm>
+#include <chrono>
 #include <mutex>
-
-// threads update the value of this atomic bool to determine if updateLevels process in a detached
-// thread has completed. This set to true allows the next thread to enter the updateLevels function
-std::atomic<bool> LsmTree::is_ready(true);
-
-// a mutex used to lock access to portions of read and write related to the Node objects and the root
-// object of each BTree on disk
-std::mutex m;
+#include <climits>
 
 /**
  Constructor to initialize the Lsm Tree using tunable parameters.
@@ -46,20 +43,25 @@ std::mutex m;
  @param c0_percentage_of_c1 what percentage of c1 can c0 be before a rolling merge occurs?
  @param threadedRollingMerge should the threaded rolling merge occur in its own thread?
  
- // 1 FUTURE PLAN - for chunk all moves to where it can fit
- // 2 ONLY ONE FUNCTIONAL AT THIS TIME - for insert all here then take out whatever doesn't fit and move to next
+ // 1 leveled - each level is made of sorted runs with non-overlapping key ranges, a compaction moves one run
+ //   and merges it with only the overlapping runs of the next level
+ // 2 for insert all here then take out whatever doesn't fit and move to next
+ // 3 size-tiered - each level holds up to sizeBetweenLevels sorted runs with overlapping key ranges, once full
+ //   they are merged together into a single run of the next level
  @param mergeStrategy LsmTree::updateLevels() determines strategy using this param
+ @param filePrefix the prefix of the names of the level files, used to keep the files of several Lsm Trees apart
  
  */
-LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelMaxFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge)
+LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelMaxFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge, const std::string &filePrefix)
 {
-
+    
     // class member variables to represent the tunable parameters passsed in the constructor for usage during the
     // lifetime of the application
     LsmTree::c0DataStructure = c0DataStructure;
     LsmTree::copyAllFromC0 = copyAllFromC0;
     LsmTree::numberOfLevels = numberOfLevels;
     LsmTree::mergeStrategy = mergeStrategy;
+    LsmTree::sizeBetweenLevels = sizeBetweenLevels;
     LsmTree::firstLevelFileSize = firstLevelMaxFileSize;
     LsmTree::c0_percentage_of_c1 = c0_percentage_of_c1;
     LsmTree::c0_percentage_to_copy = c0_percentage_to_copy;
@@ -67,6 +69,54 @@ LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, lo
     LsmTree::readOptimized = readOptimized;
     LsmTree::isThreadedRollingMerge = threadedRollingMerge;
     
+    // no update levels thread is running and c0 starts empty
+    LsmTree::is_ready = true;
+    LsmTree::c0_limit_counter = 0;
+    LsmTree::rollingMergeCounter = 0;
+    
+    // start the amplification counters at 0
+    LsmTree::lookupsCount = 0;
+    LsmTree::bytesIngested = 0;
+    
+    // no listener is attached until setEventListener is called
+    LsmTree::eventListener = NULL;
+    
+    // the tunable parameters stay as passed in until setTuner is called
+    LsmTree::tuner = NULL;
+    
+    // threaded rolling merges start a detached thread until setMergeDistributor is called
+    LsmTree::mergeDistributor = NULL;
+    
+    // the I/O is not scheduled until setIOScheduler is called
+    LsmTree::ioScheduler = NULL;
+    
+    // lookups are not cached until setRowCache is called
+    LsmTree::rowCache = NULL;
+    
+    // operands are inserted as values until setMergeOperator is called
+    LsmTree::mergeOperator = NULL;
+    
+    // writes are slowed down and blocked at the default multiples of c0, no writes have been held back
+    LsmTree::slowdownDebtLimit = (long) (c0_max_size * WRITE_SLOWDOWN_DEBT_RATIO);
+    LsmTree::stopDebtLimit = (long) (c0_max_size * WRITE_STOP_DEBT_RATIO);
+    LsmTree::compactionDebt = 0;
+    for (int i = 0; i < WRITE_STALL_REASON_COUNT; i++) stallStats[i] = LsmWriteStallStats();
+    
+    // no writes have been made and no snapshots are held
+    LsmTree::lastSequence = 0;
+    LsmTree::snapshotsCount = 0;
+    
+    // the writes kept for the snapshots held are limited to a multiple of c0, none has been expired
+    LsmTree::snapshotVersionsLimit = (long) (c0_max_size * SNAPSHOT_VERSIONS_RATIO);
+    LsmTree::expiredSnapshotsCount = 0;
+    
+    // c0 is empty, so is its zone map
+    LsmTree::isC0ZoneSet = false;
+    
+    // the point tombstones held when the Lsm Tree was last closed still hide the copies in the levels
+    LsmTree::pointTombstonesFileName = filePrefix + "c0.tombstones";
+    pointTombstones.open(pointTombstonesFileName);
+    
     // if c0 is a vector
     if (c0DataStructure == 2)
     {
@@ -81,6 +131,10 @@ LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, lo
     // it is larger after each level creation in the for loop below by using 'sizeBetweenLevels'
     long levelMaxFileSize = firstLevelMaxFileSize;
     
+    // the number of values in each sorted run when mergeStrategy is 1, a quarter of c1 but never less than a page
+    long runMaxValues = (firstLevelMaxFileSize / 50) / 4;
+    if (runMaxValues < RUN_PAGE_VALUES) runMaxValues = RUN_PAGE_VALUES;
+    
     // create the LsmLevel objects for each level of the Disk resident BTrees
     for (int i = 1; i <= numberOfLevels; i++) {
         
@@ -90,6 +144,8 @@ LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, lo
         
         c_level.maxFileSize = levelMaxFileSize;
         
+        c_level.filterBitsPerKey = 0;
+        
         // char to convert int to char for the filename
         char char1;
         
@@ -99,13 +155,46 @@ LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, lo
         char FileName[10] =  { 'c',char1, '.', 'b', 'i', 'n', '\0' };
         
         // create a string of the char array to pass to the constructor of the Btree on disk for the level
-        strncpy(c_level.fileName, FileName, sizeof(c_level.fileName)-1);
+        std::string prefixedFileName = filePrefix + FileName;
+        memset(c_level.fileName, 0, sizeof(c_level.fileName));
+        strncpy(c_level.fileName, prefixedFileName.c_str(), sizeof(c_level.fileName)-1);
+        
+        // the leveled merge strategy keeps each level as sorted runs listed in a manifest instead of a BTree
+        if (mergeStrategy == 1)
+        {
+            new (&lsmLevelPartitions[i]) LsmLevelPartitioned(i, runMaxValues, filePrefix);
+            c_level.lsmLevelPartitioned = &lsmLevelPartitions[i];
+            c_level.lsmLevelTiered = NULL;
+            c_level.lsmLevelDisk = NULL;
+        } else if (mergeStrategy == 3) {
+            // the size-tiered merge strategy keeps each level as up to sizeBetweenLevels overlapping sorted runs
+            new (&lsmLevelTiers[i]) LsmLevelTiered(i, sizeBetweenLevels, filePrefix);
+            c_level.lsmLevelTiered = &lsmLevelTiers[i];
+            c_level.lsmLevelPartitioned = NULL;
+            c_level.lsmLevelDisk = NULL;
+        } else {
+            // create an LsmLevelDisk object for each level, pass in the filename created above
+            new (&lsmLevelDisks[i]) LsmLevelDisk(c_level.fileName);
+            c_level.lsmLevelDisk = &lsmLevelDisks[i];
+            c_level.lsmLevelPartitioned = NULL;
+            c_level.lsmLevelTiered = NULL;
+        }
         
-        // create an LsmLevelDisk object for each level, pass in the filename created above
-        new (&lsmLevelDisks[i]) LsmLevelDisk(c_level.fileName);
-        c_level.lsmLevelDisk = &lsmLevelDisks[i];
+        // the level drops the values deleted by the range and point tombstones, and folds the merge operands,
+        // as it is rewritten
+        if (c_level.lsmLevelPartitioned != NULL) (*c_level.lsmLevelPartitioned).setRangeTombstones(&rangeTombstones);
+        if (c_level.lsmLevelTiered != NULL) (*c_level.lsmLevelTiered).setRangeTombstones(&rangeTombstones);
+        if (c_level.lsmLevelDisk != NULL) (*c_level.lsmLevelDisk).setRangeTombstones(&rangeTombstones);
+        if (c_level.lsmLevelPartitioned != NULL) (*c_level.lsmLevelPartitioned).setPointTombstones(&pointTombstones);
+        if (c_level.lsmLevelTiered != NULL) (*c_level.lsmLevelTiered).setPointTombstones(&pointTombstones);
+        if (c_level.lsmLevelDisk != NULL) (*c_level.lsmLevelDisk).setPointTombstones(&pointTombstones);
+        if (c_level.lsmLevelPartitioned != NULL) (*c_level.lsmLevelPartitioned).setMergeOperands(&mergeOperands);
+        if (c_level.lsmLevelTiered != NULL) (*c_level.lsmLevelTiered).setMergeOperands(&mergeOperands);
+        if (c_level.lsmLevelDisk != NULL) (*c_level.lsmLevelDisk).setMergeOperands(&mergeOperands);
         
         // add the LsmLevel to the vector of levels representing the LsmTree's total levels
+        // the fence pointers of an existing level are built by its first search, so opening is not slowed by
+        // reading the BTree
         levels.push_back(c_level);
         
         // set the max file size for the next level
@@ -115,12 +204,16 @@ LsmTree::LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, lo
 
 LsmTree::~LsmTree()
 {
-    //dtor
+    // finish the asynchronous reads before the levels they search go away
+    readDistributor.reset();
+    
+    // wait for a rolling merge running in a detached thread, it uses the levels of the Lsm Tree
+    waitUntilReady();
+    
+    // the point tombstones not yet retired are kept for when the Lsm Tree is opened again
+    pointTombstones.write(pointTombstonesFileName);
 }
 
-// this counter is used to determine when c0 if full by comparing its value to LsmTree::c0_max_size
-long c0_limit_counter;
-
 /**
  adds a key value pair to the Lsm Tree
  
@@ -129,6 +222,37 @@ long c0_limit_counter;
  */
 void LsmTree::insert_value( dtype value )
 {
+    // count the bytes inserted for the write amplification
+    bytesIngested += sizeof(dtype);
+    if (tuner != NULL) (*tuner).recordWrite();
+    
+    // hold the write back while the threaded rolling merges are behind
+    throttleWrite();
+    
+    // stamp the write with the next sequence number, the write is kept from c0 while a snapshot is held
+    long sequence = ++lastSequence;
+    value.key = sequence;
+    if (holdWrite(VERSION_INSERT, value.value, value.value, sequence)) return;
+    
+    applyInsert(value);
+}
+
+/**
+ write a value to c0, once the write is stamped with its sequence number
+ 
+ @param value the data to be inserted
+ 
+ */
+void LsmTree::applyInsert(dtype value)
+{
+    // a value written into a deleted range is not hidden by the range tombstone
+    rangeTombstones.recordWrite(value.value);
+    
+    // a value written after it was deleted is newer than its point tombstone
+    pointTombstones.recordWrite(value.value);
+    
+    // a value written after merges to it replaces the operands not yet folded
+    mergeOperands.recordWrite(value.value);
     
     // if read optimization is enabled
     if (readOptimized)
@@ -139,29 +263,6 @@ void LsmTree::insert_value( dtype value )
             // if the value is in the tombstone, remove it using the erase function
             tombstoneVector.erase(std::remove(tombstoneVector.begin(), tombstoneVector.end(), value.value), tombstoneVector.end());
         }
-        
-        // if the range for the dataset has not yet been set (this is the first call to insert_value)
-        // then set the min and max values to this first insert
-        if (isRangeSet == false)
-        {
-            LsmTree::minValueOfDataset = value.value;
-            LsmTree::maxValueOfDataset = value.value;
-            
-            // the initial range is set
-            isRangeSet = true;
-        }
-        
-        // set the min and max value present in the dataset
-        // change either value if this new value requires it
-        if (value.value < minValueOfDataset)
-        {
-            LsmTree::minValueOfDataset = value.value;
-        }
-        
-        if (value.value > maxValueOfDataset)
-        {
-            LsmTree::maxValueOfDataset = value.value;
-        }
     }
     
     // c0 is a btree
@@ -211,6 +312,12 @@ void LsmTree::insert_value( dtype value )
             c0Vector.push_back(value.value);
         }
     }
+    
+    // the value is in c0, past any rolling merge the write made
+    widenC0Zone(value.value);
+    
+    // the cached result of the value is stale once the write is made
+    if (rowCache != NULL) (*rowCache).invalidate(value.value);
 }
 
 /**
@@ -221,6 +328,27 @@ void LsmTree::insert_value( dtype value )
  */
 void LsmTree::delete_value(dtype value)
 {
+    if (tuner != NULL) (*tuner).recordDelete();
+    
+    // stamp the write with the next sequence number, the write is kept from c0 while a snapshot is held
+    long sequence = ++lastSequence;
+    if (holdWrite(VERSION_DELETE, value.value, value.value, sequence)) return;
+    
+    applyDelete(value, sequence);
+}
+
+/**
+ delete a value from c0, once the write is stamped with its sequence number
+ 
+ @param value the data to be deleted
+ @param sequence the sequence number of the delete
+ 
+ */
+void LsmTree::applyDelete(dtype value, long sequence)
+{
+    // the operands not yet folded are deleted with the value
+    mergeOperands.recordWrite(value.value);
+    
     // c0 is a BTREE
     if (LsmTree::c0DataStructure == 1)
     {
@@ -232,14 +360,12 @@ void LsmTree::delete_value(dtype value)
             // otherwise, use the blind delete technique
         } else {
             
-            // blind delete at all levels
+            // blind delete, the value is removed from c0 and its older copies in the levels are shadowed by
+            // a point tombstone until a rolling merge removes them
             
             c0.DelNode(value);
             
-            for (int i = 0; i < numberOfLevels; ++i)
-            {
-                (*levels[i].lsmLevelDisk).DelNode(value);
-            }
+            pointTombstones.add(value.value, sequence);
         }
     }
     
@@ -254,16 +380,17 @@ void LsmTree::delete_value(dtype value)
             // otherwise, use the blind delete technique
         } else {
             
-            // blind delete at all levels
+            // blind delete, the value is removed from c0 and its older copies in the levels are shadowed by
+            // a point tombstone until a rolling merge removes them
             
             c0Vector.erase(std::remove(c0Vector.begin(), c0Vector.end(), value.value), c0Vector.end());
             
-            for (int i = 0; i < numberOfLevels; ++i)
-            {
-                (*levels[i].lsmLevelDisk).DelNode(value);
-            }
+            pointTombstones.add(value.value, sequence);
         }
     }
+    
+    // the cached result of the value is stale once the delete is made
+    if (rowCache != NULL) (*rowCache).invalidate(value.value);
 }
 
 /**
@@ -276,177 +403,1073 @@ void LsmTree::delete_value(dtype value)
  */
 bool LsmTree::read_value(dtype value)
 {
-    // if read optimization is enabled, use the min max range technique stop searches quickly when requested values are not in the
-    // range of the LsmTree value set
-    if (LsmTree::readOptimized == true)
+    LsmIOScope ioScope(ioScheduler, IO_Foreground);
+    
+    // count the lookup for the read amplification
+    lookupsCount++;
+    if (tuner != NULL) (*tuner).recordRead();
+    
+    // a write kept from c0 while a snapshot is held is newer than the copies in c0 and the levels
+    bool isPresent;
+    if (versionLog.isPresent(value.value, LONG_MAX, isPresent)) return isPresent;
+    
+    return searchCached(value);
+}
+
+/**
+ Search for the value in the Lsm Tree as it was when a snapshot was taken, a snapshot expired reads the latest
+ values
+ 
+ @param value the data to search for
+ @param snapshot the snapshot to read at, or NULL to read the latest values
+ @return true if the value was in the Lsm Tree when the snapshot was taken
+ 
+ */
+bool LsmTree::read_value(dtype value, const LsmSnapshot *snapshot)
+{
+    if (snapshot == NULL || (*snapshot).isExpired) return read_value(value);
+    
+    LsmIOScope ioScope(ioScheduler, IO_Foreground);
+    
+    // count the lookup for the read amplification
+    lookupsCount++;
+    if (tuner != NULL) (*tuner).recordRead();
+    
+    // the writes made since the snapshot was taken are kept from c0 until it is released, so the newest
+    // version of the value no newer than the snapshot is the one it sees
+    bool isPresent;
+    if (versionLog.isPresent(value.value, (*snapshot).sequence, isPresent)) return isPresent;
+    
+    // the value was not written between the oldest write kept and the snapshot, c0 and the levels hold
+    // the value it sees
+    return searchCached(value);
+}
+
+/**
+ Search for a record in the Lsm Tree by its key and get its newest value, with the operands written to it
+ by merge_value folded in by the merge operator
+ 
+ @param key the record to get, only its key is compared
+ @param result set to the record found
+ @return true if the record is in the Lsm Tree
+ 
+ */
+bool LsmTree::read_value(const lsm_value_t &key, lsm_value_t &result)
+{
+    LsmIOScope ioScope(ioScheduler, IO_Foreground);
+    
+    // count the lookup for the read amplification
+    lookupsCount++;
+    if (tuner != NULL) (*tuner).recordRead();
+    
+    // a read overlapping a rolling merge writing folded records to c0 is made again, so the operands it got
+    // are not folded twice
+    while (true)
     {
-        if (!(value.value >= LsmTree::minValueOfDataset & value.value <= maxValueOfDataset))
+        long generation = mergeOperands.getGeneration();
+        if ((generation & 1) == 1)
         {
-            // the value does not fall within the range contained by the dataset, return false and do not proceed to check the levels
-            return false;
+            std::this_thread::yield();
+            continue;
         }
+        
+        std::vector<lsm_value_t> operands;
+        bool hasOperands = mergeOperands.get(key, operands);
+        
+        lsm_value_t value;
+        bool isFound = readNewest(key, value);
+        if (hasOperands) isFound = mergeOperands.fold(isFound ? &value : NULL, operands, value);
+        
+        // the writes kept from c0 while a snapshot is held are newer than the record read
+        std::vector<LsmVersion> versions;
+        versionLog.get(key, LONG_MAX, versions);
+        for (size_t i = 0; i < versions.size(); i++) isFound = foldVersion(versions[i], key, isFound, value);
+        
+        if (mergeOperands.getGeneration() != generation) continue;
+        
+        if (isFound) result = value;
+        return isFound;
     }
+}
+
+/**
+ deletes every key value pair within a range from the Lsm Tree with a single range tombstone
+ 
+ the levels are not searched or rewritten, lookups and scans hide the values the range tombstone covers and
+ the rolling merges drop them from the levels they rewrite
+ 
+ @param low the smallest value to delete
+ @param high the largest value to delete
+ 
+ */
+void LsmTree::delete_range(const lsm_value_t &low, const lsm_value_t &high)
+{
+    if (high < low) return;
     
-    // c0 is a BTREE
-    if (LsmTree::c0DataStructure == 1)
+    if (tuner != NULL) (*tuner).recordDelete();
+    
+    // stamp the write with the next sequence number, the write is kept from c0 while a snapshot is held
+    long sequence = ++lastSequence;
+    if (holdWrite(VERSION_DELETE_RANGE, low, high, sequence)) return;
+    
+    applyDeleteRange(low, high);
+}
+
+/**
+ delete every value within a range with a range tombstone, once the write is stamped with its sequence number
+ 
+ @param low the smallest value to delete
+ @param high the largest value to delete
+ 
+ */
+void LsmTree::applyDeleteRange(const lsm_value_t &low, const lsm_value_t &high)
+{
+    rangeTombstones.add(low, high);
+    mergeOperands.recordRangeDelete(low, high);
+    
+    // the cached results of the values in the range are stale once it is deleted
+    if (rowCache != NULL) (*rowCache).invalidateRange(low, high);
+}
+
+/**
+ compare two key value pairs by value, used to sort c0 before it is merged into sorted runs
+ 
+ @param a the first key value pair
+ @param b the second key value pair
+ @return true if a sorts before b
+ 
+ */
+static bool compareValues(const dtype &a, const dtype &b)
+{
+    return a.value < b.value;
+}
+
+/**
+ Search for a batch of values in the Lsm Tree, the lookups are sorted by value and searched together, a
+ level at a time
+ 
+ @param values the data to search for
+ @param found set to a vector holding, for each value in the order given, true if the value is found
+ 
+ */
+void LsmTree::read_values(const std::vector<dtype> &values, std::vector<bool> &found)
+{
+    LsmIOScope ioScope(ioScheduler, IO_Foreground);
+    
+    // count the lookups for the read amplification
+    lookupsCount += values.size();
+    if (tuner != NULL)
+    {
+        for (size_t i = 0; i < values.size(); i++) (*tuner).recordRead();
+    }
+    
+    // sort the lookups by value, keeping the position of each to give the results back in order
+    std::vector<size_t> order(values.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&values](size_t a, size_t b) {return values[a].value < values[b].value;});
+    
+    std::vector<dtype> lookups(values.size());
+    for (size_t i = 0; i < order.size(); i++) lookups[i] = values[order[i]];
+    std::vector<char> states(values.size(), LookupPending);
+    
+    // if read optimization is enabled, the values outside the range of the dataset and the values marked as
+    // deleted are answered as read_value does, without searching the levels
+    if (LsmTree::readOptimized)
     {
+        std::vector<lsm_value_t> tombstones(tombstoneVector);
+        std::sort(tombstones.begin(), tombstones.end());
         
-        if (LsmTree::readOptimized) {
-            
-            bool tombstone_search_result = std::find(tombstoneVector.begin(), tombstoneVector.end(), value.value) != tombstoneVector.end();
-            
-            // if value is marked as tombstone delete, exit search
-            if (tombstone_search_result == true)
+        for (size_t i = 0; i < lookups.size(); i++)
+        {
+            if (!isInZones(lookups[i].value))
             {
-                // return true and exit search
-                return tombstone_search_result;
+                states[i] = LookupMissing;
+            } else if (std::binary_search(tombstones.begin(), tombstones.end(), lookups[i].value)) {
+                states[i] = LsmTree::c0DataStructure == 1 ? LookupFound : LookupMissing;
             }
         }
-        
-        // look for the value in c0 memory
-        bool memory_search_result = c0.search_value(value);
-        if (memory_search_result) { return memory_search_result; }
-        
-        // not found in memory, look for it at each level
-        for (int i = 0; i < numberOfLevels; ++i)
-        {
-            bool disk_search_result = (*levels[i].lsmLevelDisk).search_value(value);
-            if (disk_search_result) { return disk_search_result; }
-        }
     }
     
-    // c0 is a vector
-    if (LsmTree::c0DataStructure == 2)
+    // the records with operands not yet folded are found, they were written after any delete of them
+    if (!mergeOperands.empty())
     {
-        if (LsmTree::readOptimized == true) {
-            
-            bool tombstone_search_result = std::find(tombstoneVector.begin(), tombstoneVector.end(), value.value) != tombstoneVector.end();
-            
-            // if value is marked as tombstone delete, exit search
-            if (tombstone_search_result == true)
-            {
-                // found in the tombstone vector, return false for search
-                return false;
-            }
-        }
-        bool memory_search_result = std::find(c0Vector.begin(), c0Vector.end(), value.value) != c0Vector.end();
-        if (memory_search_result == true)
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            return true;
+            if (mergeOperands.contains(lookups[i].value)) states[i] = LookupFound;
         }
-        
-        // not found in memory, look for it at each level
-        for (int i = 0; i < numberOfLevels; ++i)
+    }
+    
+    // the writes kept from c0 while a snapshot is held are newer than the copies in c0 and the levels
+    if (!versionLog.empty())
+    {
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            bool disk_search_result = (*levels[i].lsmLevelDisk).search_value(value);
-            if (disk_search_result == true) {
-                
-                return disk_search_result;
-            }
+            bool isPresent;
+            if (versionLog.isPresent(lookups[i].value, LONG_MAX, isPresent)) states[i] = isPresent ? LookupFound : LookupMissing;
         }
     }
-    return false;
-}
-
-/**
- Update the key value pair of the Lsm Tree
- 
- @param old_value the data to be deleted
- @param new_value the new value to update
- 
- */
-void LsmTree::update_value(dtype old_value, dtype new_value)
-{
     
-    // if read optimization is enabled
-    if (readOptimized == true)
+    // the values in a deleted range and not written since are missing, whichever level holds them
+    if (!rangeTombstones.empty())
     {
-        // if the value is in the tombstone vector, remove it
-        if ((std::find(tombstoneVector.begin(), tombstoneVector.end(), new_value.value) != tombstoneVector.end())) {
-            tombstoneVector.erase(std::remove(tombstoneVector.begin(), tombstoneVector.end(), new_value.value), tombstoneVector.end());
-        }
-        
-        // if the range for the dataset has not yet been set (this is the first call to insert_value
-        // then set the min and max values to this first insert
-        if (isRangeSet == false)
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            LsmTree::minValueOfDataset = new_value.value;
-            LsmTree::maxValueOfDataset = new_value.value;
-            
-            // initial values set for the range
-            isRangeSet = true;
+            if (states[i] == LookupPending && rangeTombstones.isDeleted(lookups[i].value)) states[i] = LookupMissing;
         }
-        
-        // set the min and max value present in the dataset
-        // change either value if this new value requires it
-        if (new_value.value < minValueOfDataset)
+    }
+    
+    // the values deleted by a blind write are missing, the copies left in the levels are older
+    if (!pointTombstones.empty())
+    {
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            
-            LsmTree::minValueOfDataset = new_value.value;
+            if (states[i] == LookupPending && pointTombstones.isDeleted(lookups[i].value)) states[i] = LookupMissing;
         }
-        
-        if (new_value.value > maxValueOfDataset)
+    }
+    
+    // the values with a cached result are answered by the row cache, the others are cached once the levels
+    // are searched, unless one of their shards is written to in the meantime
+    std::vector<long> generations;
+    if (rowCache != NULL)
+    {
+        generations.assign(lookups.size(), -1);
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            LsmTree::maxValueOfDataset = new_value.value;
+            bool isFound;
+            if (states[i] == LookupPending && (*rowCache).lookup(lookups[i].value, isFound, generations[i]))
+            {
+                states[i] = isFound ? LookupFound : LookupMissing;
+            }
         }
     }
     
     // c0 is a BTREE
     if (LsmTree::c0DataStructure == 1)
     {
-        // use tombstone delete technique with read optimized
-        if (LsmTree::readOptimized == true) {
-            
-            tombstoneVector.push_back(old_value.value);
-            
-            // insert new value to c0
-            c0.insert(new_value);
-            
-        } else {
-            
-            // blind delete from memory level c0
-            c0.DelNode(old_value);
-            
-            // not found in memory, blind delete it at at each level until found
-            for (int i = 0; i < numberOfLevels; ++i)
-            {
-                (*levels[i].lsmLevelDisk).DelNode(old_value);
-            }
-            
-            // insert new value to c0
-            c0.insert(new_value);
-        }
+        c0.search_values(lookups, states);
     }
     
-    // c0 is a std::vector
+    // c0 is a vector, it is sorted once for the batch instead of scanned for each value
     if (LsmTree::c0DataStructure == 2)
     {
-        // c0 is small enough to contain the value
-        if (c0_limit_counter < LsmTree::c0_max_size)
+        std::vector<lsm_value_t> memoryValues(c0Vector);
+        std::sort(memoryValues.begin(), memoryValues.end());
+        
+        for (size_t i = 0; i < lookups.size(); i++)
         {
-            
-            if (LsmTree::readOptimized == true)
-            {
-                
-                tombstoneVector.push_back(old_value.value);
-                
-                c0Vector.push_back(new_value.value);
-                
-                c0_limit_counter++;
-                
-            } else {
-                
-                // blind delete at all levels
-                
-                c0Vector.erase(std::remove(c0Vector.begin(), c0Vector.end(), old_value.value), c0Vector.end());
-                
-                for (int i = 0; i < numberOfLevels; ++i)
-                {
-                    (*levels[i].lsmLevelDisk).DelNode(old_value);
-                }
-                
-                // insert new value to c0
-                c0Vector.push_back(new_value.value);
+            if (states[i] == LookupPending && std::binary_search(memoryValues.begin(), memoryValues.end(), lookups[i].value)) states[i] = LookupFound;
+        }
+    }
+    
+    // not found in memory, look for them at each level
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        if (std::find(states.begin(), states.end(), (char) LookupPending) == states.end()) break;
+        searchLevelValues(i, lookups, states);
+    }
+    
+    if (rowCache != NULL)
+    {
+        for (size_t i = 0; i < lookups.size(); i++)
+        {
+            if (generations[i] >= 0) (*rowCache).insert(lookups[i].value, states[i] == LookupFound, generations[i]);
+        }
+    }
+    
+    found.assign(values.size(), false);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        found[order[i]] = states[i] == LookupFound;
+        
+        // every level was searched, the kind of lookup the level filters save I/O for
+        if (states[i] == LookupPending && tuner != NULL) (*tuner).recordEmptyRead();
+    }
+}
+
+/**
+ get the pool running the asynchronous reads, creating it with LSM_READ_THREADS threads the first time
+ 
+ @return the pool
+ 
+ */
+lsm_task_distributor& LsmTree::getReadDistributor()
+{
+    std::call_once(readDistributorOnce, [this]() {
+        readDistributor.reset(new lsm_task_distributor([](std::function<void()> &task) { task(); }, LSM_READ_THREADS, 16));
+    });
+    return (*readDistributor);
+}
+
+/**
+ Search for the value in the Lsm Tree on the read pool of the Lsm Tree
+ 
+ @param value the data to search for
+ @return a future set to true if the value is found
+ 
+ */
+std::future<bool> LsmTree::read_async(dtype value)
+{
+    std::shared_ptr<std::promise<bool>> result(new std::promise<bool>());
+    
+    getReadDistributor()([this, value, result]() {
+        result->set_value(read_value(value));
+    });
+    
+    return result->get_future();
+}
+
+/**
+ Search for the value in the Lsm Tree on the read pool of the Lsm Tree, calling a function with the result
+ 
+ @param value the data to search for
+ @param callback the function called with the value and true if the value is found
+ 
+ */
+void LsmTree::read_async(dtype value, std::function<void(dtype, bool)> callback)
+{
+    getReadDistributor()([this, value, callback]() {
+        callback(value, read_value(value));
+    });
+}
+
+/**
+ Search for a batch of values in the Lsm Tree on the read pool of the Lsm Tree, the values are split into
+ groups of LSM_READ_BATCH_VALUES searched in parallel
+ 
+ @param values the data to search for
+ @return a future set to a vector holding, for each value in the order given, true if the value is found
+ 
+ */
+std::future<std::vector<bool>> LsmTree::read_async(const std::vector<dtype> &values)
+{
+    // the state shared by the groups, the last group to finish sets the result
+    struct read_batch {
+        std::vector<dtype> values;
+        std::vector<char> found;
+        std::atomic<size_t> groupsLeft;
+        std::promise<std::vector<bool>> result;
+    };
+    
+    std::shared_ptr<read_batch> batch(new read_batch());
+    (*batch).values = values;
+    (*batch).found.assign(values.size(), 0);
+    
+    size_t groupsCount = (values.size() + LSM_READ_BATCH_VALUES - 1) / LSM_READ_BATCH_VALUES;
+    (*batch).groupsLeft = groupsCount;
+    
+    std::future<std::vector<bool>> future = (*batch).result.get_future();
+    if (groupsCount == 0)
+    {
+        (*batch).result.set_value(std::vector<bool>());
+        return future;
+    }
+    
+    std::vector<std::function<void()>> tasks;
+    for (size_t group = 0; group < groupsCount; group++)
+    {
+        tasks.push_back([this, batch, group]() {
+            size_t first = group * LSM_READ_BATCH_VALUES;
+            size_t last = std::min(first + LSM_READ_BATCH_VALUES, (*batch).values.size());
+            
+            std::vector<dtype> values((*batch).values.begin() + first, (*batch).values.begin() + last);
+            std::vector<bool> found;
+            read_values(values, found);
+            for (size_t i = first; i < last; i++)
+            {
+                (*batch).found[i] = found[i - first];
+            }
+            
+            if (--(*batch).groupsLeft == 0)
+            {
+                (*batch).result.set_value(std::vector<bool>((*batch).found.begin(), (*batch).found.end()));
+            }
+        });
+    }
+    getReadDistributor().submit(tasks.begin(), tasks.end());
+    
+    return future;
+}
+
+/**
+ get the values of the Lsm Tree within a range
+ 
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order with no duplicates
+ 
+ */
+void LsmTree::scan_values(const lsm_value_t &low, const lsm_value_t &high, std::vector<lsm_value_t> &values)
+{
+    LsmIOScope ioScope(ioScheduler, IO_Foreground);
+    
+    // a scan overlapping a rolling merge writing folded records to c0 is made again, so the operands it got
+    // are not folded twice
+    size_t valuesCount = values.size();
+    while (true)
+    {
+        long generation = mergeOperands.getGeneration();
+        if ((generation & 1) == 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        values.resize(valuesCount);
+        
+        std::vector<dtype> found;
+        
+        // c0 is a BTREE
+        if (LsmTree::c0DataStructure == 1)
+        {
+            c0.getRangeValues(low, high, found);
+        }
+        
+        // c0 is a vector, read newest first
+        if (LsmTree::c0DataStructure == 2)
+        {
+            for (size_t i = c0Vector.size(); i > 0; i--)
+            {
+                if (c0Vector[i - 1] < low || high < c0Vector[i - 1]) continue;
+                
+                dtype x;
+                x.key = 0;
+                x.value = c0Vector[i - 1];
+                found.push_back(x);
+            }
+        }
+        
+        for (int i = 0; i < numberOfLevels; ++i)
+        {
+            scanLevel(i, low, high, found);
+        }
+        
+        // a value held by more than one level is got once, c0 and the levels were read newest first so the
+        // stable sort keeps the newest copy at the front
+        std::stable_sort(found.begin(), found.end(), compareValues);
+        
+        // the values marked as deleted by the tombstone technique are left out
+        std::vector<lsm_value_t> tombstones(tombstoneVector);
+        std::sort(tombstones.begin(), tombstones.end());
+        
+        // the records with operands not yet folded, sorted by record
+        std::vector<LsmMergeStack> stacks;
+        mergeOperands.getRange(low, high, stacks);
+        size_t stackIndex = 0;
+        
+        lsm_value_t folded;
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            if (i > 0 && found[i - 1].value == found[i].value) continue;
+            
+            // the records before this value with operands are not in the levels, they are made from their operands
+            for (; stackIndex < stacks.size() && stacks[stackIndex].operands.back() < found[i].value; stackIndex++)
+            {
+                if (mergeOperands.fold(NULL, stacks[stackIndex].operands, folded)) values.push_back(folded);
+            }
+            
+            bool isDeleted = std::binary_search(tombstones.begin(), tombstones.end(), found[i].value) || rangeTombstones.isDeleted(found[i].value) || pointTombstones.isDeleted(found[i].value);
+            
+            // the operands of the value are folded into it, or into nothing when it is deleted
+            if (stackIndex < stacks.size() && stacks[stackIndex].operands.back() == found[i].value)
+            {
+                if (mergeOperands.fold(isDeleted ? NULL : &found[i].value, stacks[stackIndex].operands, folded)) values.push_back(folded);
+                stackIndex++;
+                continue;
+            }
+            
+            if (isDeleted) continue;
+            values.push_back(found[i].value);
+        }
+        for (; stackIndex < stacks.size(); stackIndex++)
+        {
+            if (mergeOperands.fold(NULL, stacks[stackIndex].operands, folded)) values.push_back(folded);
+        }
+        
+        // the writes kept from c0 while a snapshot is held are newer than the values read, they are applied
+        // to the values in sequence order
+        std::vector<LsmVersion> versions;
+        versionLog.getRange(low, high, LONG_MAX, versions);
+        if (!versions.empty())
+        {
+            std::map<lsm_value_t, lsm_value_t> records;
+            for (size_t i = valuesCount; i < values.size(); i++) records[values[i]] = values[i];
+            
+            for (size_t i = 0; i < versions.size(); i++)
+            {
+                const LsmVersion &version = versions[i];
+                if (version.kind == VERSION_DELETE_RANGE)
+                {
+                    records.erase(records.lower_bound(version.value), records.upper_bound(version.high));
+                    continue;
+                }
+                
+                // an update changes its old value as well as its new one
+                for (int changed = 0; changed < (version.kind == VERSION_UPDATE ? 2 : 1); changed++)
+                {
+                    const lsm_value_t &key = changed == 0 ? version.value : version.high;
+                    if (key < low || high < key) continue;
+                    
+                    std::map<lsm_value_t, lsm_value_t>::iterator it = records.find(key);
+                    lsm_value_t record = it != records.end() ? it->second : key;
+                    if (foldVersion(version, key, it != records.end(), record))
+                    {
+                        records[key] = record;
+                    } else if (it != records.end()) {
+                        records.erase(it);
+                    }
+                }
+            }
+            
+            values.resize(valuesCount);
+            std::map<lsm_value_t, lsm_value_t>::const_iterator it;
+            for (it = records.begin(); it != records.end(); ++it) values.push_back(it->second);
+        }
+        
+        if (mergeOperands.getGeneration() == generation) return;
+    }
+}
+
+/**
+ search c0 and every disk level for the latest value
+ 
+ @param value the data to search for
+ @param isLookup true when the search is made for a read, so an empty read is counted by the tuner
+ @return true if the value is in the Lsm Tree
+ 
+ */
+bool LsmTree::searchLevels(dtype value, bool isLookup)
+{
+    // a record with operands not yet folded was written after any delete of it
+    if (mergeOperands.contains(value.value)) return true;
+    
+    // if read optimization is enabled, use the zone maps of c0 and the levels to stop searches quickly when requested values
+    // are not in the range of any level
+    if (LsmTree::readOptimized == true)
+    {
+        if (!isInZones(value.value))
+        {
+            // the value does not fall within any zone, return false and do not proceed to check the levels
+            return false;
+        }
+    }
+    
+    // the value is in a deleted range and was not written since, the copies in c0 and the levels are hidden
+    if (rangeTombstones.isDeleted(value.value)) return false;
+    
+    // the value was deleted by a blind write, the copies left in the levels are older
+    if (pointTombstones.isDeleted(value.value)) return false;
+    
+    // c0 is a BTREE
+    if (LsmTree::c0DataStructure == 1)
+    {
+        
+        if (LsmTree::readOptimized) {
+            
+            bool tombstone_search_result = std::find(tombstoneVector.begin(), tombstoneVector.end(), value.value) != tombstoneVector.end();
+            
+            // if value is marked as tombstone delete, exit search
+            if (tombstone_search_result == true)
+            {
+                // return true and exit search
+                return tombstone_search_result;
+            }
+        }
+        
+        // look for the value in c0 memory
+        bool memory_search_result = c0.search_value(value);
+        if (memory_search_result) { return memory_search_result; }
+        
+        // not found in memory, look for it at each level
+        for (int i = 0; i < numberOfLevels; ++i)
+        {
+            bool disk_search_result = searchLevel(i, value);
+            if (disk_search_result) { return disk_search_result; }
+        }
+    }
+    
+    // c0 is a vector
+    if (LsmTree::c0DataStructure == 2)
+    {
+        if (LsmTree::readOptimized == true) {
+            
+            bool tombstone_search_result = std::find(tombstoneVector.begin(), tombstoneVector.end(), value.value) != tombstoneVector.end();
+            
+            // if value is marked as tombstone delete, exit search
+            if (tombstone_search_result == true)
+            {
+                // found in the tombstone vector, return false for search
+                return false;
+            }
+        }
+        bool memory_search_result = std::find(c0Vector.begin(), c0Vector.end(), value.value) != c0Vector.end();
+        if (memory_search_result == true)
+        {
+            return true;
+        }
+        
+        // not found in memory, look for it at each level
+        for (int i = 0; i < numberOfLevels; ++i)
+        {
+            bool disk_search_result = searchLevel(i, value);
+            if (disk_search_result == true) {
+                
+                return disk_search_result;
+            }
+        }
+    }
+    
+    // every level was searched, the kind of lookup the level filters save I/O for
+    if (isLookup && tuner != NULL) (*tuner).recordEmptyRead();
+    return false;
+}
+
+/**
+ search for the latest value of a lookup, in the row cache first and then in c0 and every disk level,
+ caching the result
+ 
+ @param value the data to search for
+ @return true if the value is in the Lsm Tree
+ 
+ */
+bool LsmTree::searchCached(dtype value)
+{
+    if (rowCache == NULL) return searchLevels(value, true);
+    
+    bool found;
+    long generation;
+    if ((*rowCache).lookup(value.value, found, generation)) return found;
+    
+    found = searchLevels(value, true);
+    (*rowCache).insert(value.value, found, generation);
+    return found;
+}
+
+/**
+ check the zone maps of c0 and every disk level for a value, top down so a value moved down a level by a
+ rolling merge is still seen by one of them
+ 
+ @param value the value to check
+ @return false if the value is outside every zone, it is not in the Lsm Tree
+ 
+ */
+bool LsmTree::isInZones(const lsm_value_t &value)
+{
+    {
+        std::lock_guard<std::mutex> guard(c0ZoneMutex);
+        if (isC0ZoneSet && !(value < c0MinValue) && !(c0MaxValue < value)) return true;
+    }
+    
+    // a rolling merge inserts a value to the next level before removing it from the previous one
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        if (levelMayContain(i, value, value)) return true;
+    }
+    return false;
+}
+
+/**
+ widen the zone map of c0 to hold a value written to c0
+ 
+ @param value the value written
+ 
+ */
+void LsmTree::widenC0Zone(const lsm_value_t &value)
+{
+    std::lock_guard<std::mutex> guard(c0ZoneMutex);
+    
+    if (!isC0ZoneSet)
+    {
+        c0MinValue = value;
+        c0MaxValue = value;
+        isC0ZoneSet = true;
+        return;
+    }
+    if (value < c0MinValue) c0MinValue = value;
+    if (c0MaxValue < value) c0MaxValue = value;
+}
+
+/**
+ narrow the zone map of c0 once a rolling merge moved values out of it. The zone of a vector is the range
+ of the values left, the zone of a btree is kept until it is emptied
+ 
+ */
+void LsmTree::updateC0Zone()
+{
+    std::lock_guard<std::mutex> guard(c0ZoneMutex);
+    
+    // c0 is a btree, its smallest and largest values are not tracked as values are removed
+    if (LsmTree::c0DataStructure == 1)
+    {
+        if (c0.getValuesCount() == 0) isC0ZoneSet = false;
+        return;
+    }
+    
+    // c0 is a vector, the values left are walked once
+    isC0ZoneSet = !c0Vector.empty();
+    for (size_t i = 0; i < c0Vector.size(); i++)
+    {
+        if (i == 0 || c0Vector[i] < c0MinValue) c0MinValue = c0Vector[i];
+        if (i == 0 || c0MaxValue < c0Vector[i]) c0MaxValue = c0Vector[i];
+    }
+}
+
+/**
+ keep a write in the version log while a snapshot is held, so the snapshots held do not see it. The writes
+ kept that no snapshot held is older than are written to c0 first
+ 
+ @param kind the kind of write, one of the VERSION_ defines
+ @param value the value written, or the smallest value of a range deleted
+ @param high the old value of an update, or the largest value of a range deleted
+ @param sequence the sequence number of the write
+ @return false if the write is to be written to c0, no snapshot is held and no write is kept
+ 
+ */
+bool LsmTree::holdWrite(char kind, const lsm_value_t &value, const lsm_value_t &high, long sequence)
+{
+    // the writes kept go to c0 before this one, so c0 gets the writes in sequence order
+    if (!versionLog.empty()) applyVersions();
+    
+    // a snapshot is counted before it reads the last sequence number, so a snapshot taken before this write
+    // was stamped is counted here
+    if (snapshotsCount == 0 && versionLog.empty()) return false;
+    
+    LsmVersion version;
+    version.sequence = sequence;
+    version.kind = kind;
+    version.value = value;
+    version.high = high;
+    versionLog.add(version);
+    
+    // a snapshot held for long would keep every write made since in memory, past the limit the oldest
+    // snapshots are expired and the writes kept for them are written to c0
+    while (snapshotVersionsLimit > 0 && versionLog.getCount() > snapshotVersionsLimit && expireOldestSnapshot())
+    {
+        applyVersions();
+    }
+    return true;
+}
+
+/**
+ write the writes kept in the version log to c0, in sequence order, up to the oldest snapshot held. A write
+ is removed from the log only once it is in c0, so reads see it in one or the other
+ 
+ */
+void LsmTree::applyVersions()
+{
+    // every snapshot held sees the writes no newer than the oldest, every write is written once none is held
+    long oldestSequence = LONG_MAX;
+    {
+        std::lock_guard<std::mutex> guard(snapshotMutex);
+        if (!snapshots.empty()) oldestSequence = snapshots.begin()->first;
+    }
+    
+    LsmVersion version;
+    while (versionLog.getOldest(version) && version.sequence <= oldestSequence)
+    {
+        dtype x;
+        x.key = version.sequence;
+        x.value = version.value;
+        
+        if (version.kind == VERSION_INSERT) applyInsert(x);
+        if (version.kind == VERSION_DELETE) applyDelete(x, version.sequence);
+        if (version.kind == VERSION_DELETE_RANGE) applyDeleteRange(version.value, version.high);
+        if (version.kind == VERSION_MERGE) applyMerge(x, version.sequence);
+        if (version.kind == VERSION_UPDATE)
+        {
+            dtype old;
+            old.key = 0;
+            old.value = version.high;
+            applyUpdate(old, x, version.sequence);
+        }
+        
+        versionLog.removeOldest();
+    }
+}
+
+/**
+ apply a write kept in the version log to a record read from c0 and the levels
+ 
+ @param version the write
+ @param key the record, only its key is compared
+ @param isFound true if the record is in the Lsm Tree before the write
+ @param value the record before the write, set to the record after it
+ @return true if the record is in the Lsm Tree after the write
+ 
+ */
+bool LsmTree::foldVersion(const LsmVersion &version, const lsm_value_t &key, bool isFound, lsm_value_t &value)
+{
+    // the operand is folded into the record, or into nothing when the record is not in the Lsm Tree
+    if (version.kind == VERSION_MERGE)
+    {
+        std::vector<lsm_value_t> operands(1, version.value);
+        lsm_value_t folded;
+        if (!mergeOperands.fold(isFound ? &value : NULL, operands, folded)) return false;
+        
+        value = folded;
+        return true;
+    }
+    
+    // the old value of an update is deleted, unless the update wrote it back
+    if (version.kind == VERSION_INSERT || (version.kind == VERSION_UPDATE && version.value == key))
+    {
+        value = version.value;
+        return true;
+    }
+    return false;
+}
+
+/**
+ get the newest value of a record from c0 and the disk levels, without the operands written to it
+ 
+ @param key the record to get, only its key is compared
+ @param value set to the record found
+ @return false if the record is not in the Lsm Tree or is deleted
+ 
+ */
+bool LsmTree::readNewest(const lsm_value_t &key, lsm_value_t &value)
+{
+    if (isHidden(key)) return false;
+    if (readC0(key, value)) return true;
+    
+    // not found in memory, the first level holding the record holds its newest value
+    std::vector<dtype> found;
+    for (int i = 0; i < numberOfLevels && found.empty(); ++i)
+    {
+        scanLevel(i, key, key, found);
+    }
+    
+    if (found.empty()) return false;
+    value = found[0].value;
+    return true;
+}
+
+/**
+ check whether a record is hidden from the lookups without reading c0 or a level, because it is deleted or
+ outside the zones of c0 and the levels
+ 
+ @param key the record to check, only its key is compared
+ @return true if the record is not in the Lsm Tree
+ 
+ */
+bool LsmTree::isHidden(const lsm_value_t &key)
+{
+    // the record is deleted and was not written since, the copies in c0 and the levels are hidden
+    if (LsmTree::readOptimized == true)
+    {
+        if (!isInZones(key)) return true;
+        if (std::find(tombstoneVector.begin(), tombstoneVector.end(), key) != tombstoneVector.end()) return true;
+    }
+    return rangeTombstones.isDeleted(key) || pointTombstones.isDeleted(key);
+}
+
+/**
+ get the newest value of a record held by c0
+ 
+ @param key the record to get, only its key is compared
+ @param value set to the record found
+ @return false if c0 holds no copy of the record
+ 
+ */
+bool LsmTree::readC0(const lsm_value_t &key, lsm_value_t &value)
+{
+    // c0 is a BTREE
+    if (LsmTree::c0DataStructure == 1)
+    {
+        std::vector<dtype> found;
+        c0.getRangeValues(key, key, found);
+        if (found.empty()) return false;
+        
+        value = found[0].value;
+        return true;
+    }
+    
+    // c0 is a vector, the last copy pushed is the newest
+    for (size_t i = c0Vector.size(); i > 0; i--)
+    {
+        if (c0Vector[i - 1] != key) continue;
+        
+        value = c0Vector[i - 1];
+        return true;
+    }
+    return false;
+}
+
+/**
+ take a snapshot of the Lsm Tree, reads made with it see the values present when it was taken while
+ writes and rolling merges continue
+ 
+ @return the snapshot, to be released with releaseSnapshot
+ 
+ */
+const LsmSnapshot* LsmTree::getSnapshot()
+{
+    std::lock_guard<std::mutex> guard(snapshotMutex);
+    
+    // the snapshot is counted before it reads the last sequence number, so a write stamped after it is kept
+    // from c0
+    snapshotsCount++;
+    
+    LsmSnapshot *snapshot = new LsmSnapshot();
+    (*snapshot).sequence = lastSequence;
+    (*snapshot).isExpired = false;
+    snapshots.insert(std::make_pair((*snapshot).sequence, snapshot));
+    
+    return snapshot;
+}
+
+/**
+ release a snapshot, the versions recorded for writes no remaining snapshot can see are removed
+ 
+ @param snapshot the snapshot returned by getSnapshot
+ 
+ */
+void LsmTree::releaseSnapshot(const LsmSnapshot *snapshot)
+{
+    if (snapshot == NULL) return;
+    
+    std::lock_guard<std::mutex> guard(snapshotMutex);
+    
+    // a snapshot expired is no longer held
+    std::multimap<long, LsmSnapshot*>::iterator held = snapshots.lower_bound((*snapshot).sequence);
+    for (; held != snapshots.end() && held->first == (*snapshot).sequence; ++held)
+    {
+        if (held->second != snapshot) continue;
+        
+        snapshots.erase(held);
+        break;
+    }
+    snapshotsCount = snapshots.size();
+    delete snapshot;
+}
+
+/**
+ expire the oldest snapshot held, reads made with it see the latest values from then on
+ 
+ @return false if no snapshot is held
+ 
+ */
+bool LsmTree::expireOldestSnapshot()
+{
+    std::lock_guard<std::mutex> guard(snapshotMutex);
+    if (snapshots.empty()) return false;
+    
+    // the snapshot is marked before the writes kept for it are written to c0, so a read made with it that
+    // finds it not expired once the read is done saw the values present when it was taken
+    (*snapshots.begin()->second).isExpired = true;
+    snapshots.erase(snapshots.begin());
+    snapshotsCount = snapshots.size();
+    expiredSnapshotsCount++;
+    return true;
+}
+
+/**
+ set the limit of the writes kept in the version log while snapshots are held, a write past the limit expires
+ the oldest snapshots held until the writes kept are back under it
+ 
+ @param versions the writes kept the oldest snapshot is expired above, 0 to never expire a snapshot
+ 
+ */
+void LsmTree::setSnapshotVersionsLimit(long versions)
+{
+    LsmTree::snapshotVersionsLimit = versions;
+}
+
+/**
+ Update the key value pair of the Lsm Tree
+ 
+ @param old_value the data to be deleted
+ @param new_value the new value to update
+ 
+ */
+void LsmTree::update_value(dtype old_value, dtype new_value)
+{
+    // count the bytes inserted for the write amplification
+    bytesIngested += sizeof(dtype);
+    if (tuner != NULL) (*tuner).recordWrite();
+    
+    // hold the write back while the threaded rolling merges are behind
+    throttleWrite();
+    
+    // stamp the write with the next sequence number, the write is kept from c0 while a snapshot is held
+    long sequence = ++lastSequence;
+    new_value.key = sequence;
+    if (holdWrite(VERSION_UPDATE, new_value.value, old_value.value, sequence)) return;
+    
+    applyUpdate(old_value, new_value, sequence);
+}
+
+/**
+ update a value in c0, once the write is stamped with its sequence number
+ 
+ @param old_value the data to be deleted
+ @param new_value the new value to update
+ @param sequence the sequence number of the update
+ 
+ */
+void LsmTree::applyUpdate(dtype old_value, dtype new_value, long sequence)
+{
+    rangeTombstones.recordWrite(new_value.value);
+    mergeOperands.recordWrite(old_value.value);
+    mergeOperands.recordWrite(new_value.value);
+    
+    // if read optimization is enabled
+    if (readOptimized == true)
+    {
+        // if the value is in the tombstone vector, remove it
+        if ((std::find(tombstoneVector.begin(), tombstoneVector.end(), new_value.value) != tombstoneVector.end())) {
+            tombstoneVector.erase(std::remove(tombstoneVector.begin(), tombstoneVector.end(), new_value.value), tombstoneVector.end());
+        }
+    }
+    
+    // c0 is a BTREE
+    if (LsmTree::c0DataStructure == 1)
+    {
+        // use tombstone delete technique with read optimized
+        if (LsmTree::readOptimized == true) {
+            
+            tombstoneVector.push_back(old_value.value);
+            
+            // insert new value to c0
+            c0.insert(new_value);
+        
+        } else {
+            
+            // blind delete from memory level c0
+            c0.DelNode(old_value);
+            
+            // the older copies in the levels are shadowed by a point tombstone until a rolling merge removes them
+            pointTombstones.add(old_value.value, sequence);
+            
+            // insert new value to c0
+            c0.insert(new_value);
+        }
+    }
+    
+    // c0 is a std::vector
+    if (LsmTree::c0DataStructure == 2)
+    {
+        // c0 is small enough to contain the value
+        if (c0_limit_counter < LsmTree::c0_max_size)
+        {
+            
+            if (LsmTree::readOptimized == true)
+            {
+                
+                tombstoneVector.push_back(old_value.value);
+                
+                c0Vector.push_back(new_value.value);
+                
+                c0_limit_counter++;
+            
+            } else {
+                
+                // blind delete, the older copies in the levels are shadowed by a point tombstone
+                
+                c0Vector.erase(std::remove(c0Vector.begin(), c0Vector.end(), old_value.value), c0Vector.end());
+                
+                pointTombstones.add(old_value.value, sequence);
+                
+                // insert new value to c0
+                c0Vector.push_back(new_value.value);
                 
                 c0_limit_counter++;
             }
@@ -465,7 +1488,7 @@ void LsmTree::update_value(dtype old_value, dtype new_value)
                 // insert the value to c0
                 c0Vector.push_back(new_value.value);
                 tombstoneVector.push_back(old_value.value);
-                
+            
             } else {
                 
                 // true - copy entire c0 to c1 on rollingMerge
@@ -473,139 +1496,824 @@ void LsmTree::update_value(dtype old_value, dtype new_value)
                 
                 c0_limit_counter = 0;
                 
-                // blind delete at all levels
+                // blind delete, the older copies in the levels are shadowed by a point tombstone
                 c0Vector.erase(std::remove(c0Vector.begin(), c0Vector.end(), old_value.value), c0Vector.end());
                 
-                for (int i = 0; i < numberOfLevels; ++i)
-                {
-                    (*levels[i].lsmLevelDisk).DelNode(old_value);
-                }
+                pointTombstones.add(old_value.value, sequence);
                 
                 // insert the value to c0
                 c0Vector.push_back(new_value.value);
             }
         }
     }
+    
+    // the new value is in c0, past any rolling merge the update made
+    widenC0Zone(new_value.value);
+    
+    // the new value is newer than the point tombstone of the old value when the two are the same
+    pointTombstones.recordWrite(new_value.value);
+    
+    // the cached results of both values are stale once the update is made
+    if (rowCache != NULL)
+    {
+        (*rowCache).invalidate(old_value.value);
+        (*rowCache).invalidate(new_value.value);
+    }
+}
+
+/**
+ write an operand for the merge operator to fold into the value of its record. The write is blind, the
+ operand is stacked on the operands of its record and no level is read
+ 
+ @param operand the operand
+ 
+ */
+void LsmTree::merge_value(dtype operand)
+{
+    // without a merge operator there is nothing to fold, the operand is the value
+    if (mergeOperator == NULL)
+    {
+        insert_value(operand);
+        return;
+    }
+    
+    // count the bytes inserted for the write amplification
+    bytesIngested += sizeof(dtype);
+    if (tuner != NULL) (*tuner).recordWrite();
+    
+    // hold the write back while the threaded rolling merges are behind
+    throttleWrite();
+    
+    // stamp the write with the next sequence number, the write is kept from c0 while a snapshot is held
+    long sequence = ++lastSequence;
+    if (holdWrite(VERSION_MERGE, operand.value, operand.value, sequence)) return;
+    
+    applyMerge(operand, sequence);
+}
+
+/**
+ stack an operand on the operands of its record, once the write is stamped with its sequence number
+ 
+ @param operand the operand
+ @param sequence the sequence number of the merge
+ 
+ */
+void LsmTree::applyMerge(dtype operand, long sequence)
+{
+    // the operands take room in c0 as inserts do, the rolling merge folds them once c0 is full
+    if (c0_limit_counter < LsmTree::c0_max_size)
+    {
+        c0_limit_counter++;
+    } else {
+        
+        // copyAllFromC0 == true - copy entire c0 to c1 on rollingMerge
+        rollingMerge(LsmTree::copyAllFromC0);
+        
+        // reset the counter for the next batch of inserts to c0
+        c0_limit_counter = 0;
+    }
+    
+    mergeOperands.add(operand.value, sequence);
+    
+    // the cached result of the record is stale once the operand is written
+    if (rowCache != NULL) (*rowCache).invalidate(operand.value);
+}
+
+// three simple functions to get the virtual and physical memory stats
+// found at - http://stackoverflow.com/questions/2513505/how-to-get-available-memory-c-g
+
+// parse lines for proc/self/status file
+int LsmTree::parseLine(char* line){
+    int i = strlen(line);
+    while (*line < '0' || *line > '9') line++;
+    line[i-3] = '\0';
+    i = atoi(line);
+    return i;
+}
+
+// Virtual Memory currently used by current process:
+int LsmTree::getValueVirtualMemory(){ //Note: this value is in KB!
+    FILE* file = fopen("/proc/self/status", "r");
+    int result = -1;
+    char line[128];
+    
+    while (fgets(line, 128, file) != NULL){
+        if (strncmp(line, "VmSize:", 7) == 0){
+            result = parseLine(line);
+            break;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+// physical memory currently used by current process:
+int LsmTree::getValuePhysicalMemory(){ //Note: this value is in KB!
+    FILE* file = fopen("/proc/self/status", "r");
+    int result = -1;
+    char line[128];
+    
+    while (fgets(line, 128, file) != NULL){
+        if (strncmp(line, "VmRSS:", 6) == 0){
+            result = parseLine(line);
+            break;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+/**
+ print the statistics for the LsmTree including the disk level information and memory level value count
+ 
+ example output -
+ 
+ C5 file size is - 670896
+ LEVEL NUMBER - 5
+ maxFileSize - 32000
+ lsmLevelDisk - 0x7fff5fbf6f68
+ fileName - c5.bin
+ the values count in this level is 19370
+ 
+ */
+void LsmTree::printStats() {
+    
+    //struct sysinfo memInfo;
+    
+    //sysinfo (&memInfo);
+    //        long long totalVirtualMem = memInfo.totalram;
+    //        //Add other values in next statement to avoid int overflow on right hand side...
+    //        totalVirtualMem += memInfo.totalswap;
+    //        totalVirtualMem *= memInfo.mem_unit;
+    
+    //       cout << "TOTAL VIRTUAL MEMORY - " << totalVirtualMem << endl;
+    
+    //        long long virtualMemUsed = memInfo.totalram - memInfo.freeram;
+    //        //Add other values in next statement to avoid int overflow on right hand side...
+    //        virtualMemUsed += memInfo.totalswap - memInfo.freeswap;
+    //        virtualMemUsed *= memInfo.mem_unit;
+    //
+    //        cout << "TOTAL VIRTUAL MEMORY USED - " << virtualMemUsed << endl;
+    //
+    //        cout << "TOTAL AVAILABLE VIRTUAL MEMORY - " << totalVirtualMem - virtualMemUsed << endl;
+    //
+    //        // Virtual Memory currently used by current process:
+    //        cout << "Virtual Memory currently used by current process: " << getValueVirtualMemory() << endl;
+    //
+    //        long long totalPhysMem = memInfo.totalram;
+    //        //Multiply in next statement to avoid int overflow on right hand side...
+    //        totalPhysMem *= memInfo.mem_unit;
+    //
+    //        cout << "TOTAL Physical MEMORY  - " << totalPhysMem << endl;
+    //
+    //        // PHYSICAL Memory currently used by current process:
+    //        cout << "PHYSICAL Memory currently used by current process: " << getValuePhysicalMemory() << endl;
+    //
+    //
+    //        long long physMemUsed = memInfo.totalram - memInfo.freeram;
+    //        //Multiply in next statement to avoid int overflow on right hand side...
+    //        physMemUsed *= memInfo.mem_unit;
+    //
+    //        cout << "TOTAL PHYSICAL MEMORY USED - " << physMemUsed << endl;
+    //        cout << "TOTAL AVAILABLE PHYSICAL MEMORY - " << totalPhysMem - physMemUsed << endl;
+    
+    //cout << "C0 PRINT CONTENTS" << endl;
+    //c0.print();
+    
+    /* ********************************************** DEBUG ******************************************************
+     *************************************************************************************************************/
+    cout << endl;
+    cout << "C0 VALUES COUNT " << c0Vector.size() << endl;
+    //c0.print();
+    for (int a = 0; a < LsmTree::numberOfLevels; a++)
+    {
+        cout << "-------------------------------------------------------------------------------" << endl;
+        cout << "C" << a+1 << " file size is - " << getLevelFileSize(a) << endl;
+        cout <<  "LEVEL NUMBER - " << levels[a].levelNumber << endl;
+        cout <<  "maxFileSize - " << levels[a].maxFileSize << endl;
+        cout <<  "lsmLevelDisk - " << levels[a].lsmLevelDisk << endl;
+        cout <<  "fileName - " << levels[a].fileName << endl;
+        if (levels[a].lsmLevelPartitioned != NULL)
+        {
+            cout <<  "sorted runs - " << (*levels[a].lsmLevelPartitioned).getRunsCount() << endl;
+        }
+        if (levels[a].lsmLevelTiered != NULL)
+        {
+            cout <<  "sorted runs - " << (*levels[a].lsmLevelTiered).getRunsCount() << endl;
+        }
+        cout <<  "the values count in this level is " << getLevelValuesCount(a) << endl;
+        
+        // the I/O and merge counters for the level
+        LsmLevelIOStats ioStats = getLevelIOStats(levels[a].levelNumber);
+        cout <<  "node reads - " << ioStats.nodeReads << " (" << ioStats.bytesRead << " bytes), lookup reads - " << ioStats.lookupReads << ", cache hits - " << ioStats.cacheHits << endl;
+        cout <<  "node writes - " << ioStats.nodeWrites << " (" << ioStats.bytesWritten << " bytes)" << endl;
+        cout <<  "keys merged in - " << ioStats.keysMergedIn << ", keys merged out - " << ioStats.keysMergedOut << endl;
+        cout <<  "scans skipped by the range filters - " << ioStats.rangeSkips << ", lookups and scans skipped by the zone maps - " << ioStats.zoneSkips << endl;
+        cout <<  "filter bits per key - " << levels[a].filterBitsPerKey << ", lookups skipped by the point filters - " << ioStats.filterSkips << endl;
+        if (levels[a].lsmLevelDisk != NULL)
+        {
+            cout <<  "fence pointers - " << (*levels[a].lsmLevelDisk).getFencesCount() << endl;
+        }
+        //(*levels[a].lsmLevelDisk).print();
+        cout << endl;
+    }
+    cout << "-------------------------------------------------------------------------------" << endl;
+    cout << "READ AMPLIFICATION - " << getReadAmplification() << " node reads per lookup" << endl;
+    cout << "WRITE AMPLIFICATION - " << getWriteAmplification() << " bytes written per byte inserted" << endl;
+    cout << "SIZE BETWEEN LEVELS - " << sizeBetweenLevels << ", C0 PERCENTAGE OF C1 - " << c0_percentage_of_c1 << endl;
+    if (tuner != NULL)
+    {
+        cout << "TUNER RETUNES - " << (*tuner).getRetunesCount() << endl;
+    }
+    LsmWriteStallStats slowdowns = getWriteStallStats(Stall_Slowdown);
+    LsmWriteStallStats stops = getWriteStallStats(Stall_Stop);
+    LsmWriteStallStats c0Full = getWriteStallStats(Stall_C0Full);
+    cout << "WRITE SLOWDOWNS - " << slowdowns.writes << " (" << slowdowns.micros << " microseconds), STOPS - " << stops.writes << " (" << stops.micros << " microseconds), C0 FULL - " << c0Full.writes << " (" << c0Full.micros << " microseconds)" << endl;
+    if (ioScheduler != NULL)
+    {
+        const char *classNames[IO_PRIORITY_COUNT] = {"FOREGROUND", "FLUSH", "COMPACTION"};
+        for (int i = 0; i < IO_PRIORITY_COUNT; i++)
+        {
+            LsmIOClassStats ioClassStats = (*ioScheduler).getStats((lsm_io_priority) i);
+            cout << classNames[i] << " I/O - " << ioClassStats.bytes << " bytes in " << ioClassStats.requests << " requests, held back " << ioClassStats.waitMicros << " microseconds" << endl;
+        }
+    }
+    if (rowCache != NULL)
+    {
+        LsmRowCacheStats rowCacheStats = (*rowCache).getStats();
+        cout << "ROW CACHE HITS - " << rowCacheStats.hits << " (" << rowCacheStats.negativeHits << " not found), MISSES - " << rowCacheStats.misses << ", ENTRIES - " << rowCacheStats.entries << ", EVICTIONS - " << rowCacheStats.evictions << ", INVALIDATIONS - " << rowCacheStats.invalidations << endl;
+    }
+    cout << "RANGE TOMBSTONES - " << rangeTombstones.getRangesCount() << ", VALUES DROPPED BY MERGES - " << rangeTombstones.getDroppedCount() << endl;
+    cout << "POINT TOMBSTONES - " << pointTombstones.getCount() << ", VALUES DROPPED BY MERGES - " << pointTombstones.getDroppedCount() << ", RETIRED BY MERGES - " << pointTombstones.getRetiredCount() << endl;
+    cout << "MERGE OPERANDS - " << mergeOperands.getCount() << ", COMBINED AS WRITTEN - " << mergeOperands.getPartialMergeCount() << ", RECORDS FOLDED BY MERGES - " << mergeOperands.getFoldedCount() << endl;
+    cout << "LAST SEQUENCE - " << lastSequence << ", SNAPSHOTS HELD - " << snapshotsCount << ", SNAPSHOTS EXPIRED - " << expiredSnapshotsCount << ", VERSIONS KEPT - " << versionLog.getCount() << endl;
+}
+
+/**
+ get the I/O and merge counters for a disk level
+ 
+ @param levelNumber the level to get the counters for --> for example c1 has a value of 1
+ @return the counters for the level
+ 
+ */
+LsmLevelIOStats LsmTree::getLevelIOStats(int levelNumber)
+{
+    return getIOStats(levels[levelNumber - 1]);
+}
+
+/**
+ get the read amplification of the Lsm Tree
+ 
+ @return the average number of disk node reads made by each call to read_value
+ 
+ */
+double LsmTree::getReadAmplification()
+{
+    // no lookups have been made yet
+    if (lookupsCount == 0) return 0;
+    
+    // add up the node reads made by lookups at each level
+    long lookupReads = 0;
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        lookupReads += getIOStats(levels[i]).lookupReads;
+    }
+    return (double) lookupReads / lookupsCount;
+}
+
+/**
+ get the write amplification of the Lsm Tree
+ 
+ @return the bytes written to all disk levels for each byte inserted to the Lsm Tree
+ 
+ */
+double LsmTree::getWriteAmplification()
+{
+    // nothing has been inserted yet
+    if (bytesIngested == 0) return 0;
+    
+    // add up the bytes written to each level
+    long bytesWritten = 0;
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        bytesWritten += getIOStats(levels[i]).bytesWritten;
+    }
+    return (double) bytesWritten / bytesIngested;
+}
+
+/**
+ attach a listener to receive the flush and compaction events of the Lsm Tree
+ 
+ @param listener the listener to attach, or NULL to detach the current listener
+ 
+ */
+void LsmTree::setEventListener(LsmEventListener *listener)
+{
+    LsmTree::eventListener = listener;
+}
+
+/**
+ attach a tuner to adjust the size ratio between levels, the size of c0 and the filter memory of each
+ level to the workload while the Lsm Tree is in use
+ 
+ @param tuner the tuner to attach, or NULL to keep the current settings from now on
+ 
+ */
+void LsmTree::setTuner(LsmTuner *tuner)
+{
+    LsmTree::tuner = tuner;
+}
+
+/**
+ run the update levels process of threaded rolling merges on the threads of a worker queue in place of a
+ new detached thread for each rolling merge
+ 
+ @param mergeDistributor the worker queue to use, or NULL to start a detached thread for each rolling merge
+ 
+ */
+void LsmTree::setMergeDistributor(lsm_task_distributor *mergeDistributor)
+{
+    LsmTree::mergeDistributor = mergeDistributor;
+}
+
+/**
+ schedule the disk I/O of the Lsm Tree by priority, lookups first, then flushes, then compactions
+ 
+ @param ioScheduler the scheduler to charge the I/O to, or NULL to leave the I/O unscheduled
+ 
+ */
+void LsmTree::setIOScheduler(LsmIOScheduler *ioScheduler)
+{
+    LsmTree::ioScheduler = ioScheduler;
+}
+
+/**
+ cache the results of read_value and read_values in front of c0 and every disk level
+ 
+ @param rowCache the cache, or NULL to search the levels for every lookup
+ 
+ */
+void LsmTree::setRowCache(LsmRowCache *rowCache)
+{
+    LsmTree::rowCache = rowCache;
+}
+
+/**
+ set the merge operator folding the operands written by merge_value
+ 
+ @param mergeOperator the merge operator, or NULL to insert the operands as values
+ 
+ */
+void LsmTree::setMergeOperator(LsmMergeOperator *mergeOperator)
+{
+    LsmTree::mergeOperator = mergeOperator;
+    mergeOperands.setMergeOperator(mergeOperator);
+}
+
+/**
+ start the update levels process of a threaded rolling merge, on the merge distributor when one is set or
+ otherwise in a detached thread
+ 
+ @param merge the update levels process to run
+ 
+ */
+void LsmTree::startMerge(std::function<void()> merge)
+{
+    // the flush is complete and no merge is in progress, so the levels can be counted
+    LsmTree::compactionDebt = getCompactionDebt();
+    
+    // set before the merge starts so the next rolling merge waits for it
+    LsmTree::is_ready = false;
+    
+    // the I/O of the merge is charged to the scheduler as compaction, whichever thread runs it. Once it
+    // completes is_ready is set back to true under the ready mutex, so a write waiting on the condition can
+    // not miss the signal and the Lsm Tree is not destroyed while the signal is given
+    LsmIOScheduler *scheduler = ioScheduler;
+    merge = [this, scheduler, merge]() {
+        {
+            LsmIOScope ioScope(scheduler, IO_Compaction);
+            merge();
+        }
+        
+        std::lock_guard<std::mutex> lock(readyMutex);
+        LsmTree::is_ready = true;
+        readyCondition.notify_all();
+    };
+    
+    if (mergeDistributor != NULL)
+    {
+        (*mergeDistributor)(std::move(merge));
+        return;
+    }
+    
+    // detach the new thread and let it finish the update levels
+    std::thread updateLevelsThread(merge);
+    updateLevelsThread.detach();
 }
 
-// three simple functions to get the virtual and physical memory stats
-// found at - http://stackoverflow.com/questions/2513505/how-to-get-available-memory-c-g
+/**
+ get the values the update levels process has to move out of full levels, called while no threaded
+ rolling merge is in progress
+ 
+ @return the values of the levels above their maximum
+ 
+ */
+long LsmTree::getCompactionDebt()
+{
+    long debt = 0;
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        // a full size-tiered level merges all of its runs, and the levels below it are only merged if it is full
+        if (levels[i].lsmLevelTiered != NULL)
+        {
+            if (!(*levels[i].lsmLevelTiered).isFull()) break;
+            debt += getLevelValuesCount(i);
+            continue;
+        }
+        
+        // the last level of the other strategies is left to grow
+        if (i + 1 == numberOfLevels) break;
+        
+        long excess = getLevelValuesCount(i) - (long) levels[i].maxFileSize / 50;
+        if (excess > 0) debt += excess;
+    }
+    return debt;
+}
 
-// parse lines for proc/self/status file
-int LsmTree::parseLine(char* line){
-    int i = strlen(line);
-    while (*line < '0' || *line > '9') line++;
-    line[i-3] = '\0';
-    i = atoi(line);
-    return i;
+/**
+ set the limits of the merge debt, the values written to c0 behind a threaded rolling merge plus the values
+ the merge has still to move out of full levels
+ 
+ @param slowdownValues the debt, in values, writes are slowed down above, 0 to never slow writes down
+ @param stopValues the debt, in values, writes are blocked above, 0 to never block writes
+ 
+ */
+void LsmTree::setWriteStallLimits(long slowdownValues, long stopValues)
+{
+    LsmTree::slowdownDebtLimit = slowdownValues;
+    LsmTree::stopDebtLimit = stopValues;
 }
 
-// Virtual Memory currently used by current process:
-int LsmTree::getValueVirtualMemory(){ //Note: this value is in KB!
-    FILE* file = fopen("/proc/self/status", "r");
-    int result = -1;
-    char line[128];
+/**
+ get the writes held back for a reason and for how long
+ 
+ @param reason the reason the writes were held back
+ @return the writes held back for the reason
+ 
+ */
+LsmWriteStallStats LsmTree::getWriteStallStats(lsm_write_stall reason)
+{
+    std::lock_guard<std::mutex> guard(stallMutex);
+    return stallStats[reason];
+}
+
+/**
+ get the current merge debt, 0 when no threaded rolling merge is in progress
+ 
+ @return the values written to c0 behind the merge in progress plus the values it has still to move
+ 
+ */
+long LsmTree::getWriteDebt()
+{
+    if (LsmTree::is_ready) return 0;
     
-    while (fgets(line, 128, file) != NULL){
-        if (strncmp(line, "VmSize:", 7) == 0){
-            result = parseLine(line);
-            break;
-        }
+    // c0_limit_counter was reset as the merge started, so it counts the values written behind it
+    return compactionDebt + c0_limit_counter;
+}
+
+/**
+ slow down or block a write while the merge debt is above its limits
+ 
+ */
+void LsmTree::throttleWrite()
+{
+    long debt = getWriteDebt();
+    if (debt == 0) return;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    // above the stop limit the write blocks until the merge completes and the debt is paid
+    if (stopDebtLimit > 0 && debt >= stopDebtLimit)
+    {
+        waitUntilReady();
+        recordStall(Stall_Stop, start);
+        return;
     }
-    fclose(file);
-    return result;
+    
+    if (slowdownDebtLimit <= 0 || debt <= slowdownDebtLimit) return;
+    
+    // the delay grows with the debt, from nothing at the slowdown limit to WRITE_SLOWDOWN_MAX_MICROS at the
+    // stop limit, so writes slow down gradually as the merge falls behind in place of stopping all at once
+    double range = stopDebtLimit > slowdownDebtLimit ? stopDebtLimit - slowdownDebtLimit : slowdownDebtLimit;
+    double pressure = (debt - slowdownDebtLimit) / range;
+    if (pressure > 1) pressure = 1;
+    
+    long delayMicros = (long) (WRITE_SLOWDOWN_MAX_MICROS * pressure);
+    if (delayMicros < 1) delayMicros = 1;
+    std::this_thread::sleep_for(std::chrono::microseconds(delayMicros));
+    
+    recordStall(Stall_Slowdown, start);
 }
 
-// physical memory currently used by current process:
-int LsmTree::getValuePhysicalMemory(){ //Note: this value is in KB!
-    FILE* file = fopen("/proc/self/status", "r");
-    int result = -1;
-    char line[128];
+/**
+ wait for the threaded rolling merge in progress to complete before c0 is merged again, counting the wait as a
+ c0 full stall
+ 
+ */
+void LsmTree::waitForMerge()
+{
+    if (LsmTree::is_ready) return;
     
-    while (fgets(line, 128, file) != NULL){
-        if (strncmp(line, "VmRSS:", 6) == 0){
-            result = parseLine(line);
-            break;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    waitUntilReady();
+    recordStall(Stall_C0Full, start);
+}
+
+/**
+ block until the threaded rolling merge in progress completes, without counting a stall
+ 
+ */
+void LsmTree::waitUntilReady()
+{
+    std::unique_lock<std::mutex> lock(readyMutex);
+    readyCondition.wait(lock, [this]() {return (bool) LsmTree::is_ready;});
+}
+
+/**
+ count a write held back since a time
+ 
+ @param reason the reason the write was held back
+ @param start when the write started to be held back
+ 
+ */
+void LsmTree::recordStall(lsm_write_stall reason, std::chrono::steady_clock::time_point start)
+{
+    long micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    
+    std::lock_guard<std::mutex> guard(stallMutex);
+    stallStats[reason].writes++;
+    stallStats[reason].micros += micros;
+}
+
+/**
+ apply the settings chosen by the tuner once it has counted its window of operations
+ 
+ waits for a detached update levels thread to complete, since the maximum size of the levels changes
+ 
+ */
+void LsmTree::applyTuner()
+{
+    if (!(*tuner).isDue()) return;
+    
+    // make this thread wait until the detached thread running update levels has completed
+    waitUntilReady();
+    
+    // describe the Lsm Tree and its current settings to the tuner
+    LsmTreeShape shape;
+    shape.totalValues = 0;
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        shape.totalValues += getLevelValuesCount(i);
+    }
+    shape.firstLevelValues = firstLevelFileSize / 50;
+    shape.numberOfLevels = numberOfLevels;
+    shape.isTiered = mergeStrategy == 3;
+    
+    LsmTuning current;
+    current.sizeBetweenLevels = sizeBetweenLevels;
+    current.c0_percentage_of_c1 = c0_percentage_of_c1;
+    
+    LsmTuning tuning = (*tuner).tune(shape, current);
+    
+    // c0 takes its new size from the next insert on
+    LsmTree::sizeBetweenLevels = tuning.sizeBetweenLevels;
+    LsmTree::c0_percentage_of_c1 = tuning.c0_percentage_of_c1;
+    LsmTree::c0_max_size = (long) (LsmTree::firstLevelFileSize * LsmTree::c0_percentage_of_c1) / 50;
+    
+    // the levels after c1 take their maximum size from the new size ratio, a level over its new maximum
+    // passes the values it no longer has room for to the next level on its next update
+    long levelMaxFileSize = firstLevelFileSize;
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        levels[i].maxFileSize = levelMaxFileSize;
+        levels[i].filterBitsPerKey = tuning.filterBitsPerKey[i];
+        
+        // the point filters of the level take their new size as they are built, so the filter memory moves
+        // between the levels over the following merges
+        if (levels[i].lsmLevelDisk != NULL)
+        {
+            (*levels[i].lsmLevelDisk).setFilterBitsPerKey(levels[i].filterBitsPerKey);
+        }
+        if (levels[i].lsmLevelPartitioned != NULL)
+        {
+            (*levels[i].lsmLevelPartitioned).setFilterBitsPerKey(levels[i].filterBitsPerKey);
+        }
+        if (levels[i].lsmLevelTiered != NULL)
+        {
+            (*levels[i].lsmLevelTiered).setMaxRunsCount(sizeBetweenLevels);
+            (*levels[i].lsmLevelTiered).setFilterBitsPerKey(levels[i].filterBitsPerKey);
         }
+        levelMaxFileSize = levelMaxFileSize * sizeBetweenLevels;
     }
-    fclose(file);
-    return result;
 }
 
 /**
- print the statistics for the LsmTree including the disk level information and memory level value count
+ retire the point tombstones merged down to the last level holding values, the merges have dropped every
+ older copy of their values. Called by the rolling merges
  
- example output -
+ the point tombstones are left for a later merge while a detached update levels thread is running, since the
+ levels are changing
  
- C5 file size is - 670896
- LEVEL NUMBER - 5
- maxFileSize - 32000
- lsmLevelDisk - 0x7fff5fbf6f68
- fileName - c5.bin
- the values count in this level is 19370
+ */
+void LsmTree::retirePointTombstones()
+{
+    if (pointTombstones.empty() || !is_ready) return;
+    
+    pointTombstones.retire(getLastLevel());
+}
+
+/**
+ function used to get the deepest level holding values, the levels below it hold no copy of any value
+ 
+ @return the level number of the level, 0 if every level is empty
  
  */
-void LsmTree::printStats() {
+int LsmTree::getLastLevel()
+{
+    for (int i = numberOfLevels - 1; i >= 0; --i)
+    {
+        if (getLevelValuesCount(i) > 0) return levels[i].levelNumber;
+    }
+    return 0;
+}
+
+/**
+ fold the operands written by merge_value since the last merge into the records c0 holds, and into nothing
+ for the records deleted, write the folded records to c0 and retire the operands. Called by the rolling
+ merges
+ 
+ no level is read, the merges between levels fold the operands of the records they stream. Waits for a
+ detached update levels thread to complete, since it folds operands
+ 
+ */
+void LsmTree::applyMergeOperands()
+{
+    if (mergeOperands.empty()) return;
     
-    //struct sysinfo memInfo;
+    // make this thread wait until the detached thread running update levels has completed
+    waitForMerge();
     
-    //sysinfo (&memInfo);
-    //        long long totalVirtualMem = memInfo.totalram;
-    //        //Add other values in next statement to avoid int overflow on right hand side...
-    //        totalVirtualMem += memInfo.totalswap;
-    //        totalVirtualMem *= memInfo.mem_unit;
+    // the stacks written since the last merge, and those merged past the last level holding values
+    int lastLevel = getLastLevel();
+    std::vector<LsmMergeStack> pending;
+    mergeOperands.getPending(pending, lastLevel);
     
-    //       cout << "TOTAL VIRTUAL MEMORY - " << totalVirtualMem << endl;
+    // the operands are folded into the copy of the record in c0, or into nothing when no level holds the
+    // record, the others are left for the merges between levels
+    std::vector<dtype> folded;
+    std::vector<LsmMergeStack> applied;
+    std::vector<LsmMergeStack> deferred;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        const lsm_value_t &key = pending[i].operands.back();
+        
+        lsm_value_t value;
+        bool isFound = false;
+        if (pending[i].depth < 0 && !isHidden(key))
+        {
+            isFound = readC0(key, value);
+            if (!isFound && lastLevel > 0)
+            {
+                deferred.push_back(pending[i]);
+                continue;
+            }
+        }
+        
+        dtype x;
+        x.key = pending[i].sequence;
+        if (mergeOperands.fold(isFound ? &value : NULL, pending[i].operands, x.value)) folded.push_back(x);
+        applied.push_back(pending[i]);
+    }
+    mergeOperands.defer(deferred);
     
-    //        long long virtualMemUsed = memInfo.totalram - memInfo.freeram;
-    //        //Add other values in next statement to avoid int overflow on right hand side...
-    //        virtualMemUsed += memInfo.totalswap - memInfo.freeswap;
-    //        virtualMemUsed *= memInfo.mem_unit;
-    //
-    //        cout << "TOTAL VIRTUAL MEMORY USED - " << virtualMemUsed << endl;
-    //
-    //        cout << "TOTAL AVAILABLE VIRTUAL MEMORY - " << totalVirtualMem - virtualMemUsed << endl;
-    //
-    //        // Virtual Memory currently used by current process:
-    //        cout << "Virtual Memory currently used by current process: " << getValueVirtualMemory() << endl;
-    //
-    //        long long totalPhysMem = memInfo.totalram;
-    //        //Multiply in next statement to avoid int overflow on right hand side...
-    //        totalPhysMem *= memInfo.mem_unit;
-    //
-    //        cout << "TOTAL Physical MEMORY  - " << totalPhysMem << endl;
-    //
-    //        // PHYSICAL Memory currently used by current process:
-    //        cout << "PHYSICAL Memory currently used by current process: " << getValuePhysicalMemory() << endl;
-    //
-    //
-    //        long long physMemUsed = memInfo.totalram - memInfo.freeram;
-    //        //Multiply in next statement to avoid int overflow on right hand side...
-    //        physMemUsed *= memInfo.mem_unit;
-    //
-    //        cout << "TOTAL PHYSICAL MEMORY USED - " << physMemUsed << endl;
-    //        cout << "TOTAL AVAILABLE PHYSICAL MEMORY - " << totalPhysMem - physMemUsed << endl;
+    // lookups overlapping the writes to c0 are made again, they would fold the operands twice
+    mergeOperands.beginApply();
     
-    //cout << "C0 PRINT CONTENTS" << endl;
-    //c0.print();
+    // c0 is a BTREE, the folded record replaces the value held, a record c0 did not hold takes room in c0
+    // as an insert does
+    if (LsmTree::c0DataStructure == 1)
+    {
+        for (size_t i = 0; i < folded.size(); i++)
+        {
+            lsm_value_t held;
+            if (!readC0(folded[i].value, held)) c0_limit_counter++;
+            c0.insert(folded[i]);
+        }
+    }
     
-    /* ********************************************** DEBUG ******************************************************
-     *************************************************************************************************************/
-    cout << endl;
-    cout << "C0 VALUES COUNT " << c0Vector.size() << endl;
-    //c0.print();
-    for (int a = 0; a < LsmTree::numberOfLevels; a++)
+    // c0 is a vector, the older copies of the records are removed so the folded records are the only ones,
+    // the records are sorted to be searched and a record c0 did not hold takes room in c0 as an insert does
+    if (LsmTree::c0DataStructure == 2)
     {
-        cout << "-------------------------------------------------------------------------------" << endl;
-        cout << "C" << a+1 << " file size is - " << LsmLevelDisk::getFileSize(levels[a].fileName) << endl;
-        cout <<  "LEVEL NUMBER - " << levels[a].levelNumber << endl;
-        cout <<  "maxFileSize - " << levels[a].maxFileSize << endl;
-        cout <<  "lsmLevelDisk - " << levels[a].lsmLevelDisk << endl;
-        cout <<  "fileName - " << levels[a].fileName << endl;
-        cout <<  "the values count in this level is " << (*levels[a].lsmLevelDisk).getValuesCount((*levels[a].lsmLevelDisk).root) << endl;
-        //(*levels[a].lsmLevelDisk).print();
-        cout << endl;
+        std::vector<lsm_value_t> records;
+        for (size_t i = 0; i < folded.size(); i++) records.push_back(folded[i].value);
+        std::sort(records.begin(), records.end());
+        
+        std::vector<bool> isHeld(records.size(), false);
+        c0Vector.erase(std::remove_if(c0Vector.begin(), c0Vector.end(), [&records, &isHeld](const lsm_value_t &value)
+        {
+            std::vector<lsm_value_t>::iterator it = std::lower_bound(records.begin(), records.end(), value);
+            if (it == records.end() || value < *it) return false;
+            
+            isHeld[it - records.begin()] = true;
+            return true;
+        }), c0Vector.end());
+        c0Vector.insert(c0Vector.end(), records.begin(), records.end());
+        c0_limit_counter += std::count(isHeld.begin(), isHeld.end(), false);
+    }
+    
+    for (size_t i = 0; i < folded.size(); i++)
+    {
+        const lsm_value_t &record = folded[i].value;
+        
+        // the folded record is newer than the deletes of the record
+        if (LsmTree::readOptimized && !tombstoneVector.empty())
+        {
+            tombstoneVector.erase(std::remove(tombstoneVector.begin(), tombstoneVector.end(), record), tombstoneVector.end());
+        }
+        rangeTombstones.recordWrite(record);
+        pointTombstones.recordWrite(record);
+        
+        widenC0Zone(record);
+        if (rowCache != NULL) (*rowCache).invalidate(record);
     }
+    
+    mergeOperands.retire(applied, folded.size());
+    mergeOperands.endApply();
+}
+
+/**
+ raise the begin event of a flush or compaction and start its timer
+ 
+ does nothing, and does not read the clock, when no listener is attached
+ 
+ @param listener the listener to raise the event on, or NULL
+ @param type the type of the event
+ @param sourceLevel the level values are moved from
+ @param targetLevel the level values are moved to
+ @param inputValues the number of values to be passed to the target level
+ @param target the target level
+ @param timer the timer to start
+ 
+ */
+void LsmTree::raiseBeginEvent(LsmEventListener *listener, lsm_event_type type, int sourceLevel, int targetLevel, long inputValues, const LsmLevel &target, LsmEventTimer &timer)
+{
+    if (listener == NULL) return;
+    
+    // remember when the work started and how much had been written to the target before it
+    timer.start = std::chrono::steady_clock::now();
+    timer.bytesWrittenBefore = getIOStats(target).bytesWritten;
+    
+    LsmEvent event;
+    event.type = type;
+    event.sourceLevel = sourceLevel;
+    event.targetLevel = targetLevel;
+    event.inputValues = inputValues;
+    event.outputBytes = 0;
+    event.durationMicros = 0;
+    event.timestampMicros = std::chrono::duration_cast<std::chrono::microseconds>(timer.start.time_since_epoch()).count();
+    (*listener).onEvent(event);
+}
+
+/**
+ raise the end event of a flush or compaction using the timer started by raiseBeginEvent
+ 
+ does nothing, and does not read the clock, when no listener is attached
+ 
+ @param listener the listener to raise the event on, or NULL
+ @param type the type of the event
+ @param sourceLevel the level values were moved from
+ @param targetLevel the level values were moved to
+ @param inputValues the number of values passed to the target level
+ @param target the target level
+ @param timer the timer started by raiseBeginEvent
+ 
+ */
+void LsmTree::raiseEndEvent(LsmEventListener *listener, lsm_event_type type, int sourceLevel, int targetLevel, long inputValues, const LsmLevel &target, const LsmEventTimer &timer)
+{
+    if (listener == NULL) return;
+    
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    
+    LsmEvent event;
+    event.type = type;
+    event.sourceLevel = sourceLevel;
+    event.targetLevel = targetLevel;
+    event.inputValues = inputValues;
+    event.outputBytes = getIOStats(target).bytesWritten - timer.bytesWrittenBefore;
+    event.durationMicros = std::chrono::duration_cast<std::chrono::microseconds>(end - timer.start).count();
+    event.timestampMicros = std::chrono::duration_cast<std::chrono::microseconds>(end.time_since_epoch()).count();
+    (*listener).onEvent(event);
 }
 
 /**
@@ -621,16 +2329,7 @@ void LsmTree::printStats() {
  */
 void LsmTree::updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOfLevels, int mergeStrategy)
 {
-    
-    cout << "UPDATE LEVELS START" << endl;
-    
-    // if mergeStrategy == 1 I WOULD LIKE TO HAVE COPY ENTIRE FILE IF NEXT LEVEL IS EMPTY
-    // if mergeStrategy == 2 do fill each level and remainder to next level
-    
-    if (mergeStrategy == 1)
-    {
-        
-    }
+    LsmIOScope ioScope(IO_Compaction);
     
     // if mergeStrategy == 2 do fill each level and remainder to next level
     if (mergeStrategy == 2)
@@ -640,12 +2339,14 @@ void LsmTree::updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOf
         LsmLevelDisk* previous_level_pointer = c1;
         LsmLevelDisk* current_level_pointer;
         
+        // the total to pass to the level after the current one, carried from level to level
+        long after_c1_total_to_pass = c1_total_to_pass;
+        
         // for each level of the LSM Tree after C1
         for (int i = 1; i < numberOfLevels; ++i)
         {
-            // long variables to represent the current level array cout and total to pass for subsequent levels after c1
-            long active_array_count;
-            long after_c1_total_to_pass;
+            // long variable to represent the current level array count
+            long active_array_count = c1_total_to_pass;
             
             // if the level is c2, use the c1 total for the active array counter
             if (levels[i].levelNumber == 2)
@@ -680,11 +2381,16 @@ void LsmTree::updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOf
                 }
             }
             
+            // time the compaction for the event listener
+            LsmEventTimer compactionTimer;
+            raiseBeginEvent(eventListener, Event_CompactionBegin, levels[i].levelNumber - 1, levels[i].levelNumber, active_array_count, levels[i], compactionTimer);
+            
             //CAN THIS LEVEL CONTAIN THE ENTIRE ARRAY PASSED TO IT? NO
             if (!canLevelContainAll)
             {
                 // this level cannot contain all of the values, do a merge copy to the next level
-                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count);
+                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count, levels[i].levelNumber - 1);
+                raiseEndEvent(eventListener, Event_CompactionEnd, levels[i].levelNumber - 1, levels[i].levelNumber, active_array_count, levels[i], compactionTimer);
                 
                 // get the value count for the current level now that the copy was complete
                 after_c1_total_to_pass = (*current_level_pointer).getValuesCount((*current_level_pointer).root) - current_level_max_values;
@@ -697,7 +2403,8 @@ void LsmTree::updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOf
             } else {
                 
                 // copy all of the values from the previous level to this level and exit the update levels rolling merge process
-                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count);
+                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count, levels[i].levelNumber - 1);
+                raiseEndEvent(eventListener, Event_CompactionEnd, levels[i].levelNumber - 1, levels[i].levelNumber, active_array_count, levels[i], compactionTimer);
                 
                 return;
             }
@@ -705,9 +2412,6 @@ void LsmTree::updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOf
     }
 }
 
-// reset the counter for the next rolling merge process
-long rollingMergeCounter = 0;
-
 /**
  rollingMerge function is responsible for the rolling merge process once c0 fills up
  
@@ -716,11 +2420,31 @@ long rollingMergeCounter = 0;
  */
 void LsmTree::rollingMerge(bool copyAllFromC0)
 {
+    // the I/O of c0 moving to c1 is a flush, the levels below c1 switch to compaction as they are updated
+    LsmIOScope ioScope(ioScheduler, IO_Flush);
+    
+    // let the tuner adjust the tunable parameters before the merge
+    if (tuner != NULL) applyTuner();
+    
+    // retire the point tombstones the merges have carried down to the last level
+    retirePointTombstones();
+    
+    // fold the operands written since the last merge into their records, which are merged with c0
+    applyMergeOperands();
+    
+    // the leveled and size-tiered merge strategies write c0 to the sorted runs of c1
+    if (LsmTree::mergeStrategy == 1 || LsmTree::mergeStrategy == 3)
+    {
+        rollingMergeRuns(copyAllFromC0);
+        updateC0Zone();
+        return;
+    }
     
     // c0 is a btree
     if (LsmTree::c0DataStructure == 1)
     {
-        cout << "ROLLING MERGE START" << endl;
+        // make this thread wait until the detached thread running update levels has completed and released the mutex
+        waitForMerge();
         
         // copy a portion of c0 to a new array
         // a pointer to the c0 memory level object
@@ -746,6 +2470,11 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
         // get size of disk level
         std::string stringFileName(levels[levelCounter].fileName);
         
+        // time the flush for the event listener
+        long flushValuesCount = rollingMergeCounter;
+        LsmEventTimer flushTimer;
+        raiseBeginEvent(eventListener, Event_FlushBegin, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
+        
         // can this level contain the entire array? YES
         if (current_level_max_values >= rollingMergeCounter)
         {
@@ -753,6 +2482,7 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             // copy from c0 to c1
             LsmLevelDisk *c = levels[levelCounter].lsmLevelDisk;
             c0.memoryLevelCopy(c, cPoint, copyAllFromC0, LsmTree::c0_percentage_to_copy);
+            raiseEndEvent(eventListener, Event_FlushEnd, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
             
             // reset the rolling merge counter to 0
             rollingMergeCounter = 0;
@@ -765,6 +2495,7 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             
             // copy values from c0 to c1
             c0.memoryLevelCopy(c1, cPoint, copyAllFromC0, LsmTree::c0_percentage_to_copy);
+            raiseEndEvent(eventListener, Event_FlushEnd, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
             
             // get the c1 max value size
             long current_level_max_values = (long)levels[levelCounter].maxFileSize / 50;
@@ -773,9 +2504,9 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             long c1_total_to_pass = (*c1).getValuesCount((*c1).root) - current_level_max_values;
             
             // update the levels of the LSM Tree in a separate thread
+            // the count to pass is copied to the thread, it outlives this function
             
             vector<LsmLevel>* levelsPtr = &levels;
-            long* c1_total_to_passPtr = &c1_total_to_pass;
             int* mergeStrategyPtr = &mergeStrategy;
             int* numberOfLevelsPtr = &numberOfLevels;
             
@@ -786,12 +2517,8 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             // if the bool is set for an update levels action in a new thread
             if (LsmTree::isThreadedRollingMerge)
             {
-                cout << "UPDATING LEVELS IN A NEW THREAD" << endl;
-                std::thread updateLevelsThread(updateLevelsThreaded,c1_total_to_passPtr, c1PtrPtr, numberOfLevelsPtr, mergeStrategyPtr, levelsPtr);
-                
-                // detach the new thread and let it finish the update levels
-                updateLevelsThread.detach();
-                
+                startMerge(std::bind(updateLevelsThreaded, c1_total_to_pass, c1PtrPtr, numberOfLevelsPtr, mergeStrategyPtr, levelsPtr, eventListener, &mergeMutex));
+            
             // update levels in a single thread operation
             } else {
                 LsmTree::updateLevels(c1_total_to_pass, c1, LsmTree::numberOfLevels, LsmTree::mergeStrategy);
@@ -800,19 +2527,14 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
         
         // reset the rolling merge counter for the next call
         rollingMergeCounter = 0;
-        
-        cout << "ROLLING MERGE END" << endl;
+    
     }
     
     // c0 is a vector
     if (LsmTree::c0DataStructure == 2)
     {
-        cout << "ROLLING MERGE START" << endl;
-
         // make this thread wait until the detached thread running update levels has completed and released the mutex
-        while (!LsmTree::is_ready) {
-            std::this_thread::yield();
-        }
+        waitForMerge();
         
         // copy a portion of c0 to a new array
         // a pointer to the c0 memory level object
@@ -825,7 +2547,7 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
         // if all is to be copied from c0
         if (copyAllFromC0) {
             rollingMergeCounter = c0Vector.size();
- 
+        
         } else {
             rollingMergeCounter = (long)c0Vector.size() * c0_percentage_to_copy;
             current_level_max_values = (long)(levels[levelCounter].maxFileSize / 50) * c0_percentage_to_copy;
@@ -834,36 +2556,47 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
         // get size of disk level
         std::string stringFileName(levels[levelCounter].fileName);
         
+        // time the flush for the event listener
+        long flushValuesCount = rollingMergeCounter;
+        LsmEventTimer flushTimer;
+        raiseBeginEvent(eventListener, Event_FlushBegin, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
+        
         // can this level contain the entire array? YES
         if (current_level_max_values >= rollingMergeCounter)
         {
- 
+            
             LsmLevelDisk *c = levels[levelCounter].lsmLevelDisk;
-
             
-            std::vector<long> c0VectorCopy(c0Vector);
-            std::vector<long>* c0VectorCopyPtr = &c0VectorCopy;
+            
+            std::vector<lsm_value_t> c0VectorCopy(c0Vector);
+            std::vector<lsm_value_t>* c0VectorCopyPtr = &c0VectorCopy;
             c0Vector.clear();
             
             c0.memoryLevelCopyVector(c0VectorCopyPtr, c, copyAllFromC0, LsmTree::c0_percentage_to_copy);
+            raiseEndEvent(eventListener, Event_FlushEnd, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
             
+            // the values a partial copy left behind stay in c0
+            c0Vector.assign(c0VectorCopy.begin(), c0VectorCopy.end());
             c0VectorCopy.clear();
-
+            
             // reset the rolling merge counter to 0
             rollingMergeCounter = 0;
-            
-            
+        
+        
         // can this level contain the entire array? NO
         } else {
             
             LsmLevelDisk *c1 = levels[levelCounter].lsmLevelDisk;
             
-            std::vector<long> c0VectorCopy(c0Vector);
-            std::vector<long>* c0VectorCopyPtr = &c0VectorCopy;
+            std::vector<lsm_value_t> c0VectorCopy(c0Vector);
+            std::vector<lsm_value_t>* c0VectorCopyPtr = &c0VectorCopy;
             c0Vector.clear();
             
             c0.memoryLevelCopyVector(c0VectorCopyPtr, c1, copyAllFromC0, LsmTree::c0_percentage_to_copy);
+            raiseEndEvent(eventListener, Event_FlushEnd, 0, 1, flushValuesCount, levels[levelCounter], flushTimer);
             
+            // the values a partial copy left behind stay in c0
+            c0Vector.assign(c0VectorCopy.begin(), c0VectorCopy.end());
             c0VectorCopy.clear();
             
             long current_level_max_values = (long)levels[levelCounter].maxFileSize / 50;
@@ -872,9 +2605,9 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             long c1_total_to_pass = (*c1).getValuesCount((*c1).root) - current_level_max_values;
             
             // update the levels of the LSM Tree in a new thread
+            // the count to pass is copied to the thread, it outlives this function
             
             vector<LsmLevel>* levelsPtr = &levels;
-            long* c1_total_to_passPtr = &c1_total_to_pass;
             int* mergeStrategyPtr = &mergeStrategy;
             int* numberOfLevelsPtr = &numberOfLevels;
             
@@ -883,19 +2616,21 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
             // if the bool is set for an update levels action in a new thread
             if (LsmTree::isThreadedRollingMerge)
             {
-                cout << "UPDATING LEVELS IN A NEW THREAD" << endl;
-                std::thread updateLevelsThread(updateLevelsThreaded,c1_total_to_passPtr, c1PtrPtr, numberOfLevelsPtr, mergeStrategyPtr, levelsPtr);
-
-                // detach the new thread and let it finish the update levels
-                updateLevelsThread.detach();
-                
+                startMerge(std::bind(updateLevelsThreaded, c1_total_to_pass, c1PtrPtr, numberOfLevelsPtr, mergeStrategyPtr, levelsPtr, eventListener, &mergeMutex));
+            
             } else {
                 LsmTree::updateLevels(c1_total_to_pass, c1, LsmTree::numberOfLevels, LsmTree::mergeStrategy);
             }
         }
         rollingMergeCounter = 0;
-        cout << "ROLLING MERGE END" << endl;
     }
+    
+    // the values moved to c1 are covered by its zone map now
+    updateC0Zone();
+    
+    // rebuild the fence pointers of the levels changed by the rolling merge, a level still being changed by
+    // a detached update levels thread is skipped and rebuilt by the thread once it completes
+    buildFences(LsmTree::numberOfLevels, &levels);
 }
 
 /**
@@ -910,25 +2645,13 @@ void LsmTree::rollingMerge(bool copyAllFromC0)
  @param c1 a pointer to the c1 disk Btree object
  @param levels pointer to the levels vector that contains the c1-n levels information
  @param mergeStrategy tunable parameter for different merge strategies
+ @param listener the event listener to raise compaction events on, or NULL
  
  */
-void LsmTree::updateLevelsThreaded(long* c1_total_to_pass, LsmLevelDisk* c1, int* numberOfLevels, int* mergeStrategy, vector<LsmLevel>* levels)
+void LsmTree::updateLevelsThreaded(long c1_total_to_pass, LsmLevelDisk* c1, int* numberOfLevels, int* mergeStrategy, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex)
 {
-    cout << "THREADED UPDATE LEVELS START" << endl;
-
     // get a lock on the mutex for proceeding to the the update levels in the detached thread instructed to do so
-    std::unique_lock<std::mutex> lock(m);
-    
-    // set the atomic variable so that future threads have to wait before entering here
-    LsmTree::is_ready = false;
-    
-    // if mergeStrategy == 1 I WOULD LIKE TO HAVE COPY ENTIRE FILE IF NEXT LEVEL IS EMPTY
-    // if mergeStrategy == 2 do fill each level and remainder to next level
-    
-    if ((*mergeStrategy) == 1)
-    {
-        
-    }
+    std::unique_lock<std::mutex> lock(*mergeMutex);
     
     // if mergeStrategy == 2 do fill each level and remainder to next level
     if ((*mergeStrategy) == 2)
@@ -936,26 +2659,28 @@ void LsmTree::updateLevelsThreaded(long* c1_total_to_pass, LsmLevelDisk* c1, int
         // get pointers to the c1 and c2 disk resident Btrees
         LsmLevelDisk* previous_level_pointer = c1;
         LsmLevelDisk* current_level_pointer;
-
+        
+        // the total to pass to the level after the current one, carried from level to level
+        long after_c1_total_to_pass = c1_total_to_pass;
+        
         // for each level of the LSM Tree after C1
         for (int i = 1; i < (*numberOfLevels); ++i)
         {
-            // long variables to represent the current level array cout and total to pass for subsequent levels after c1
-            long active_array_count;
-            long after_c1_total_to_pass;
+            // long variable to represent the current level array count
+            long active_array_count = c1_total_to_pass;
             
             // if the level is c2, use the c1 total for the active array counter
             if ((*levels)[i].levelNumber == 2)
             {
-                active_array_count = (*c1_total_to_pass);
-                
+                active_array_count = c1_total_to_pass;
+            
             }
             // the level is after c2, use the counter as the value passed from the previous level
             if ((*levels)[i].levelNumber > 2) {
                 active_array_count = after_c1_total_to_pass;
-                
+            
             }
-
+            
             // get the max the current level can hold and the value count of the current level
             long current_level_max_values = (long)(*levels)[i].maxFileSize / 50;
             long current_level_values_count = (*(*levels)[i].lsmLevelDisk).getValuesCount((*(*levels)[i].lsmLevelDisk).root);
@@ -974,34 +2699,388 @@ void LsmTree::updateLevelsThreaded(long* c1_total_to_pass, LsmLevelDisk* c1, int
                 {
                     canLevelContainAll = true;
                 }
-                
+            
             }
             
+            // time the compaction for the event listener
+            LsmEventTimer compactionTimer;
+            raiseBeginEvent(listener, Event_CompactionBegin, (*levels)[i].levelNumber - 1, (*levels)[i].levelNumber, active_array_count, (*levels)[i], compactionTimer);
+            
             //CAN THIS LEVEL CONTAIN THE ENTIRE ARRAY PASSED TO IT? NO
             if (!canLevelContainAll)
             {
                 
                 // this level cannot contain all of the values, do a merge copy to the next level
-                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count);
+                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count, (*levels)[i].levelNumber - 1);
+                raiseEndEvent(listener, Event_CompactionEnd, (*levels)[i].levelNumber - 1, (*levels)[i].levelNumber, active_array_count, (*levels)[i], compactionTimer);
                 
                 // get the value count for the current level now that the copy was complete
                 after_c1_total_to_pass = (*current_level_pointer).getValuesCount((*current_level_pointer).root) - current_level_max_values;
                 
                 // change the current pointer to be the preveious level pointer before examining the next level
                 previous_level_pointer = current_level_pointer;
-                
-                
+            
+            
             //CAN THIS LEVEL CONTAIN THE ENTIRE ARRAY PASSED TO IT? YES
             } else {
-
+                
                 // copy all of the values from the previous level to this level and exit the update levels rolling merge process
-                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count);
-
-                LsmTree::is_ready = true;
- 
+                (*previous_level_pointer).diskLevelCopy(previous_level_pointer, current_level_pointer, ((*previous_level_pointer).root), active_array_count, (*levels)[i].levelNumber - 1);
+                raiseEndEvent(listener, Event_CompactionEnd, (*levels)[i].levelNumber - 1, (*levels)[i].levelNumber, active_array_count, (*levels)[i], compactionTimer);
+                
+                // rebuild the fence pointers of the levels changed by the compaction
+                buildFences((*numberOfLevels), levels);
+                
                 return;
             }
         }
     }
-    LsmTree::is_ready = true;
-}
\ No newline at end of file
+    
+    // rebuild the fence pointers of the levels changed by the compaction
+    buildFences((*numberOfLevels), levels);
+}
+
+/**
+ rollingMerge for mergeStrategy 1 and 3
+ 
+ for mergeStrategy 1 c0 is merged into the overlapping sorted runs of c1, for mergeStrategy 3 c0 is
+ added to c1 as a new sorted run
+ 
+ @copyAllFromc0 - should all of c0 be copied to c1 on a rolling merge
+ 
+ */
+void LsmTree::rollingMergeRuns(bool copyAllFromC0)
+{
+    // make this thread wait until the detached thread running update levels has completed and released the mutex
+    waitForMerge();
+    
+    // the values to merge into c1, sorted by value
+    std::vector<dtype> flushValues;
+    
+    // c0 is a btree, its values come out already sorted
+    if (LsmTree::c0DataStructure == 1)
+    {
+        long c0TotalValues = c0.getValuesCount();
+        long counter_limit = copyAllFromC0 ? c0TotalValues : (long) (c0TotalValues * c0_percentage_to_copy);
+        
+        // take the smallest values so the values moved cover one contiguous key range
+        c0.getSortedValues(flushValues, counter_limit);
+        
+        // remove the values being moved from c0
+        for (size_t i = 0; i < flushValues.size(); i++)
+        {
+            c0.DelNode(flushValues[i]);
+        }
+    }
+    
+    // c0 is a vector
+    if (LsmTree::c0DataStructure == 2)
+    {
+        long counter_limit = copyAllFromC0 ? (long) c0Vector.size() : (long) (c0Vector.size() * c0_percentage_to_copy);
+        
+        // sort c0, keeping the order they were inserted in for equal values, so the smallest values are moved
+        // and they cover one contiguous key range. Every copy of the last value moved is moved with it
+        std::stable_sort(c0Vector.begin(), c0Vector.end());
+        while (counter_limit > 0 && counter_limit < (long) c0Vector.size() && c0Vector[counter_limit] == c0Vector[counter_limit - 1])
+        {
+            counter_limit++;
+        }
+        
+        for (long i = 0; i < counter_limit; i++)
+        {
+            dtype x;
+            x.key = i;
+            x.value = c0Vector[i];
+            flushValues.push_back(x);
+        }
+        c0Vector.erase(c0Vector.begin(), c0Vector.begin() + counter_limit);
+        
+        // a value inserted more than once is only kept once, the most recent insert is kept
+        size_t kept = 0;
+        for (size_t i = 0; i < flushValues.size(); i++)
+        {
+            if (i + 1 < flushValues.size() && flushValues[i + 1].value == flushValues[i].value) continue;
+            flushValues[kept++] = flushValues[i];
+        }
+        flushValues.resize(kept);
+    }
+    
+    // the values deleted by a range or point tombstone are dropped before they reach c1
+    rangeTombstones.filter(flushValues);
+    pointTombstones.filter(flushValues, NULL, NULL, 0, 0, NULL);
+    
+    // write the values to the sorted runs of c1
+    LsmEventTimer flushTimer;
+    raiseBeginEvent(eventListener, Event_FlushBegin, 0, 1, flushValues.size(), levels[0], flushTimer);
+    
+    if (LsmTree::mergeStrategy == 1)
+    {
+        (*levels[0].lsmLevelPartitioned).merge(flushValues);
+        (*levels[0].lsmLevelPartitioned).countMergedKeys(flushValues.size(), 0);
+    } else {
+        (*levels[0].lsmLevelTiered).addRun(flushValues);
+        (*levels[0].lsmLevelTiered).countMergedKeys(flushValues.size(), 0);
+    }
+    
+    raiseEndEvent(eventListener, Event_FlushEnd, 0, 1, flushValues.size(), levels[0], flushTimer);
+    
+    // if the bool is set for an update levels action in a new thread
+    if (LsmTree::isThreadedRollingMerge)
+    {
+        startMerge(std::bind(LsmTree::mergeStrategy == 1 ? updateLevelsPartitioned : updateLevelsTiered, LsmTree::numberOfLevels, &levels, eventListener, &mergeMutex));
+    
+    } else if (LsmTree::mergeStrategy == 1) {
+        LsmIOScope ioScope(IO_Compaction);
+        updateLevelsPartitioned(LsmTree::numberOfLevels, &levels, eventListener, &mergeMutex);
+    } else {
+        LsmIOScope ioScope(IO_Compaction);
+        updateLevelsTiered(LsmTree::numberOfLevels, &levels, eventListener, &mergeMutex);
+    }
+}
+
+/**
+ updateLevels for mergeStrategy 1
+ 
+ while a level holds more values than its maximum, one of its sorted runs is merged into the overlapping
+ runs of the next level. This is static so that it can also run in a detached thread.
+ 
+ @param numberOfLevels the number of disk resident levels for the Lsm Tree
+ @param levels pointer to the levels vector that contains the c1-n levels information
+ @param listener the event listener to raise compaction events on, or NULL
+ 
+ */
+void LsmTree::updateLevelsPartitioned(int numberOfLevels, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex)
+{
+    // get a lock on the mutex shared with the threaded update levels
+    std::unique_lock<std::mutex> lock(*mergeMutex);
+    
+    // the last level has nowhere to move values to, so it is left to grow
+    for (int i = 0; i + 1 < numberOfLevels; ++i)
+    {
+        LsmLevel &level = (*levels)[i];
+        LsmLevel &nextLevel = (*levels)[i + 1];
+        
+        long level_max_values = (long) level.maxFileSize / 50;
+        
+        // move one run at a time until the level is back under its maximum
+        while ((*level.lsmLevelPartitioned).getValuesCount() > level_max_values)
+        {
+            long compaction_values_count = (*level.lsmLevelPartitioned).getCompactionValuesCount();
+            
+            LsmEventTimer compactionTimer;
+            raiseBeginEvent(listener, Event_CompactionBegin, level.levelNumber, nextLevel.levelNumber, compaction_values_count, nextLevel, compactionTimer);
+            
+            (*level.lsmLevelPartitioned).compactInto(nextLevel.lsmLevelPartitioned);
+            
+            raiseEndEvent(listener, Event_CompactionEnd, level.levelNumber, nextLevel.levelNumber, compaction_values_count, nextLevel, compactionTimer);
+        }
+    }
+}
+
+/**
+ updateLevels for mergeStrategy 3
+ 
+ once a level holds sizeBetweenLevels sorted runs, they are merged together into a single run added to
+ the next level, and the last level merges its runs in place. This is static so that it can also run
+ in a detached thread.
+ 
+ @param numberOfLevels the number of disk resident levels for the Lsm Tree
+ @param levels pointer to the levels vector that contains the c1-n levels information
+ @param listener the event listener to raise compaction events on, or NULL
+ 
+ */
+void LsmTree::updateLevelsTiered(int numberOfLevels, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex)
+{
+    // get a lock on the mutex shared with the threaded update levels
+    std::unique_lock<std::mutex> lock(*mergeMutex);
+    
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        LsmLevel &level = (*levels)[i];
+        
+        // the levels below a level that is not full are unchanged
+        if (!(*level.lsmLevelTiered).isFull()) break;
+        
+        // the last level merges its runs in place
+        LsmLevel &target = i + 1 < numberOfLevels ? (*levels)[i + 1] : level;
+        long compaction_values_count = (*level.lsmLevelTiered).getValuesCount();
+        
+        LsmEventTimer compactionTimer;
+        raiseBeginEvent(listener, Event_CompactionBegin, level.levelNumber, target.levelNumber, compaction_values_count, target, compactionTimer);
+        
+        if (&target != &level)
+        {
+            (*level.lsmLevelTiered).compactInto(target.lsmLevelTiered);
+        } else {
+            (*level.lsmLevelTiered).compactInPlace();
+        }
+        
+        raiseEndEvent(listener, Event_CompactionEnd, level.levelNumber, target.levelNumber, compaction_values_count, target, compactionTimer);
+    }
+}
+
+/**
+ build the fence pointers of each disk level held in a BTree, levels whose fence pointers are up to date
+ are skipped
+ 
+ @param numberOfLevels the number of disk resident levels for the Lsm Tree
+ @param levels pointer to the levels vector that contains the c1-n levels information
+ 
+ */
+void LsmTree::buildFences(int numberOfLevels, vector<LsmLevel>* levels)
+{
+    for (int i = 0; i < numberOfLevels; ++i)
+    {
+        if ((*levels)[i].lsmLevelDisk != NULL) (*(*levels)[i].lsmLevelDisk).buildFences();
+    }
+}
+
+/**
+ search a disk level for a value
+ 
+ @param levelIndex the position of the level in the levels vector
+ @param value the data value to search for
+ @return true if the value is in the level
+ 
+ */
+bool LsmTree::searchLevel(int levelIndex, dtype value)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelPartitioned).search_value(value);
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelTiered).search_value(value);
+    }
+    return (*levels[levelIndex].lsmLevelDisk).search_value(value);
+}
+
+/**
+ check whether a disk level may hold any value within a range, from the zone maps of the level
+ 
+ @param levelIndex the position of the level in the levels vector
+ @param low the smallest value of the range
+ @param high the largest value of the range
+ @return false if no value of the level is within the range
+ 
+ */
+bool LsmTree::levelMayContain(int levelIndex, const lsm_value_t &low, const lsm_value_t &high)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelPartitioned).mayContainRange(low, high);
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelTiered).mayContainRange(low, high);
+    }
+    return (*levels[levelIndex].lsmLevelDisk).mayContainRange(low, high);
+}
+
+/**
+ search for a batch of values in a disk level
+ 
+ @param levelIndex the position of the level in the levels vector
+ @param values the data values to search for, sorted by value
+ @param states the state of each lookup, the pending lookups found are set to LookupFound
+ 
+ */
+void LsmTree::searchLevelValues(int levelIndex, const std::vector<dtype> &values, std::vector<char> &states)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        (*levels[levelIndex].lsmLevelPartitioned).search_values(values, states);
+        return;
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        (*levels[levelIndex].lsmLevelTiered).search_values(values, states);
+        return;
+    }
+    (*levels[levelIndex].lsmLevelDisk).search_values(values, states);
+}
+
+/**
+ get the values of a disk level within a range
+ 
+ @param levelIndex the position of the level in the levels vector
+ @param low the smallest value to get
+ @param high the largest value to get
+ @param values the vector the values are appended to, in sorted order
+ 
+ */
+void LsmTree::scanLevel(int levelIndex, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        (*levels[levelIndex].lsmLevelPartitioned).getRangeValues(low, high, values);
+        return;
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        (*levels[levelIndex].lsmLevelTiered).getRangeValues(low, high, values);
+        return;
+    }
+    (*levels[levelIndex].lsmLevelDisk).getRangeValues(low, high, values);
+}
+
+/**
+ get the values count of a disk level
+ 
+ @param levelIndex the position of the level in the levels vector
+ @return the values count
+ 
+ */
+long LsmTree::getLevelValuesCount(int levelIndex)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelPartitioned).getValuesCount();
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelTiered).getValuesCount();
+    }
+    return (*levels[levelIndex].lsmLevelDisk).getValuesCount((*levels[levelIndex].lsmLevelDisk).root);
+}
+
+/**
+ get the size on disk, in bytes, of a disk level
+ 
+ @param levelIndex the position of the level in the levels vector
+ @return the size of the level's files
+ 
+ */
+long LsmTree::getLevelFileSize(int levelIndex)
+{
+    if (levels[levelIndex].lsmLevelPartitioned != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelPartitioned).getFileSize();
+    }
+    if (levels[levelIndex].lsmLevelTiered != NULL)
+    {
+        return (*levels[levelIndex].lsmLevelTiered).getFileSize();
+    }
+    return LsmLevelDisk::getFileSize(levels[levelIndex].fileName);
+}
+
+/**
+ get the I/O and merge counters for a disk level, from either its BTree or its sorted runs
+ 
+ @param level the level to get the counters for
+ @return the counters for the level
+ 
+ */
+LsmLevelIOStats LsmTree::getIOStats(const LsmLevel &level)
+{
+    if (level.lsmLevelPartitioned != NULL)
+    {
+        return (*level.lsmLevelPartitioned).getIOStats();
+    }
+    if (level.lsmLevelTiered != NULL)
+    {
+        return (*level.lsmLevelTiered).getIOStats();
+    }
+    return (*level.lsmLevelDisk).getIOStats();
+}
@@ -9,20 +9,81 @@
 #ifndef LSMTREE_H
 #define LSMTREE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <memory>
 #include <thread>
 
 #include "LsmLevelDisk.h"
 #include "LsmLevelMemory.h"
+#include "LsmLevelPartitioned.h"
+#include "LsmLevelTiered.h"
+#include "LsmEventListener.h"
+#include "LsmIOScheduler.h"
+#include "LsmMergeOperands.h"
+#include "LsmMergeOperator.h"
+#include "LsmPointTombstones.h"
+#include "LsmRangeTombstones.h"
+#include "LsmRowCache.h"
+#include "LsmTuner.h"
+#include "LsmVersionLog.h"
+#include "WorkerQueue.h"
 
 using namespace std;
 
+// a worker queue running tasks, such as the rolling merges of Lsm Trees, on its pool of threads
+typedef distributor<std::function<void()>> lsm_task_distributor;
+
+// the number of threads of the pool each Lsm Tree runs its asynchronous reads on
+#define LSM_READ_THREADS 4
+
+// the number of values of a batch of asynchronous reads searched by each task of the pool
+#define LSM_READ_BATCH_VALUES 64
+
+// an enum to describe why a write to the Lsm Tree was held back
+// a slowdown delays a write while the merge debt is above the slowdown limit, a stop blocks a write while it
+// is above the stop limit, and c0 full blocks the write that fills c0 until the merge in progress completes
+enum lsm_write_stall {Stall_Slowdown, Stall_Stop, Stall_C0Full};
+
+// the number of reasons a write can be held back
+#define WRITE_STALL_REASON_COUNT 3
+
+// the default slowdown and stop limits of the merge debt, in multiples of the maximum values count of c0
+#define WRITE_SLOWDOWN_DEBT_RATIO 0.5
+#define WRITE_STOP_DEBT_RATIO 4.0
+
+// the longest delay, in microseconds, given to a write during a slowdown, reached at the stop limit
+#define WRITE_SLOWDOWN_MAX_MICROS 1000
+
+// the default limit of the writes kept in the version log while snapshots are held, in multiples of the
+// maximum values count of c0
+#define SNAPSHOT_VERSIONS_RATIO 4.0
+
+// a struct to contain the writes held back for a reason and for how long
+struct LsmWriteStallStats {
+    long writes;   // the number of writes held back
+    long micros;   // the time, in microseconds, the writes were held back
+};
+
 // a struct to contain data for each disk level of the Lsm Tree
 struct LsmLevel {
     int levelNumber;             // The level number --> for example c1 has a value of 1
     long fileSize;                // the level's associated file's size --> for example size of c1.bin
     long maxFileSize;            // the maximum size, in kb, of the level's associated file
-    char fileName[10];           // the name of the disk resident file for the level --> for example c1.bin
+    char fileName[32];           // the name of the disk resident file for the level --> for example c1.bin
     LsmLevelDisk *lsmLevelDisk;  // a pointer to the memory location of the BTree associated with this level
+    LsmLevelPartitioned *lsmLevelPartitioned;  // a pointer to the level's sorted runs when mergeStrategy is 1, otherwise NULL
+    LsmLevelTiered *lsmLevelTiered;            // a pointer to the level's sorted runs when mergeStrategy is 3, otherwise NULL
+    double filterBitsPerKey;                   // the point filter memory, in bits per value, given to the level by the tuner
+};
+
+// a struct to define a snapshot of the Lsm Tree, reads made with it see the values present when it was taken
+struct LsmSnapshot {
+    long sequence;                // the sequence number of the last write the snapshot sees
+    std::atomic<bool> isExpired;  // set once the snapshot is expired to bound the version log, reads made with it then see the latest values
 };
 
 class LsmTree
@@ -31,7 +92,7 @@ public:
     
     // threads update the value of this atomic bool to determine if updateLevels process in a detached
     // thread has completed. This set to true allows the next thread to enter the updateLevels function
-    static std::atomic<bool> is_ready;
+    std::atomic<bool> is_ready;
     
     /**
      Constructor to initialize the Lsm Tree using tunable parameters.
@@ -46,12 +107,16 @@ public:
      @param c0_percentage_of_c1 what percentage of c1 can c0 be before a rolling merge occurs?
      @param threadedRollingMerge should the threaded rolling merge occur in its own thread?
      
-     // 1 FUTURE PLAN - for chunk all moves to where it can fit
-     // 2 ONLY ONE FUNCTIONAL AT THIS TIME - for insert all here then take out whatever doesn't fit and move to next
+     // 1 leveled - each level is made of sorted runs with non-overlapping key ranges, a compaction moves one run
+     //   and merges it with only the overlapping runs of the next level
+     // 2 for insert all here then take out whatever doesn't fit and move to next
+     // 3 size-tiered - each level holds up to sizeBetweenLevels sorted runs with overlapping key ranges, once full
+     //   they are merged together into a single run of the next level
      @param mergeStrategy LsmTree::updateLevels() determines strategy using this param
+     @param filePrefix the prefix of the names of the level files, used to keep the files of several Lsm Trees apart
      
      */
-    LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge);
+    LsmTree(bool readOptimized, int c0DataStructure, int numberOfLevels, long firstLevelFileSize, int sizeBetweenLevels, bool copyAllFromC0, double c0_percentage_to_copy, double c0_percentage_of_c1, int mergeStrategy, bool threadedRollingMerge, const std::string &filePrefix = "");
     virtual ~LsmTree();
     
     
@@ -71,6 +136,19 @@ public:
      */
     void delete_value(dtype value);
     
+    /**
+     deletes every key value pair within a range from the Lsm Tree with a single range tombstone
+     
+     the levels are not searched or rewritten, lookups and scans hide the values the range tombstone covers
+     and the rolling merges drop them from the levels they rewrite. A value written after the range is
+     deleted is not hidden
+     
+     @param low the smallest value to delete
+     @param high the largest value to delete
+     
+     */
+    void delete_range(const lsm_value_t &low, const lsm_value_t &high);
+    
     /**
      Search for the value in the Lsm Tree.
      
@@ -81,6 +159,83 @@ public:
      */
     bool read_value(dtype value);
     
+    /**
+     Search for the value in the Lsm Tree as it was when a snapshot was taken, a snapshot expired reads the
+     latest values
+     
+     @param value the data to search for
+     @param snapshot the snapshot to read at, or NULL to read the latest values
+     @return true if the value was in the Lsm Tree when the snapshot was taken
+     
+     */
+    bool read_value(dtype value, const LsmSnapshot *snapshot);
+    
+    /**
+     Search for a record in the Lsm Tree by its key and get its newest value, with the operands written to it
+     by merge_value folded in by the merge operator
+     
+     @param key the record to get, only its key is compared
+     @param result set to the record found
+     @return true if the record is in the Lsm Tree
+     
+     */
+    bool read_value(const lsm_value_t &key, lsm_value_t &result);
+    
+    /**
+     Search for a batch of values in the Lsm Tree
+     
+     the lookups are sorted by value and searched together, a level at a time, so a page or leaf node of a
+     level holding several of the values is read once for all of them and the pages of a level are read in
+     file order. The lookups in c0 are walked down its BTree together, the next node of each prefetched
+     while the others are searched
+     
+     @param values the data to search for
+     @param found set to a vector holding, for each value in the order given, true if the value is found
+     
+     */
+    void read_values(const std::vector<dtype> &values, std::vector<bool> &found);
+    
+    /**
+     Search for the value in the Lsm Tree on the read pool of the Lsm Tree, so the caller can make other
+     requests while the search is running
+     
+     @param value the data to search for
+     @return a future set to true if the value is found
+     
+     */
+    std::future<bool> read_async(dtype value);
+    
+    /**
+     Search for the value in the Lsm Tree on the read pool of the Lsm Tree, calling a function with the result
+     
+     the function is called on a thread of the pool, so it should be quick and must not wait on other reads
+     
+     @param value the data to search for
+     @param callback the function called with the value and true if the value is found
+     
+     */
+    void read_async(dtype value, std::function<void(dtype, bool)> callback);
+    
+    /**
+     Search for a batch of values in the Lsm Tree on the read pool of the Lsm Tree, the values are split into
+     groups of LSM_READ_BATCH_VALUES searched in parallel
+     
+     @param values the data to search for
+     @return a future set to a vector holding, for each value in the order given, true if the value is found
+     
+     */
+    std::future<std::vector<bool>> read_async(const std::vector<dtype> &values);
+    
+    /**
+     get the values of the Lsm Tree within a range
+     
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order with no duplicates
+     
+     */
+    void scan_values(const lsm_value_t &low, const lsm_value_t &high, std::vector<lsm_value_t> &values);
+    
     /**
      Update the key value pair of the Lsm Tree
      
@@ -90,12 +245,71 @@ public:
      */
     void update_value(dtype old_value, dtype new_value);
     
+    /**
+     write an operand for the merge operator to fold into the value of its record, such as an amount to add
+     to a counter. The write is blind, it costs as much as an insert and no level is read
+     
+     the operands of a record are folded by read_value and by the rolling merges, operands written to the
+     same record between two rolling merges are combined as they are written when the merge operator can do
+     so. Without a merge operator the operand is inserted as the value of its record
+     
+     @param operand the operand
+     
+     */
+    void merge_value(dtype operand);
+    
+    /**
+     take a snapshot of the Lsm Tree, reads made with it see the values present when it was taken while
+     writes and rolling merges continue
+     
+     while any snapshot is held the writes are kept in memory, each stamped with its sequence number, in
+     place of being written to c0. No level is read for them, and they are written to c0 in order once no
+     snapshot held is older than them. Once more writes are kept than the limit set by
+     setSnapshotVersionsLimit the oldest snapshot is expired, its isExpired is set and the writes kept for it
+     are written to c0, so the reads made with it are to be checked against isExpired after they are made
+     
+     @return the snapshot, to be released with releaseSnapshot
+     
+     */
+    const LsmSnapshot* getSnapshot();
+    
+    /**
+     release a snapshot, the writes kept for it are written to c0 by the next write once no snapshot held
+     is older than them
+     
+     @param snapshot the snapshot returned by getSnapshot
+     
+     */
+    void releaseSnapshot(const LsmSnapshot *snapshot);
+    
+    /**
+     set the limit of the writes kept in the version log while snapshots are held, a write past the limit
+     expires the oldest snapshots held until the writes kept are back under it. By default the limit is
+     SNAPSHOT_VERSIONS_RATIO times the maximum values count of c0
+     
+     @param versions the writes kept the oldest snapshot is expired above, 0 to never expire a snapshot
+     
+     */
+    void setSnapshotVersionsLimit(long versions);
+    
+    // function used to get the number of snapshots expired to bound the version log
+    long getExpiredSnapshotsCount() {return expiredSnapshotsCount;}
+    
+    /**
+     get the sequence number of the last write, every insert, update and delete takes the next number and
+     the key of an inserted value is set to it
+     
+     @return the last sequence number
+     
+     */
+    long getLastSequence() {return lastSequence;}
+    
     // Functions to get the virtual and physical memory stats
     int parseLine(char* line);
     int getValueVirtualMemory();
     int getValuePhysicalMemory();
     
-  
+    
     // Global counter for keys
     long key_counter = 0;
     
@@ -124,6 +338,130 @@ public:
      */
     void printStats();
     
+    /**
+     get the I/O and merge counters for a disk level
+     
+     @param levelNumber the level to get the counters for --> for example c1 has a value of 1
+     @return the counters for the level
+     
+     */
+    LsmLevelIOStats getLevelIOStats(int levelNumber);
+    
+    /**
+     get the read amplification of the Lsm Tree
+     
+     @return the average number of disk node reads made by each call to read_value
+     
+     */
+    double getReadAmplification();
+    
+    /**
+     get the write amplification of the Lsm Tree
+     
+     @return the bytes written to all disk levels for each byte inserted to the Lsm Tree
+     
+     */
+    double getWriteAmplification();
+    
+    /**
+     attach a listener to receive the flush and compaction events of the Lsm Tree
+     
+     events are raised on the thread doing the rolling merge, when no listener is attached no events are
+     created and the clock is not read
+     
+     @param listener the listener to attach, or NULL to detach the current listener
+     
+     */
+    void setEventListener(LsmEventListener *listener);
+    
+    /**
+     attach a tuner to adjust the size ratio between levels, the size of c0 and the filter memory of each
+     level to the workload while the Lsm Tree is in use
+     
+     the tuner counts every operation and is consulted before a rolling merge, once it has counted its
+     window of operations. The tuner is owned by the caller.
+     
+     @param tuner the tuner to attach, or NULL to keep the current settings from now on
+     
+     */
+    void setTuner(LsmTuner *tuner);
+    
+    /**
+     run the update levels process of threaded rolling merges on the threads of a worker queue in place of a
+     new detached thread for each rolling merge, so several Lsm Trees can share a pool of threads
+     
+     the worker queue is owned by the caller and must outlive the rolling merges passed to it
+     
+     @param mergeDistributor the worker queue to use, or NULL to start a detached thread for each rolling merge
+     
+     */
+    void setMergeDistributor(lsm_task_distributor *mergeDistributor);
+    
+    /**
+     schedule the disk I/O of the Lsm Tree by priority, lookups first, then flushes, then compactions, with
+     flushes and compactions held to the background budget of the scheduler
+     
+     the scheduler is owned by the caller and must outlive the Lsm Tree, the shards of a sharded Lsm Tree can
+     share one scheduler so they share one budget
+     
+     @param ioScheduler the scheduler to charge the I/O to, or NULL to leave the I/O unscheduled
+     
+     */
+    void setIOScheduler(LsmIOScheduler *ioScheduler);
+    
+    /**
+     cache the results of read_value and read_values in front of c0 and every disk level, found or not, so
+     hot values are answered without searching the levels. Every write removes the results of the values it
+     writes from the cache
+     
+     the cache is owned by the caller and must outlive the Lsm Tree, the shards of a sharded Lsm Tree can
+     share one cache so they share one memory budget, as they hold different values
+     
+     @param rowCache the cache, or NULL to search the levels for every lookup
+     
+     */
+    void setRowCache(LsmRowCache *rowCache);
+    
+    /**
+     set the merge operator folding the operands written by merge_value, set before the first merge_value.
+     The merge operator is owned by the caller and must outlive the Lsm Tree
+     
+     @param mergeOperator the merge operator, or NULL to insert the operands as values
+     
+     */
+    void setMergeOperator(LsmMergeOperator *mergeOperator);
+    
+    /**
+     set the limits of the merge debt, the values written to c0 behind a threaded rolling merge plus the
+     values the merge has still to move out of full levels
+     
+     above the slowdown limit each write is delayed, longer the closer the debt is to the stop limit, and above
+     the stop limit writes block until the merge completes. By default the limits are WRITE_SLOWDOWN_DEBT_RATIO
+     and WRITE_STOP_DEBT_RATIO times the maximum values count of c0
+     
+     @param slowdownValues the debt, in values, writes are slowed down above, 0 to never slow writes down
+     @param stopValues the debt, in values, writes are blocked above, 0 to never block writes
+     
+     */
+    void setWriteStallLimits(long slowdownValues, long stopValues);
+    
+    /**
+     get the writes held back for a reason and for how long
+     
+     @param reason the reason the writes were held back
+     @return the writes held back for the reason
+     
+     */
+    LsmWriteStallStats getWriteStallStats(lsm_write_stall reason);
+    
+    /**
+     get the current merge debt, 0 when no threaded rolling merge is in progress
+     
+     @return the values written to c0 behind the merge in progress plus the values it has still to move
+     
+     */
+    long getWriteDebt();
+
 protected:
 private:
     
@@ -133,6 +471,7 @@ private:
     bool copyAllFromC0;
     int numberOfLevels;
     int mergeStrategy;
+    int sizeBetweenLevels;
     long firstLevelFileSize;
     double c0_percentage_of_c1;
     long c0_max_size;
@@ -140,12 +479,89 @@ private:
     bool readOptimized;
     bool isThreadedRollingMerge;
     
-    // the min and max values, when the value is a long, present in the lsm tree's data
-    long minValueOfDataset;
-    long maxValueOfDataset;
+    // this counter is used to determine when c0 if full by comparing its value to LsmTree::c0_max_size
+    long c0_limit_counter;
+    
+    // the number of values moved from c0 by the current rolling merge
+    long rollingMergeCounter;
+    
+    // a mutex used to lock access to portions of read and write related to the Node objects and the root
+    // object of each BTree on disk, held by the update levels process
+    std::mutex mergeMutex;
+    
+    // the zone map of c0, the smallest and largest values written to c0 since it was last emptied. The disk
+    // levels keep their own zone maps, so a lookup outside every zone is answered without searching
+    lsm_value_t c0MinValue;
+    lsm_value_t c0MaxValue;
+    
+    // has a value been written to c0 since it was last emptied?
+    bool isC0ZoneSet;
+    
+    // a mutex used to lock access to the zone map of c0, read by lookups while the writes change it
+    std::mutex c0ZoneMutex;
+    
+    // the number of calls to read_value, used to derive the read amplification
+    std::atomic<long> lookupsCount;
+    
+    // the bytes inserted to the Lsm Tree, used to derive the write amplification
+    std::atomic<long> bytesIngested;
+    
+    // the listener receiving flush and compaction events, NULL when none is attached
+    LsmEventListener *eventListener;
+    
+    // the tuner adjusting the tunable parameters to the workload, NULL when none is attached
+    LsmTuner *tuner;
+    
+    // the worker queue running the threaded rolling merges, NULL when each starts a detached thread
+    lsm_task_distributor *mergeDistributor;
+    
+    // the scheduler the disk I/O is charged to, NULL when the I/O is not scheduled
+    LsmIOScheduler *ioScheduler;
+    
+    // the cache of lookup results in front of the levels, NULL when lookups are not cached
+    LsmRowCache *rowCache;
+    
+    // the merge operator folding the operands written by merge_value, NULL when none is set
+    LsmMergeOperator *mergeOperator;
     
-    // have the min and max range values of the dataset been set?
-    bool isRangeSet;
+    // the limits of the merge debt writes are slowed down and blocked above, 0 for no limit
+    long slowdownDebtLimit;
+    long stopDebtLimit;
+    
+    // the values the threaded rolling merge in progress has to move out of full levels, counted as it starts
+    std::atomic<long> compactionDebt;
+    
+    // the writes held back for each reason and for how long
+    LsmWriteStallStats stallStats[WRITE_STALL_REASON_COUNT];
+    
+    // a mutex used to protect the stall counters, counted by the writers and read by any thread
+    std::mutex stallMutex;
+    
+    // signalled once a threaded rolling merge sets is_ready back to true, so waiting writes block on it in
+    // place of spinning
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+    
+    // the pool running the asynchronous reads, created by the first call to read_async
+    std::unique_ptr<lsm_task_distributor> readDistributor;
+    std::once_flag readDistributorOnce;
+    
+    // the sequence number of the last write
+    std::atomic<long> lastSequence;
+    
+    // the snapshots held by sequence number, and their count used to skip the mutex while there are none
+    std::multimap<long, LsmSnapshot*> snapshots;
+    std::atomic<long> snapshotsCount;
+    
+    // the limit of the writes kept in the version log, 0 for no limit, and the snapshots expired to keep to it
+    long snapshotVersionsLimit;
+    std::atomic<long> expiredSnapshotsCount;
+    
+    // the writes made while snapshots are held, stamped with their sequence numbers and not yet written to c0
+    LsmVersionLog versionLog;
+    
+    // a mutex used to protect the snapshots held
+    std::mutex snapshotMutex;
     
     // a vector to contain all of the level structs
     vector<LsmLevel> levels;
@@ -153,14 +569,158 @@ private:
     // an array to contain a maximum of 11 instances of the lsmLevelDisk class
     LsmLevelDisk lsmLevelDisks[11];
     
+    // an array to contain a maximum of 11 instances of the LsmLevelPartitioned class, used when mergeStrategy is 1
+    LsmLevelPartitioned lsmLevelPartitions[11];
+    
+    // an array to contain a maximum of 11 instances of the LsmLevelTiered class, used when mergeStrategy is 3
+    LsmLevelTiered lsmLevelTiers[11];
+    
     // c0 instance of LsmLevelMemory
     LsmLevelMemory c0;
     
     // c0 as a vector
-    std::vector<long> c0Vector;
+    std::vector<lsm_value_t> c0Vector;
     
     // create a tombstone vector to mark values as deleted
-    std::vector<long> tombstoneVector;
+    std::vector<lsm_value_t> tombstoneVector;
+    
+    // the range tombstones marking key ranges as deleted, shared with the levels so they drop the values
+    LsmRangeTombstones rangeTombstones;
+    
+    // the point tombstones of the values deleted by blind writes, when read optimization is not enabled
+    LsmPointTombstones pointTombstones;
+    
+    // the name of the file the point tombstones are written to when the Lsm Tree is closed
+    std::string pointTombstonesFileName;
+    
+    // the operands written by merge_value and not yet folded into their records by a rolling merge
+    LsmMergeOperands mergeOperands;
+    
+    /**
+     search c0 and every disk level for the latest value
+     
+     @param value the data to search for
+     @param isLookup true when the search is made for a read, so an empty read is counted by the tuner
+     @return true if the value is in the Lsm Tree
+     
+     */
+    bool searchLevels(dtype value, bool isLookup);
+    
+    /**
+     search for the latest value of a lookup, in the row cache first and then in c0 and every disk level,
+     caching the result
+     
+     @param value the data to search for
+     @return true if the value is in the Lsm Tree
+     
+     */
+    bool searchCached(dtype value);
+    
+    /**
+     check the zone maps of c0 and every disk level for a value, top down so a value moved down a level by a
+     rolling merge is still seen by one of them
+     
+     @param value the value to check
+     @return false if the value is outside every zone, it is not in the Lsm Tree
+     
+     */
+    bool isInZones(const lsm_value_t &value);
+    
+    /**
+     widen the zone map of c0 to hold a value written to c0
+     
+     @param value the value written
+     
+     */
+    void widenC0Zone(const lsm_value_t &value);
+    
+    /**
+     narrow the zone map of c0 once a rolling merge moved values out of it. The zone of a vector is the range
+     of the values left, the zone of a btree is kept until it is emptied
+     
+     */
+    void updateC0Zone();
+    
+    /**
+     keep a write in the version log while a snapshot is held, so the snapshots held do not see it. The
+     writes kept that no snapshot held is older than are written to c0 first
+     
+     @param kind the kind of write, one of the VERSION_ defines
+     @param value the value written, or the smallest value of a range deleted
+     @param high the old value of an update, or the largest value of a range deleted
+     @param sequence the sequence number of the write
+     @return false if the write is to be written to c0, no snapshot is held and no write is kept
+     
+     */
+    bool holdWrite(char kind, const lsm_value_t &value, const lsm_value_t &high, long sequence);
+    
+    /**
+     write the writes kept in the version log to c0, in sequence order, up to the oldest snapshot held. A
+     write is removed from the log only once it is in c0, so reads see it in one or the other
+     
+     */
+    void applyVersions();
+    
+    /**
+     expire the oldest snapshot held, reads made with it see the latest values from then on
+     
+     @return false if no snapshot is held
+     
+     */
+    bool expireOldestSnapshot();
+    
+    /**
+     write a value, a delete, an update, a range delete or a merge operand to c0, once the write is stamped
+     with its sequence number
+     
+     */
+    void applyInsert(dtype value);
+    void applyDelete(dtype value, long sequence);
+    void applyUpdate(dtype old_value, dtype new_value, long sequence);
+    void applyDeleteRange(const lsm_value_t &low, const lsm_value_t &high);
+    void applyMerge(dtype operand, long sequence);
+    
+    /**
+     apply a write kept in the version log to a record read from c0 and the levels
+     
+     @param version the write
+     @param key the record, only its key is compared
+     @param isFound true if the record is in the Lsm Tree before the write
+     @param value the record before the write, set to the record after it
+     @return true if the record is in the Lsm Tree after the write
+     
+     */
+    bool foldVersion(const LsmVersion &version, const lsm_value_t &key, bool isFound, lsm_value_t &value);
+    
+    /**
+     get the newest value of a record from c0 and the disk levels, without the operands written to it
+     
+     @param key the record to get, only its key is compared
+     @param value set to the record found
+     @return false if the record is not in the Lsm Tree or is deleted
+     
+     */
+    bool readNewest(const lsm_value_t &key, lsm_value_t &value);
+    
+    /**
+     check whether a record is hidden from the lookups without reading c0 or a level, because it is deleted or
+     outside the zones of c0 and the levels
+     
+     @param key the record to check, only its key is compared
+     @return true if the record is not in the Lsm Tree
+     
+     */
+    bool isHidden(const lsm_value_t &key);
+    
+    /**
+     get the newest value of a record held by c0
+     
+     @param key the record to get, only its key is compared
+     @param value set to the record found
+     @return false if c0 holds no copy of the record
+     
+     */
+    bool readC0(const lsm_value_t &key, lsm_value_t &value);
     
     /**
      rollingMerge function is responsible for the rolling merge process once c0 fills up
@@ -170,6 +730,100 @@ private:
      */
     void rollingMerge(bool copyAllFromC0);
     
+    /**
+     apply the settings chosen by the tuner once it has counted its window of operations
+     
+     waits for a detached update levels thread to complete, since the maximum size of the levels changes
+     
+     */
+    void applyTuner();
+    
+    /**
+     retire the point tombstones merged down to the last level holding values, the merges have dropped every
+     older copy of their values. Called by the rolling merges
+     
+     the point tombstones are left for a later merge while a detached update levels thread is running, since
+     the levels are changing
+     
+     */
+    void retirePointTombstones();
+    
+    /**
+     fold the operands written by merge_value since the last merge into the records c0 holds, and into
+     nothing for the records deleted, write the folded records to c0 so they are merged into c1 with it, and
+     retire the operands. No level is read, the operands of the other records are folded by the merges between
+     levels as the records stream through them, and those merged past the last level holding values are
+     folded into nothing. Called by the rolling merges
+     
+     waits for a detached update levels thread to complete, since the merges between levels fold operands
+     
+     */
+    void applyMergeOperands();
+    
+    /**
+     function used to get the deepest level holding values, the levels below it hold no copy of any value
+     
+     @return the level number of the level, 0 if every level is empty
+     
+     */
+    int getLastLevel();
+    
+    /**
+     start the update levels process of a threaded rolling merge, on the merge distributor when one is set or
+     otherwise in a detached thread
+     
+     is_ready is set to false before the merge starts so the next rolling merge waits for it
+     
+     @param merge the update levels process to run
+     
+     */
+    void startMerge(std::function<void()> merge);
+    
+    /**
+     get the values the update levels process has to move out of full levels, called while no threaded
+     rolling merge is in progress
+     
+     @return the values of the levels above their maximum
+     
+     */
+    long getCompactionDebt();
+    
+    /**
+     slow down or block a write while the merge debt is above its limits
+     
+     */
+    void throttleWrite();
+    
+    /**
+     wait for the threaded rolling merge in progress to complete before c0 is merged again, counting the wait as
+     a c0 full stall
+     
+     */
+    void waitForMerge();
+    
+    /**
+     block until the threaded rolling merge in progress completes, without counting a stall
+     
+     */
+    void waitUntilReady();
+    
+    /**
+     count a write held back since a time
+     
+     @param reason the reason the write was held back
+     @param start when the write started to be held back
+     
+     */
+    void recordStall(lsm_write_stall reason, std::chrono::steady_clock::time_point start);
+    
+    /**
+     get the pool running the asynchronous reads, creating it with LSM_READ_THREADS threads the first time
+     
+     @return the pool
+     
+     */
+    lsm_task_distributor& getReadDistributor();
+    
     /**
      the rolling merge strategy is determined here.
      
@@ -182,7 +836,7 @@ private:
      
      */
     void updateLevels(long c1_total_to_pass, LsmLevelDisk* c1, int numberOfLevels, int mergeStrategy);
-
+    
     /**
      
      updateLevels operating in a detached thread 
@@ -195,10 +849,161 @@ private:
      @param c1 a pointer to the c1 disk Btree object
      @param levels pointer to the levels vector that contains the c1-n levels information
      @param mergeStrategy tunable parameter for different merge strategies
+     @param listener the event listener to raise compaction events on, or NULL
+     @param mergeMutex the mutex of the Lsm Tree held while the levels are updated
+     
+     */
+    static void updateLevelsThreaded(long c1_total_to_pass, LsmLevelDisk* c1, int* numberOfLevels, int* mergeStrategy, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex);
+    
+    /**
+     rollingMerge for mergeStrategy 1 and 3
+     
+     for mergeStrategy 1 c0 is merged into the overlapping sorted runs of c1, for mergeStrategy 3 c0 is
+     added to c1 as a new sorted run
+     
+     @copyAllFromc0 - should all of c0 be copied to c1 on a rolling merge
+     
+     */
+    void rollingMergeRuns(bool copyAllFromC0);
+    
+    /**
+     updateLevels for mergeStrategy 1
+     
+     while a level holds more values than its maximum, one of its sorted runs is merged into the overlapping
+     runs of the next level. This is static so that it can also run in a detached thread.
+     
+     @param numberOfLevels the number of disk resident levels for the Lsm Tree
+     @param levels pointer to the levels vector that contains the c1-n levels information
+     @param listener the event listener to raise compaction events on, or NULL
+     @param mergeMutex the mutex of the Lsm Tree held while the levels are updated
+     
+     */
+    static void updateLevelsPartitioned(int numberOfLevels, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex);
+    
+    /**
+     updateLevels for mergeStrategy 3
+     
+     once a level holds sizeBetweenLevels sorted runs, they are merged together into a single run added to
+     the next level, and the last level merges its runs in place. This is static so that it can also run
+     in a detached thread.
+     
+     @param numberOfLevels the number of disk resident levels for the Lsm Tree
+     @param levels pointer to the levels vector that contains the c1-n levels information
+     @param listener the event listener to raise compaction events on, or NULL
+     @param mergeMutex the mutex of the Lsm Tree held while the levels are updated
+     
+     */
+    static void updateLevelsTiered(int numberOfLevels, vector<LsmLevel>* levels, LsmEventListener* listener, std::mutex* mergeMutex);
+    
+    /**
+     build the fence pointers of each disk level held in a BTree, levels whose fence pointers are up to date
+     are skipped
+     
+     @param numberOfLevels the number of disk resident levels for the Lsm Tree
+     @param levels pointer to the levels vector that contains the c1-n levels information
      
      */
-    static void updateLevelsThreaded(long* c1_total_to_pass, LsmLevelDisk* c1, int* numberOfLevels, int* mergeStrategy, vector<LsmLevel>* levels);
+    static void buildFences(int numberOfLevels, vector<LsmLevel>* levels);
     
+    /**
+     search a disk level for a value
+     
+     @param levelIndex the position of the level in the levels vector
+     @param value the data value to search for
+     @return true if the value is in the level
+     
+     */
+    bool searchLevel(int levelIndex, dtype value);
+    
+    /**
+     check whether a disk level may hold any value within a range, from the zone maps of the level
+     
+     @param levelIndex the position of the level in the levels vector
+     @param low the smallest value of the range
+     @param high the largest value of the range
+     @return false if no value of the level is within the range
+     
+     */
+    bool levelMayContain(int levelIndex, const lsm_value_t &low, const lsm_value_t &high);
+    
+    /**
+     get the values of a disk level within a range
+     
+     @param levelIndex the position of the level in the levels vector
+     @param low the smallest value to get
+     @param high the largest value to get
+     @param values the vector the values are appended to, in sorted order
+     
+     */
+    void scanLevel(int levelIndex, const lsm_value_t &low, const lsm_value_t &high, std::vector<dtype> &values);
+    
+    /**
+     search for a batch of values in a disk level
+     
+     @param levelIndex the position of the level in the levels vector
+     @param values the data values to search for, sorted by value
+     @param states the state of each lookup, the pending lookups found are set to LookupFound
+     
+     */
+    void searchLevelValues(int levelIndex, const std::vector<dtype> &values, std::vector<char> &states);
+    
+    /**
+     get the values count of a disk level
+     
+     @param levelIndex the position of the level in the levels vector
+     @return the values count
+     
+     */
+    long getLevelValuesCount(int levelIndex);
+    
+    /**
+     get the size on disk, in bytes, of a disk level
+     
+     @param levelIndex the position of the level in the levels vector
+     @return the size of the level's files
+     
+     */
+    long getLevelFileSize(int levelIndex);
+    
+    /**
+     get the I/O and merge counters for a disk level, from either its BTree or its sorted runs
+     
+     @param level the level to get the counters for
+     @return the counters for the level
+     
+     */
+    static LsmLevelIOStats getIOStats(const LsmLevel &level);
+    
+    /**
+     raise the begin event of a flush or compaction and start its timer
+     
+     does nothing, and does not read the clock, when no listener is attached
+     
+     @param listener the listener to raise the event on, or NULL
+     @param type the type of the event
+     @param sourceLevel the level values are moved from
+     @param targetLevel the level values are moved to
+     @param inputValues the number of values to be passed to the target level
+     @param target the target level
+     @param timer the timer to start
+     
+     */
+    static void raiseBeginEvent(LsmEventListener *listener, lsm_event_type type, int sourceLevel, int targetLevel, long inputValues, const LsmLevel &target, LsmEventTimer &timer);
+    
+    /**
+     raise the end event of a flush or compaction using the timer started by raiseBeginEvent
+     
+     @param listener the listener to raise the event on, or NULL
+     @param type the type of the event
+     @param sourceLevel the level values were moved from
+     @param targetLevel the level values were moved to
+     @param inputValues the number of values passed to the target level
+     @param target the target level
+     @param timer the timer started by raiseBeginEvent
+     
+     */
+    static void raiseEndEvent(LsmEventListener *listener, lsm_event_type type, int sourceLevel, int targetLevel, long inputValues, const LsmLevel &target, const LsmEventTimer &timer);
+
 };
 
 #endif // LSMTREE_H
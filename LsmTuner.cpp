@@ -0,0 +1,201 @@
+/**
+ C++11 - GCC Compiler
+ LsmTuner.cpp
+ 
+ Watches the mix of reads, writes and deletes made to the Lsm Tree and chooses the size ratio between
+ levels, the size of c0 and the filter memory of each level that minimize the expected I/O cost per
+ operation. The cost model follows the LSM tree design space literature - writes cost the number of
+ times a value is rewritten per page, lookups cost the false positives of the level filters, with the
+ filter memory spread over the levels so that larger levels get the higher false positive rates.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmTuner.h"
+
+#include <math.h>
+
+#include "LsmSortedRun.h"
+
+// the percentages of c1 the tuner will choose from for the size of c0
+static const double c0Percentages[] = {0.1, 0.25, 0.5, 0.75, 1.0};
+
+/**
+ Constructor to initialize the tuner
+ 
+ @param windowOperations the number of operations counted between tunings
+ @param memoryBudgetBytes the memory, in bytes, shared by c0 and the filters of the levels
+ 
+ */
+LsmTuner::LsmTuner(long windowOperations, long memoryBudgetBytes)
+: reads(0), emptyReads(0), writes(0), deletes(0), operationsCount(0)
+{
+    LsmTuner::windowOperations = windowOperations > 0 ? windowOperations : 1;
+    LsmTuner::memoryBudgetBytes = memoryBudgetBytes;
+    history = LsmWorkloadStats();
+    retunesCount = 0;
+}
+
+/**
+ function used to check whether enough operations have been counted since the last tuning
+ 
+ @return true if tune should be called
+ 
+ */
+bool LsmTuner::isDue()const
+{
+    return operationsCount >= windowOperations;
+}
+
+/**
+ function used to get the operations counted by the tuner
+ 
+ @return the operations counted
+ 
+ */
+LsmWorkloadStats LsmTuner::getWorkloadStats()const
+{
+    LsmWorkloadStats workload = history;
+    workload.reads += reads;
+    workload.emptyReads += emptyReads;
+    workload.writes += writes;
+    workload.deletes += deletes;
+    return workload;
+}
+
+/**
+ function used to estimate the expected page I/Os per operation of a workload with some settings
+ 
+ the filterBitsPerKey of the tuning are set to the filter memory of each level for the settings
+ 
+ @param shape the shape of the Lsm Tree
+ @param workload the operations to estimate the cost of
+ @param tuning the settings to estimate the cost of
+ @param filterMemoryBits the memory, in bits, shared by the filters of the levels
+ @return the expected page I/Os per operation
+ 
+ */
+double LsmTuner::estimateCost(const LsmTreeShape &shape, const LsmWorkloadStats &workload, LsmTuning &tuning, double filterMemoryBits)
+{
+    double sizeRatio = tuning.sizeBetweenLevels;
+    double pageValues = RUN_PAGE_VALUES;
+    double totalValues = shape.totalValues > 0 ? shape.totalValues : 1;
+    double firstLevelValues = shape.firstLevelValues > 0 ? shape.firstLevelValues : 1;
+    double c0Values = firstLevelValues * tuning.c0_percentage_of_c1;
+    if (c0Values < 1) c0Values = 1;
+    
+    // the number of levels needed to hold the values, each level holding sizeRatio times the one before it.
+    // When tiered, c1 holds sizeRatio runs the size of c0
+    int levelsCount = 1;
+    double levelCapacity = shape.isTiered ? c0Values * sizeRatio : firstLevelValues;
+    double capacity = levelCapacity;
+    while (capacity < totalValues && levelsCount < shape.numberOfLevels)
+    {
+        levelCapacity *= sizeRatio;
+        capacity += levelCapacity;
+        levelsCount++;
+    }
+    
+    // the runs a lookup may search in each level
+    double runsPerLevel = shape.isTiered ? sizeRatio : 1;
+    
+    // a value is written once per level when tiered. When leveled it is rewritten by each merge into a
+    // level until the level is full, c0 being merged into c1 c1 / c0 times and a level into the next
+    // sizeRatio times, on average half of them after the value arrives
+    double writeCost;
+    if (shape.isTiered)
+    {
+        writeCost = levelsCount / pageValues;
+    } else {
+        writeCost = (firstLevelValues / (2 * c0Values) + (levelsCount - 1) * sizeRatio / 2) / pageValues;
+    }
+    
+    // the false positives of a lookup that finds nothing, with the filter false positive rate of each level
+    // sizeRatio times lower than the level after it
+    double ln2Squared = log(2.0) * log(2.0);
+    double bitsPerKey = filterMemoryBits > 0 ? filterMemoryBits / totalValues : 0;
+    double emptyReadCost = runsPerLevel * exp(-bitsPerKey * ln2Squared) * pow(sizeRatio, sizeRatio / (sizeRatio - 1)) / (sizeRatio - 1);
+    if (emptyReadCost > runsPerLevel * levelsCount) emptyReadCost = runsPerLevel * levelsCount;
+    
+    // the false positive rate of each level, and the bits per value needed for it
+    double lastLevelRate = emptyReadCost / runsPerLevel * (sizeRatio - 1) / sizeRatio;
+    tuning.filterBitsPerKey.assign(shape.numberOfLevels, 0);
+    for (int i = 0; i < shape.numberOfLevels; i++)
+    {
+        // the empty levels after the last level needed are given the filter memory of the last level
+        int levelsAfter = i < levelsCount ? levelsCount - 1 - i : 0;
+        double rate = lastLevelRate / pow(sizeRatio, levelsAfter);
+        if (rate < 1) tuning.filterBitsPerKey[i] = -log(rate) / ln2Squared;
+    }
+    
+    // a lookup that finds its value reads the page holding it, a blind delete searches every run of every level
+    double readCost = 1 + emptyReadCost;
+    double deleteCost = runsPerLevel * levelsCount;
+    
+    double operations = workload.reads + workload.writes + workload.deletes;
+    if (operations <= 0) return 0;
+    
+    double emptyReads = workload.emptyReads < workload.reads ? workload.emptyReads : workload.reads;
+    return (workload.writes * writeCost + emptyReads * emptyReadCost + (workload.reads - emptyReads) * readCost
+            + workload.deletes * deleteCost) / operations;
+}
+
+/**
+ function used to choose the settings with the lowest expected cost for the workload counted so far
+ 
+ the operations counted are halved afterwards, so the tuning follows a workload that shifts over time
+ 
+ @param shape the shape of the Lsm Tree
+ @param current the settings the Lsm Tree is using, the cost is set by this function
+ @return the settings with the lowest cost, or current when no settings are cheaper by
+         TUNER_MIN_IMPROVEMENT
+ 
+ */
+LsmTuning LsmTuner::tune(const LsmTreeShape &shape, LsmTuning &current)
+{
+    // move the operations of the window just ended to the history, halving the older windows
+    long windowReads = reads, windowEmptyReads = emptyReads, windowWrites = writes, windowDeletes = deletes;
+    reads -= windowReads;
+    emptyReads -= windowEmptyReads;
+    writes -= windowWrites;
+    deletes -= windowDeletes;
+    operationsCount = 0;
+    
+    history.reads = history.reads / 2 + windowReads;
+    history.emptyReads = history.emptyReads / 2 + windowEmptyReads;
+    history.writes = history.writes / 2 + windowWrites;
+    history.deletes = history.deletes / 2 + windowDeletes;
+    
+    // the memory left for the filters once c0 has been given its share
+    double budgetBits = (double) memoryBudgetBytes * 8;
+    double firstLevelBits = (double) shape.firstLevelValues * sizeof(dtype) * 8;
+    
+    double currentFilterBits = budgetBits - firstLevelBits * current.c0_percentage_of_c1;
+    current.cost = estimateCost(shape, history, current, currentFilterBits > 0 ? currentFilterBits : 0);
+    
+    LsmTuning best = current;
+    for (int sizeRatio = TUNER_MIN_SIZE_RATIO; sizeRatio <= TUNER_MAX_SIZE_RATIO; sizeRatio++)
+    {
+        for (size_t i = 0; i < sizeof(c0Percentages) / sizeof(c0Percentages[0]); i++)
+        {
+            // settings that leave no memory for the filters are not considered
+            double filterBits = budgetBits - firstLevelBits * c0Percentages[i];
+            if (filterBits < 0) continue;
+            
+            LsmTuning candidate;
+            candidate.sizeBetweenLevels = sizeRatio;
+            candidate.c0_percentage_of_c1 = c0Percentages[i];
+            candidate.cost = estimateCost(shape, history, candidate, filterBits);
+            
+            if (candidate.cost < best.cost) best = candidate;
+        }
+    }
+    
+    // small improvements are ignored so the settings do not swing back and forth
+    if (best.cost < current.cost * (1 - TUNER_MIN_IMPROVEMENT))
+    {
+        retunesCount++;
+        return best;
+    }
+    return current;
+}
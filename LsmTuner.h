@@ -0,0 +1,137 @@
+/**
+ C++11 - GCC Compiler
+ LsmTuner.h
+ 
+ Watches the mix of reads, writes and deletes made to the Lsm Tree and chooses the size ratio between
+ levels, the size of c0 and the filter memory of each level that minimize the expected I/O cost per
+ operation. The cost model follows the LSM tree design space literature - writes cost the number of
+ times a value is rewritten per page, lookups cost the false positives of the level filters, with the
+ filter memory spread over the levels so that larger levels get the higher false positive rates.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMTUNER_H
+#define LSMTUNER_H
+
+#include <atomic>
+#include <vector>
+
+// the smallest and largest size ratio between levels the tuner will choose
+#define TUNER_MIN_SIZE_RATIO 2
+#define TUNER_MAX_SIZE_RATIO 10
+
+// a new tuning is only applied when its cost is at least this fraction lower than the current settings
+#define TUNER_MIN_IMPROVEMENT 0.1
+
+// struct to define the operations counted by the tuner, older windows count for half as much as the last one
+struct LsmWorkloadStats {
+    double reads;       // the calls to read_value
+    double emptyReads;  // the calls to read_value that searched every level without finding the value
+    double writes;      // the calls to insert_value and update_value
+    double deletes;     // the calls to delete_value
+};
+
+// struct to define the settings the Lsm Tree is tuned with
+struct LsmTuning {
+    int sizeBetweenLevels;                 // the size increase for each additional level
+    double c0_percentage_of_c1;            // the percentage of c1 c0 can be before a rolling merge occurs
+    std::vector<double> filterBitsPerKey;  // the filter memory, in bits per value, of each level, c1 first
+    double cost;                           // the expected page I/Os per operation with these settings
+};
+
+// struct to define the shape of the Lsm Tree the tuner needs to estimate the cost of its settings
+struct LsmTreeShape {
+    long totalValues;        // the number of values in the disk levels
+    long firstLevelValues;   // the number of values c1 holds
+    int numberOfLevels;      // the number of disk levels
+    bool isTiered;           // true for the size-tiered merge strategy
+};
+
+class LsmTuner {
+public:
+    
+    /**
+     Constructor to initialize the tuner
+     
+     @param windowOperations the number of operations counted between tunings
+     @param memoryBudgetBytes the memory, in bytes, shared by c0 and the filters of the levels
+     
+     */
+    LsmTuner(long windowOperations, long memoryBudgetBytes);
+    
+    // functions called by the Lsm Tree to count each operation
+    void recordRead() {reads++; operationsCount++;}
+    void recordEmptyRead() {emptyReads++;}
+    void recordWrite() {writes++; operationsCount++;}
+    void recordDelete() {deletes++; operationsCount++;}
+    
+    /**
+     function used to check whether enough operations have been counted since the last tuning
+     
+     @return true if tune should be called
+     
+     */
+    bool isDue()const;
+    
+    /**
+     function used to choose the settings with the lowest expected cost for the workload counted so far
+     
+     the operations counted are halved afterwards, so the tuning follows a workload that shifts over time
+     
+     @param shape the shape of the Lsm Tree
+     @param current the settings the Lsm Tree is using, the cost is set by this function
+     @return the settings with the lowest cost, or current when no settings are cheaper by
+             TUNER_MIN_IMPROVEMENT
+     
+     */
+    LsmTuning tune(const LsmTreeShape &shape, LsmTuning &current);
+    
+    /**
+     function used to estimate the expected page I/Os per operation of a workload with some settings
+     
+     the filterBitsPerKey of the tuning are set to the filter memory of each level for the settings
+     
+     @param shape the shape of the Lsm Tree
+     @param workload the operations to estimate the cost of
+     @param tuning the settings to estimate the cost of
+     @param filterMemoryBits the memory, in bits, shared by the filters of the levels
+     @return the expected page I/Os per operation
+     
+     */
+    static double estimateCost(const LsmTreeShape &shape, const LsmWorkloadStats &workload, LsmTuning &tuning, double filterMemoryBits);
+    
+    /**
+     function used to get the operations counted by the tuner
+     
+     @return the operations counted
+     
+     */
+    LsmWorkloadStats getWorkloadStats()const;
+    
+    // the number of times tune has chosen new settings
+    long getRetunesCount()const {return retunesCount;}
+
+private:
+    
+    // the number of operations counted between tunings
+    long windowOperations;
+    
+    // the memory, in bytes, shared by c0 and the filters of the levels
+    long memoryBudgetBytes;
+    
+    // the operations counted in the current window, counted by the threads using the Lsm Tree
+    std::atomic<long> reads;
+    std::atomic<long> emptyReads;
+    std::atomic<long> writes;
+    std::atomic<long> deletes;
+    std::atomic<long> operationsCount;
+    
+    // the operations counted in earlier windows, each window counting half as much as the one after it
+    LsmWorkloadStats history;
+    
+    // the number of times tune has chosen new settings
+    long retunesCount;
+};
+
+#endif // LSMTUNER_H
@@ -0,0 +1,253 @@
+/**
+ C++11 - GCC Compiler
+ LsmVersionLog.cpp
+ 
+ Holds the writes made while snapshots of the Lsm Tree are held, each stamped with its sequence number, so
+ reads at a snapshot take the versions no newer than the snapshot and the levels are left as the snapshots
+ see them until the writer applies the versions.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#include "LsmVersionLog.h"
+
+#include <algorithm>
+
+/**
+ compare two versions by sequence number
+ 
+ @param a the first version
+ @param b the second version
+ @return true if a was written before b
+ 
+ */
+static bool compareSequences(const LsmVersion &a, const LsmVersion &b)
+{
+    return a.sequence < b.sequence;
+}
+
+LsmVersionLog::LsmVersionLog()
+{
+    versionsCount = 0;
+}
+
+/**
+ add a write, its sequence number is larger than those of the versions held
+ 
+ @param version the write
+ 
+ */
+void LsmVersionLog::add(const LsmVersion &version)
+{
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    
+    sequenceVersions.push_back(version);
+    
+    // a range deleted is checked against each value read, the other writes are found by their values
+    if (version.kind == VERSION_DELETE_RANGE)
+    {
+        rangeVersions.push_back(version);
+    } else {
+        valueVersions[version.value].push_back(version);
+        if (version.kind == VERSION_UPDATE && version.high != version.value) valueVersions[version.high].push_back(version);
+    }
+    versionsCount = sequenceVersions.size();
+}
+
+/**
+ check whether a value was in the Lsm Tree as of a sequence number, from the newest version of the value
+ with a sequence number no larger
+ 
+ @param value the value to check
+ @param sequence the sequence number to read at
+ @param isPresent set to true if the value was inserted or merged to by the newest version, false if it was
+ deleted
+ @return false if no version of the value has a sequence number no larger, the levels hold its value
+ 
+ */
+bool LsmVersionLog::isPresent(const lsm_value_t &value, long sequence, bool &isPresent)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    
+    const LsmVersion *newest = Newest(value, sequence);
+    if (newest == NULL) return false;
+    
+    // the old value of an update is deleted, unless the update wrote it back
+    isPresent = (*newest).kind == VERSION_INSERT || (*newest).kind == VERSION_MERGE || ((*newest).kind == VERSION_UPDATE && (*newest).value == value);
+    return true;
+}
+
+/**
+ function used to get the versions of a value with a sequence number no larger than one
+ 
+ @param value the value
+ @param sequence the sequence number to read at
+ @param versions the vector the versions are appended to, in sequence order
+ 
+ */
+void LsmVersionLog::get(const lsm_value_t &value, long sequence, std::vector<LsmVersion> &versions)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    
+    size_t first = versions.size();
+    
+    std::map<lsm_value_t, std::deque<LsmVersion> >::const_iterator it = valueVersions.find(value);
+    if (it != valueVersions.end())
+    {
+        for (size_t i = 0; i < it->second.size() && it->second[i].sequence <= sequence; i++)
+        {
+            versions.push_back(it->second[i]);
+        }
+    }
+    for (size_t i = 0; i < rangeVersions.size() && rangeVersions[i].sequence <= sequence; i++)
+    {
+        if (Changes(rangeVersions[i], value)) versions.push_back(rangeVersions[i]);
+    }
+    
+    std::stable_sort(versions.begin() + first, versions.end(), compareSequences);
+}
+
+/**
+ function used to get the versions changing values within a range, with a sequence number no larger than
+ one
+ 
+ @param low the smallest value
+ @param high the largest value
+ @param sequence the sequence number to read at
+ @param versions the vector the versions are appended to, in sequence order
+ 
+ */
+void LsmVersionLog::getRange(const lsm_value_t &low, const lsm_value_t &high, long sequence, std::vector<LsmVersion> &versions)
+{
+    if (empty()) return;
+    
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    
+    size_t first = versions.size();
+    
+    std::map<lsm_value_t, std::deque<LsmVersion> >::const_iterator it;
+    for (it = valueVersions.lower_bound(low); it != valueVersions.end() && !(high < it->first); ++it)
+    {
+        for (size_t i = 0; i < it->second.size() && it->second[i].sequence <= sequence; i++)
+        {
+            const LsmVersion &version = it->second[i];
+            
+            // an update with both of its values in the range is got once, with its new value
+            if (version.kind == VERSION_UPDATE && it->first != version.value && !(version.value < low) && !(high < version.value)) continue;
+            
+            versions.push_back(version);
+        }
+    }
+    for (size_t i = 0; i < rangeVersions.size() && rangeVersions[i].sequence <= sequence; i++)
+    {
+        if (!(high < rangeVersions[i].value) && !(rangeVersions[i].high < low)) versions.push_back(rangeVersions[i]);
+    }
+    
+    std::stable_sort(versions.begin() + first, versions.end(), compareSequences);
+}
+
+/**
+ function used to get the oldest version, for the writer to apply
+ 
+ @param version set to the oldest version
+ @return false if no version is held
+ 
+ */
+bool LsmVersionLog::getOldest(LsmVersion &version)
+{
+    if (empty()) return false;
+    
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    if (sequenceVersions.empty()) return false;
+    
+    version = sequenceVersions.front();
+    return true;
+}
+
+/**
+ remove the oldest version, once the writer applied it to c0. The versions of each value and of the ranges
+ are in sequence order, so the oldest version is the first of each it is in
+ 
+ */
+void LsmVersionLog::removeOldest()
+{
+    std::lock_guard<std::mutex> guard(versionsMutex);
+    if (sequenceVersions.empty()) return;
+    
+    const LsmVersion &oldest = sequenceVersions.front();
+    if (oldest.kind == VERSION_DELETE_RANGE)
+    {
+        rangeVersions.pop_front();
+    } else {
+        std::map<lsm_value_t, std::deque<LsmVersion> >::iterator it = valueVersions.find(oldest.value);
+        (*it).second.pop_front();
+        if ((*it).second.empty()) valueVersions.erase(it);
+        
+        if (oldest.kind == VERSION_UPDATE && oldest.high != oldest.value)
+        {
+            it = valueVersions.find(oldest.high);
+            (*it).second.pop_front();
+            if ((*it).second.empty()) valueVersions.erase(it);
+        }
+    }
+    
+    sequenceVersions.pop_front();
+    versionsCount = sequenceVersions.size();
+}
+
+/**
+ function used to get the newest version changing a value with a sequence number no larger than one,
+ called while the lock is held
+ 
+ @param value the value
+ @param sequence the sequence number to read at
+ @return the version, or NULL if there is none
+ 
+ */
+const LsmVersion* LsmVersionLog::Newest(const lsm_value_t &value, long sequence)const
+{
+    const LsmVersion *newest = NULL;
+    
+    std::map<lsm_value_t, std::deque<LsmVersion> >::const_iterator it = valueVersions.find(value);
+    if (it != valueVersions.end())
+    {
+        for (size_t i = it->second.size(); i > 0; i--)
+        {
+            if (it->second[i - 1].sequence > sequence) continue;
+            
+            newest = &it->second[i - 1];
+            break;
+        }
+    }
+    
+    // a range deleted after the newest write of the value hides it
+    for (size_t i = rangeVersions.size(); i > 0; i--)
+    {
+        const LsmVersion &version = rangeVersions[i - 1];
+        if (newest != NULL && version.sequence < (*newest).sequence) break;
+        if (version.sequence > sequence || !Changes(version, value)) continue;
+        
+        newest = &version;
+        break;
+    }
+    return newest;
+}
+
+/**
+ function used to check whether a version changes a value
+ 
+ @param version the version
+ @param value the value
+ @return true if the version inserts, deletes or merges to the value
+ 
+ */
+bool LsmVersionLog::Changes(const LsmVersion &version, const lsm_value_t &value)
+{
+    if (version.kind == VERSION_DELETE_RANGE) return !(value < version.value) && !(version.high < value);
+    if (version.kind == VERSION_UPDATE) return version.value == value || version.high == value;
+    return version.value == value;
+}
@@ -0,0 +1,150 @@
+/**
+ C++11 - GCC Compiler
+ LsmVersionLog.h
+ 
+ Holds the writes made while snapshots of the Lsm Tree are held, each stamped with its sequence number. A
+ write made while a snapshot is held is kept here in place of being applied to c0 and the levels, so the
+ levels keep the values every snapshot held sees and a write never reads a level. A read at a snapshot
+ takes the newest version of its value with a sequence number no larger than the snapshot's, and a read of
+ the latest values takes the newest version, before either searches the levels.
+ 
+ The writer applies the versions to c0 in sequence order once no snapshot held is older than them, and
+ removes each only once it is applied.
+ 
+ @author N. Ruta
+ @version 1.0 4/01/16
+ */
+#ifndef LSMVERSIONLOG_H
+#define LSMVERSIONLOG_H
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "LsmLevelMemory.h"
+
+// the kinds of write kept as a version
+#define VERSION_INSERT 1        // value inserted
+#define VERSION_DELETE 2        // value deleted
+#define VERSION_UPDATE 3        // high deleted and value inserted
+#define VERSION_DELETE_RANGE 4  // the values from value to high deleted
+#define VERSION_MERGE 5         // value written as an operand for the merge operator
+
+// struct to define a write made while a snapshot was held
+struct LsmVersion {
+    long sequence;      // the sequence number of the write
+    char kind;          // the kind of write, one of the VERSION_ defines
+    lsm_value_t value;  // the value written, or the smallest value of a range deleted
+    lsm_value_t high;   // the old value of an update, or the largest value of a range deleted
+};
+
+class LsmVersionLog {
+public:
+    LsmVersionLog();
+    
+    /**
+     add a write, its sequence number is larger than those of the versions held
+     
+     @param version the write
+     
+     */
+    void add(const LsmVersion &version);
+    
+    /**
+     check whether a value was in the Lsm Tree as of a sequence number, from the newest version of the value
+     with a sequence number no larger
+     
+     @param value the value to check
+     @param sequence the sequence number to read at
+     @param isPresent set to true if the value was inserted or merged to by the newest version, false if it
+     was deleted
+     @return false if no version of the value has a sequence number no larger, the levels hold its value
+     
+     */
+    bool isPresent(const lsm_value_t &value, long sequence, bool &isPresent);
+    
+    /**
+     function used to get the versions of a value with a sequence number no larger than one
+     
+     @param value the value
+     @param sequence the sequence number to read at
+     @param versions the vector the versions are appended to, in sequence order
+     
+     */
+    void get(const lsm_value_t &value, long sequence, std::vector<LsmVersion> &versions);
+    
+    /**
+     function used to get the versions changing values within a range, with a sequence number no larger
+     than one
+     
+     @param low the smallest value
+     @param high the largest value
+     @param sequence the sequence number to read at
+     @param versions the vector the versions are appended to, in sequence order
+     
+     */
+    void getRange(const lsm_value_t &low, const lsm_value_t &high, long sequence, std::vector<LsmVersion> &versions);
+    
+    /**
+     function used to get the oldest version, for the writer to apply
+     
+     @param version set to the oldest version
+     @return false if no version is held
+     
+     */
+    bool getOldest(LsmVersion &version);
+    
+    /**
+     remove the oldest version, once the writer applied it to c0
+     
+     */
+    void removeOldest();
+    
+    // true if no version is held, checked without taking the lock
+    bool empty()const {return versionsCount == 0;}
+    
+    // function used to get the number of versions held
+    long getCount()const {return versionsCount;}
+
+private:
+    
+    // every version, in sequence order
+    std::deque<LsmVersion> sequenceVersions;
+    
+    // the versions of each value written, inserted, deleted or updated, in sequence order
+    std::map<lsm_value_t, std::deque<LsmVersion> > valueVersions;
+    
+    // the versions deleting a range, in sequence order
+    std::deque<LsmVersion> rangeVersions;
+    
+    // the number of versions held
+    std::atomic<long> versionsCount;
+    
+    // a mutex used to keep the writer and the reads from interleaving
+    std::mutex versionsMutex;
+    
+    /**
+     function used to get the newest version changing a value with a sequence number no larger than one,
+     called while the lock is held
+     
+     @param value the value
+     @param sequence the sequence number to read at
+     @return the version, or NULL if there is none
+     
+     */
+    const LsmVersion* Newest(const lsm_value_t &value, long sequence)const;
+    
+    /**
+     function used to check whether a version changes a value
+     
+     @param version the version
+     @param value the value
+     @return true if the version inserts, deletes or merges to the value
+     
+     */
+    static bool Changes(const LsmVersion &version, const lsm_value_t &value);
+};
+
+#endif // LSMVERSIONLOG_H
@@ -2,9 +2,13 @@
  C++11 - GCC Compiler
  WorkerQueue.h
  
- An implementation of a worker queue used for thread pooling in order to process reads and deletes in the LSM Tree. It makes use of the c++11 threading primitives, lambda function s and move semantics. 
+ An implementation of a worker queue used for thread pooling in order to process reads and deletes in the LSM Tree. It makes use of the c++11 threading primitives, lambda function s and move semantics.
  
- It is provided a function at constructure time which defines how to process one item of work. To pass work to the queue, the function operator of the object is called.
+ It is provided a function at constructure time which defines how to process one item of work. To pass work to the queue, the function operator of the object is called, or submit to pass a batch of items at once.
+ 
+ Each thread has its own deque of work, so threads do not contend on a single queue lock. Work passed to the queue is spread over the deques, each thread takes a batch of items from its own deque under one lock and, once its deque is empty, steals half of the items of the deque of another thread. The queue can be used to process items such as reads, or with a std::function<void()> item type to run tasks such as the rolling merges of the LSM Tree.
+ 
+ For high rates of small items, such as reads, mpmc_ring can be passed as the Queue instead. The threads then share one bounded lock-free ring buffer, so passing an item costs a few atomic operations instead of a lock and a notify. Threads that find the ring empty, and callers that find it full, spin for a while before sleeping.
  
  When the destructor is called, when the object reaches the end of its scope, all remaining items are processed and background threads are joined.
  
@@ -13,19 +17,167 @@
  @author N. Ruta
  @version 1.0 4/01/16
  */
+#ifndef WORKERQUEUE_H
+#define WORKERQUEUE_H
+
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <stdexcept>
 #include <thread>
 #include <vector>
 
-template <typename Type, typename Queue = std::queue<Type>>
-class distributor: Queue, std::mutex, std::condition_variable {
+// the number of times a thread, or a caller of an mpmc_ring distributor, tries the ring before sleeping
+#define DISTRIBUTOR_SPIN_COUNT 2048
+
+// the size of a cache line, the positions of the ring are kept on lines of their own
+#define DISTRIBUTOR_CACHE_LINE 64
+
+// tell the processor the thread is spinning, so it gives its resources to the other hyperthread of its core
+static inline void distributor_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+/**
+ A bounded lock-free queue for many producers and many consumers, stored in a ring buffer whose size is a power of
+ two. Each cell holds a sequence number telling whether it is ready to be written or read at a position, so a
+ producer or consumer claims a position with one compare and swap and never waits on another thread, except for
+ the one writing or reading the same cell.
+ 
+ Based on the bounded MPMC queue of D. Vyukov. The Type must be default constructible and movable.
+ */
+template <typename Type>
+class mpmc_ring {
+    
+    struct cell {
+        std::atomic<size_t> sequence;
+        Type data;
+    };
+    
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    alignas(DISTRIBUTOR_CACHE_LINE) std::atomic<size_t> enqueue_position {0};
+    alignas(DISTRIBUTOR_CACHE_LINE) std::atomic<size_t> dequeue_position {0};
+
+public:
+    
+    /**
+     Constructor to initialize the ring
+     
+     @param capacity the number of items the ring holds, rounded up to a power of two
+     
+     */
+    explicit mpmc_ring(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        
+        cells.reset(new cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    
+    mpmc_ring(const mpmc_ring &) = delete;
+    mpmc_ring &operator=(const mpmc_ring &) = delete;
+    
+    /**
+     add an item to the ring if it is not full
+     
+     @param value the item, moved from only when it is added
+     @return true if the item was added
+     
+     */
+    bool try_push(Type &value)
+    {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        cell *target;
+        while (true) {
+            target = &cells[position & mask];
+            intptr_t difference = (intptr_t) target->sequence.load(std::memory_order_acquire) - (intptr_t) position;
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+        target->data = std::move(value);
+        target->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /**
+     take an item from the ring if it is not empty
+     
+     @param value set to the item taken
+     @return true if an item was taken
+     
+     */
+    bool try_pop(Type &value)
+    {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        cell *target;
+        while (true) {
+            target = &cells[position & mask];
+            intptr_t difference = (intptr_t) target->sequence.load(std::memory_order_acquire) - (intptr_t) (position + 1);
+            if (difference == 0) {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(target->data);
+        target->sequence.store(position + mask + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // true if no position has been claimed to write that has not also been claimed to read
+    bool empty()const {return enqueue_position.load() == dequeue_position.load();}
+    
+    // true if every cell has been claimed to write and not yet read
+    bool full()const {return enqueue_position.load() - dequeue_position.load() > mask;}
+};
+
+template <typename Type, typename Queue = std::deque<Type>>
+class distributor {
+    
+    // the deque of work of a thread, taken from the front by its thread and stolen from the back by the others
+    struct worker_deque {
+        std::mutex mutex;
+        Queue items;
+    };
+    
     typename Queue::size_type capacity;
-    bool done = false;
+    typename Queue::size_type max_items_per_thread;
+    std::vector<std::unique_ptr<worker_deque>> deques;
     std::vector<std::thread> threads;
     
+    // the number of items in the deques, and the deque the next item passed to the queue is added to
+    std::atomic<typename Queue::size_type> pending {0};
+    std::atomic<unsigned int> next_deque {0};
+    
+    // threads with no work and callers waiting for room sleep on these, only when there is someone to wake is
+    // the mutex taken
+    std::mutex sleep_mutex;
+    std::condition_variable work_available;
+    std::condition_variable room_available;
+    std::atomic<unsigned int> sleeping_threads {0};
+    std::atomic<unsigned int> sleeping_callers {0};
+    bool done = false;
+
 public:
     template<typename Function>
     distributor( Function function
@@ -33,7 +185,7 @@ public:
                 unsigned int concurrency = 4
                 , typename Queue::size_type max_items_per_thread = 1
                 )
-    : capacity{concurrency * max_items_per_thread}
+    : capacity{concurrency * max_items_per_thread}, max_items_per_thread{max_items_per_thread}
     {
         
         // manage cases in which the queue is not properly initialized
@@ -43,8 +195,11 @@ public:
             throw std::invalid_argument("Max items per thread must be non-zero");
         
         for (unsigned int count {0}; count < concurrency; count += 1)
-            threads.emplace_back(static_cast<void (distributor::*)(Function)>
-                                 (&distributor::consume), this, function);
+            deques.emplace_back(new worker_deque);
+        
+        for (unsigned int count {0}; count < concurrency; count += 1)
+            threads.emplace_back(static_cast<void (distributor::*)(Function, unsigned int)>
+                                 (&distributor::consume), this, function, count);
             }
     
     distributor(distributor &&) = default;
@@ -54,40 +209,277 @@ public:
     ~distributor()
     {
         {
-            std::lock_guard<std::mutex> guard(*this);
+            std::lock_guard<std::mutex> guard(sleep_mutex);
+            done = true;
+            work_available.notify_all();
+        }
+        for (auto &&thread: threads) thread.join();
+    }
+    
+    void operator()(Type &&value)
+    {
+        wait_for_room(1);
+        
+        worker_deque &target = *deques[next_deque++ % deques.size()];
+        {
+            std::lock_guard<std::mutex> guard(target.mutex);
+            target.items.push_back(std::forward<Type>(value));
+        }
+        added(1);
+    }
+    
+    /**
+     pass a batch of items to the queue, the items are moved from the range and added to the deques
+     max_items_per_thread at a time, each group under one lock
+     
+     @param first the first item of the batch
+     @param last the item after the last item of the batch
+     
+     */
+    template <typename Iterator>
+    void submit(Iterator first, Iterator last)
+    {
+        while (first != last)
+        {
+            typename Queue::size_type count = 0;
+            wait_for_room(max_items_per_thread);
+            
+            worker_deque &target = *deques[next_deque++ % deques.size()];
+            {
+                std::lock_guard<std::mutex> guard(target.mutex);
+                for (; first != last && count < max_items_per_thread; ++first, ++count)
+                    target.items.push_back(std::move(*first));
+            }
+            added(count);
+        }
+    }
+
+private:
+    
+    // wait until count more items can be added without going over the capacity
+    void wait_for_room(typename Queue::size_type count)
+    {
+        if (pending + count <= capacity) return;
+        
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping_callers++;
+        while (pending != 0 && pending + count > capacity) room_available.wait(lock);
+        sleeping_callers--;
+    }
+    
+    // count the items added to the deques, waking a thread with no work
+    void added(typename Queue::size_type count)
+    {
+        pending += count;
+        if (sleeping_threads != 0)
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex);
+            if (count == 1) work_available.notify_one();
+            else work_available.notify_all();
+        }
+    }
+    
+    // count the items taken from the deques, waking the callers waiting for room
+    void taken(typename Queue::size_type count)
+    {
+        pending -= count;
+        if (sleeping_callers != 0)
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex);
+            room_available.notify_all();
+        }
+    }
+    
+    // take up to max_items_per_thread items from the front of the thread's own deque
+    typename Queue::size_type take_own(unsigned int index, std::vector<Type> &batch)
+    {
+        worker_deque &own = *deques[index];
+        std::lock_guard<std::mutex> guard(own.mutex);
+        
+        typename Queue::size_type count = 0;
+        for (; not own.items.empty() && count < max_items_per_thread; ++count)
+        {
+            batch.push_back(std::move(own.items.front()));
+            own.items.pop_front();
+        }
+        return count;
+    }
+    
+    // steal half of the items from the back of the first other deque holding any, deques being locked by
+    // another thread are passed over
+    typename Queue::size_type steal(unsigned int index, std::vector<Type> &batch)
+    {
+        for (unsigned int offset {1}; offset < deques.size(); offset += 1)
+        {
+            worker_deque &victim = *deques[(index + offset) % deques.size()];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (not lock.owns_lock() or victim.items.empty()) continue;
+            
+            typename Queue::size_type count = (victim.items.size() + 1) / 2;
+            for (typename Queue::size_type taken {0}; taken < count; taken += 1)
+            {
+                batch.push_back(std::move(victim.items.back()));
+                victim.items.pop_back();
+            }
+            return count;
+        }
+        return 0;
+    }
+    
+    template <typename Function>
+    void consume(Function process, unsigned int index)
+    {
+        // take a batch of work from the thread's own deque, or steal it from another, and process the work based
+        // on the data type passed from the LSM Tree
+        std::vector<Type> batch;
+        while (true) {
+            typename Queue::size_type count = take_own(index, batch);
+            if (count == 0) count = steal(index, batch);
+            
+            if (count != 0) {
+                taken(count);
+                for (auto &&item: batch) process(item);
+                batch.clear();
+                continue;
+            }
+            
+            // no work was found, sleep until work is added or the queue is done
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping_threads++;
+            while (pending == 0 && not done) work_available.wait(lock);
+            sleeping_threads--;
+            if (pending == 0 && done) break;
+        }
+    }
+};
+
+// the distributor used when the Queue is an mpmc_ring, its threads share one ring of concurrency *
+// max_items_per_thread items, rounded up to a power of two
+template <typename Type>
+class distributor<Type, mpmc_ring<Type>> {
+    
+    mpmc_ring<Type> ring;
+    std::vector<std::thread> threads;
+    
+    // the number of times to spin before sleeping, none on a single processor since the thread to wait for
+    // can not run while this one spins
+    unsigned int spin_count;
+
+    // threads and callers sleep on these once they have spun spin_count times, only when there is
+    // someone to wake is the mutex taken
+    std::mutex sleep_mutex;
+    std::condition_variable work_available;
+    std::condition_variable room_available;
+    std::atomic<unsigned int> sleeping_threads {0};
+    std::atomic<unsigned int> sleeping_callers {0};
+    std::atomic<bool> done {false};
+
+public:
+    template<typename Function>
+    distributor( Function function
+                , unsigned int concurrency = 4
+                , size_t max_items_per_thread = 1
+                )
+    : ring{concurrency * max_items_per_thread}
+    , spin_count(std::thread::hardware_concurrency() > 1 ? DISTRIBUTOR_SPIN_COUNT : 0)
+    {
+        
+        // manage cases in which the queue is not properly initialized
+        if (not concurrency)
+            throw std::invalid_argument("Concurrency must be non-zero");
+        if (not max_items_per_thread)
+            throw std::invalid_argument("Max items per thread must be non-zero");
+        
+        for (unsigned int count {0}; count < concurrency; count += 1)
+            threads.emplace_back(static_cast<void (distributor::*)(Function)>
+                                 (&distributor::consume), this, function);
+    }
+    
+    distributor(distributor &&) = delete;
+    distributor &operator=(distributor &&) = delete;
+    
+    // deconstructor call makes a call to thread.join() and notifies that work is complete using notify_all()
+    ~distributor()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex);
             done = true;
-            notify_all();
+            work_available.notify_all();
         }
         for (auto &&thread: threads) thread.join();
     }
     
     void operator()(Type &&value)
     {
-        std::unique_lock<std::mutex> lock(*this);
-        while (Queue::size() == capacity) wait(lock);
-        Queue::push(std::forward<Type>(value));
-        notify_one();
+        // spin while the ring is full, then sleep until a thread takes an item
+        for (unsigned int spins {0}; not ring.try_push(value); spins += 1)
+        {
+            if (spins < spin_count) {
+                distributor_relax();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping_callers++;
+            while (ring.full()) room_available.wait(lock);
+            sleeping_callers--;
+        }
+        
+        // wake a sleeping thread, the fence orders the item before the count of sleeping threads is read
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_threads != 0)
+        {
+            std::lock_guard<std::mutex> guard(sleep_mutex);
+            work_available.notify_one();
+        }
     }
     
+    /**
+     pass a batch of items to the queue, the items are moved from the range
+     
+     @param first the first item of the batch
+     @param last the item after the last item of the batch
+     
+     */
+    template <typename Iterator>
+    void submit(Iterator first, Iterator last)
+    {
+        for (; first != last; ++first) (*this)(std::move(*first));
+    }
+
 private:
     template <typename Function>
     void consume(Function process)
     {
-        // get a lock,  pop off from the queue the work, and process the work based on the data type passed from the LSM Tree
-        std::unique_lock<std::mutex> lock(*this);
+        // take an item from the ring and process it, spinning while the ring is empty before going to sleep
+        Type item;
+        unsigned int spins {0};
         while (true) {
-            if (not Queue::empty()) {
-                Type item { std::move(Queue::front()) };
-                Queue::pop();
-                notify_one();
-                lock.unlock();
+            if (ring.try_pop(item)) {
+                spins = 0;
+                
+                // wake a caller waiting for room, the fence orders the take before the count of sleeping callers
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (sleeping_callers != 0)
+                {
+                    std::lock_guard<std::mutex> guard(sleep_mutex);
+                    room_available.notify_all();
+                }
+                
                 process(item);
-                lock.lock();
-            } else if (done) {
+            } else if (done && ring.empty()) {
                 break;
+            } else if (spins < spin_count) {
+                spins += 1;
+                distributor_relax();
             } else {
-                wait(lock);
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleeping_threads++;
+                while (ring.empty() && not done) work_available.wait(lock);
+                sleeping_threads--;
+                spins = 0;
             }
         }
     }
-};
\ No newline at end of file
+};
+
+#endif // WORKERQUEUE_H